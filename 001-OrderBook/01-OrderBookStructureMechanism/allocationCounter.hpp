@@ -0,0 +1,48 @@
+#ifndef ALLOCATIONCOUNTER_HPP
+#define ALLOCATIONCOUNTER_HPP
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Counts every heap allocation made through the global operator new, so a driver can
+// prove a code path never touches the heap. This replaces the global operator new and
+// delete, so include it from exactly one translation unit (the one holding main).
+
+#if defined(__GNUC__) && !defined(__clang__)
+// new and delete below are a matched malloc/free pair, GCC cannot see that once they are inlined
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+std::atomic<unsigned long long> heapAllocationCount(0);
+
+void* operator new(std::size_t size) {
+    heapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    void* memory = std::malloc(size ? size : 1);
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+#endif // ALLOCATIONCOUNTER_HPP
@@ -0,0 +1,203 @@
+#include "benchmarkSupport.hpp"
+#include "persistence.hpp"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Depth of the book, size of the flow and its bursts, where the journal goes
+struct BatchBenchmarkConfig {
+    size_t depth; // resting orders before the timed flow
+    size_t commands; // timed commands
+    size_t burst; // commands per batch
+    Price levels; // per side the passive orders spread over
+    string journalDirectory; // where the journaled runs keep their segments, deleted afterwards
+    unsigned long long seed;
+
+    BatchBenchmarkConfig() {
+        depth = 1000000;
+        commands = 1000000;
+        burst = 256;
+        levels = 1000;
+        journalDirectory = "batch-journal";
+        seed = 42;
+    }
+};
+
+// Folds the execution reports into a hash a word at a time; EventChecksum's byte-wise
+// checksum would cost more than the commands being timed
+class ReportHash : public ExecutionListener {
+    public:
+    unsigned long long count;
+    unsigned long long hash;
+
+    ReportHash() : count(0), hash(CHECKSUM_SEED) {};
+
+    void onEvent(const ExecutionEvent& event) {
+        unsigned long long words[3] = {((unsigned long long)event.type << 8) | event.reason, event.orderId ^ (event.contraOrderId << 32),
+                                       (unsigned long long)event.price ^ ((unsigned long long)event.quantity << 20) ^ ((unsigned long long)event.leavesQuantity << 40)};
+        for (unsigned long long word : words) {
+            hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+            hash ^= hash >> 29;
+        }
+        ++count;
+    }
+};
+
+// What one run came to; both runs must agree on everything but the time
+struct BatchRun {
+    double seconds; // executing the bursts only
+    ReportHash events;
+    unsigned long long resultHash; // of every result, in order
+    unsigned long long bookChecksum;
+    unsigned long long balanceChecksum;
+    size_t accepted; // commands that went through
+    unsigned long long journalRecords; // 0 without a journal
+};
+
+// Deletes the journal segments of a directory and nothing else
+void clearJournal(const string& directory) {
+    for (const JournalSegment &segment : listJournalSegments(directory)) {
+        filesystem::remove(segment.path);
+    }
+}
+
+// Cancel-heavy flow against a deep book. The next burst only depends on the seed and the
+// results of the previous ones, so two runs that execute the commands the same way see the
+// same bursts.
+RandomFlowConfig flowConfig(const BatchBenchmarkConfig& config) {
+    RandomFlowConfig flow;
+    flow.levels = config.levels;
+    flow.aggressivePercent = 10;
+    flow.cancelPercent = 35;
+    flow.reducePercent = 5;
+    flow.seed = config.seed;
+    return flow;
+}
+
+// Builds the book up to depth, then runs the timed bursts one command at a time or as
+// batches, journaling them (synced) when journaled is set
+bool runBursts(const BatchBenchmarkConfig& config, bool batched, bool journaled, BatchRun& run) {
+    unique_ptr<OrderBook> book = makeBenchmarkBook(config.depth + config.commands + 1024);
+    Amount deposit = 1000000000LL * ATOMS_PER_UNIT;
+    RandomFlow flow(flowConfig(config), fundTraders(*book, "BatchTrader", 2, deposit, deposit));
+    flow.reserve(config.depth + config.commands);
+    for (size_t i = 0; i < config.depth; ++i) {
+        flow.rest(*book);
+    }
+    vector<BookCommand> burst;
+    vector<BookResult> results;
+
+    Journal journal;
+    if (journaled) {
+        clearJournal(config.journalDirectory);
+        if (!journal.open(config.journalDirectory, 0)) {
+            cerr << journal.error() << endl;
+            return false;
+        }
+        book->setJournal(&journal);
+    }
+    book->setListener(&run.events);
+    run.seconds = 0;
+    run.resultHash = CHECKSUM_SEED;
+    run.accepted = 0;
+    for (size_t done = 0; done < config.commands; done += burst.size()) {
+        burst.resize(min(config.burst, config.commands - done));
+        results.resize(burst.size());
+        for (BookCommand &command : burst) {
+            command = flow.next();
+        }
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        if (batched) {
+            run.accepted += book->submitBatch(burst.data(), burst.size(), results.data());
+        } else {
+            for (size_t i = 0; i < burst.size(); ++i) {
+                run.accepted += executeBookCommand(*book, burst[i], results[i]) ? 1 : 0;
+            }
+        }
+        run.seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        for (size_t i = 0; i < burst.size(); ++i) {
+            run.resultHash = mixChecksum(run.resultHash, results[i].orderId);
+            flow.learn(burst[i], results[i]);
+        }
+    }
+    book->setListener(nullptr);
+    book->setJournal(nullptr);
+    run.journalRecords = journaled ? journal.lastSequence() : 0;
+    bool closed = !journaled || journal.close();
+    if (journaled) {
+        clearJournal(config.journalDirectory);
+    }
+    if (!closed) {
+        cerr << journal.error() << endl;
+        return false;
+    }
+    run.bookChecksum = book->bookChecksum();
+    run.balanceChecksum = book->balanceChecksum();
+    return true;
+}
+
+// Whether two runs left the same trail
+bool sameRun(const BatchRun& a, const BatchRun& b) {
+    return a.events.count == b.events.count && a.events.hash == b.events.hash && a.resultHash == b.resultHash && a.bookChecksum == b.bookChecksum &&
+           a.balanceChecksum == b.balanceChecksum && a.accepted == b.accepted && a.journalRecords == b.journalRecords;
+}
+
+/**
+ * @brief Runs the same bursts of commands against a deep book one call at a time and
+ *        through OrderBook::submitBatch, without and with a synced journal, and checks
+ *        every run leaves the same trail
+ *
+ * @details All runs must produce the same execution reports, the same results (order IDs
+ *          handed out, cancels that went through), the same book and the same balances,
+ *          and the journaled runs the same number of records; only the time spent
+ *          executing the bursts differs. The journal segments go to --journal and are
+ *          deleted after each run.
+ *
+ *          Usage: batchBenchmark [--depth 1000000] [--commands 1000000] [--burst 256]
+ *                                [--levels 1000] [--journal batch-journal] [--seed 42]
+ *
+ * @return int 0, 1 on a bad argument, a journal that fails or if the runs differ
+ */
+int main(int argc, char* argv[]) {
+    BatchBenchmarkConfig config;
+    BenchmarkOptions options("batchBenchmark");
+    options.add("--depth", config.depth);
+    options.add("--commands", config.commands);
+    options.add("--burst", config.burst);
+    options.add("--levels", config.levels);
+    options.add("--journal", config.journalDirectory, "DIR");
+    options.add("--seed", config.seed);
+    if (!options.parse(argc, argv)) {
+        return 1;
+    }
+    if (config.burst == 0 || config.levels <= 0 || config.levels >= BENCHMARK_MID_PRICE) {
+        cerr << "--burst must be positive and --levels between 1 and " << BENCHMARK_MID_PRICE - 1 << endl;
+        return 1;
+    }
+    filesystem::create_directories(config.journalDirectory);
+
+    BatchRun single, batched, singleJournaled, batchedJournaled;
+    if (!runBursts(config, false, false, single) || !runBursts(config, true, false, batched) || !runBursts(config, false, true, singleJournaled) ||
+        !runBursts(config, true, true, batchedJournaled)) {
+        return 1;
+    }
+
+    double commands = config.commands > 0 ? (double)config.commands : 1.0;
+    cout << "Depth " << config.depth << ", " << config.commands << " commands in bursts of " << config.burst << ", " << batched.accepted << " went through, "
+         << batchedJournaled.journalRecords << " journal records" << endl;
+    cout << fixed << setprecision(1);
+    cout << "                      no journal   journal" << endl;
+    cout << "One call per command: " << setw(10) << single.seconds * 1e9 / commands << setw(10) << singleJournaled.seconds * 1e9 / commands << " ns per command" << endl;
+    cout << "submitBatch:          " << setw(10) << batched.seconds * 1e9 / commands << setw(10) << batchedJournaled.seconds * 1e9 / commands << " ns per command" << endl;
+    batched.journalRecords = single.journalRecords = singleJournaled.journalRecords; // no journal, nothing to compare
+    bool same = sameRun(single, batched) && sameRun(single, singleJournaled) && sameRun(single, batchedJournaled);
+    cout << "Reports, results, book and balances " << (same ? "identical" : "DIFFER") << " (" << single.events.count << " reports)" << endl;
+    return same ? 0 : 1;
+}
@@ -0,0 +1,312 @@
+#ifndef BENCHMARKSUPPORT_HPP
+#define BENCHMARKSUPPORT_HPP
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "orderBook.hpp"
+
+// What the engine benchmarks share: their command line, their book and their order flow.
+
+const Price BENCHMARK_MID_PRICE = 11350; // 113.50 USD, between the market makers' seed bids and asks
+
+// Option values, false if the text is not a whole number (or list) of the target's type
+inline bool parseOptionValue(const std::string& text, long long& value) {
+    char *end = nullptr;
+    errno = 0;
+    value = std::strtoll(text.c_str(), &end, 10);
+    return !text.empty() && *end == '\0' && errno == 0;
+}
+
+inline bool parseOptionValue(const std::string& text, unsigned long long& value) {
+    char *end = nullptr;
+    errno = 0;
+    value = std::strtoull(text.c_str(), &end, 10);
+    return !text.empty() && text[0] != '-' && *end == '\0' && errno == 0;
+}
+
+inline bool parseOptionValue(const std::string& text, unsigned long& value) {
+    unsigned long long wide = 0;
+    if (!parseOptionValue(text, wide) || wide > (unsigned long)-1) {
+        return false;
+    }
+    value = (unsigned long)wide;
+    return true;
+}
+
+inline bool parseOptionValue(const std::string& text, unsigned int& value) {
+    unsigned long long wide = 0;
+    if (!parseOptionValue(text, wide) || wide > 0xFFFFFFFFULL) {
+        return false;
+    }
+    value = (unsigned int)wide;
+    return true;
+}
+
+inline bool parseOptionValue(const std::string& text, int& value) {
+    long long wide = 0;
+    if (!parseOptionValue(text, wide) || wide < -0x7FFFFFFFLL - 1 || wide > 0x7FFFFFFFLL) {
+        return false;
+    }
+    value = (int)wide;
+    return true;
+}
+
+inline bool parseOptionValue(const std::string& text, bool& value) {
+    value = text != "0";
+    return text == "0" || text == "1";
+}
+
+inline bool parseOptionValue(const std::string& text, std::string& value) {
+    value = text;
+    return !text.empty();
+}
+
+// Comma separated list, e.g. "10,1000,100000"
+template <class T>
+bool parseOptionValue(const std::string& text, std::vector<T>& values) {
+    std::vector<T> parsed;
+    std::istringstream list(text);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        T value;
+        if (!parseOptionValue(item, value)) {
+            return false;
+        }
+        parsed.push_back(value);
+    }
+    values = parsed;
+    return !values.empty();
+}
+
+/**
+ * @brief Command line of a benchmark: "--name value" options and bare "--name" flags, each
+ *        bound to the config field it sets
+ *
+ * @details Fields keep their defaults unless the option is given. Anything unknown, a
+ *          missing value or a value that does not parse prints the usage line and fails.
+ */
+class BenchmarkOptions {
+    private:
+    struct Option {
+        std::string name;
+        std::string placeholder; // empty for a flag
+        std::function<bool(const std::string&)> set;
+    };
+    std::string program;
+    std::vector<Option> options;
+
+    public:
+    explicit BenchmarkOptions(const std::string& programName) : program(programName) {};
+
+    template <class T>
+    void add(const std::string& name, T& target, const std::string& placeholder = "N") {
+        options.push_back(Option{name, placeholder, [&target](const std::string& text) { return parseOptionValue(text, target); }});
+    }
+
+    // A flag takes no value; given, it sets target to value
+    void addFlag(const std::string& name, bool& target, bool value = true) {
+        options.push_back(Option{name, "", [&target, value](const std::string&) {
+            target = value;
+            return true;
+        }});
+    }
+
+    std::string usage() const {
+        std::string text = "Usage: " + program;
+        for (const Option &option : options) {
+            text += " [" + option.name + (option.placeholder.empty() ? "" : " " + option.placeholder) + "]";
+        }
+        return text;
+    }
+
+    bool parse(int argc, char* argv[]) {
+        for (int i = 1; i < argc; ++i) {
+            const Option *option = nullptr;
+            for (const Option &candidate : options) {
+                option = candidate.name == argv[i] ? &candidate : option;
+            }
+            std::string name = argv[i];
+            bool flag = option != nullptr && option->placeholder.empty();
+            if (option == nullptr || (!flag && i + 1 >= argc) || !option->set(flag ? std::string() : std::string(argv[++i]))) {
+                std::cerr << "Bad option " << name << "\n" << usage() << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// The default book (seeded with the market makers), sized for orderCapacity orders
+inline std::unique_ptr<OrderBook> makeBenchmarkBook(size_t orderCapacity, bool cumulativeDepth = true) {
+    BookConfig bookConfig;
+    bookConfig.orderCapacity = orderCapacity;
+    bookConfig.cumulativeDepth = cumulativeDepth;
+    return std::unique_ptr<OrderBook>(new OrderBook(bookConfig));
+}
+
+// Creates count accounts named prefix0, prefix1... and deposits usd and stock atoms into each
+inline std::vector<AccountId> fundTraders(OrderBook& book, const std::string& prefix, size_t count, Amount usd, Amount stock) {
+    std::vector<AccountId> traders;
+    for (size_t i = 0; i < count; ++i) {
+        AccountId trader = book.makeUser(prefix + std::to_string(i));
+        book.addBalance(trader, "USD", usd);
+        book.addBalance(trader, TICKER, stock);
+        traders.push_back(trader);
+    }
+    return traders;
+}
+
+// Runs one command through the single-order call it names, as a front end without the
+// batch API does; returns whether it went through
+inline bool executeBookCommand(OrderBook& book, const BookCommand& command, BookResult& result) {
+    std::memset(&result, 0, sizeof(result));
+    result.orderId = INVALID_ORDER_ID;
+    switch (command.type) {
+        case BOOK_BID: result.orderId = book.addOrder(SIDE_BID, (OrderType)command.orderType, command.account, command.price, command.quantity); break;
+        case BOOK_ASK: result.orderId = book.addOrder(SIDE_ASK, (OrderType)command.orderType, command.account, command.price, command.quantity); break;
+        case BOOK_CANCEL: result.orderId = book.cancel(command.orderId) ? command.orderId : INVALID_ORDER_ID; break;
+        case BOOK_REDUCE: result.orderId = book.reduce(command.orderId, command.quantity) ? command.orderId : INVALID_ORDER_ID; break;
+        case BOOK_REPLACE: result.orderId = book.replace(command.orderId, command.price, command.quantity); break;
+    }
+    return result.orderId != INVALID_ORDER_ID;
+}
+
+// Shape of a RandomFlow: prices, sizes and the share of each command in percent (what the
+// listed shares leave of 100 are replaces)
+struct RandomFlowConfig {
+    Price mid; // passive bids rest below it, passive asks above
+    Price levels; // ticks either side of the mid that passive orders spread over
+    Quantity maxQuantity; // of passive orders and replaces
+    Quantity maxAggressiveQuantity; // of orders priced into the other side
+    Quantity maxReduce;
+    unsigned int passivePercent;
+    unsigned int aggressivePercent;
+    unsigned int cancelPercent;
+    unsigned int reducePercent;
+    unsigned int invalidPercent; // orders at an out-of-band price or for an unknown account
+    unsigned long long seed;
+
+    RandomFlowConfig() {
+        mid = BENCHMARK_MID_PRICE;
+        levels = 1000;
+        maxQuantity = 10;
+        maxAggressiveQuantity = 20;
+        maxReduce = 1;
+        passivePercent = 40;
+        aggressivePercent = 15;
+        cancelPercent = 25;
+        reducePercent = 8;
+        invalidPercent = 0;
+        seed = 42;
+    }
+};
+
+/**
+ * @brief Deterministic mix of passive and crossing orders, cancels, reduces and replaces
+ *        from a set of traders
+ *
+ * @details Cancels, reduces and replaces pick from the orders the flow was given an ID
+ *          for, some of which have filled or been cancelled since. The next command only
+ *          depends on the seed and on the results learnt so far, so two runs that execute
+ *          the commands the same way, one at a time or in batches, see the same flow.
+ */
+class RandomFlow {
+    private:
+    RandomFlowConfig config;
+    std::mt19937_64 random;
+    std::vector<AccountId> traders;
+    std::vector<OrderId> ids; // orders handed out
+
+    AccountId trader() { return traders[random() % traders.size()]; }
+    Price offset() { return 1 + (Price)(random() % config.levels); }
+    Quantity quantity(Quantity most) { return 1 + (Quantity)(random() % most); }
+
+    public:
+    unsigned long long accepted; // orders the book gave an ID to
+
+    RandomFlow(const RandomFlowConfig& flowConfig, const std::vector<AccountId>& flowTraders)
+        : config(flowConfig), random(flowConfig.seed), traders(flowTraders), accepted(0) {};
+
+    void reserve(size_t orders) { ids.reserve(orders); }
+
+    // Order on a random level of a random side that does not cross
+    BookCommand passive() {
+        bool bid = (random() & 1) != 0;
+        Price away = offset();
+        BookCommand command = {(unsigned char)(bid ? BOOK_BID : BOOK_ASK), ORDER_LIMIT, {0, 0}, trader(), bid ? config.mid - away : config.mid + away,
+                               quantity(config.maxQuantity), INVALID_ORDER_ID};
+        return command;
+    }
+
+    BookCommand next() {
+        unsigned int kind = (unsigned int)(random() % 100);
+        unsigned int aggressiveUpTo = config.passivePercent + config.aggressivePercent;
+        unsigned int cancelUpTo = aggressiveUpTo + config.cancelPercent;
+        unsigned int reduceUpTo = cancelUpTo + config.reducePercent;
+        unsigned int invalidUpTo = reduceUpTo + config.invalidPercent;
+        bool needsOrder = (kind >= aggressiveUpTo && kind < reduceUpTo) || kind >= invalidUpTo; // cancel, reduce, replace
+        if (kind < config.passivePercent || (needsOrder && ids.empty())) {
+            return passive();
+        }
+        BookCommand command = {BOOK_CANCEL, ORDER_LIMIT, {0, 0}, INVALID_ACCOUNT, 0, 0, INVALID_ORDER_ID};
+        bool bid = (random() & 1) != 0;
+        if (kind < aggressiveUpTo) {
+            Price into = offset(); // crosses, fills at or below the limit
+            command.type = bid ? BOOK_BID : BOOK_ASK;
+            command.account = trader();
+            command.price = bid ? config.mid + into : config.mid - into;
+            command.quantity = quantity(config.maxAggressiveQuantity);
+        } else if (kind < cancelUpTo) {
+            command.orderId = ids[random() % ids.size()];
+        } else if (kind < reduceUpTo) {
+            command.type = BOOK_REDUCE;
+            command.quantity = quantity(config.maxReduce);
+            command.orderId = ids[random() % ids.size()];
+        } else if (kind < invalidUpTo) {
+            bool badPrice = (random() & 1) != 0;
+            command.type = bid ? BOOK_BID : BOOK_ASK;
+            command.account = badPrice ? trader() : INVALID_ACCOUNT - 1; // PRICE_OUT_OF_BAND or UNKNOWN_ACCOUNT
+            command.price = badPrice ? 0 : config.mid;
+            command.quantity = 1;
+        } else {
+            Price away = offset();
+            command.type = BOOK_REPLACE;
+            command.price = bid ? config.mid - away : config.mid + away; // may cross when the order is on the other side
+            command.quantity = quantity(config.maxQuantity);
+            command.orderId = ids[random() % ids.size()];
+        }
+        return command;
+    }
+
+    // Remembers the ID a command was handed, if any
+    void learn(const BookCommand& command, const BookResult& result) {
+        if (result.orderId != INVALID_ORDER_ID && result.orderId != command.orderId) {
+            ids.push_back(result.orderId);
+            ++accepted;
+        }
+    }
+
+    void rest(OrderBook& book) {
+        BookCommand command = passive();
+        BookResult result;
+        executeBookCommand(book, command, result);
+        learn(command, result);
+    }
+
+    void step(OrderBook& book) {
+        BookCommand command = next();
+        BookResult result;
+        executeBookCommand(book, command, result);
+        learn(command, result);
+    }
+};
+
+#endif // BENCHMARKSUPPORT_HPP
@@ -0,0 +1,15 @@
+#ifndef CHECKSUM_HPP
+#define CHECKSUM_HPP
+
+// Folds one value into a running FNV-1a style checksum, used to compare engine runs
+inline unsigned long long mixChecksum(unsigned long long hash, unsigned long long value) {
+    for (int byte = 0; byte < 8; ++byte) {
+        hash ^= (value >> (byte * 8)) & 0xFF;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+const unsigned long long CHECKSUM_SEED = 14695981039346656037ULL; // FNV-1a offset basis
+
+#endif // CHECKSUM_HPP
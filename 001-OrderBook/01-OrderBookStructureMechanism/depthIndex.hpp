@@ -0,0 +1,121 @@
+#ifndef DEPTHINDEX_HPP
+#define DEPTHINDEX_HPP
+
+#include <vector>
+#include "fixedPoint.hpp"
+
+// Result of sweeping one side of the book from its best price, in ticks and lots
+struct SweepQuote {
+    Quantity quantity; // lots available, at most what was asked for
+    long long notionalTicks; // sum of price x quantity over the fills, in tick-lots
+    Amount notional; // the same in atoms of the quote asset (filled in by OrderBook)
+    Price bestPrice; // first level touched, -1 (NO_PRICE) if nothing is available
+    Price worstPrice; // last level touched, -1 (NO_PRICE) if nothing is available
+    unsigned int levels; // price levels touched
+
+    double averagePrice() const { return quantity > 0 ? (double)notionalTicks / quantity : 0; } // VWAP, in ticks
+    // Distance of the VWAP from the best price, in basis points of the best price
+    double slippageBps() const {
+        if (quantity <= 0 || bestPrice <= 0) {
+            return 0;
+        }
+        double average = averagePrice();
+        return (average > bestPrice ? average - bestPrice : bestPrice - average) / bestPrice * 10000.0;
+    }
+};
+
+// Running totals of a range of ladder levels
+struct DepthTotals {
+    Quantity quantity; // lots
+    long long notionalTicks; // price x quantity, in tick-lots
+    long long levels; // occupied levels
+
+    void add(const DepthTotals& other) {
+        quantity += other.quantity;
+        notionalTicks += other.notionalTicks;
+        levels += other.levels;
+    }
+};
+
+/**
+ * @brief Fenwick (binary indexed) tree of quantity, notional and level count over the
+ *        ticks of one side's ladder
+ *
+ * @details Ticks are offsets from the bottom of the price band. Updating one tick and
+ *          reading the totals of every tick up to a given one are both O(log ticks), and
+ *          findAbove() finds where the running quantity crosses a target in one
+ *          O(log ticks) descent, which is what a sweep quote needs. The three totals of a
+ *          node share a cache line.
+ */
+class CumulativeDepth {
+    private:
+    std::vector<DepthTotals> tree; // 1-based, tree[i] covers ticks (i - lowbit(i), i]
+    size_t topBit; // highest power of two <= number of ticks
+    DepthTotals all; // totals of every tick
+
+    public:
+    CumulativeDepth() : topBit(0), all() {};
+
+    void init(size_t ticks) {
+        DepthTotals zero = {0, 0, 0};
+        tree.assign(ticks + 1, zero);
+        all = zero;
+        topBit = 1;
+        while (topBit * 2 <= ticks) {
+            topBit *= 2;
+        }
+    }
+
+    // Adds quantity lots (negative to remove) at a tick worth price ticks, and levelDelta
+    // when the level becomes occupied (+1) or empty (-1)
+    void add(size_t tick, Price price, Quantity quantity, int levelDelta) {
+        DepthTotals delta = {quantity, price * quantity, levelDelta};
+        all.add(delta);
+        for (size_t i = tick + 1; i < tree.size(); i += i & (0 - i)) {
+            tree[i].add(delta);
+        }
+    }
+
+    // Totals of ticks 0..tick inclusive
+    DepthTotals upTo(size_t tick) const {
+        DepthTotals sum = {0, 0, 0};
+        if (tree.empty()) {
+            return sum;
+        }
+        for (size_t i = tick + 1 < tree.size() ? tick + 1 : tree.size() - 1; i > 0; i -= i & (0 - i)) {
+            sum.add(tree[i]);
+        }
+        return sum;
+    }
+
+    const DepthTotals& total() const { return all; }
+
+    /**
+     * @brief Finds the first tick from the bottom where the running quantity goes above
+     *        limit
+     *
+     * @param limit Quantity to stay at or below
+     * @param below Receives the totals of every tick before the returned one
+     * @param inclusive Stop before the running quantity reaches limit (<) instead of
+     *        going above it (<=)
+     *
+     * @return size_t The tick, or the number of ticks if the total never gets there
+     */
+    size_t findAbove(Quantity limit, DepthTotals& below, bool inclusive) const {
+        size_t position = 0;
+        below = DepthTotals();
+        for (size_t step = topBit; step > 0 && !tree.empty(); step >>= 1) {
+            size_t next = position + step;
+            if (next < tree.size()) {
+                Quantity running = below.quantity + tree[next].quantity;
+                if (inclusive ? running < limit : running <= limit) {
+                    position = next;
+                    below.add(tree[next]);
+                }
+            }
+        }
+        return position; // ticks 0..position-1 are in below, tick position crosses the limit
+    }
+};
+
+#endif // DEPTHINDEX_HPP
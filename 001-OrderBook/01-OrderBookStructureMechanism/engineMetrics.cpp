@@ -0,0 +1,188 @@
+#include "engineMetrics.hpp"
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+using namespace std;
+
+/**
+ * @brief Timestamp ticks per nanosecond, measured once over 20 ms against steady_clock
+ *
+ * @note The first call blocks for the measurement; EngineMetrics' constructor makes it, so
+ *       reading a summary never does
+ */
+double timestampTicksPerNanosecond() {
+    static const double ticksPerNs = [] {
+        chrono::steady_clock::time_point wallStart = chrono::steady_clock::now();
+        unsigned long long start = readTimestamp();
+        this_thread::sleep_for(chrono::milliseconds(20));
+        unsigned long long end = readTimestamp();
+        double nanos = chrono::duration<double, nano>(chrono::steady_clock::now() - wallStart).count();
+        return end > start && nanos > 0 ? (end - start) / nanos : 1.0;
+    }();
+    return ticksPerNs;
+}
+
+const char* metricsStageText(MetricsStage stage) {
+    switch (stage) {
+        case STAGE_VALIDATE: return "validate";
+        case STAGE_MATCH: return "match";
+        case STAGE_SETTLE: return "settle";
+        case STAGE_REST: return "rest";
+        case STAGE_CANCEL: return "cancel";
+        case STAGE_REPLACE: return "replace";
+        case STAGE_DEPTH: return "depth";
+    }
+    return "unknown";
+}
+
+HistogramSummary LatencyHistogram::summary(double unitsPer) const {
+    HistogramSummary result;
+    memset(&result, 0, sizeof(result));
+    unsigned long long counts[BUCKETS]; // one pass over the live buckets, the ranks below use this copy
+    unsigned long long total = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        counts[i] = buckets[i].load(memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return result;
+    }
+    unsigned long long highest = maximum.load(memory_order_relaxed);
+    double fractions[4] = {0.50, 0.90, 0.99, 0.999};
+    double *outputs[4] = {&result.p50, &result.p90, &result.p99, &result.p999};
+    unsigned long long seen = 0;
+    size_t next = 0;
+    bool haveMin = false;
+    for (size_t i = 0; i < BUCKETS && next < 4; ++i) {
+        if (counts[i] == 0) {
+            continue;
+        }
+        if (!haveMin) {
+            result.min = bucketLow(i) / unitsPer;
+            haveMin = true;
+        }
+        seen += counts[i];
+        while (next < 4 && seen >= (unsigned long long)(fractions[next] * total + 0.999999)) {
+            unsigned long long high = bucketHigh(i);
+            *outputs[next++] = (high < highest ? high : highest) / unitsPer;
+        }
+    }
+    result.count = total;
+    result.mean = sum.load(memory_order_relaxed) / (double)total / unitsPer;
+    result.max = highest / unitsPer;
+    return result;
+}
+
+EngineMetrics::EngineMetrics() : trades(0), tradedLots(0), restingOrders(0), bidLevels(0), askLevels(0) {
+    for (atomic<unsigned long long> &count : events) {
+        count.store(0, memory_order_relaxed);
+    }
+    for (atomic<unsigned long long> &count : rejects) {
+        count.store(0, memory_order_relaxed);
+    }
+    timestampTicksPerNanosecond();
+}
+
+// One histogram row of a report
+static void writeSummary(ostream& out, const char* name, const HistogramSummary& summary) {
+    out << left << setw(14) << name << right << setw(12) << summary.count << setw(10) << summary.min << setw(10) << summary.p50 << setw(10)
+        << summary.p90 << setw(10) << summary.p99 << setw(10) << summary.p999 << setw(12) << summary.max << setw(10) << summary.mean << "\n";
+}
+
+/**
+ * @brief Writes the stage latencies (ns), levels per match and every counter as plain text
+ *
+ * @details Layout, one block per call:
+ *          stage count min p50 p90 p99 p99.9 max mean   one row per stage, then "levels/match"
+ *          events  accepted=N partialFill=N ...       every EventType
+ *          rejects unknownAccount=N ...               EVENT_REJECTED by RejectReason
+ *          trades=N lots=N resting=N bidLevels=N askLevels=N
+ */
+void EngineMetrics::write(ostream& out) const {
+    static const char* eventNames[METRICS_EVENT_TYPES] = {"accepted", "partialFill", "fill", "rested", "reduced", "cancelled", "rejected", "settlementFailed"};
+    static const char* rejectNames[METRICS_REJECT_REASONS] = {"none", "unknownAccount", "insufficientBalance", "priceOutOfBand", "invalidQuantity",
+                                                              "bookFull", "orderNotFound", "quantityTooLarge", "unknownCommand", "openOrderLimit",
+                                                              "notionalLimit", "notFillable", "notPermitted"};
+    ios::fmtflags flags = out.flags();
+    streamsize precision = out.precision();
+    out << fixed << setprecision(1);
+    out << left << setw(14) << "stage (ns)" << right << setw(12) << "count" << setw(10) << "min" << setw(10) << "p50" << setw(10) << "p90" << setw(10)
+        << "p99" << setw(10) << "p99.9" << setw(12) << "max" << setw(10) << "mean" << "\n";
+    for (size_t stage = 0; stage < METRICS_STAGES; ++stage) {
+        writeSummary(out, metricsStageText((MetricsStage)stage), stageSummary((MetricsStage)stage));
+    }
+    writeSummary(out, "levels/match", levelsSummary());
+    out << "events";
+    for (size_t type = 0; type < METRICS_EVENT_TYPES; ++type) {
+        out << " " << eventNames[type] << "=" << eventCount((EventType)type);
+    }
+    out << "\nrejects";
+    for (size_t reason = REJECT_NONE + 1; reason < METRICS_REJECT_REASONS; ++reason) {
+        out << " " << rejectNames[reason] << "=" << rejectCount((RejectReason)reason);
+    }
+    out << "\ntrades=" << tradeCount() << " lots=" << tradedQuantity() << " resting=" << restingOrderCount() << " bidLevels=" << bidLevelCount()
+        << " askLevels=" << askLevelCount() << "\n";
+    out.flags(flags);
+    out.precision(precision);
+}
+
+/**
+ * @brief Starts appending reports of source to filePath every intervalMs milliseconds
+ *
+ * @return bool false if the dumper is already running
+ */
+bool MetricsDumper::start(const EngineMetrics& source, const string& filePath, unsigned int intervalMs) {
+    if (dumper.joinable()) {
+        return false;
+    }
+    metrics = &source;
+    path = filePath;
+    interval = chrono::milliseconds(intervalMs > 0 ? intervalMs : 1);
+    stopping = false;
+    dumps = 0;
+    lastError.clear();
+    dumper = thread(&MetricsDumper::run, this);
+    return true;
+}
+
+// Writes the last report and stops the thread
+void MetricsDumper::stop() {
+    if (!dumper.joinable()) {
+        return;
+    }
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    dumper.join();
+}
+
+void MetricsDumper::run() {
+    unique_lock<mutex> guard(lock);
+    while (!wake.wait_for(guard, interval, [this] { return stopping; })) {
+        guard.unlock();
+        dump();
+        guard.lock();
+    }
+    guard.unlock();
+    dump();
+}
+
+bool MetricsDumper::dump() {
+    ofstream file(path, ios::app);
+    if (!file) {
+        lastError = "cannot append to " + path;
+        return false;
+    }
+    unsigned long long wallMs = (unsigned long long)chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+    file << "# metrics " << wallMs << " dump " << ++dumps << "\n";
+    metrics->write(file);
+    file.flush();
+    if (!file) {
+        lastError = "cannot write to " + path;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,220 @@
+#ifndef ENGINEMETRICS_HPP
+#define ENGINEMETRICS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include "executionEvents.hpp"
+#include "fixedPoint.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Instrumentation is compiled into the engine only with ORDERBOOK_METRICS defined (the CMake
+// option of the same name). Without it every hook is behind a constant false and disappears.
+#ifdef ORDERBOOK_METRICS
+const bool METRICS_ENABLED = true;
+#else
+const bool METRICS_ENABLED = false;
+#endif
+
+/**
+ * @brief Cheapest timestamp the machine has: the time stamp counter on x86, steady_clock ns elsewhere
+ *
+ * @note Not serializing, so a stage of a few instructions can be off by a few cycles; use
+ *       timestampTicksPerNanosecond() to turn differences into time
+ */
+inline unsigned long long readTimestamp() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+double timestampTicksPerNanosecond(); // calibrated against steady_clock on first use, engineMetrics.cpp
+
+// Stages of a command the engine times, each into its own histogram
+enum MetricsStage {
+    STAGE_VALIDATE, // addBid/addAsk from entry until the order is accepted: account, band, balance, pool slot
+    STAGE_MATCH,    // walking the opposite side, fills, settlement and their reports; crossing orders only
+    STAGE_SETTLE,   // one flipBalance, per fill (inside STAGE_MATCH)
+    STAGE_REST,     // appending the remainder to its level
+    STAGE_CANCEL,   // a successful cancel, cancelBid/cancelAsk or reduce
+    STAGE_REPLACE,  // a replace up to the re-entry of the new order (timed by its own stages)
+    STAGE_DEPTH     // formatting the getDepth() text
+};
+const size_t METRICS_STAGES = STAGE_DEPTH + 1;
+const size_t METRICS_EVENT_TYPES = EVENT_SETTLEMENT_FAILED + 1;
+const size_t METRICS_REJECT_REASONS = REJECT_NOT_PERMITTED + 1;
+
+const char* metricsStageText(MetricsStage stage); // short name for reports
+
+// Adds to a counter only one thread ever writes: no locked instruction, readers see it whole
+inline void bumpCounter(std::atomic<unsigned long long>& counter, unsigned long long by = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+}
+
+// Distribution of a histogram in the unit it was asked for
+struct HistogramSummary {
+    unsigned long long count;
+    double min, mean, p50, p90, p99, p999, max;
+};
+
+/**
+ * @brief Log-linear histogram of non-negative values, HDR style: 32 linear buckets per
+ *        power of two, so any value is known to within 1/32 (3%) from 0 up to 2^64
+ *
+ * @details Fixed size (15 KiB) and allocation free. Values 0-63 get a bucket each; above
+ *          that, bucket (shift << 5) + (value >> shift) where shift puts value >> shift
+ *          in 32..63. Written by one thread (the book's) with plain relaxed stores, read
+ *          by any thread at any time: a reader may see a value in a bucket but not yet in
+ *          the sum, never a torn counter.
+ */
+class LatencyHistogram {
+    public:
+    static const unsigned SUB_BITS = 5;
+    static const size_t SUB_BUCKETS = (size_t)1 << SUB_BITS;
+    static const size_t BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    private:
+    std::atomic<unsigned long long> buckets[BUCKETS];
+    std::atomic<unsigned long long> sum; // of every value recorded, for the mean
+    std::atomic<unsigned long long> maximum;
+
+    static size_t bucketOf(unsigned long long value) {
+        unsigned magnitude = 63 - (unsigned)__builtin_clzll(value | 1);
+        unsigned shift = magnitude > SUB_BITS ? magnitude - SUB_BITS : 0;
+        return ((size_t)shift << SUB_BITS) + (size_t)(value >> shift);
+    }
+
+    public:
+    LatencyHistogram() : sum(0), maximum(0) {
+        for (std::atomic<unsigned long long> &bucket : buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    // Single writer only
+    void record(unsigned long long value) {
+        bumpCounter(buckets[bucketOf(value)]);
+        bumpCounter(sum, value);
+        if (value > maximum.load(std::memory_order_relaxed)) {
+            maximum.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    // Smallest and largest value that land in a bucket
+    static unsigned long long bucketLow(size_t bucket) {
+        unsigned shift = bucket < 2 * SUB_BUCKETS ? 0 : (unsigned)(bucket >> SUB_BITS) - 1;
+        return (unsigned long long)(bucket - ((size_t)shift << SUB_BITS)) << shift;
+    }
+    static unsigned long long bucketHigh(size_t bucket) {
+        unsigned shift = bucket < 2 * SUB_BUCKETS ? 0 : (unsigned)(bucket >> SUB_BITS) - 1;
+        return bucketLow(bucket) + (((unsigned long long)1 << shift) - 1);
+    }
+
+    /**
+     * @brief Summary with every value divided by unitsPer (ticks per ns for latencies, 1 for counts)
+     *
+     * @note Percentiles are the top of the bucket holding that rank, capped at the maximum
+     */
+    HistogramSummary summary(double unitsPer = 1.0) const;
+};
+
+/**
+ * @brief Everything the engine measures about one book: stage latencies, levels touched
+ *        per match, event and reject counters and the current depth
+ *
+ * @details Attach one to a book with OrderBook::setMetrics(); only the book's thread writes
+ *          it, any thread may read it or write() a report while the book runs. ~130 KiB,
+ *          allocate it once next to the book. In a build without ORDERBOOK_METRICS it
+ *          stays all zero.
+ */
+class EngineMetrics {
+    private:
+    LatencyHistogram stages[METRICS_STAGES]; // timestamp ticks
+    LatencyHistogram levelsPerMatch; // price levels an incoming order traded against, crossing orders only
+    std::atomic<unsigned long long> events[METRICS_EVENT_TYPES]; // execution reports by EventType
+    std::atomic<unsigned long long> rejects[METRICS_REJECT_REASONS]; // EVENT_REJECTED by reason
+    std::atomic<unsigned long long> trades; // one per fill, counted on the bid side's report
+    std::atomic<unsigned long long> tradedLots;
+    std::atomic<unsigned long long> restingOrders; // depth gauges, as of the last command
+    std::atomic<unsigned long long> bidLevels;
+    std::atomic<unsigned long long> askLevels;
+
+    public:
+    EngineMetrics();
+    EngineMetrics(const EngineMetrics&) = delete;
+    EngineMetrics& operator=(const EngineMetrics&) = delete;
+
+    // Written by the book only
+    void recordStage(MetricsStage stage, unsigned long long start, unsigned long long end) { stages[stage].record(end - start); }
+    void recordLevels(unsigned long long levels) { levelsPerMatch.record(levels); }
+    void countEvent(EventType type, RejectReason reason, bool isBid, Quantity qty) {
+        bumpCounter(events[type]);
+        if (type == EVENT_REJECTED) {
+            bumpCounter(rejects[reason]);
+        } else if ((type == EVENT_FILL || type == EVENT_PARTIAL_FILL) && isBid) {
+            bumpCounter(trades);
+            bumpCounter(tradedLots, (unsigned long long)qty);
+        }
+    }
+    void setDepth(size_t orders, size_t bids, size_t asks) {
+        restingOrders.store(orders, std::memory_order_relaxed);
+        bidLevels.store(bids, std::memory_order_relaxed);
+        askLevels.store(asks, std::memory_order_relaxed);
+    }
+
+    // Read from any thread
+    HistogramSummary stageSummary(MetricsStage stage) const { return stages[stage].summary(timestampTicksPerNanosecond()); } // ns
+    HistogramSummary levelsSummary() const { return levelsPerMatch.summary(); }
+    unsigned long long eventCount(EventType type) const { return events[type].load(std::memory_order_relaxed); }
+    unsigned long long rejectCount(RejectReason reason) const { return rejects[reason].load(std::memory_order_relaxed); }
+    unsigned long long tradeCount() const { return trades.load(std::memory_order_relaxed); }
+    unsigned long long tradedQuantity() const { return tradedLots.load(std::memory_order_relaxed); }
+    unsigned long long restingOrderCount() const { return restingOrders.load(std::memory_order_relaxed); }
+    unsigned long long bidLevelCount() const { return bidLevels.load(std::memory_order_relaxed); }
+    unsigned long long askLevelCount() const { return askLevels.load(std::memory_order_relaxed); }
+    void write(std::ostream& out) const; // plain text report, see MetricsDumper
+};
+
+/**
+ * @brief Appends an EngineMetrics report to a file at a fixed interval, from its own thread
+ *
+ * @details Each report starts with a "# metrics" line carrying the wall clock time in ms and
+ *          the dump number. stop() writes a last report, so short runs still leave one.
+ */
+class MetricsDumper {
+    private:
+    const EngineMetrics* metrics;
+    std::string path;
+    std::chrono::milliseconds interval;
+    std::thread dumper;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping;
+    unsigned long long dumps; // reports written
+    std::string lastError;
+
+    void run();
+    bool dump(); // appends one report
+
+    public:
+    MetricsDumper() : metrics(nullptr), interval(1000), stopping(false), dumps(0) {};
+    ~MetricsDumper() { stop(); }
+
+    bool start(const EngineMetrics& source, const std::string& filePath, unsigned int intervalMs); // false if already running
+    void stop();
+    unsigned long long dumpCount() const { return dumps; } // after stop()
+    const std::string& error() const { return lastError; } // after stop(), empty if every report was written
+};
+
+#endif // ENGINEMETRICS_HPP
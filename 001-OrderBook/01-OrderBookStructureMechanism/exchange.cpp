@@ -0,0 +1,268 @@
+#include "exchange.hpp"
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+using namespace std;
+
+/**
+ * @brief Constructor for the Exchange class
+ *
+ * @param exchangeConfig Shard count, ledger size and the BookConfig of every instrument
+ *
+ * @note The shards are created here but their threads only start with start()
+ */
+Exchange::Exchange(const ExchangeConfig& exchangeConfig) : config(exchangeConfig), ledger(exchangeConfig.maxAssets), running(false) {
+    ledger.reserveAccounts(config.expectedAccounts);
+    unsigned int count = config.shards > 0 ? config.shards : 1;
+    for (unsigned int i = 0; i < count; ++i) {
+        shards.push_back(unique_ptr<ExchangeShard>(new ExchangeShard()));
+    }
+}
+
+AssetId Exchange::addAsset(const string& name) {
+    return running ? INVALID_ASSET : ledger.addAsset(name);
+}
+
+AccountId Exchange::addAccount(const string& name) {
+    return running ? INVALID_ACCOUNT : ledger.addAccount(name); // may move the balance table
+}
+
+/**
+ * @brief Lists a new instrument with an empty book on the shared ledger
+ *
+ * @param symbol Unique symbol of the instrument
+ * @param base Asset delivered by sellers, usually registered under the same symbol
+ * @param quote Asset paid by buyers
+ * @param tickSize Price step in atoms of the quote asset
+ * @param lotSize Quantity step in atoms of the base asset
+ *
+ * @return InstrumentId ID used by ExchangeCommand, or INVALID_INSTRUMENT if the exchange
+ *         is running, the symbol is taken, an asset is unknown or tickSize * lotSize is
+ *         not a positive multiple of ATOMS_PER_UNIT
+ */
+InstrumentId Exchange::addInstrument(const string& symbol, AssetId base, AssetId quote, Amount tickSize, Amount lotSize) {
+    if (running || instrumentIds.find(symbol) != instrumentIds.end() || base >= ledger.assetCount() || quote >= ledger.assetCount() || base == quote) {
+        return INVALID_INSTRUMENT;
+    }
+    if (!InstrumentSpec::isValidGrid(tickSize, lotSize)) {
+        return INVALID_INSTRUMENT; // a zero tickLotValue would make every notional 0 and fitsAmount() divide by it
+    }
+    InstrumentId id = (InstrumentId)books.size();
+    books.push_back(unique_ptr<OrderBook>(new OrderBook(InstrumentSpec(symbol, tickSize, lotSize), ledger, base, quote, config.book)));
+    books.back()->setListener(shards[shardOf(id)].get());
+    instrumentIds[symbol] = id;
+    return id;
+}
+
+/**
+ * @brief Credits an account, e.g. for a deposit or a transfer in
+ *
+ * @return bool false if the account or asset does not exist, or the amount is not positive
+ *
+ * @note Atomic, so it may be called while shards are settling trades of the same account
+ */
+bool Exchange::deposit(AccountId account, AssetId asset, Amount amount) {
+    if (!ledger.isAccount(account) || asset >= ledger.assetCount() || amount <= 0) {
+        return false;
+    }
+    ledger.credit(account, asset, amount);
+    return true;
+}
+
+/**
+ * @brief Sets an account's open order and open notional limits, see OrderBook::setLimits
+ *
+ * @return bool false if the account does not exist or a limit is negative
+ *
+ * @note The limits cover the account's orders in every book; the shards pick them up with
+ *       their next order of the account
+ */
+bool Exchange::setLimits(AccountId account, unsigned int maxOpenOrders, Amount maxOpenNotional) {
+    if (!ledger.isAccount(account) || maxOpenNotional < 0) {
+        return false;
+    }
+    ledger.setLimits(account, maxOpenOrders, maxOpenNotional);
+    return true;
+}
+
+InstrumentId Exchange::findInstrument(const string& symbol) const {
+    auto it = instrumentIds.find(symbol);
+    return it == instrumentIds.end() ? INVALID_INSTRUMENT : it->second;
+}
+
+/**
+ * @brief Runs one command on its instrument's book
+ *
+ * @param shard Shard owning the instrument, counts what happened
+ * @param command The command
+ *
+ * @note 
+ * - Only ever called by the shard's own thread (or inline while stopped)
+ * - A cancel, reduce or replace only goes ahead for the account that owns the order;
+ *   anyone else's is counted as a reject and never reaches the book
+ */
+void Exchange::execute(ExchangeShard& shard, const ExchangeCommand& command) {
+    ++shard.stats.commands;
+    if (command.instrument >= books.size()) {
+        ++shard.stats.unknownInstrument;
+        return;
+    }
+    OrderBook &book = *books[command.instrument];
+    switch (command.type) {
+        case EXCHANGE_BID: book.addOrder(SIDE_BID, (OrderType)command.orderType, command.account, command.price, command.quantity); break;
+        case EXCHANGE_ASK: book.addOrder(SIDE_ASK, (OrderType)command.orderType, command.account, command.price, command.quantity); break;
+        case EXCHANGE_CANCEL:
+        case EXCHANGE_REDUCE:
+        case EXCHANGE_REPLACE: {
+            AccountId owner = book.ownerOf(command.orderId);
+            if (owner != INVALID_ACCOUNT && owner != command.account) {
+                ++shard.stats.rejects;
+            } else if (command.type == EXCHANGE_CANCEL) {
+                book.cancel(command.orderId);
+            } else if (command.type == EXCHANGE_REDUCE) {
+                book.reduce(command.orderId, command.quantity);
+            } else {
+                book.replace(command.orderId, command.price, command.quantity);
+            }
+            break;
+        }
+        default: ++shard.stats.rejects; break;
+    }
+}
+
+/**
+ * @brief Body of a shard's thread
+ *
+ * @details Sleeps until commands arrive, swaps the whole inbox out under the lock and
+ *          matches the batch with the lock released, so producers only ever wait for a
+ *          vector swap.
+ *
+ * @param index The shard
+ */
+void Exchange::runShard(unsigned int index) {
+    ExchangeShard &shard = *shards[index];
+    unique_lock<mutex> guard(shard.lock);
+    while (true) {
+        shard.wake.wait(guard, [&shard] { return !shard.inbox.empty() || shard.stopping; });
+        if (shard.inbox.empty()) {
+            return; // stopping and nothing left to match
+        }
+        shard.batch.swap(shard.inbox);
+        guard.unlock();
+
+        for (const ExchangeCommand &command : shard.batch) {
+            execute(shard, command);
+        }
+        size_t done = shard.batch.size();
+        shard.batch.clear();
+
+        guard.lock();
+        shard.processed += done;
+        shard.idle.notify_all();
+    }
+}
+
+/**
+ * @brief Launches the shard threads
+ *
+ * @note With ExchangeConfig::pinThreads each thread is pinned to its own core (modulo
+ *       the number of cores), keeping its books in that core's caches
+ */
+void Exchange::start() {
+    if (running) {
+        return;
+    }
+    running = true;
+    unsigned int cores = thread::hardware_concurrency();
+    for (unsigned int i = 0; i < shards.size(); ++i) {
+        shards[i]->stopping = false;
+        shards[i]->worker = thread(&Exchange::runShard, this, i);
+#ifdef __linux__
+        if (config.pinThreads && cores > 0) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(i % cores, &cpus);
+            pthread_setaffinity_np(shards[i]->worker.native_handle(), sizeof(cpus), &cpus);
+        }
+#else
+        (void)cores;
+#endif
+    }
+}
+
+/**
+ * @brief Stops the shard threads once they have matched everything submitted
+ */
+void Exchange::stop() {
+    if (!running) {
+        return;
+    }
+    for (unique_ptr<ExchangeShard> &shard : shards) {
+        lock_guard<mutex> guard(shard->lock);
+        shard->stopping = true;
+        shard->wake.notify_one();
+    }
+    for (unique_ptr<ExchangeShard> &shard : shards) {
+        shard->worker.join();
+    }
+    running = false;
+}
+
+/**
+ * @brief Queues commands for the shards owning their instruments
+ *
+ * @details Commands are bucketed per shard first, then each shard's lock is taken once
+ *          for the whole call. Safe to call from many threads; commands of one call (and
+ *          of successive calls from one thread) keep their order per instrument.
+ *
+ * @param commands Commands to queue
+ * @param count Number of commands
+ *
+ * @note While the exchange is stopped the commands are executed on the calling thread
+ */
+void Exchange::submit(const ExchangeCommand* commands, size_t count) {
+    if (!running) {
+        for (size_t i = 0; i < count; ++i) {
+            const ExchangeCommand &command = commands[i];
+            execute(*shards[command.instrument < books.size() ? shardOf(command.instrument) : 0], command);
+        }
+        return;
+    }
+
+    thread_local vector<vector<ExchangeCommand>> outgoing; // per shard, reused across calls
+    if (outgoing.size() < shards.size()) {
+        outgoing.resize(shards.size());
+    }
+    for (size_t i = 0; i < count; ++i) {
+        const ExchangeCommand &command = commands[i];
+        outgoing[command.instrument < books.size() ? shardOf(command.instrument) : 0].push_back(command);
+    }
+    for (unsigned int s = 0; s < shards.size(); ++s) {
+        if (outgoing[s].empty()) {
+            continue;
+        }
+        ExchangeShard &shard = *shards[s];
+        {
+            lock_guard<mutex> guard(shard.lock);
+            shard.inbox.insert(shard.inbox.end(), outgoing[s].begin(), outgoing[s].end());
+            shard.submitted += outgoing[s].size();
+        }
+        shard.wake.notify_one();
+        outgoing[s].clear();
+    }
+}
+
+/**
+ * @brief Blocks until every shard has matched everything submitted so far
+ */
+void Exchange::drain() {
+    if (!running) {
+        return;
+    }
+    for (unique_ptr<ExchangeShard> &shard : shards) {
+        unique_lock<mutex> guard(shard->lock);
+        ExchangeShard *current = shard.get();
+        current->idle.wait(guard, [current] { return current->processed == current->submitted; });
+    }
+}
@@ -0,0 +1,147 @@
+#ifndef EXCHANGE_HPP
+#define EXCHANGE_HPP
+
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "orderBook.hpp"
+
+typedef unsigned int InstrumentId; // dense index of an instrument, handed out by addInstrument
+
+const InstrumentId INVALID_INSTRUMENT = 0xFFFFFFFFu;
+
+enum ExchangeCommandType {
+    EXCHANGE_BID = 1,
+    EXCHANGE_ASK,
+    EXCHANGE_CANCEL,
+    EXCHANGE_REDUCE,
+    EXCHANGE_REPLACE
+};
+
+// One order entry for an instrument of the exchange
+struct ExchangeCommand {
+    unsigned char type; // ExchangeCommandType
+    unsigned char orderType; // OrderType (bid, ask), ORDER_LIMIT (0) otherwise
+    unsigned char reserved[2];
+    InstrumentId instrument;
+    AccountId account; // bid, ask; for cancel, reduce and replace the account that owns the order
+    Price price; // ticks of the instrument (bid, ask, replace)
+    Quantity quantity; // lots of the instrument (bid, ask, reduce, replace)
+    OrderId orderId; // cancel, reduce, replace: an ID handed out by the instrument's book
+};
+
+// Sizes an exchange; every instrument's book gets the same BookConfig
+struct ExchangeConfig {
+    unsigned int shards; // matching threads, instruments are spread over them round robin
+    size_t maxAssets; // balance columns per account, one per instrument plus the quote assets
+    size_t expectedAccounts; // accounts to size the ledger for up front
+    bool pinThreads; // pin shard i to core i modulo the core count (Linux only)
+    BookConfig book;
+
+    ExchangeConfig() {
+        shards = 1;
+        maxAssets = 1024;
+        expectedAccounts = 1024;
+        pinThreads = true;
+    }
+};
+
+// What a shard's books reported, counted by the shard's thread
+struct ShardStats {
+    unsigned long long commands; // commands executed
+    unsigned long long trades; // fills, each counted once
+    unsigned long long rejects; // commands refused, including cancels, reduces and replaces of another account's order
+    unsigned long long settlementFailures; // trades that matched but could not be paid for
+    unsigned long long unknownInstrument; // commands for an instrument that does not exist
+};
+
+// One matching thread and the books it owns. Only the shard's thread touches its books
+// while the exchange runs, so matching needs no lock; the mutex only guards the inbox.
+struct ExchangeShard : public ExecutionListener {
+    std::mutex lock;
+    std::condition_variable wake; // inbox has commands or the shard is stopping
+    std::condition_variable idle; // processed has caught up with submitted
+    std::vector<ExchangeCommand> inbox; // filled by submit() under lock
+    std::vector<ExchangeCommand> batch; // swapped out of inbox and matched without the lock
+    unsigned long long submitted; // under lock
+    unsigned long long processed; // under lock
+    bool stopping; // under lock
+    ShardStats stats; // written by the shard's thread only
+    std::thread worker;
+
+    ExchangeShard() : submitted(0), processed(0), stopping(false) { std::memset(&stats, 0, sizeof(stats)); }
+
+    void onEvent(const ExecutionEvent& event) {
+        switch (event.type) {
+            case EVENT_FILL:
+            case EVENT_PARTIAL_FILL: stats.trades += event.isBid ? 1 : 0; break; // once per trade, for the bid's report
+            case EVENT_REJECTED: ++stats.rejects; break;
+            case EVENT_SETTLEMENT_FAILED: ++stats.settlementFailures; break;
+            default: break;
+        }
+    }
+};
+
+/**
+ * @brief Many instruments, each with its own book and base/quote pair, matched on a
+ *        configurable number of threads
+ *
+ * @details Instruments are assigned to shards round robin and every shard's books are
+ *          driven by that shard's thread alone, so the books need no locking. All books
+ *          settle on one shared Ledger with atomic debits and credits, which is the
+ *          cross-shard path: an account can trade instruments on different shards with
+ *          one set of balances, and concurrent trades can neither overdraw it nor create
+ *          or lose atoms.
+ *
+ *          Set up assets, accounts and instruments first, then start() the shards and
+ *          submit() commands from any thread. Commands for one instrument are executed in
+ *          the order they were submitted by one producer. deposit() and setLimits() work at
+ *          any time.
+ */
+class Exchange {
+    private:
+    ExchangeConfig config;
+    Ledger ledger;
+    std::vector<std::unique_ptr<OrderBook>> books; // indexed by InstrumentId
+    std::unordered_map<std::string, InstrumentId> instrumentIds;
+    std::vector<std::unique_ptr<ExchangeShard>> shards;
+    bool running;
+
+    void execute(ExchangeShard& shard, const ExchangeCommand& command); // runs one command on its book
+    void runShard(unsigned int index); // body of a shard's thread
+
+    public:
+    Exchange(const ExchangeConfig& exchangeConfig = ExchangeConfig());
+    ~Exchange() { stop(); }
+    Exchange(const Exchange&) = delete;
+    Exchange& operator=(const Exchange&) = delete;
+
+    // Set up, only while stopped; each returns the INVALID_* ID when refused
+    AssetId addAsset(const std::string& name); // registers an asset (or returns its existing ID)
+    AccountId addAccount(const std::string& name); // registers an account with zero balances
+    InstrumentId addInstrument(const std::string& symbol, AssetId base, AssetId quote, Amount tickSize, Amount lotSize); // new empty book
+    bool deposit(AccountId account, AssetId asset, Amount amount); // credits a positive number of atoms, safe while running
+    bool setLimits(AccountId account, unsigned int maxOpenOrders, Amount maxOpenNotional); // pre-trade limits over every book, safe while running
+
+    void start(); // launches one thread per shard
+    void stop(); // matches what was submitted, then joins the threads
+    void submit(const ExchangeCommand* commands, size_t count); // queues commands, thread safe; runs them inline when stopped
+    void drain(); // waits until every submitted command has been matched
+
+    InstrumentId findInstrument(const std::string& symbol) const;
+    unsigned int shardOf(InstrumentId instrument) const { return instrument % (unsigned int)shards.size(); }
+    unsigned int shardCount() const { return (unsigned int)shards.size(); }
+    size_t instrumentCount() const { return books.size(); }
+    bool isRunning() const { return running; }
+    OrderBook& book(InstrumentId instrument) { return *books[instrument]; } // only touch while stopped or drained
+    const OrderBook& book(InstrumentId instrument) const { return *books[instrument]; }
+    const Ledger& getLedger() const { return ledger; }
+    const ShardStats& shardStats(unsigned int shard) const { return shards[shard]->stats; } // read while stopped or drained
+};
+
+#endif // EXCHANGE_HPP
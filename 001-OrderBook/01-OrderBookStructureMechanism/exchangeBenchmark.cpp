@@ -0,0 +1,191 @@
+#include "benchmarkSupport.hpp"
+#include "exchange.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Shard counts to compare and the shape of the flow they all run
+struct ExchangeBenchmarkConfig {
+    vector<unsigned int> threads; // shard counts to run the same flow with
+    size_t instruments;
+    size_t accounts;
+    size_t operations; // commands in the flow
+    Price levels; // ticks around the mid that passive orders rest on
+    int aggressivePercent; // share of orders priced through the other side
+    unsigned long long seed;
+
+    ExchangeBenchmarkConfig() {
+        threads = {1, 2, 4, 8};
+        instruments = 1000;
+        accounts = 1000;
+        operations = 2000000;
+        levels = 50;
+        aggressivePercent = 50;
+        seed = 42;
+    }
+};
+
+const Amount DEPOSIT = 1000000000LL * ATOMS_PER_UNIT; // per account and asset, enough that no settlement fails
+
+// Random limit orders spread evenly over the instruments and accounts
+vector<ExchangeCommand> makeFlow(const ExchangeBenchmarkConfig& config) {
+    mt19937_64 random(config.seed);
+    vector<ExchangeCommand> flow(config.operations);
+    for (ExchangeCommand &command : flow) {
+        bool bid = (random() & 1) != 0;
+        bool aggressive = (int)(random() % 100) < config.aggressivePercent;
+        Price offset = aggressive ? -config.levels : 1 + (Price)(random() % config.levels);
+        command.type = bid ? EXCHANGE_BID : EXCHANGE_ASK;
+        command.instrument = (InstrumentId)(random() % config.instruments);
+        command.account = (AccountId)(random() % config.accounts);
+        command.price = bid ? BENCHMARK_MID_PRICE - offset : BENCHMARK_MID_PRICE + offset;
+        command.quantity = 1 + (Quantity)(random() % 10);
+        command.orderId = INVALID_ORDER_ID;
+    }
+    return flow;
+}
+
+// Totals of one run, compared across shard counts
+struct RunResult {
+    double seconds;
+    ShardStats stats;
+    unsigned long long bookChecksum; // over every instrument's book, in ID order
+    bool conserved; // every asset still sums to what was deposited
+};
+
+/**
+ * @brief Runs the whole flow through a freshly set up exchange with the given shard count
+ *
+ * @details Set up (assets, accounts, deposits, books) is not timed. The flow is submitted
+ *          from this thread in chunks of 4096 commands and the time runs until every
+ *          shard has drained.
+ */
+RunResult runExchange(const ExchangeBenchmarkConfig& config, unsigned int shards, const vector<ExchangeCommand>& flow) {
+    ExchangeConfig exchangeConfig;
+    exchangeConfig.shards = shards;
+    exchangeConfig.maxAssets = config.instruments + 1;
+    exchangeConfig.expectedAccounts = config.accounts;
+    exchangeConfig.book.orderCapacity = 1 << 12;
+    exchangeConfig.book.minPrice = BENCHMARK_MID_PRICE - config.levels - 1;
+    exchangeConfig.book.maxPrice = BENCHMARK_MID_PRICE + config.levels + 1;
+    Exchange exchange(exchangeConfig);
+
+    AssetId usd = exchange.addAsset("USD");
+    for (size_t i = 0; i < config.instruments; ++i) {
+        string symbol = "SYM" + to_string(i);
+        exchange.addInstrument(symbol, exchange.addAsset(symbol), usd, ATOMS_PER_UNIT / 100, ATOMS_PER_UNIT);
+    }
+    for (size_t i = 0; i < config.accounts; ++i) {
+        AccountId account = exchange.addAccount("Trader" + to_string(i));
+        for (AssetId asset = 0; asset < exchange.getLedger().assetCount(); ++asset) {
+            exchange.deposit(account, asset, DEPOSIT);
+        }
+    }
+
+    exchange.start();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (size_t i = 0; i < flow.size(); i += 4096) {
+        exchange.submit(flow.data() + i, min((size_t)4096, flow.size() - i));
+    }
+    exchange.drain();
+    RunResult result;
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    exchange.stop();
+
+    memset(&result.stats, 0, sizeof(result.stats));
+    for (unsigned int s = 0; s < exchange.shardCount(); ++s) {
+        const ShardStats &stats = exchange.shardStats(s);
+        result.stats.commands += stats.commands;
+        result.stats.trades += stats.trades;
+        result.stats.rejects += stats.rejects;
+        result.stats.settlementFailures += stats.settlementFailures;
+        result.stats.unknownInstrument += stats.unknownInstrument;
+    }
+    result.bookChecksum = CHECKSUM_SEED;
+    for (InstrumentId id = 0; id < exchange.instrumentCount(); ++id) {
+        result.bookChecksum = mixChecksum(result.bookChecksum, exchange.book(id).bookChecksum());
+    }
+    const Ledger &ledger = exchange.getLedger();
+    result.conserved = true;
+    for (AssetId asset = 0; asset < ledger.assetCount(); ++asset) {
+        Amount total = 0;
+        for (AccountId account = 0; account < ledger.accountCount(); ++account) {
+            total += ledger.total(account, asset); // available plus what resting orders hold
+        }
+        result.conserved = result.conserved && total == DEPOSIT * (Amount)ledger.accountCount();
+    }
+    return result;
+}
+
+/**
+ * @brief Measures how Exchange throughput scales with the number of shards
+ *
+ * @details The same random flow, spread evenly over the instruments, is run once per
+ *          shard count. Every run must end with the same books (the flow of each
+ *          instrument is executed in order whatever the sharding) and with every asset
+ *          summing to what was deposited; a run that does not is reported as a mismatch.
+ *
+ *          Options:
+ *          - --threads 1,2,4,8       shard counts
+ *          - --instruments 1000
+ *          - --accounts 1000
+ *          - --ops 2000000           commands per run
+ *          - --levels 50             ticks either side of the mid for passive orders
+ *          - --aggressive 50         percent of orders crossing the book
+ *          - --seed 42
+ *
+ * @return int 0, 1 on a bad option or a mismatch between runs
+ */
+int main(int argc, char* argv[]) {
+    ExchangeBenchmarkConfig config;
+    BenchmarkOptions options("exchangeBenchmark");
+    options.add("--threads", config.threads, "N,N,...");
+    options.add("--instruments", config.instruments);
+    options.add("--accounts", config.accounts);
+    options.add("--ops", config.operations);
+    options.add("--levels", config.levels);
+    options.add("--aggressive", config.aggressivePercent);
+    options.add("--seed", config.seed);
+    if (!options.parse(argc, argv)) {
+        return 1;
+    }
+    if (config.instruments == 0 || config.accounts == 0 || config.operations == 0 || config.levels <= 0 || config.levels >= BENCHMARK_MID_PRICE - 1
+        || config.instruments >= INVALID_ASSET || find(config.threads.begin(), config.threads.end(), 0u) != config.threads.end()) {
+        cerr << "--instruments, --accounts, --ops and --threads must be positive, --levels between 1 and " << BENCHMARK_MID_PRICE - 2 << endl;
+        return 1;
+    }
+
+    vector<ExchangeCommand> flow = makeFlow(config);
+    cout << config.instruments << " instruments, " << config.accounts << " accounts, " << config.operations << " commands, "
+         << config.aggressivePercent << "% aggressive, " << thread::hardware_concurrency() << " cores" << endl;
+    cout << setw(8) << "threads" << setw(14) << "commands/sec" << setw(10) << "speedup" << setw(12) << "trades" << setw(10) << "rejects"
+         << setw(20) << "book checksum" << setw(12) << "balances" << endl;
+
+    bool consistent = true;
+    double baseline = 0;
+    unsigned long long expectedChecksum = 0;
+    for (size_t i = 0; i < config.threads.size(); ++i) {
+        RunResult result = runExchange(config, config.threads[i], flow);
+        double rate = result.seconds > 0 ? flow.size() / result.seconds : 0;
+        if (i == 0) {
+            baseline = rate;
+            expectedChecksum = result.bookChecksum;
+        }
+        bool same = result.bookChecksum == expectedChecksum && result.stats.settlementFailures == 0;
+        consistent = consistent && same && result.conserved;
+        cout << setw(8) << config.threads[i] << setw(14) << (unsigned long long)rate << setw(9) << fixed << setprecision(2)
+             << (baseline > 0 ? rate / baseline : 0) << "x" << setw(12) << result.stats.trades << setw(10) << result.stats.rejects
+             << setw(20) << hex << result.bookChecksum << dec << (same ? " " : "!") << setw(11) << (result.conserved ? "conserved" : "MISMATCH") << endl;
+    }
+    if (!consistent) {
+        cerr << "Runs disagree: books differ between shard counts or balances were not conserved" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,118 @@
+#ifndef EXECUTIONEVENTS_HPP
+#define EXECUTIONEVENTS_HPP
+
+#include <vector>
+#include "fixedPoint.hpp"
+#include "ledger.hpp"
+#include "orderPool.hpp"
+
+// What happened to an order
+enum EventType {
+    EVENT_ACCEPTED,     // order passed validation and got its ID, matching follows
+    EVENT_PARTIAL_FILL, // order traded part of its quantity, some is left
+    EVENT_FILL,         // order traded its last quantity and is done
+    EVENT_RESTED,       // unfilled quantity was placed in the book
+    EVENT_REDUCED,      // resting quantity was lowered, time priority kept
+    EVENT_CANCELLED,    // resting order was removed
+    EVENT_REJECTED,     // command refused, see RejectReason
+    EVENT_SETTLEMENT_FAILED // a trade matched but a party could not pay or deliver (an unknown account; funds are held on accept)
+};
+
+// Why a command was refused (or why settlement failed)
+enum RejectReason {
+    REJECT_NONE,
+    REJECT_UNKNOWN_ACCOUNT,
+    REJECT_INSUFFICIENT_BALANCE,
+    REJECT_PRICE_OUT_OF_BAND,
+    REJECT_INVALID_QUANTITY,
+    REJECT_BOOK_FULL,
+    REJECT_ORDER_NOT_FOUND,
+    REJECT_QUANTITY_TOO_LARGE,
+    REJECT_UNKNOWN_COMMAND,
+    REJECT_OPEN_ORDER_LIMIT, // the account already has its maximum of open orders
+    REJECT_NOTIONAL_LIMIT, // the order would take the account's open notional past its limit
+    REJECT_NOT_FILLABLE, // a fill-or-kill order cannot fill in full, or a market order finds nothing to trade against
+    REJECT_NOT_PERMITTED // the gateway session is not the one the order's account is attached to
+};
+
+// Short human readable text for a reject reason, for logs and consoles
+inline const char* rejectReasonText(RejectReason reason) {
+    switch (reason) {
+        case REJECT_NONE: return "none";
+        case REJECT_UNKNOWN_ACCOUNT: return "account does not exist";
+        case REJECT_INSUFFICIENT_BALANCE: return "insufficient balance";
+        case REJECT_PRICE_OUT_OF_BAND: return "price outside the book's price band";
+        case REJECT_INVALID_QUANTITY: return "quantity must be positive and its notional must fit";
+        case REJECT_BOOK_FULL: return "order book is full";
+        case REJECT_ORDER_NOT_FOUND: return "order not found";
+        case REJECT_QUANTITY_TOO_LARGE: return "quantity larger than the resting order";
+        case REJECT_UNKNOWN_COMMAND: return "unknown command";
+        case REJECT_OPEN_ORDER_LIMIT: return "open order limit reached";
+        case REJECT_NOTIONAL_LIMIT: return "open notional limit reached";
+        case REJECT_NOT_FILLABLE: return "not fillable";
+        case REJECT_NOT_PERMITTED: return "account not attached to this session";
+    }
+    return "unknown";
+}
+
+// One execution report. Plain data so it can be copied into ring buffers and files as is.
+// Fills are reported twice, once for each order involved, with the other side in the contra fields.
+struct ExecutionEvent {
+    unsigned long long sequence; // position in the book's event stream, starts at 1
+    OrderId orderId; // order the event is about (INVALID_ORDER_ID for rejected entries)
+    OrderId contraOrderId; // other order of a fill
+    Price price; // order price, or trade price for fills
+    Quantity quantity; // quantity accepted, traded, rested, reduced or cancelled
+    Quantity leavesQuantity; // quantity of orderId still open after this event
+    AccountId account; // owner of orderId
+    AccountId contraAccount; // owner of contraOrderId
+    unsigned char type; // EventType
+    unsigned char reason; // RejectReason
+    bool isBid; // side of orderId
+};
+
+// Receives execution reports as the engine produces them. Called from inside the
+// matching loop, so implementations must be cheap: copy the event and return.
+class ExecutionListener {
+    public:
+    virtual ~ExecutionListener() {};
+    virtual void onEvent(const ExecutionEvent& event) = 0;
+};
+
+// Preallocated single-threaded ring of execution reports. The engine appends, the front
+// end drains whenever it likes (e.g. after each command) outside the matching loop.
+// When the ring is full the oldest report is overwritten and counted as dropped.
+class EventRing : public ExecutionListener {
+    private:
+    std::vector<ExecutionEvent> events; // capacity is a power of two
+    unsigned long long head; // total events ever read
+    unsigned long long tail; // total events ever written
+    unsigned long long dropped; // events overwritten before they were read
+
+    public:
+    EventRing(size_t minCapacity = 4096) : head(0), tail(0), dropped(0) {
+        size_t capacity = 1;
+        while (capacity < minCapacity) {
+            capacity <<= 1;
+        }
+        events.resize(capacity);
+    }
+
+    void onEvent(const ExecutionEvent& event) {
+        if (tail - head == events.size()) {
+            ++head;
+            ++dropped;
+        }
+        events[tail & (events.size() - 1)] = event;
+        ++tail;
+    }
+
+    bool empty() const { return head == tail; }
+    size_t size() const { return (size_t)(tail - head); }
+    unsigned long long droppedCount() const { return dropped; }
+
+    // Removes and returns the oldest unread report, only valid when !empty()
+    const ExecutionEvent& pop() { return events[head++ & (events.size() - 1)]; }
+};
+
+#endif // EXECUTIONEVENTS_HPP
@@ -0,0 +1,198 @@
+#ifndef FIXEDPOINT_HPP
+#define FIXEDPOINT_HPP
+
+#include <cassert>
+#include <string>
+
+typedef long long Price;    // price as a whole number of ticks of the instrument
+typedef long long Quantity; // quantity as a whole number of lots of the instrument
+typedef long long Amount;   // asset amount in atoms, 1 atom = 1e-8 of a unit (USD, GOOGL, UNI...)
+
+// Binance and most venues quote prices and sizes with 8 decimals, so that is the finest
+// resolution we ever need to hold exactly.
+const int ATOM_DECIMALS = 8;
+const Amount ATOMS_PER_UNIT = 100000000LL;
+const Amount MAX_AMOUNT = 9223372036854775807LL;
+
+/**
+ * @brief Parses a decimal string such as "5.30300000", "110" or "-0.5" into atoms
+ *
+ * @details Reads the digits straight into an integer, no floating point and no allocation.
+ *          Trailing zeros past the 8th decimal are accepted, any other digit there is not.
+ *
+ * @param first Pointer to the first character of the number
+ * @param last Pointer one past the last character of the number
+ * @param out Receives the value in atoms on success
+ *
+ * @return bool false on an empty, malformed, too precise or out of range number
+ */
+inline bool parseAtoms(const char* first, const char* last, Amount& out) {
+    bool negative = false;
+    if (first != last && (*first == '-' || *first == '+')) {
+        negative = (*first == '-');
+        ++first;
+    }
+    if (first == last) {
+        return false;
+    }
+
+    Amount whole = 0;
+    int digits = 0;
+    while (first != last && *first >= '0' && *first <= '9') {
+        if (whole > (MAX_AMOUNT / ATOMS_PER_UNIT) / 10) {
+            return false; // would not fit once scaled to atoms
+        }
+        whole = whole * 10 + (*first - '0');
+        ++first;
+        ++digits;
+    }
+
+    Amount fraction = 0;
+    int fractionDigits = 0;
+    if (first != last && *first == '.') {
+        ++first;
+        while (first != last && *first >= '0' && *first <= '9') {
+            if (fractionDigits < ATOM_DECIMALS) {
+                fraction = fraction * 10 + (*first - '0');
+                ++fractionDigits;
+            } else if (*first != '0') {
+                return false; // finer than one atom
+            }
+            ++first;
+            ++digits;
+        }
+    }
+    if (first != last || digits == 0) {
+        return false;
+    }
+
+    for (int i = fractionDigits; i < ATOM_DECIMALS; ++i) {
+        fraction *= 10;
+    }
+    out = whole * ATOMS_PER_UNIT + fraction;
+    if (negative) {
+        out = -out;
+    }
+    return true;
+}
+
+inline bool parseAtoms(const std::string& text, Amount& out) {
+    return parseAtoms(text.data(), text.data() + text.size(), out);
+}
+
+/**
+ * @brief Formats an amount in atoms as a decimal string
+ *
+ * @param atoms The amount to print
+ * @param decimals How many decimals to show (0-8), extra atom digits are truncated
+ *
+ * @return string e.g. formatAtoms(530300000, 3) == "5.303"
+ */
+inline std::string formatAtoms(Amount atoms, int decimals = ATOM_DECIMALS) {
+    std::string text;
+    unsigned long long magnitude = atoms < 0 ? 0ULL - (unsigned long long)atoms : (unsigned long long)atoms;
+    unsigned long long whole = magnitude / ATOMS_PER_UNIT;
+    unsigned long long fraction = magnitude % ATOMS_PER_UNIT;
+
+    if (atoms < 0) {
+        text += '-';
+    }
+    text += std::to_string(whole);
+    if (decimals > 0) {
+        char digits[ATOM_DECIMALS];
+        for (int i = ATOM_DECIMALS - 1; i >= 0; --i) {
+            digits[i] = char('0' + fraction % 10);
+            fraction /= 10;
+        }
+        text += '.';
+        text.append(digits, decimals);
+    }
+    return text;
+}
+
+/**
+ * @brief Counts the decimals needed to print multiples of a given step without loss
+ *
+ * @param step Step size in atoms, e.g. 1000000 (0.01) needs 2 decimals
+ */
+inline int decimalsFor(Amount step) {
+    int decimals = ATOM_DECIMALS;
+    while (decimals > 0 && step % 10 == 0) {
+        step /= 10;
+        --decimals;
+    }
+    return decimals;
+}
+
+// Describes how prices and quantities of one instrument map onto integers.
+// Prices are held as ticks and quantities as lots so every comparison in the matching
+// engine is a single integer compare, and balances never drift.
+struct InstrumentSpec {
+    std::string symbol;
+    Amount tickSize;     // smallest price step, in atoms of the quote asset (0.01 USD = 1000000)
+    Amount lotSize;      // smallest quantity step, in atoms of the base asset (1 share = 100000000)
+    Amount tickLotValue; // quote atoms for one lot at a price of one tick
+    int priceDecimals;   // decimals shown when printing a price
+    int quantityDecimals; // decimals shown when printing a quantity
+
+    InstrumentSpec() {};
+
+    // tickSize * lotSize must be a positive multiple of ATOMS_PER_UNIT so that the
+    // notional of any (price, quantity) pair is a whole, non-zero number of atoms
+    static bool isValidGrid(Amount tick, Amount lot) {
+        return tick > 0 && lot > 0 && tick <= MAX_AMOUNT / lot && (tick * lot) % ATOMS_PER_UNIT == 0;
+    }
+
+    InstrumentSpec(std::string sym, Amount tick, Amount lot) {
+        assert(isValidGrid(tick, lot));
+        symbol = sym;
+        tickSize = tick;
+        lotSize = lot;
+        tickLotValue = (tick * lot) / ATOMS_PER_UNIT;
+        priceDecimals = decimalsFor(tick);
+        quantityDecimals = decimalsFor(lot);
+    }
+
+    // Converts a decimal price string to ticks, rejecting prices that are not positive or
+    // off the tick grid
+    bool parsePrice(const char* first, const char* last, Price& ticks) const {
+        Amount atoms;
+        if (!parseAtoms(first, last, atoms) || atoms <= 0 || atoms % tickSize != 0) {
+            return false;
+        }
+        ticks = atoms / tickSize;
+        return true;
+    }
+
+    bool parsePrice(const std::string& text, Price& ticks) const {
+        return parsePrice(text.data(), text.data() + text.size(), ticks);
+    }
+
+    // Converts a decimal quantity string to lots, rejecting quantities that are not positive
+    // or off the lot grid
+    bool parseQuantity(const char* first, const char* last, Quantity& lots) const {
+        Amount atoms;
+        if (!parseAtoms(first, last, atoms) || atoms <= 0 || atoms % lotSize != 0) {
+            return false;
+        }
+        lots = atoms / lotSize;
+        return true;
+    }
+
+    bool parseQuantity(const std::string& text, Quantity& lots) const {
+        return parseQuantity(text.data(), text.data() + text.size(), lots);
+    }
+
+    Amount notional(Price price, Quantity qty) const { return price * qty * tickLotValue; } // quote atoms paid
+    Amount baseAmount(Quantity qty) const { return qty * lotSize; } // base atoms delivered
+
+    // Whether notional(price, qty) and baseAmount(qty) fit in an Amount, for a positive price and quantity
+    bool fitsAmount(Price price, Quantity qty) const {
+        return price <= MAX_AMOUNT / tickLotValue && qty <= MAX_AMOUNT / (price * tickLotValue) && qty <= MAX_AMOUNT / lotSize;
+    }
+
+    std::string formatPrice(Price price) const { return formatAtoms(price * tickSize, priceDecimals); }
+    std::string formatQuantity(Quantity qty) const { return formatAtoms(qty * lotSize, quantityDecimals); }
+};
+
+#endif // FIXEDPOINT_HPP
@@ -0,0 +1,194 @@
+#include "benchmarkSupport.hpp"
+#include "orderGateway.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Client counts to compare, the gateway's queues and the shape of each client's flow
+struct GatewayBenchmarkConfig {
+    vector<unsigned int> producers; // client session counts to run
+    size_t orders; // orders per session
+    size_t queueCapacity;
+    size_t batchSize;
+    int core; // matching thread core, -1 for none
+    Price levels;
+    int aggressivePercent;
+    unsigned long long seed;
+
+    GatewayBenchmarkConfig() {
+        producers = {1, 2, 4};
+        orders = 200000;
+        queueCapacity = 4096;
+        batchSize = 64;
+        core = -1;
+        levels = 100;
+        aggressivePercent = 50;
+        seed = 42;
+    }
+};
+
+const Amount DEPOSIT = 1000000000LL * ATOMS_PER_UNIT; // per account and asset
+
+// What one client thread saw
+struct ClientResult {
+    vector<unsigned int> nanos; // submit to EVENT_ACCEPTED/EVENT_REJECTED of each request
+    unsigned long long reports;
+    unsigned long long refused; // submits the full request ring turned away
+};
+
+/**
+ * @brief One client: submits its orders without blocking, reads its reports whenever the
+ *        request ring pushes back, and finishes once every request has been answered
+ */
+void runClient(GatewaySession& session, AccountId account, const GatewayBenchmarkConfig& config, unsigned long long seed, ClientResult& result) {
+    mt19937_64 random(seed);
+    vector<chrono::steady_clock::time_point> sent(config.orders + 1);
+    result.nanos.reserve(config.orders);
+    result.reports = 0;
+    size_t answered = 0;
+    GatewayReport report;
+    auto drain = [&]() {
+        while (session.poll(report)) {
+            ++result.reports;
+            if (report.requestId != 0 && (report.event.type == EVENT_ACCEPTED || report.event.type == EVENT_REJECTED)) {
+                result.nanos.push_back((unsigned int)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - sent[report.requestId]).count());
+                ++answered;
+            }
+        }
+    };
+
+    for (size_t i = 0; i < config.orders; ++i) {
+        bool bid = (random() & 1) != 0;
+        bool aggressive = (int)(random() % 100) < config.aggressivePercent;
+        Price offset = aggressive ? -config.levels : 1 + (Price)(random() % config.levels);
+        Quantity qty = 1 + (Quantity)(random() % 10);
+        sent[i + 1] = chrono::steady_clock::now(); // request IDs of a session count from 1
+        while ((bid ? session.bid(account, BENCHMARK_MID_PRICE - offset, qty, false) : session.ask(account, BENCHMARK_MID_PRICE + offset, qty, false)) == 0) {
+            drain(); // backpressure: the ring is full, read reports while the engine catches up
+            sent[i + 1] = chrono::steady_clock::now();
+        }
+        if ((i & 63) == 0) {
+            drain();
+        }
+    }
+    Backoff backoff;
+    while (answered < config.orders) {
+        drain();
+        backoff.pause();
+    }
+    result.refused = session.refusedCount();
+}
+
+unsigned int percentile(vector<unsigned int>& nanos, double p) {
+    if (nanos.empty()) {
+        return 0;
+    }
+    size_t rank = (size_t)(p / 100.0 * (nanos.size() - 1));
+    nth_element(nanos.begin(), nanos.begin() + rank, nanos.end());
+    return nanos[rank];
+}
+
+/**
+ * @brief Measures OrderGateway throughput and round trip latency with many client threads
+ *
+ * @details Each client thread owns a session and an account and sends random limit orders
+ *          around one mid price into a single book. A run checks that every request got
+ *          its answer and that both assets still sum to what was deposited.
+ *
+ *          Options:
+ *          - --producers 1,2,4       client thread counts
+ *          - --orders 200000         orders per client
+ *          - --queue 4096            request ring capacity per session
+ *          - --batch 64              requests drained per session visit
+ *          - --core -1               core to pin the matching thread to
+ *          - --levels 100            ticks either side of the mid for passive orders
+ *          - --aggressive 50         percent of orders crossing the book
+ *          - --seed 42
+ *
+ * @return int 0, 1 on a bad option or a failed check
+ */
+int main(int argc, char* argv[]) {
+    GatewayBenchmarkConfig config;
+    BenchmarkOptions options("gatewayBenchmark");
+    options.add("--producers", config.producers, "N,N,...");
+    options.add("--orders", config.orders);
+    options.add("--queue", config.queueCapacity);
+    options.add("--batch", config.batchSize);
+    options.add("--core", config.core);
+    options.add("--levels", config.levels);
+    options.add("--aggressive", config.aggressivePercent);
+    options.add("--seed", config.seed);
+    if (!options.parse(argc, argv)) {
+        return 1;
+    }
+    if (config.orders == 0 || config.queueCapacity == 0 || config.batchSize == 0 || config.levels <= 0 || config.levels >= BENCHMARK_MID_PRICE - 1
+        || find(config.producers.begin(), config.producers.end(), 0u) != config.producers.end()) {
+        cerr << "--producers, --orders, --queue and --batch must be positive, --levels between 1 and " << BENCHMARK_MID_PRICE - 2 << endl;
+        return 1;
+    }
+
+    cout << config.orders << " orders per client, " << config.aggressivePercent << "% aggressive, " << thread::hardware_concurrency()
+         << " cores; latency is submit to accept, in ns" << endl;
+    cout << setw(8) << "clients" << setw(14) << "orders/sec" << setw(10) << "p50" << setw(10) << "p99" << setw(10) << "p99.9"
+         << setw(10) << "refused" << setw(10) << "batch" << setw(12) << "balances" << endl;
+
+    bool ok = true;
+    for (unsigned int clients : config.producers) {
+        Ledger ledger(2);
+        AssetId usd = ledger.addAsset("USD");
+        AssetId stock = ledger.addAsset(TICKER);
+        BookConfig bookConfig;
+        bookConfig.orderCapacity = clients * config.orders + 1024;
+        OrderBook book(InstrumentSpec(TICKER, ATOMS_PER_UNIT / 100, ATOMS_PER_UNIT), ledger, stock, usd, bookConfig);
+        OrderGateway gateway(book, config.queueCapacity, config.batchSize);
+        vector<AccountId> accounts;
+        vector<GatewaySession*> sessions;
+        for (unsigned int c = 0; c < clients; ++c) {
+            accounts.push_back(ledger.addAccount("Client" + to_string(c)));
+            ledger.balance(accounts[c], usd) = DEPOSIT;
+            ledger.balance(accounts[c], stock) = DEPOSIT;
+            sessions.push_back(&gateway.openSession());
+            gateway.attachAccount(accounts[c], *sessions[c]);
+        }
+
+        gateway.start(config.core);
+        vector<ClientResult> results(clients);
+        vector<thread> threads;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (unsigned int c = 0; c < clients; ++c) {
+            threads.push_back(thread(runClient, ref(*sessions[c]), accounts[c], cref(config), config.seed + c, ref(results[c])));
+        }
+        for (thread &client : threads) {
+            client.join();
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        gateway.stop();
+
+        vector<unsigned int> nanos;
+        unsigned long long refused = 0;
+        for (ClientResult &result : results) {
+            nanos.insert(nanos.end(), result.nanos.begin(), result.nanos.end());
+            refused += result.refused;
+        }
+        Amount totalUsd = 0, totalStock = 0;
+        for (AccountId account : accounts) {
+            totalUsd += ledger.total(account, usd);
+            totalStock += ledger.total(account, stock);
+        }
+        bool conserved = totalUsd == DEPOSIT * clients && totalStock == DEPOSIT * clients && nanos.size() == clients * config.orders;
+        ok = ok && conserved;
+        const GatewayStats &stats = gateway.getStats();
+        size_t total = clients * config.orders;
+        cout << setw(8) << clients << setw(14) << (unsigned long long)(seconds > 0 ? total / seconds : 0) << setw(10) << percentile(nanos, 50)
+             << setw(10) << percentile(nanos, 99) << setw(10) << percentile(nanos, 99.9) << setw(10) << refused << setw(10) << fixed
+             << setprecision(1) << (stats.batches > 0 ? (double)stats.requests / stats.batches : 0) << setw(12) << (conserved ? "conserved" : "MISMATCH")
+             << endl;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,201 @@
+#ifndef LEDGER_HPP
+#define LEDGER_HPP
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "fixedPoint.hpp"
+
+typedef unsigned int AccountId; // dense index of a user account, handed out by makeUser
+typedef unsigned short AssetId; // dense index of an asset (USD, GOOGL, ...)
+
+const AccountId INVALID_ACCOUNT = 0xFFFFFFFFu;
+const AssetId INVALID_ASSET = 0xFFFFu;
+const int MAX_ASSETS = 16; // default columns per account row in the balance table
+const unsigned int NO_ORDER_LIMIT = 0xFFFFFFFFu; // maxOpenOrders of an account without a limit
+const Amount NO_NOTIONAL_LIMIT = 0x7FFFFFFFFFFFFFFFLL; // maxOpenNotional of an account without a limit
+
+// Pre-trade risk state of one account: what its open orders add up to over every book on
+// the ledger, and the limits a new order is checked against. The counters move with every
+// accept, fill and cancel, so a check never has to look at the orders themselves.
+struct AccountRisk {
+    unsigned int openOrders; // accepted orders not yet filled or cancelled
+    unsigned int maxOpenOrders; // NO_ORDER_LIMIT unless set
+    Amount openNotional; // quote atoms of their open quantity at their limit prices
+    Amount maxOpenNotional; // NO_NOTIONAL_LIMIT unless set
+};
+
+// Holds every account's balances as two dense account x asset tables of atoms: what is
+// available, and what is held for the account's open orders (quote atoms at the limit price
+// for a bid, base atoms for an ask). An account owns the sum of both. Names are only hashed
+// when an account or asset is created or looked up at the edge of the system; everything
+// else addresses balances by integer IDs.
+//
+// A ledger shared by books matching on different threads is only read and changed through
+// the atomic accessors (availableBalance, tryDebit, credit, tryHold, releaseHeld and the risk
+// counters). Accounts and assets must then all be created before the threads start, since
+// adding an account can move the tables.
+class Ledger {
+    private:
+    size_t assetColumns; // columns per account row, the most assets this ledger can hold
+    std::vector<std::string> accountNames; // account ID -> user name
+    std::unordered_map<std::string, AccountId> accountIds; // user name -> account ID
+    std::vector<std::string> assetNames; // asset ID -> asset name
+    std::unordered_map<std::string, AssetId> assetIds; // asset name -> asset ID
+    std::vector<Amount> balances; // available atoms, row per account, MAX_ASSETS columns per row
+    std::vector<Amount> holds; // atoms held by open orders, same layout
+    std::vector<AccountRisk> risks; // one per account
+
+    public:
+    Ledger(size_t maxAssets = MAX_ASSETS) : assetColumns(maxAssets) {};
+
+    // Sizes the table for accounts accounts up front
+    void reserveAccounts(size_t accounts) {
+        accountNames.reserve(accounts);
+        balances.reserve(accounts * assetColumns);
+        holds.reserve(accounts * assetColumns);
+        risks.reserve(accounts);
+    }
+
+    // Registers a new account with zero balances, returns INVALID_ACCOUNT if the name is taken
+    AccountId addAccount(const std::string& name) {
+        if (accountIds.find(name) != accountIds.end()) {
+            return INVALID_ACCOUNT;
+        }
+        AccountId id = (AccountId)accountNames.size();
+        accountNames.push_back(name);
+        accountIds[name] = id;
+        balances.resize(balances.size() + assetColumns, 0);
+        holds.resize(holds.size() + assetColumns, 0);
+        AccountRisk risk = {0, NO_ORDER_LIMIT, 0, NO_NOTIONAL_LIMIT};
+        risks.push_back(risk);
+        return id;
+    }
+
+    // Returns the ID of a user name, or INVALID_ACCOUNT if unknown
+    AccountId findAccount(const std::string& name) const {
+        auto it = accountIds.find(name);
+        return it == accountIds.end() ? INVALID_ACCOUNT : it->second;
+    }
+
+    // Registers an asset (or returns its existing ID), INVALID_ASSET once every column is in use
+    AssetId addAsset(const std::string& name) {
+        auto it = assetIds.find(name);
+        if (it != assetIds.end()) {
+            return it->second;
+        }
+        if (assetNames.size() >= assetColumns || assetNames.size() >= (size_t)INVALID_ASSET) {
+            return INVALID_ASSET;
+        }
+        AssetId id = (AssetId)assetNames.size();
+        assetNames.push_back(name);
+        assetIds[name] = id;
+        return id;
+    }
+
+    // Returns the ID of an asset name, or INVALID_ASSET if unknown
+    AssetId findAsset(const std::string& name) const {
+        auto it = assetIds.find(name);
+        return it == assetIds.end() ? INVALID_ASSET : it->second;
+    }
+
+    bool isAccount(AccountId account) const { return account < accountNames.size(); }
+    size_t accountCount() const { return accountNames.size(); }
+    size_t assetCount() const { return assetNames.size(); }
+    size_t maxAssets() const { return assetColumns; }
+    const std::string& accountName(AccountId account) const { return accountNames[account]; }
+    const std::string& assetName(AssetId asset) const { return assetNames[asset]; }
+
+    // Available and held cell of one account and asset, in atoms. IDs are not range checked.
+    Amount& balance(AccountId account, AssetId asset) { return balances[(size_t)account * assetColumns + asset]; }
+    Amount balance(AccountId account, AssetId asset) const { return balances[(size_t)account * assetColumns + asset]; }
+    Amount& held(AccountId account, AssetId asset) { return holds[(size_t)account * assetColumns + asset]; }
+    Amount held(AccountId account, AssetId asset) const { return holds[(size_t)account * assetColumns + asset]; }
+    Amount total(AccountId account, AssetId asset) const { return balance(account, asset) + held(account, asset); } // everything the account owns
+    AccountRisk& risk(AccountId account) { return risks[account]; }
+    const AccountRisk& risk(AccountId account) const { return risks[account]; }
+
+    // Atomic read of a balance cell of a shared ledger
+    Amount availableBalance(AccountId account, AssetId asset) const {
+        return __atomic_load_n(&balances[(size_t)account * assetColumns + asset], __ATOMIC_ACQUIRE);
+    }
+
+    // Atomically takes amount from a balance cell if it holds at least that much
+    bool tryDebit(AccountId account, AssetId asset, Amount amount) {
+        Amount *cell = &balance(account, asset);
+        Amount current = __atomic_load_n(cell, __ATOMIC_RELAXED);
+        while (current >= amount) {
+            if (__atomic_compare_exchange_n(cell, &current, current - amount, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Atomically adds amount to a balance cell
+    void credit(AccountId account, AssetId asset, Amount amount) { __atomic_fetch_add(&balance(account, asset), amount, __ATOMIC_ACQ_REL); }
+
+    // Atomic read of a held cell of a shared ledger
+    Amount heldBalance(AccountId account, AssetId asset) const {
+        return __atomic_load_n(&holds[(size_t)account * assetColumns + asset], __ATOMIC_ACQUIRE);
+    }
+
+    // Atomically moves amount from available to held if that much is available
+    bool tryHold(AccountId account, AssetId asset, Amount amount) {
+        if (!tryDebit(account, asset, amount)) {
+            return false;
+        }
+        __atomic_fetch_add(&held(account, asset), amount, __ATOMIC_ACQ_REL);
+        return true;
+    }
+
+    // Atomically takes amount off a held cell and makes all of it but spent available again
+    void releaseHeld(AccountId account, AssetId asset, Amount amount, Amount spent) {
+        __atomic_fetch_sub(&held(account, asset), amount, __ATOMIC_ACQ_REL);
+        if (amount != spent) {
+            credit(account, asset, amount - spent);
+        }
+    }
+
+    // Atomically counts one more open order, false (and nothing counted) at the account's limit
+    bool tryOpenOrder(AccountId account) {
+        AccountRisk &row = risks[account];
+        unsigned int open = __atomic_load_n(&row.openOrders, __ATOMIC_RELAXED);
+        while (open < __atomic_load_n(&row.maxOpenOrders, __ATOMIC_RELAXED)) {
+            if (__atomic_compare_exchange_n(&row.openOrders, &open, open + 1, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Atomically adds notional to the open notional, false (and nothing added) if it would pass the limit
+    bool tryOpenNotional(AccountId account, Amount notional) {
+        AccountRisk &row = risks[account];
+        Amount open = __atomic_load_n(&row.openNotional, __ATOMIC_RELAXED);
+        for (Amount most = __atomic_load_n(&row.maxOpenNotional, __ATOMIC_RELAXED); open <= most && notional <= most - open;
+             most = __atomic_load_n(&row.maxOpenNotional, __ATOMIC_RELAXED)) {
+            if (__atomic_compare_exchange_n(&row.openNotional, &open, open + notional, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Atomically takes orders and notional off what an account has open
+    void closeOpen(AccountId account, unsigned int orders, Amount notional) {
+        AccountRisk &row = risks[account];
+        if (orders > 0) {
+            __atomic_fetch_sub(&row.openOrders, orders, __ATOMIC_ACQ_REL);
+        }
+        __atomic_fetch_sub(&row.openNotional, notional, __ATOMIC_ACQ_REL);
+    }
+
+    // Sets an account's limits; atomic, so books on other threads see them on their next order
+    void setLimits(AccountId account, unsigned int maxOpenOrders, Amount maxOpenNotional) {
+        __atomic_store_n(&risks[account].maxOpenOrders, maxOpenOrders, __ATOMIC_RELEASE);
+        __atomic_store_n(&risks[account].maxOpenNotional, maxOpenNotional, __ATOMIC_RELEASE);
+    }
+};
+
+#endif // LEDGER_HPP
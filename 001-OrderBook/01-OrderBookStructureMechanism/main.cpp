@@ -0,0 +1,490 @@
+#include "orderBook.hpp"
+#include "orderFlow.hpp"
+#include "allocationCounter.hpp"
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+
+using namespace std;
+
+/**
+ * @brief Renders the pending execution reports of a book to the console
+ * 
+ * @details Drains the ring the book reports into and prints one line per report.
+ *          This runs after a command has finished, outside the matching loop.
+ * 
+ * @param book The book the reports came from, used for names and price formatting
+ * @param reports The ring attached to the book with setListener()
+ */
+void printReports(const OrderBook& book, EventRing& reports) {
+    const InstrumentSpec &spec = book.getInstrument();
+    while (!reports.empty()) {
+        const ExecutionEvent &event = reports.pop();
+        const char *side = event.isBid ? "Bid" : "Ask";
+        switch (event.type) {
+            case EVENT_ACCEPTED:
+                cout << side << " " << event.orderId << " accepted: " << spec.formatQuantity(event.quantity) << " at " << spec.formatPrice(event.price) << endl;
+                break;
+            case EVENT_PARTIAL_FILL:
+            case EVENT_FILL:
+                cout << side << " " << event.orderId << (event.type == EVENT_FILL ? " filled" : " partially filled")
+                     << " at price: " << spec.formatPrice(event.price) << " and quantity: " << spec.formatQuantity(event.quantity)
+                     << " against order " << event.contraOrderId << " of " << book.getUserName(event.contraAccount)
+                     << ", remaining " << spec.formatQuantity(event.leavesQuantity) << endl;
+                break;
+            case EVENT_RESTED:
+                cout << "Remaining quantity of " << side << " " << event.orderId << " added to Orderbook: "
+                     << spec.formatQuantity(event.quantity) << " at " << spec.formatPrice(event.price) << endl;
+                break;
+            case EVENT_REDUCED:
+                cout << "Order " << event.orderId << " reduced by " << spec.formatQuantity(event.quantity)
+                     << ", remaining " << spec.formatQuantity(event.leavesQuantity) << endl;
+                break;
+            case EVENT_CANCELLED:
+                cout << "Order " << event.orderId << " cancelled successfully!" << endl;
+                break;
+            case EVENT_REJECTED:
+                cout << side << " rejected: " << rejectReasonText((RejectReason)event.reason) << endl;
+                break;
+            case EVENT_SETTLEMENT_FAILED:
+                cout << "Settlement failed: " << rejectReasonText((RejectReason)event.reason) << " for account " << event.account << endl;
+                break;
+        }
+    }
+    if (reports.droppedCount() > 0) {
+        cout << reports.droppedCount() << " execution reports were dropped because the ring was full" << endl;
+    }
+}
+
+/**
+ * @brief Proves that steady-state order entry, matching and cancels do not allocate
+ * 
+ * @details Runs a mixed flow of passive orders, crossing orders, reduces, in-place
+ *          replaces and cancels against a fresh book, with execution reports going to a ring. One warm-up round runs first so
+ *          one-off allocations (stream buffers, locale) are not counted, then the global
+ *          heap allocation counter is compared before and after the measured rounds.
+ * 
+ * @return int 0 if no heap allocation happened, 1 otherwise
+ * 
+ * @note Run with: orderBook --check-allocations
+ */
+int checkSteadyStateAllocations() {
+    OrderBook book;
+    AccountId buyer = book.makeUser("AllocationCheckBuyer");
+    AccountId seller = book.makeUser("AllocationCheckSeller");
+    book.addBalance(buyer, "USD", 1000000000LL * ATOMS_PER_UNIT);
+    book.addBalance(seller, TICKER, 1000000000LL * ATOMS_PER_UNIT);
+
+    EventRing reports;
+    book.setListener(&reports);
+    unsigned long long allocationsBefore = 0;
+    const int rounds = 100000;
+
+    for (int round = -1; round < rounds; ++round) {
+        if (round == 0) {
+            allocationsBefore = heapAllocationCount.load();
+        }
+        Price price = 11300 + (round + 1) % 50; // 113.00 .. 113.49 USD
+        OrderId ask = book.addAsk(seller, price, 5); // rests
+        book.addBid(buyer, price, 3); // crosses, fully filled
+        OrderId bid = book.addBid(buyer, 10000, 4); // rests below the market
+        book.reduce(bid, 1);
+        book.replace(bid, 10000, 2); // same price, smaller: in place
+        book.cancel(bid);
+        book.cancel(ask);
+        while (!reports.empty()) {
+            reports.pop();
+        }
+    }
+
+    unsigned long long allocations = heapAllocationCount.load() - allocationsBefore;
+    cout << "Heap allocations during " << rounds << " steady-state rounds: " << allocations << endl;
+    cout << "Orders resting: " << book.getPool().size() << ", pool peak: " << book.getPool().peak() << " of " << book.getPool().capacity() << endl;
+    return allocations == 0 ? 0 : 1;
+}
+
+/**
+ * @brief Replays an order flow file headless and prints throughput and checksums
+ * 
+ * @details Loads the whole file first (text or binary, see orderFlow.hpp), then runs it
+ *          against a freshly seeded book. Two runs of the same file must print the same
+ *          checksums; a change in any of them means the engine behaved differently.
+ *          Built with ORDERBOOK_METRICS, the stage latencies and counters of the run follow.
+ * 
+ * @param path The order flow file
+ * 
+ * @return int 0 on success, 1 if the file could not be loaded
+ * 
+ * @note Run with: orderBook --replay flow.txt
+ */
+int runReplay(const string& path) {
+    OrderBook book;
+    OrderFlow flow;
+    string error;
+    if (!loadOrderFlow(path, book.getInstrument(), flow, error)) {
+        cerr << "Cannot replay " << path << ": " << error << endl;
+        return 1;
+    }
+
+    unique_ptr<EngineMetrics> metrics(METRICS_ENABLED ? new EngineMetrics() : nullptr);
+    book.setMetrics(metrics.get());
+    ReplayResult result = replayOrderFlow(book, flow);
+    book.setMetrics(nullptr);
+
+    cout << "Replayed " << result.commands << " commands from " << path << " for " << flow.users.size() << " users" << endl;
+    cout << "Time: " << result.seconds * 1e3 << " ms, "
+         << (result.seconds > 0 ? (unsigned long long)(result.commands / result.seconds) : 0) << " commands/sec" << endl;
+    cout << "Events: " << result.events.count << ", fills: " << result.events.fills << ", rejects: " << result.events.rejects << endl;
+    cout << "Orders resting: " << book.getPool().size() << ", pool peak: " << book.getPool().peak() << " of " << book.getPool().capacity() << endl;
+    cout << hex;
+    cout << "Event checksum:   " << result.events.hash << endl;
+    cout << "Book checksum:    " << result.bookChecksum << endl;
+    cout << "Balance checksum: " << result.balanceChecksum << endl;
+    cout << "Quote checksum:   " << mixChecksum(CHECKSUM_SEED, (unsigned long long)result.quotedAmount) << endl;
+    cout << dec;
+    if (metrics) {
+        metrics->write(cout);
+    }
+    return 0;
+}
+
+/**
+ * @brief Converts an order flow file to the binary format
+ * 
+ * @param inPath Text (or binary) order flow file
+ * @param outPath Where to write the binary file
+ * 
+ * @return int 0 on success, 1 on failure
+ * 
+ * @note Run with: orderBook --convert flow.txt flow.bin
+ */
+int convertOrderFlow(const string& inPath, const string& outPath) {
+    InstrumentSpec instrument(TICKER, ATOMS_PER_UNIT / 100, ATOMS_PER_UNIT); // same grid as OrderBook
+    OrderFlow flow;
+    string error;
+    if (!loadOrderFlow(inPath, instrument, flow, error)) {
+        cerr << "Cannot convert " << inPath << ": " << error << endl;
+        return 1;
+    }
+    ofstream out(outPath.c_str(), ios::binary);
+    if (!writeOrderFlowBinary(out, flow)) {
+        cerr << "Cannot write " << outPath << endl;
+        return 1;
+    }
+    cout << "Wrote " << flow.commands.size() << " commands to " << outPath << endl;
+    return 0;
+}
+
+/**
+ * @brief Main function implementing the trading platform interface
+ * 
+ * @details Menu options:
+ * 1. Sign Up User - Create new trading account
+ * 2. Add Balance - Add funds/stocks to user account
+ * 3. Check Market Prices - View order book depth
+ * 4. Add Bid - Place buy order (limit, IOC, FOK or market)
+ * 5. Add Ask - Place sell order (limit, IOC, FOK or market)
+ * 6. Get Quote - Check price for quantity
+ * 7. Check Balance - View user balances
+ * 8. Cancel Bid - Cancel buy order
+ * 9. Cancel Ask - Cancel sell order
+ * 10. Cancel Order by ID - Cancel any resting order by its ID
+ * 11. Reduce Order by ID - Take quantity off a resting order
+ * 12. Replace Order by ID - Change price/quantity of a resting order
+ * 13. Set Order Limits for User - Cap open orders and open notional
+ * 14. Exit - Close platform
+ * 
+ * Instead of the menu:
+ * - --check-allocations runs checkSteadyStateAllocations()
+ * - --replay <file> runs an order flow file through runReplay()
+ * - --convert <in> <out> writes an order flow file in the binary format
+ * 
+ * @return int Exit status (0 for normal exit)
+ * 
+ * @note 
+ * - Creates initial market makers on startup
+ * - Runs in continuous loop until exit
+ * - Handles all user input validation
+ */
+int main(int argc, char* argv[]) {
+    if (argc > 1 && string(argv[1]) == "--check-allocations") {
+        return checkSteadyStateAllocations();
+    }
+    if (argc > 2 && string(argv[1]) == "--replay") {
+        return runReplay(argv[2]);
+    }
+    if (argc > 3 && string(argv[1]) == "--convert") {
+        return convertOrderFlow(argv[2], argv[3]);
+    }
+
+    OrderBook EXCH;
+    for (int maker = 1; maker <= 3; ++maker) { // the seeded market makers, as the book holds them
+        string name = "MarketMaker" + to_string(maker);
+        AccountId seeded = EXCH.findUser(name);
+        cout << "Initialized OrderBook with " << name << ": " << formatAtoms(EXCH.balanceOf(seeded, "USD") + EXCH.heldOf(seeded, "USD"), 2) << " USD and "
+             << formatAtoms(EXCH.balanceOf(seeded, TICKER) + EXCH.heldOf(seeded, TICKER), 0) << " " << TICKER << "." << endl;
+    }
+    EventRing reports; // the engine reports here, printReports() renders after each command
+    EXCH.setListener(&reports);
+
+    string market;
+    int choice;
+    string username;
+    AccountId account;
+    string priceText, quantityText, valueText; // read as text and converted to ticks/lots/atoms
+    string typeText;
+    OrderType orderType;
+    Price price;
+    Quantity quantity;
+    OrderId orderId;
+
+    cout << "\n=========== " <<"WELCOME TO THE " << TICKER << " MARKET " << " =========== \n\n" << endl;
+    cout << "\n=========== " << "CURRENT MARKET PRICES " << " =========== " << endl;
+    cout << EXCH.getDepth() << endl; // display the current market
+
+    while (true) {
+        cout << "\n=========== " << TICKER << " Trading Platform ===========\n\n";
+        cout << "\n========== Trading Platform Menu ==========\n";
+        cout << "1. Sign Up User\n";
+        cout << "2. Add Balance to User Account\n";
+        cout << "3. Check Current Market Prices\n";
+        cout << "4. Add Bid to " << TICKER << " v USD market\n";
+        cout << "5. Sell your stocks in " << TICKER << " v USD Market\n";
+        cout << "6. Get Current Quote to buy " << TICKER << " stocks\n";
+        cout << "7. Check your current User Balance\n";
+        cout << "8. Cancel Bid\n";
+        cout << "9. Cancel Ask\n";
+        cout << "10. Cancel Order by ID\n";
+        cout << "11. Reduce Order by ID\n";
+        cout << "12. Replace Order by ID\n";
+        cout << "13. Set Order Limits for User\n";
+        cout << "14. Exit\n\n";
+        cout << "Enter your choice: ";
+
+        cin >> choice;
+
+        switch (choice) {
+            case 1:
+                cout << "Enter username for new user: \n";
+                cin >> username;
+                if (EXCH.makeUser(username) != INVALID_ACCOUNT) {
+                    cout << "User " << username << " created successfully." << endl;
+                } else {
+                    cout << "User " << username << " already exists." << endl;
+                }
+                break;
+            case 2:
+                cout << "Enter username to add balance: \n";
+                cin >> username;
+                account = EXCH.findUser(username);
+                if (account == INVALID_ACCOUNT) {
+                    cout << "User " << username << " does not exist.\n";
+                    break;
+                }
+                cout << "Enter market (e.g., USD): \n";
+                cin >> market;
+                cout << "Enter balance value: \n";
+                cin >> valueText;
+                Amount value;
+                if (!parseAtoms(valueText, value)) {
+                    cout << "Invalid balance value.\n";
+                    break;
+                }
+                cout << EXCH.addBalance(account, market, value) << endl;
+                break;
+            case 3:
+                cout << EXCH.getDepth() << endl;
+                break;
+            case 4:
+                cout << "Enter username for bid: \n";
+                cin >> username;
+                account = EXCH.findUser(username);
+                if (account == INVALID_ACCOUNT) {
+                    cout << "User " << username << " does not exist.\n";
+                    break;
+                }
+                cout << "Enter order type (limit, ioc, fok, market): \n";
+                cin >> typeText;
+                if (!parseOrderType(typeText, orderType)) {
+                    cout << "Invalid order type.\n";
+                    break;
+                }
+                price = 0; // market orders trade at whatever rests
+                if (orderType != ORDER_MARKET) {
+                    cout << "Enter bid price: \n";
+                    cin >> priceText;
+                    if (!EXCH.getInstrument().parsePrice(priceText, price)) {
+                        cout << "Invalid price, must be a positive multiple of " << EXCH.getInstrument().formatPrice(1) << "\n";
+                        break;
+                    }
+                }
+                cout << "Enter bid quantity: \n";
+                cin >> quantityText;
+                if (!EXCH.getInstrument().parseQuantity(quantityText, quantity)) {
+                    cout << "Invalid quantity, must be a positive multiple of " << EXCH.getInstrument().formatQuantity(1) << "\n";
+                    break;
+                }
+                EXCH.addOrder(SIDE_BID, orderType, account, price, quantity);
+                break;
+            case 5:
+                cout << "Enter username for ask: \n";
+                cin >> username;
+                account = EXCH.findUser(username);
+                if (account == INVALID_ACCOUNT) {
+                    cout << "User " << username << " does not exist.\n";
+                    break;
+                }
+                cout << "Enter order type (limit, ioc, fok, market): \n";
+                cin >> typeText;
+                if (!parseOrderType(typeText, orderType)) {
+                    cout << "Invalid order type.\n";
+                    break;
+                }
+                price = 0; // market orders trade at whatever rests
+                if (orderType != ORDER_MARKET) {
+                    cout << "Enter ask price: \n";
+                    cin >> priceText;
+                    if (!EXCH.getInstrument().parsePrice(priceText, price)) {
+                        cout << "Invalid price, must be a positive multiple of " << EXCH.getInstrument().formatPrice(1) << "\n";
+                        break;
+                    }
+                }
+                cout << "Enter ask quantity: \n";
+                cin >> quantityText;
+                if (!EXCH.getInstrument().parseQuantity(quantityText, quantity)) {
+                    cout << "Invalid quantity, must be a positive multiple of " << EXCH.getInstrument().formatQuantity(1) << "\n";
+                    break;
+                }
+                EXCH.addOrder(SIDE_ASK, orderType, account, price, quantity);
+                break;
+            case 6:
+                cout << "Enter quantity for quote: \n";
+                cin >> quantityText;
+                if (!EXCH.getInstrument().parseQuantity(quantityText, quantity)) {
+                    cout << "Invalid quantity, must be a positive multiple of " << EXCH.getInstrument().formatQuantity(1) << "\n";
+                    break;
+                }
+                EXCH.getQuote(quantity);
+                break;
+            case 7:
+                cout << "Enter username to get balance: \n";
+                cin >> username;
+                account = EXCH.findUser(username);
+                if (account == INVALID_ACCOUNT) {
+                    cout << "User " << username << " does not exist.\n";
+                    break;
+                }
+                EXCH.getBalance(account);
+                break;
+            case 8:
+                cout << "Enter username to cancel bid: \n";
+                cin >> username;
+                account = EXCH.findUser(username);
+                if (account == INVALID_ACCOUNT) {
+                    cout << "User " << username << " does not exist.\n";
+                    break;
+                }
+                cout << "Enter bid price: \n";
+                cin >> priceText;
+                if (!EXCH.getInstrument().parsePrice(priceText, price)) {
+                    cout << "Invalid price, must be a positive multiple of " << EXCH.getInstrument().formatPrice(1) << "\n";
+                    break;
+                }
+                cout << "Enter bid quantity: \n";
+                cin >> quantityText;
+                if (!EXCH.getInstrument().parseQuantity(quantityText, quantity)) {
+                    cout << "Invalid quantity, must be a positive multiple of " << EXCH.getInstrument().formatQuantity(1) << "\n";
+                    break;
+                }
+                EXCH.cancelBid(account, price, quantity);
+                break;
+            case 9:
+                cout << "Enter username to cancel ask: \n";
+                cin >> username;
+                account = EXCH.findUser(username);
+                if (account == INVALID_ACCOUNT) {
+                    cout << "User " << username << " does not exist.\n";
+                    break;
+                }
+                cout << "Enter ask price: \n";
+                cin >> priceText;
+                if (!EXCH.getInstrument().parsePrice(priceText, price)) {
+                    cout << "Invalid price, must be a positive multiple of " << EXCH.getInstrument().formatPrice(1) << "\n";
+                    break;
+                }
+                cout << "Enter ask quantity: \n";
+                cin >> quantityText;
+                if (!EXCH.getInstrument().parseQuantity(quantityText, quantity)) {
+                    cout << "Invalid quantity, must be a positive multiple of " << EXCH.getInstrument().formatQuantity(1) << "\n";
+                    break;
+                }
+                EXCH.cancelAsk(account, price, quantity);
+                break;
+            case 10:
+                cout << "Enter order ID to cancel: \n";
+                cin >> orderId;
+                EXCH.cancel(orderId);
+                break;
+            case 11:
+                cout << "Enter order ID to reduce: \n";
+                cin >> orderId;
+                cout << "Enter quantity to reduce by: \n";
+                cin >> quantityText;
+                if (!EXCH.getInstrument().parseQuantity(quantityText, quantity)) {
+                    cout << "Invalid quantity, must be a positive multiple of " << EXCH.getInstrument().formatQuantity(1) << "\n";
+                    break;
+                }
+                EXCH.reduce(orderId, quantity);
+                break;
+            case 12:
+                cout << "Enter order ID to replace: \n";
+                cin >> orderId;
+                cout << "Enter new price: \n";
+                cin >> priceText;
+                if (!EXCH.getInstrument().parsePrice(priceText, price)) {
+                    cout << "Invalid price, must be a positive multiple of " << EXCH.getInstrument().formatPrice(1) << "\n";
+                    break;
+                }
+                cout << "Enter new quantity: \n";
+                cin >> quantityText;
+                if (!EXCH.getInstrument().parseQuantity(quantityText, quantity)) {
+                    cout << "Invalid quantity, must be a positive multiple of " << EXCH.getInstrument().formatQuantity(1) << "\n";
+                    break;
+                }
+                EXCH.replace(orderId, price, quantity);
+                break;
+            case 13: {
+                cout << "Enter username to limit: \n";
+                cin >> username;
+                account = EXCH.findUser(username);
+                if (account == INVALID_ACCOUNT) {
+                    cout << "User " << username << " does not exist.\n";
+                    break;
+                }
+                unsigned int maxOrders;
+                cout << "Enter most open orders (0 for no limit): \n";
+                cin >> maxOrders;
+                cout << "Enter most open notional in USD (0 for no limit): \n";
+                cin >> valueText;
+                Amount maxNotional;
+                if (!parseAtoms(valueText, maxNotional) || maxNotional < 0) {
+                    cout << "Invalid notional.\n";
+                    break;
+                }
+                EXCH.setLimits(account, maxOrders == 0 ? NO_ORDER_LIMIT : maxOrders, maxNotional == 0 ? NO_NOTIONAL_LIMIT : maxNotional);
+                cout << "Limits set for " << username << "." << endl;
+                break;
+            }
+            case 14:
+                cout << "Exiting the trading platform. Goodbye!\n\n";
+                return 0;
+            default:
+                cout << "Invalid choice. Please try again.\n\n";
+        }
+
+        printReports(EXCH, reports);
+    }
+
+    return 0;
+}
\ No newline at end of file
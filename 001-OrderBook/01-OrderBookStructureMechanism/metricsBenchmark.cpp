@@ -0,0 +1,126 @@
+#include "benchmarkSupport.hpp"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+
+using namespace std;
+
+// Size of the flow, where the dumper writes and how often
+struct MetricsBenchmarkConfig {
+    size_t orders; // resting orders before the timed flow
+    size_t commands; // timed commands
+    string output; // file the dumper appends reports to
+    unsigned int intervalMs; // between two reports
+    unsigned long long seed;
+
+    MetricsBenchmarkConfig() {
+        orders = 100000;
+        commands = 1000000;
+        output = "engine-metrics.log";
+        intervalMs = 250;
+        seed = 42;
+    }
+};
+
+// A flow touching every instrumented stage, rejects included
+RandomFlowConfig flowConfig(const MetricsBenchmarkConfig& config) {
+    RandomFlowConfig flow;
+    flow.maxAggressiveQuantity = 30; // crosses one or a few levels
+    flow.passivePercent = 45;
+    flow.cancelPercent = 20; // some are filled or cancelled already: ORDER_NOT_FOUND
+    flow.invalidPercent = 4; // PRICE_OUT_OF_BAND and UNKNOWN_ACCOUNT
+    flow.seed = config.seed;
+    return flow;
+}
+
+// Runs the seeded flow on a fresh book; returns ns per timed command
+double runFlow(const MetricsBenchmarkConfig& config, EngineMetrics* metrics, unique_ptr<OrderBook>& book, unsigned long long& accepted) {
+    book = makeBenchmarkBook(config.orders + config.commands + 1024);
+    Amount deposit = 1000000000LL * ATOMS_PER_UNIT;
+    RandomFlow flow(flowConfig(config), fundTraders(*book, "MetricsTrader", 2, deposit, deposit));
+    for (size_t i = 0; i < config.orders; ++i) {
+        flow.rest(*book);
+    }
+    book->setMetrics(metrics);
+    unsigned long long before = flow.accepted;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (size_t i = 0; i < config.commands; ++i) {
+        flow.step(*book);
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    book->getDepth();
+    book->setMetrics(nullptr);
+    accepted = flow.accepted - before;
+    return seconds * 1e9 / (config.commands > 0 ? config.commands : 1);
+}
+
+/**
+ * @brief Runs a mixed order flow with the engine's stage histograms and counters attached,
+ *        dumping them to a file periodically, and compares the cost with a detached run
+ *
+ * @details The same seeded flow (passive and crossing orders, cancels, reduces, replaces
+ *          and a few rejects, then one getDepth()) runs on a book without metrics and on
+ *          one with an EngineMetrics attached while a MetricsDumper appends reports every
+ *          --interval ms. The final report is printed; its counters must agree with the
+ *          flow and the book (accepted orders, resting orders, levels per side) and the
+ *          file must hold every report. Built without ORDERBOOK_METRICS the attached run
+ *          is the detached one and the metrics stay zero, which is checked instead.
+ *
+ *          Usage: metricsBenchmark [--orders 100000] [--commands 1000000]
+ *                                  [--out engine-metrics.log] [--interval 250] [--seed 42]
+ *
+ * @return int 0, 1 on a bad argument, an unwritable file or counters that do not add up
+ */
+int main(int argc, char* argv[]) {
+    MetricsBenchmarkConfig config;
+    BenchmarkOptions options("metricsBenchmark");
+    options.add("--orders", config.orders);
+    options.add("--commands", config.commands);
+    options.add("--out", config.output, "FILE");
+    options.add("--interval", config.intervalMs, "ms");
+    options.add("--seed", config.seed);
+    if (!options.parse(argc, argv)) {
+        return 1;
+    }
+
+    unique_ptr<OrderBook> book;
+    unsigned long long accepted = 0;
+    double detached = runFlow(config, nullptr, book, accepted);
+
+    unique_ptr<EngineMetrics> metrics(new EngineMetrics());
+    MetricsDumper dumper;
+    dumper.start(*metrics, config.output, config.intervalMs);
+    double attached = runFlow(config, metrics.get(), book, accepted);
+    dumper.stop();
+    if (!dumper.error().empty()) {
+        cerr << dumper.error() << endl;
+        return 1;
+    }
+
+    cout << "Instrumentation " << (METRICS_ENABLED ? "compiled in" : "compiled out (build with -DORDERBOOK_METRICS=ON)") << ", "
+         << fixed << setprecision(3) << timestampTicksPerNanosecond() << " timestamp ticks per ns" << endl;
+    cout << setprecision(1) << "Mixed command: " << detached << " ns without metrics, " << attached << " ns with metrics attached" << endl;
+    metrics->write(cout);
+
+    ifstream file(config.output);
+    string line;
+    unsigned long long reports = 0;
+    while (getline(file, line)) {
+        reports += line.compare(0, 10, "# metrics ") == 0 ? 1 : 0;
+    }
+    cout << dumper.dumpCount() << " reports appended to " << config.output << " (" << reports << " in the file)" << endl;
+
+    bool ok = reports >= dumper.dumpCount() && dumper.dumpCount() > 0;
+    if (METRICS_ENABLED) {
+        ok = ok && metrics->eventCount(EVENT_ACCEPTED) == accepted && metrics->restingOrderCount() == book->getPool().size() &&
+             metrics->bidLevelCount() == book->getBids().levelCount() && metrics->askLevelCount() == book->getAsks().levelCount() &&
+             metrics->tradeCount() > 0 && metrics->stageSummary(STAGE_DEPTH).count == 1;
+    } else {
+        ok = ok && metrics->eventCount(EVENT_ACCEPTED) == 0 && metrics->stageSummary(STAGE_VALIDATE).count == 0;
+    }
+    cout << "Counters " << (ok ? "agree with the flow and the book" : "DO NOT ADD UP") << endl;
+    return ok ? 0 : 1;
+}
@@ -1,57 +1,250 @@
 #include "orderBook.hpp"
-#include <iostream>
-#include <algorithm>
+#include "persistence.hpp"
+#include <cmath>
+#include <cstring>
 #include <iomanip>
+#include <iostream>
+#include <string>
 
 using namespace std;
 
-int Order::orderCounterBid = 0; // Initialize the static counter for BID orders
-int Order::orderCounterAsk = 0; // Initialize the static counter for ASK orders
-
 /**
  * @brief Executes a balance transfer between two users during a trade
  * 
  * @details This function handles the actual transaction between buyer and seller:
  *          1. Transfers USD from buyer to seller
  *          2. Transfers stocks from seller to buyer
- *          3. Validates balances before transfer
- * 
- * @param userId1 The buyer's username (receiving stocks, paying USD)
- * @param userId2 The seller's username (receiving USD, giving stocks)
- * @param quantity Number of stocks to transfer
- * @param price Price per stock for the transaction
- * 
- * @note Transaction will only proceed if:
- *       - Both users exist
- *       - Buyer has sufficient USD balance
- *       - Seller has sufficient stock balance
- * 
- * @return void, but prints transaction status to console
- */
-void OrderBook::flipBalance(const std::string& userId1, const std::string& userId2, double quantity, double price) {
-    if (users.find(userId1) != users.end() && users.find(userId2) != users.end()) {
-        if (users[userId1].userBalance.balance["USD"] >= quantity * price) {
-            if (users[userId2].userBalance.balance[TICKER] >= quantity) {
-                users[userId1].userBalance.balance["USD"] -= quantity * price;
-                users[userId1].userBalance.balance[TICKER] += quantity;
-
-                users[userId2].userBalance.balance["USD"] += quantity * price;
-                users[userId2].userBalance.balance[TICKER] -= quantity;
-
-                cout << "Funds and stocks Transaction successful: " << userId1 << " bought " << quantity << " " << TICKER << " from " << userId2 << " at price " << price << endl;
-                return;
-            } else {
-                cout << "User " << userId2 << " does not have enough " << TICKER << " balance to complete the transaction." << endl;
-                return;
-            }
-        } else {
-            cout << "User " << userId1 << " does not have enough USD balance to complete the transaction." << endl;
-            return;
+ *          3. Takes the traded quantity off both accounts' open notional
+ *          Both sides were reserved when their orders were accepted, so the buyer's cash
+ *          and the seller's stock come out of their held balances and cannot be short.
+ *          The buyer held the notional at its own limit price; whatever the trade price
+ *          saves on that goes back to the buyer's available cash. On a shared ledger every
+ *          cell is changed with an atomic add, so books settling on other threads can
+ *          neither overdraw an account nor create or lose atoms.
+ * 
+ * @param buyer The buyer's account (receiving stocks, paying USD)
+ * @param seller The seller's account (receiving USD, giving stocks)
+ * @param quantity Number of lots to transfer
+ * @param price Price per lot for the transaction, in ticks
+ * @param buyerLimit Limit price of the buyer's order, the price its cash was held at
+ * @param sellerLimit Limit price of the seller's order, for its open notional
+ * 
+ * @note Transaction will only proceed if both accounts exist.
+ *       Balances are addressed by account and asset ID, no string is hashed here.
+ * 
+ * @return bool true if the balances moved, false (and an EVENT_SETTLEMENT_FAILED report) otherwise
+ */
+bool OrderBook::flipBalance(AccountId buyer, AccountId seller, Quantity quantity, Price price, Price buyerLimit, Price sellerLimit) {
+    Amount cost = instrument.notional(price, quantity); // USD atoms paid by the buyer
+    Amount stock = instrument.baseAmount(quantity); // stock atoms delivered by the seller
+    Amount buyerHeld = instrument.notional(buyerLimit, quantity); // USD atoms the buyer's order held for this quantity
+    Amount sellerNotional = instrument.notional(sellerLimit, quantity);
+
+    if (!ledger->isAccount(buyer) || !ledger->isAccount(seller)) {
+        report(EVENT_SETTLEMENT_FAILED, REJECT_UNKNOWN_ACCOUNT, true, INVALID_ORDER_ID, buyer, price, quantity, 0, INVALID_ORDER_ID, seller);
+        return false;
+    }
+
+    if (sharedLedger) {
+        ledger->releaseHeld(buyer, quoteAsset, buyerHeld, cost);
+        ledger->releaseHeld(seller, baseAsset, stock, stock);
+        ledger->credit(buyer, baseAsset, stock);
+        ledger->credit(seller, quoteAsset, cost);
+        ledger->closeOpen(buyer, 0, buyerHeld);
+        ledger->closeOpen(seller, 0, sellerNotional);
+        return true;
+    }
+
+    ledger->held(buyer, quoteAsset) -= buyerHeld;
+    ledger->balance(buyer, quoteAsset) += buyerHeld - cost;
+    ledger->balance(buyer, baseAsset) += stock;
+
+    ledger->balance(seller, quoteAsset) += cost;
+    ledger->held(seller, baseAsset) -= stock;
+
+    ledger->risk(buyer).openNotional -= buyerHeld;
+    ledger->risk(seller).openNotional -= sellerNotional;
+    return true;
+}
+
+/**
+ * @brief Pre-trade risk checks of an incoming order, and its reservation if they pass
+ * 
+ * @details In this order: the account's open order limit, its open notional limit (the
+ *          order's notional at its limit price), and the available balance the order needs,
+ *          quote atoms at the limit price for a bid or base atoms for an ask. That balance
+ *          moves to the account's held balance, where it stays until the order fills or is
+ *          cancelled. Every check compares against a counter that accepts, fills and
+ *          cancels keep up to date, so this is a few integer compares however many orders
+ *          the account has open.
+ * 
+ * @param account A valid account
+ * @param isBid Side of the order
+ * @param price Limit price, in ticks
+ * @param qty Quantity, in lots, small enough that InstrumentSpec::fitsAmount holds
+ * 
+ * @return RejectReason REJECT_NONE once the order is counted and its funds held, otherwise
+ *         why it was refused (and nothing changed)
+ */
+RejectReason OrderBook::reserve(AccountId account, bool isBid, Price price, Quantity qty) {
+    Amount notional = instrument.notional(price, qty);
+    AssetId asset = isBid ? quoteAsset : baseAsset;
+    Amount needed = isBid ? notional : instrument.baseAmount(qty);
+
+    if (sharedLedger) {
+        if (!ledger->tryOpenOrder(account)) {
+            return REJECT_OPEN_ORDER_LIMIT;
         }
-    } else {
-        cout << "One or both users not found." << endl;
+        if (!ledger->tryOpenNotional(account, notional)) {
+            ledger->closeOpen(account, 1, 0);
+            return REJECT_NOTIONAL_LIMIT;
+        }
+        if (!ledger->tryHold(account, asset, needed)) {
+            ledger->closeOpen(account, 1, notional);
+            return REJECT_INSUFFICIENT_BALANCE;
+        }
+        return REJECT_NONE;
+    }
+
+    AccountRisk &risk = ledger->risk(account);
+    Amount &available = ledger->balance(account, asset);
+    if (risk.openOrders >= risk.maxOpenOrders) {
+        return REJECT_OPEN_ORDER_LIMIT;
+    }
+    if (risk.openNotional > risk.maxOpenNotional || notional > risk.maxOpenNotional - risk.openNotional) {
+        return REJECT_NOTIONAL_LIMIT;
+    }
+    if (available < needed) {
+        return REJECT_INSUFFICIENT_BALANCE;
+    }
+    available -= needed;
+    ledger->held(account, asset) += needed;
+    ++risk.openOrders;
+    risk.openNotional += notional;
+    return REJECT_NONE;
+}
+
+/**
+ * @brief Gives back what part of an open order held: its funds and its open notional
+ * 
+ * @param account Owner of the order
+ * @param isBid Side of the order
+ * @param price Limit price of the order, in ticks
+ * @param qty Quantity cancelled or reduced, in lots
+ * @param closes The order is gone, so it no longer counts as open
+ */
+void OrderBook::unreserve(AccountId account, bool isBid, Price price, Quantity qty, bool closes) {
+    Amount notional = instrument.notional(price, qty);
+    AssetId asset = isBid ? quoteAsset : baseAsset;
+    Amount held = isBid ? notional : instrument.baseAmount(qty);
+
+    if (sharedLedger) {
+        ledger->releaseHeld(account, asset, held, 0);
+        ledger->closeOpen(account, closes ? 1 : 0, notional);
+        return;
+    }
+    ledger->held(account, asset) -= held;
+    ledger->balance(account, asset) += held;
+    AccountRisk &risk = ledger->risk(account);
+    risk.openOrders -= closes ? 1 : 0;
+    risk.openNotional -= notional;
+}
+
+/**
+ * @brief Stamps an execution report with the next sequence number and hands it to the listener
+ * 
+ * @param type What happened (EventType)
+ * @param reason Why, for rejects and failed settlements (REJECT_NONE otherwise)
+ * @param isBid Side of the order the report is about
+ * @param id Order the report is about
+ * @param account Owner of the order
+ * @param price Order price, or trade price for fills
+ * @param qty Quantity accepted, traded, rested, reduced or cancelled
+ * @param leaves Quantity of the order still open afterwards
+ * @param contraId Other order of a fill
+ * @param contraAccount Owner of the other order
+ * 
+ * @note Does nothing beyond counting when no listener is attached
+ */
+void OrderBook::report(EventType type, RejectReason reason, bool isBid, OrderId id, AccountId account, Price price, Quantity qty, Quantity leaves,
+                       OrderId contraId, AccountId contraAccount) {
+    ++eventSequence;
+    lastReason = reason;
+    if (METRICS_ENABLED && metrics != nullptr) {
+        metrics->countEvent(type, reason, isBid, qty);
+    }
+    if (listener == nullptr) {
         return;
     }
+
+    ExecutionEvent event;
+    event.sequence = eventSequence;
+    event.orderId = id;
+    event.contraOrderId = contraId;
+    event.price = price;
+    event.quantity = qty;
+    event.leavesQuantity = leaves;
+    event.account = account;
+    event.contraAccount = contraAccount;
+    event.type = (unsigned char)type;
+    event.reason = (unsigned char)reason;
+    event.isBid = isBid;
+    listener->onEvent(event);
+}
+
+/**
+ * @brief Rests an order at the back of its price level without matching it
+ * 
+ * @param side The side to rest on (bids or asks)
+ * @param account The account placing the order
+ * @param price Price in ticks, must be inside the book's price band
+ * @param qty Quantity in lots
+ * 
+ * @return OrderId ID of the resting order, or INVALID_ORDER_ID if the pool is full or the
+ *         account cannot fund it
+ * 
+ * @note Used to seed the book; incoming orders go through submitOrder. The order is
+ *       reserved like any other, so seeding cannot overcommit an account.
+ */
+OrderId OrderBook::restOrder(BookSide& side, AccountId account, Price price, Quantity qty) {
+    bool isBid = &side == &bids;
+    if (qty <= 0 || !instrument.fitsAmount(price, qty) || reserve(account, isBid, price, qty) != REJECT_NONE) {
+        return INVALID_ORDER_ID;
+    }
+    OrderIndex slot = pool.allocate();
+    if (slot == NO_ORDER) {
+        unreserve(account, isBid, price, qty, true);
+        return INVALID_ORDER_ID;
+    }
+    Order &order = pool.at(slot);
+    order.quantity = qty;
+    order.price = price;
+    order.account = account;
+    side.append(slot, pool);
+    return pool.idOf(slot);
+}
+
+/**
+ * @brief Removes a resting order from the book and returns its slot to the pool
+ * 
+ * @details Unlinks the order from its level in O(1) through the pool links and clears
+ *          the level when it becomes empty. What the order still held goes back to its
+ *          account.
+ * 
+ * @param slot Pool slot of the order
+ * 
+ * @note The order's ID stops resolving once its slot is released
+ */
+void OrderBook::removeOrder(OrderIndex slot) {
+    const Order &order = pool.at(slot);
+    unreserve(order.account, pool.linksAt(slot).isBid, order.price, order.quantity, true);
+    if (pool.linksAt(slot).isBid) {
+        bids.unlink(slot, pool);
+    } else {
+        asks.unlink(slot, pool);
+    }
+    pool.release(slot);
+    noteDepth();
 }
 
 // Implementation of OrderBook constructor
@@ -68,59 +261,70 @@ void OrderBook::flipBalance(const std::string& userId1, const std::string& userI
  * - MarketMaker2: 10000 USD, 2000 GOOGL
  * - MarketMaker3: 50000 USD, 0 GOOGL
  * 
+ * GOOGL trades with a 0.01 USD tick and a 1 share lot, so order prices below are in cents.
+ * 
  * @note This constructor establishes the initial market state with
- *       a mix of bid and ask orders to ensure market liquidity
+ *       a mix of bid and ask orders to ensure market liquidity. Nothing is printed.
  */
-OrderBook::OrderBook() {
-    // User 1 with initial balance
-    Balance balance1("USD", 10000.0);
-    balance1.addBalances(TICKER, 1000.0);
-    User user1("MarketMaker1", balance1);
-    users[user1.userName] = user1;
+OrderBook::OrderBook(const BookConfig& config)
+    : instrument(TICKER, ATOMS_PER_UNIT / 100, ATOMS_PER_UNIT), ledger(&ownLedger), sharedLedger(false), listener(nullptr), eventSequence(0), lastReason(REJECT_NONE), journal(nullptr), metrics(nullptr) {
+    // Everything the matching path touches is sized here, once
+    pool.reserve(config.orderCapacity);
+    bids.init(true, config.minPrice, config.maxPrice, config.cumulativeDepth);
+    asks.init(false, config.minPrice, config.maxPrice, config.cumulativeDepth);
 
-    cout << "Initialized OrderBook with Market Makers 1 and balance 1." << endl;
+    quoteAsset = ledger->addAsset("USD");
+    baseAsset = ledger->addAsset(TICKER);
 
-    Order bid1(user1.userName, "BID", 110.0, 10);
-    Order ask1(user1.userName, "ASK", 115.0, 5);
-    Order bid2(user1.userName, "BID", 111.0, 8);
-    Order ask2(user1.userName, "ASK", 119.0, 12);
+    // User 1 with initial balance
+    AccountId user1 = ledger->addAccount("MarketMaker1");
+    ledger->balance(user1, quoteAsset) = 10000 * ATOMS_PER_UNIT;
+    ledger->balance(user1, baseAsset) = 1000 * ATOMS_PER_UNIT;
 
-    bids.push_back(bid1);
-    asks.push_back(ask1);
-    bids.push_back(bid2);
-    asks.push_back(ask2);
+    restOrder(bids, user1, 11000, 10); // 110.00 USD x 10
+    restOrder(asks, user1, 11500, 5); // 115.00 USD x 5
+    restOrder(bids, user1, 11100, 8); // 111.00 USD x 8
+    restOrder(asks, user1, 11900, 12); // 119.00 USD x 12
 
     // User 2 with initial balance
-    Balance balance2("USD", 10000.0);
-    balance2.addBalances(TICKER, 2000.0);
-    User user2("MarketMaker2", balance2);
-    users[user2.userName] = user2;
-
-    cout << "Initialized OrderBook with Market Makers 2 and balance 2." << endl;
+    AccountId user2 = ledger->addAccount("MarketMaker2");
+    ledger->balance(user2, quoteAsset) = 10000 * ATOMS_PER_UNIT;
+    ledger->balance(user2, baseAsset) = 2000 * ATOMS_PER_UNIT;
 
-    Order bid3(user2.userName, "bid", 109.0, 10);
-    Order ask3(user2.userName, "ask", 125.0, 5);
-    Order bid4(user2.userName, "bid", 112.0, 8);
-    Order ask4(user2.userName, "ask", 120.0, 12);
-
-    bids.push_back(bid3);
-    asks.push_back(ask3);
-    bids.push_back(bid4);
-    asks.push_back(ask4);
+    restOrder(bids, user2, 10900, 10); // 109.00 USD x 10
+    restOrder(asks, user2, 12500, 5); // 125.00 USD x 5
+    restOrder(bids, user2, 11200, 8); // 112.00 USD x 8
+    restOrder(asks, user2, 12000, 12); // 120.00 USD x 12
 
     // User 3 with initial balance
-    Balance balance3("USD", 50000.0);
-    balance3.addBalances(TICKER, 0.0);
-    User user3("MarketMaker3", balance3);
-    users[user3.userName] = user3;
-
-    cout << "Initialized OrderBook with Market Makers 3 and balance 3." << endl;
+    AccountId user3 = ledger->addAccount("MarketMaker3");
+    ledger->balance(user3, quoteAsset) = 50000 * ATOMS_PER_UNIT;
 
-    Order bid5(user3.userName, "bid", 105, 10);
-    Order bid6(user3.userName, "bid", 108, 10);
+    restOrder(bids, user3, 10500, 10); // 105.00 USD x 10
+    restOrder(bids, user3, 10800, 10); // 108.00 USD x 10
+}
 
-    bids.push_back(bid5);
-    bids.push_back(bid6);
+/**
+ * @brief Constructor for a book hosted by a multi-instrument exchange
+ * 
+ * @details The book starts empty and settles its trades on a ledger it shares with
+ *          every other instrument, so one account can trade many instruments with one
+ *          set of balances. Nothing is printed.
+ * 
+ * @param spec Symbol, tick and lot size of the instrument
+ * @param shared Ledger holding the accounts and both assets; it must outlive the book
+ * @param base Asset delivered by sellers (the instrument)
+ * @param quote Asset paid by buyers
+ * @param config Order capacity and price band to preallocate
+ * 
+ * @note Settlement uses the ledger's atomic accessors, so books on different threads may
+ *       share one ledger as long as each book is only driven by one thread.
+ */
+OrderBook::OrderBook(const InstrumentSpec& spec, Ledger& shared, AssetId base, AssetId quote, const BookConfig& config)
+    : instrument(spec), ledger(&shared), sharedLedger(true), quoteAsset(quote), baseAsset(base), listener(nullptr), eventSequence(0), lastReason(REJECT_NONE), journal(nullptr), metrics(nullptr) {
+    pool.reserve(config.orderCapacity);
+    bids.init(true, config.minPrice, config.maxPrice, config.cumulativeDepth);
+    asks.init(false, config.minPrice, config.maxPrice, config.cumulativeDepth);
 }
 
 /**
@@ -132,261 +336,555 @@ OrderBook::OrderBook() {
  * 
  * @param username The desired username for the new user
  * 
- * @return string Status message indicating:
- *         - Success: "User {username} created successfully"
- *         - Failure: "User {username} already exists"
+ * @return AccountId The compact account ID used by every other call, or
+ *         INVALID_ACCOUNT if the username already exists
  * 
  * @note New users start with zero balance in all currencies/stocks
  */
-string OrderBook::makeUser(std::string username) {
-    User newUser(username);
-    if (users.find(username) == users.end()) {
-        users[username] = newUser;
-        return "User " + username + " created successfully.";
-    } 
-    return "User " + username + " already exists.";
+AccountId OrderBook::makeUser(std::string username) {
+    if (journal != nullptr) {
+        journal->recordName(JOURNAL_MAKE_USER, INVALID_ACCOUNT, 0, username);
+    }
+    return ledger->addAccount(username);
 }
 
 /**
- * @brief Places a new bid (buy) order in the order book
+ * @brief Matches one incoming order and rests, cancels or releases what is left of it,
+ *        as its type asks
  * 
  * @details Algorithm:
- * 1. Validates user existence and USD balance
- * 2. Sorts existing ask orders by price (ascending) and time priority
- * 3. Matches against existing ask orders if possible:
- *    - Fully matches and removes completed ask orders
+ * 1. Validates user existence, the price band (not for market orders) and the quantity
+ * 2. Prices a market order at the worst level its quantity reaches on the opposite side,
+ *    and makes sure a fill-or-kill order finds its whole quantity within its limit
+ * 3. Runs the pre-trade risk checks and holds the USD (bid) or stock (ask) (reserve)
+ * 4. Walks the opposite side from its best price, oldest order first, while it crosses:
+ *    - Fully matches and removes completed resting orders
  *    - Partially matches and updates remaining quantities
- * 4. Places remaining quantity as new bid if not fully matched
+ * 5. Rests the remainder of a limit order; cancels the remainder of an IOC or market order
+ * 
+ * @tparam side SIDE_BID or SIDE_ASK
+ * @tparam type ORDER_LIMIT, ORDER_IOC, ORDER_FOK or ORDER_MARKET
  * 
- * @param Username The username of the bidder
- * @param Price The maximum price willing to pay per stock
- * @param Quantity The number of stocks to buy
+ * @param account The account placing the order
+ * @param price Limit price in ticks: the most a bid pays, the least an ask accepts;
+ *              ignored for market orders
+ * @param qty Quantity in lots
  * 
- * @return string Status message indicating:
- *         - Error if user doesn't exist
- *         - Error if insufficient USD balance
- *         - Success message with trade details
+ * @return OrderId ID of the accepted order, or INVALID_ORDER_ID if rejected because:
+ *         - the user doesn't exist
+ *         - the price is outside the band or the quantity is not positive
+ *         - a fill-or-kill order cannot fill in full, or a market order finds nothing
+ *         - the order pool is full
+ *         - the user has insufficient available balance
+ *         - the user is at its open order or open notional limit
  * 
  * @note 
- * - Implements price-time priority matching
- * - Matches at ask price, not bid price
- * - Requires sufficient USD balance: Price * Quantity
+ * - Implements price-time priority matching, at the resting order's price
+ * - Side and type are template arguments, so each of the eight instances is compiled
+ *   without branches on them; addOrder() picks the instance once per order
+ * - Nothing is re-sorted; the best opposite price is always contra.best()
+ * - Every outcome is reported to the listener: EVENT_REJECTED with a reason, or
+ *   EVENT_ACCEPTED, one fill report per order per trade, then EVENT_RESTED or, for an
+ *   immediate order with quantity left, EVENT_CANCELLED
  */
-string OrderBook::addBid(std::string Username, double Price, int Quantity) {
-    // First check if the username exists in the users map
-    if (users.find(Username) == users.end()) {
-        return "Error: User " + Username + " does not exist.";
+template <Side side, OrderType type>
+OrderId OrderBook::submitOrder(AccountId account, Price price, Quantity qty) {
+    const bool isBid = side == SIDE_BID;
+    BookSide &own = isBid ? bids : asks;
+    BookSide &contra = isBid ? asks : bids;
+    if (journal != nullptr) {
+        journal->recordOrder(isBid ? JOURNAL_ADD_BID : JOURNAL_ADD_ASK, type, account, price, qty);
     }
+    unsigned long long stageStart = stageClock();
 
-    // Check if user has enough USD balance for the bid
-    if (users[Username].userBalance.balance["USD"] < Price * Quantity) {
-        return "Error: User " + Username + " does not have enough USD balance for this bid.";
+    // First check if the account exists
+    if (!ledger->isAccount(account)) {
+        report(EVENT_REJECTED, REJECT_UNKNOWN_ACCOUNT, isBid, INVALID_ORDER_ID, account, price, qty, 0);
+        return INVALID_ORDER_ID;
     }
 
-    int remQty = Quantity; // remaining quantity to be fulfilled
+    // The ladder only covers the configured price band
+    if (type != ORDER_MARKET && !own.inBand(price)) {
+        report(EVENT_REJECTED, REJECT_PRICE_OUT_OF_BAND, isBid, INVALID_ORDER_ID, account, price, qty, 0);
+        return INVALID_ORDER_ID;
+    }
+    // So large that what it costs or delivers would not fit in an Amount; a market order's
+    // price is only known once the book is swept
+    if (qty <= 0 || (type != ORDER_MARKET && !instrument.fitsAmount(price, qty))) {
+        report(EVENT_REJECTED, REJECT_INVALID_QUANTITY, isBid, INVALID_ORDER_ID, account, price, qty, 0);
+        return INVALID_ORDER_ID;
+    }
 
-    stable_sort(asks.begin(), asks.end(), [](const Order &a, const Order &b) {
-        // If prices are equal, maintain the original order
-        if (a.price == b.price) {
-            return a.insertionOrderAsk < b.insertionOrderAsk; // Earlier insertion order has higher priority
+    // A market order is a limit order at the worst price it would reach; a fill-or-kill
+    // order must find all of its quantity before anything is held or traded
+    if (type == ORDER_MARKET) {
+        SweepQuote quote = contra.sweep(qty);
+        if (quote.quantity == 0) {
+            report(EVENT_REJECTED, REJECT_NOT_FILLABLE, isBid, INVALID_ORDER_ID, account, price, qty, 0);
+            return INVALID_ORDER_ID;
         }
-        return a.price < b.price; // sort by price, Lower price has higher priority
-    });
-
-    for (auto it = asks.begin(); it != asks.end();) {
-        if (remQty > 0  && Price >= it->price) {
-            if (it->quantity > remQty) {
-                it->quantity -= remQty;
-                flipBalance(Username, it->userName, remQty, it->price);
-                cout << "Bid Satisfied Successfully at price: " << it->price << " and quantity: " << remQty << endl;
-                remQty = 0;
-                break;
-            } else {
-                remQty -= it->quantity;
-                flipBalance(Username, it->userName, it->quantity, it->price);
-                cout << "Bid Satisfied Partially at price: " << it->price << " and quantity: " << it->quantity << endl;
-                it = asks.erase(it); // Remove the ask order as it is completely fulfilled
-            }
-        } else {
-            ++it;
+        price = quote.worstPrice;
+        if (!instrument.fitsAmount(price, qty)) {
+            report(EVENT_REJECTED, REJECT_INVALID_QUANTITY, isBid, INVALID_ORDER_ID, account, price, qty, 0);
+            return INVALID_ORDER_ID;
         }
+    } else if (type == ORDER_FOK && contra.sweepTo(price).quantity < qty) {
+        report(EVENT_REJECTED, REJECT_NOT_FILLABLE, isBid, INVALID_ORDER_ID, account, price, qty, 0);
+        return INVALID_ORDER_ID;
     }
 
-    if (remQty > 0) {
-        Order bid(Username, "bid", Price, remQty);
-        bids.push_back(bid);
-        cout << "Remaining quantity of bids added to Orderbook" << endl;
+    // Limits, then hold the USD a bid can cost at its limit price or the stock an ask can deliver
+    RejectReason risk = reserve(account, isBid, price, qty);
+    if (risk != REJECT_NONE) {
+        report(EVENT_REJECTED, risk, isBid, INVALID_ORDER_ID, account, price, qty, 0);
+        return INVALID_ORDER_ID;
+    }
+
+    // Take a pool slot up front: it gives the order its ID, even if it fills immediately
+    OrderIndex slot = pool.allocate();
+    if (slot == NO_ORDER) {
+        unreserve(account, isBid, price, qty, true);
+        report(EVENT_REJECTED, REJECT_BOOK_FULL, isBid, INVALID_ORDER_ID, account, price, qty, 0);
+        return INVALID_ORDER_ID;
+    }
+    OrderId id = pool.idOf(slot);
+    report(EVENT_ACCEPTED, REJECT_NONE, isBid, id, account, price, qty, qty);
+    stageStart = stageDone(STAGE_VALIDATE, stageStart);
+
+    Quantity remQty = qty; // remaining quantity to be fulfilled
+    unsigned long long levelsTouched = 0; // for the metrics, counted while the best price changes
+    Price lastLevel = NO_PRICE;
+
+    // Levels are ordered best price first, so stop as soon as the best opposite price no longer crosses
+    while (remQty > 0 && !contra.empty() && (isBid ? price >= contra.best() : price <= contra.best())) {
+        Price levelPrice = contra.best();
+        levelsTouched += levelPrice != lastLevel ? 1 : 0;
+        lastLevel = levelPrice;
+        OrderIndex restingSlot = contra.level(levelPrice).head; // oldest order at the best price
+        Order &resting = pool.at(restingSlot);
+        OrderId restingId = pool.idOf(restingSlot);
+        AccountId restingAccount = resting.account; // still needed once the slot is released
+        Quantity fillQty = resting.quantity < remQty ? resting.quantity : remQty;
+
+        contra.reduce(restingSlot, fillQty, pool); // keeps the level total in step
+        remQty -= fillQty;
+        unsigned long long settleStart = stageClock();
+        if (isBid) {
+            flipBalance(account, restingAccount, fillQty, levelPrice, price, levelPrice);
+        } else {
+            flipBalance(restingAccount, account, fillQty, levelPrice, levelPrice, price);
+        }
+        stageDone(STAGE_SETTLE, settleStart);
+        report(resting.quantity == 0 ? EVENT_FILL : EVENT_PARTIAL_FILL, REJECT_NONE, !isBid, restingId, restingAccount, levelPrice, fillQty, resting.quantity, id, account);
+        report(remQty == 0 ? EVENT_FILL : EVENT_PARTIAL_FILL, REJECT_NONE, isBid, id, account, levelPrice, fillQty, remQty, restingId, restingAccount);
+
+        if (resting.quantity == 0) {
+            contra.popFront(levelPrice, pool); // Remove the resting order as it is completely fulfilled
+            pool.release(restingSlot);
+            closeOrder(restingAccount);
+        }
+    }
+    if (METRICS_ENABLED && metrics != nullptr && levelsTouched > 0) {
+        metrics->recordLevels(levelsTouched);
+        stageStart = stageDone(STAGE_MATCH, stageStart);
     }
 
-    if (remQty == 0) {
-        cout << "Complete Bid Satisfied Successfully" << endl;
+    if (remQty > 0 && type == ORDER_LIMIT) {
+        Order &order = pool.at(slot);
+        order.quantity = remQty;
+        order.price = price;
+        order.account = account;
+        own.append(slot, pool);
+        report(EVENT_RESTED, REJECT_NONE, isBid, id, account, price, remQty, remQty);
+        stageDone(STAGE_REST, stageStart);
+    } else if (remQty > 0) {
+        unreserve(account, isBid, price, remQty, true); // immediate orders never rest
+        report(EVENT_CANCELLED, REJECT_NONE, isBid, id, account, price, remQty, 0);
+        pool.release(slot);
+    } else {
+        pool.release(slot); // nothing left to rest, the ID is used up
+        closeOrder(account);
     }
+    noteDepth();
 
-    return "Bid added/satified successfully.";
+    return id;
 }
 
 /**
- * @brief Places a new ask (sell) order in the order book
- * 
- * @details Algorithm:
- * 1. Validates user existence and stock balance
- * 2. Sorts existing bid orders by price (descending) and time priority
- * 3. Matches against existing bid orders if possible:
- *    - Fully matches and removes completed bid orders
- *    - Partially matches and updates remaining quantities
- * 4. Places remaining quantity as new ask if not fully matched
+ * @brief Places a new bid (buy) limit order in the order book
  * 
- * @param Username The username of the seller
- * @param Price The minimum price willing to accept per stock
- * @param Quantity The number of stocks to sell
+ * @param account The account of the bidder
+ * @param price The maximum price willing to pay per stock
+ * @param qty The number of stocks to buy
  * 
- * @return string Status message indicating:
- *         - Error if user doesn't exist
- *         - Error if insufficient stock balance
- *         - Success message with trade details
+ * @return OrderId ID of the accepted order, or INVALID_ORDER_ID if rejected
  * 
- * @note 
- * - Implements price-time priority matching
- * - Matches at bid price, not ask price
- * - Requires sufficient stock balance: Quantity
+ * @note Holds Price * Quantity of the user's available USD until the order fills or is
+ *       cancelled; fills below the limit price give the difference back. See submitOrder()
  */
-string OrderBook::addAsk(std::string Username, double Price, int Quantity) {
-    // First check if the username exists in the users map
-    if (users.find(Username) == users.end()) {
-        return "Error: User " + Username + " does not exist.";
-    }
-
-    // Check if user has enough GOOGL balance for the ask
-    if (users[Username].userBalance.balance[TICKER] < Quantity) {
-        return "Error: User " + Username + " does not have enough " + TICKER + " balance for this ask.";
-    }
-
-    int remQty = Quantity;
-
-    stable_sort(bids.begin(), bids.end(), [](const Order &a, const Order &b) {
-        // If prices are equal, maintain the original order
-        if (a.price == b.price) {
-            return a.insertionOrderBid < b.insertionOrderBid; // Earlier insertion order has higher priority
-        }
-        return a.price > b.price; // sort by price
-    });
-
-    for (auto it = bids.begin(); it != bids.end();) {
-        if (remQty > 0  && Price <= it->price) {
-            if (it->quantity > remQty) {
-                it->quantity -= remQty;
-                flipBalance(it->userName, Username, it->quantity, it->price);
-                cout << "Ask Satisfied Successfully at price: " << it->price << " and quantity: " << remQty << endl;
-                remQty = 0;
-                break;
-            } else {
-                remQty -= it->quantity;
-                flipBalance(it->userName, Username, it->quantity, it->price);
-                cout << "Ask Satisfied Partially at price: " << it->price << " and quantity: " << it->quantity << endl;
-                it = bids.erase(it); // get the next valid iterator after erasing
-            }
-        } else {
-            ++it;
-        }
-    }
+OrderId OrderBook::addBid(AccountId account, Price price, Quantity qty) {
+    return submitOrder<SIDE_BID, ORDER_LIMIT>(account, price, qty);
+}
 
-    if (remQty > 0) {
-        Order ask(Username, "ask", Price, remQty);
-        asks.push_back(ask);
-        cout << "Remaining quantity of asks added to Orderbook" << endl;
-    }
+/**
+ * @brief Places a new ask (sell) limit order in the order book
+ * 
+ * @param account The account of the seller
+ * @param price The minimum price willing to accept per stock
+ * @param qty The number of stocks to sell
+ * 
+ * @return OrderId ID of the accepted order, or INVALID_ORDER_ID if rejected
+ * 
+ * @note Holds Quantity of the user's available stock until the order fills or is
+ *       cancelled. See submitOrder()
+ */
+OrderId OrderBook::addAsk(AccountId account, Price price, Quantity qty) {
+    return submitOrder<SIDE_ASK, ORDER_LIMIT>(account, price, qty);
+}
 
-    if (remQty == 0) {
-        cout << "Complete Ask Satisfied Successfully" << endl;
+/**
+ * @brief Places an order of any side and type in the order book
+ * 
+ * @details Picks the matching kernel instance for the side and type once; everything
+ *          after that is compiled for them. Front ends that carry the side and type as
+ *          data (batches, journals, gateways, text flows) come in here.
+ * 
+ * @param side SIDE_BID or SIDE_ASK
+ * @param type ORDER_LIMIT, ORDER_IOC, ORDER_FOK or ORDER_MARKET
+ * @param account The account placing the order
+ * @param price Limit price in ticks, ignored for market orders
+ * @param qty Quantity in lots
+ * 
+ * @return OrderId ID of the accepted order, or INVALID_ORDER_ID if rejected (an unknown
+ *         type is rejected with REJECT_UNKNOWN_COMMAND)
+ */
+OrderId OrderBook::addOrder(Side side, OrderType type, AccountId account, Price price, Quantity qty) {
+    switch (type) {
+        case ORDER_LIMIT: return side == SIDE_BID ? submitOrder<SIDE_BID, ORDER_LIMIT>(account, price, qty) : submitOrder<SIDE_ASK, ORDER_LIMIT>(account, price, qty);
+        case ORDER_IOC: return side == SIDE_BID ? submitOrder<SIDE_BID, ORDER_IOC>(account, price, qty) : submitOrder<SIDE_ASK, ORDER_IOC>(account, price, qty);
+        case ORDER_FOK: return side == SIDE_BID ? submitOrder<SIDE_BID, ORDER_FOK>(account, price, qty) : submitOrder<SIDE_ASK, ORDER_FOK>(account, price, qty);
+        case ORDER_MARKET: return side == SIDE_BID ? submitOrder<SIDE_BID, ORDER_MARKET>(account, price, qty) : submitOrder<SIDE_ASK, ORDER_MARKET>(account, price, qty);
     }
-
-    return "Ask added successfully."; 
+    report(EVENT_REJECTED, REJECT_UNKNOWN_COMMAND, side == SIDE_BID, INVALID_ORDER_ID, account, price, qty, 0);
+    return INVALID_ORDER_ID;
 }
 
 /**
  * @brief Cancels an existing bid order
  * 
  * @details Search and cancellation logic:
- * 1. Searches for exact match (username, price, quantity)
+ * 1. Looks up the price level, then searches it for the user's order
  * 2. If found with larger quantity, reduces the quantity
  * 3. If found with smaller quantity, rejects cancellation
  * 4. Removes order completely if quantities match
  * 
- * @param Username The username who placed the bid
- * @param Price The price of the bid to cancel
- * @param Quantity The quantity to cancel
+ * @param account The account that placed the bid
+ * @param price The price of the bid to cancel
+ * @param qty The quantity to cancel
  * 
  * @note 
- * - Cannot cancel more than existing quantity
+ * - Cannot cancel more than existing quantity, nor a quantity that is not positive
  * - Requires exact match of all parameters
- * - Prints status messages to console
- */
-void OrderBook::cancelBid(std::string Username, double Price, int Quantity) {
-    for (auto it = bids.begin(); it != bids.end(); it++){
-        if (it->userName == Username && it->price == Price && it->quantity == Quantity) {
-            bids.erase(it);
-            cout << "Bid cancelled successfully!" << endl;
-            return;
-        } else if (it->userName == Username && it->price == Price && it->quantity > Quantity) {
-            it->quantity -= Quantity;
-            cout << "Bid cancelled successfully!" << endl;
-            return;
-        } else if (it->userName == Username && it->price == Price && it->quantity < Quantity) {
-            cout << "Cannot cancel more than existing quantity. Existing quantity is " << it->quantity << endl;
-            cout << "Bid quantity is less than the quantity you want to cancel." << endl;
-            cout << "Please enter the right quantity to cancel and retry!" << endl;
-            return;
+ * - Reports EVENT_CANCELLED, EVENT_REDUCED or EVENT_REJECTED to the listener
+ * 
+ * @return bool true if an order was cancelled or reduced
+ */
+bool OrderBook::cancelBid(AccountId account, Price price, Quantity qty) {
+    if (journal != nullptr) {
+        journal->record(JOURNAL_CANCEL_BID, account, price, qty, INVALID_ORDER_ID);
+    }
+    unsigned long long stageStart = stageClock();
+    if (qty <= 0) {
+        report(EVENT_REJECTED, REJECT_INVALID_QUANTITY, true, INVALID_ORDER_ID, account, price, qty, 0);
+        return false;
+    }
+    if (bids.inBand(price)) {
+        for (OrderIndex slot = bids.level(price).head; slot != NO_ORDER; slot = pool.at(slot).next) {
+            Order &order = pool.at(slot);
+            if (order.account == account && order.quantity == qty) {
+                report(EVENT_CANCELLED, REJECT_NONE, true, pool.idOf(slot), account, price, qty, 0);
+                removeOrder(slot);
+                stageDone(STAGE_CANCEL, stageStart);
+                return true;
+            } else if (order.account == account && order.quantity > qty) {
+                bids.reduce(slot, qty, pool);
+                unreserve(account, true, price, qty, false);
+                report(EVENT_REDUCED, REJECT_NONE, true, pool.idOf(slot), account, price, qty, order.quantity);
+                stageDone(STAGE_CANCEL, stageStart);
+                return true;
+            } else if (order.account == account && order.quantity < qty) {
+                report(EVENT_REJECTED, REJECT_QUANTITY_TOO_LARGE, true, pool.idOf(slot), account, price, qty, order.quantity);
+                return false;
+            }
         }
     }
 
-    cout << "Bid not found!! Please enter the right Username, Price and Quantity to cancel the bid!" << endl;
-    return;
+    report(EVENT_REJECTED, REJECT_ORDER_NOT_FOUND, true, INVALID_ORDER_ID, account, price, qty, 0);
+    return false;
 }
 
 /**
  * @brief Cancels an existing ask order
  * 
  * @details Search and cancellation logic:
- * 1. Searches for exact match (username, price, quantity)
+ * 1. Looks up the price level, then searches it for the user's order
  * 2. If found with larger quantity, reduces the quantity
  * 3. If found with smaller quantity, rejects cancellation
  * 4. Removes order completely if quantities match
  * 
- * @param Username The username who placed the ask
- * @param Price The price of the ask to cancel
- * @param Quantity The quantity to cancel
+ * @param account The account that placed the ask
+ * @param price The price of the ask to cancel
+ * @param qty The quantity to cancel
  * 
  * @note 
- * - Cannot cancel more than existing quantity
+ * - Cannot cancel more than existing quantity, nor a quantity that is not positive
  * - Requires exact match of all parameters
- * - Prints status messages to console
- */
-void OrderBook::cancelAsk(std::string Username, double Price, int Quantity) {
-    for (auto it = asks.begin(); it != asks.end(); it++){
-        if (it->userName == Username && it->price == Price && it->quantity == Quantity) {
-            asks.erase(it);
-            cout << "Ask cancelled successfully!" << endl;
-            return;
-        } else if (it->userName == Username && it->price == Price && it->quantity > Quantity) {
-            it->quantity -= Quantity;
-            cout << "Ask cancelled successfully!" << endl;
-            return;
-        } else if (it->userName == Username && it->price == Price && it->quantity < Quantity) {
-            cout << "Cannot cancel more than existing quantity. Existing quantity is " << it->quantity << endl;
-            cout << "Ask quantity is less than the quantity you want to cancel." << endl;
-            cout << "Please enter the right quantity to cancel and retry!" << endl;
-            return;
+ * - Reports EVENT_CANCELLED, EVENT_REDUCED or EVENT_REJECTED to the listener
+ * 
+ * @return bool true if an order was cancelled or reduced
+ */
+bool OrderBook::cancelAsk(AccountId account, Price price, Quantity qty) {
+    if (journal != nullptr) {
+        journal->record(JOURNAL_CANCEL_ASK, account, price, qty, INVALID_ORDER_ID);
+    }
+    unsigned long long stageStart = stageClock();
+    if (qty <= 0) {
+        report(EVENT_REJECTED, REJECT_INVALID_QUANTITY, false, INVALID_ORDER_ID, account, price, qty, 0);
+        return false;
+    }
+    if (asks.inBand(price)) {
+        for (OrderIndex slot = asks.level(price).head; slot != NO_ORDER; slot = pool.at(slot).next) {
+            Order &order = pool.at(slot);
+            if (order.account == account && order.quantity == qty) {
+                report(EVENT_CANCELLED, REJECT_NONE, false, pool.idOf(slot), account, price, qty, 0);
+                removeOrder(slot);
+                stageDone(STAGE_CANCEL, stageStart);
+                return true;
+            } else if (order.account == account && order.quantity > qty) {
+                asks.reduce(slot, qty, pool);
+                unreserve(account, false, price, qty, false);
+                report(EVENT_REDUCED, REJECT_NONE, false, pool.idOf(slot), account, price, qty, order.quantity);
+                stageDone(STAGE_CANCEL, stageStart);
+                return true;
+            } else if (order.account == account && order.quantity < qty) {
+                report(EVENT_REJECTED, REJECT_QUANTITY_TOO_LARGE, false, pool.idOf(slot), account, price, qty, order.quantity);
+                return false;
+            }
         }
     }
+
+    report(EVENT_REJECTED, REJECT_ORDER_NOT_FOUND, false, INVALID_ORDER_ID, account, price, qty, 0);
+    return false;
+}
+
+/**
+ * @brief Cancels a resting order by its ID
+ * 
+ * @details Resolves the ID straight to its pool slot and unlinks it from its price level,
+ *          without scanning the book.
+ * 
+ * @param id The ID returned when the order was accepted
+ * 
+ * @return bool true if the order was resting and has been removed, false otherwise
+ * 
+ * @note 
+ * - Runs in O(1) regardless of book depth
+ * - Fully filled or already cancelled orders are reported as not found
+ */
+bool OrderBook::cancel(OrderId id) {
+    if (journal != nullptr) {
+        journal->record(JOURNAL_CANCEL, INVALID_ACCOUNT, 0, 0, id);
+    }
+    unsigned long long stageStart = stageClock();
+    OrderIndex slot = pool.find(id);
+    if (slot == NO_ORDER) {
+        report(EVENT_REJECTED, REJECT_ORDER_NOT_FOUND, false, id, INVALID_ACCOUNT, 0, 0, 0);
+        return false;
+    }
+
+    const Order &order = pool.at(slot);
+    report(EVENT_CANCELLED, REJECT_NONE, pool.linksAt(slot).isBid, id, order.account, order.price, order.quantity, 0);
+    removeOrder(slot);
+    stageDone(STAGE_CANCEL, stageStart);
+    return true;
 }
 
 /**
- * @brief Retrieves current market quote for buying specified quantity
+ * @brief Reduces the quantity of a resting order by its ID
+ * 
+ * @details The order keeps its place in the queue. Reducing by the full remaining
+ *          quantity cancels the order.
+ * 
+ * @param id The ID returned when the order was accepted
+ * @param qty The quantity to take off the order
+ * 
+ * @return bool true if the order was reduced or cancelled, false otherwise
+ * 
+ * @note 
+ * - Cannot reduce by more than the remaining quantity
+ * - Runs in O(1) regardless of book depth
+ */
+bool OrderBook::reduce(OrderId id, Quantity qty) {
+    if (journal != nullptr) {
+        journal->record(JOURNAL_REDUCE, INVALID_ACCOUNT, 0, qty, id);
+    }
+    unsigned long long stageStart = stageClock();
+    OrderIndex slot = pool.find(id);
+    if (slot == NO_ORDER) {
+        report(EVENT_REJECTED, REJECT_ORDER_NOT_FOUND, false, id, INVALID_ACCOUNT, 0, qty, 0);
+        return false;
+    }
+
+    Order &order = pool.at(slot);
+    bool isBid = pool.linksAt(slot).isBid;
+    if (qty <= 0 || qty > order.quantity) {
+        report(EVENT_REJECTED, qty <= 0 ? REJECT_INVALID_QUANTITY : REJECT_QUANTITY_TOO_LARGE, isBid, id, order.account, order.price, qty, order.quantity);
+        return false;
+    }
+
+    if (qty == order.quantity) {
+        report(EVENT_CANCELLED, REJECT_NONE, isBid, id, order.account, order.price, qty, 0);
+        removeOrder(slot);
+    } else {
+        (isBid ? bids : asks).reduce(slot, qty, pool);
+        unreserve(order.account, isBid, order.price, qty, false);
+        report(EVENT_REDUCED, REJECT_NONE, isBid, id, order.account, order.price, qty, order.quantity);
+    }
+    stageDone(STAGE_CANCEL, stageStart);
+    return true;
+}
+
+/**
+ * @brief Changes the price and/or quantity of a resting order by its ID
+ * 
+ * @details 
+ * 1. Same price and same quantity: nothing changes and nothing is reported
+ * 2. Same price and smaller quantity: reduced in place, keeps time priority
+ * 3. Anything else: the order is cancelled and re-entered as a new order, which may
+ *    match immediately and goes to the back of its new price level
+ * 
+ * @param id The ID returned when the order was accepted
+ * @param price The new price
+ * @param qty The new total quantity
+ * 
+ * @return OrderId The ID of the order after the replace (unchanged when it stays in
+ *         place, a new ID otherwise), or INVALID_ORDER_ID if it failed
+ * 
+ * @note If the re-entered order fails its balance check the original order stays cancelled.
+ *       Whichever way it goes, the replace is journaled as one JOURNAL_REPLACE record, so
+ *       replay takes the same decision on the same book.
+ */
+OrderId OrderBook::replace(OrderId id, Price price, Quantity qty) {
+    if (journal != nullptr) {
+        journal->record(JOURNAL_REPLACE, INVALID_ACCOUNT, price, qty, id);
+    }
+    unsigned long long stageStart = stageClock();
+    OrderIndex slot = pool.find(id);
+    if (slot == NO_ORDER) {
+        report(EVENT_REJECTED, REJECT_ORDER_NOT_FOUND, false, id, INVALID_ACCOUNT, price, qty, 0);
+        return INVALID_ORDER_ID;
+    }
+
+    Order &order = pool.at(slot);
+    bool isBid = pool.linksAt(slot).isBid;
+    if (qty <= 0) {
+        report(EVENT_REJECTED, REJECT_INVALID_QUANTITY, isBid, id, order.account, price, qty, order.quantity);
+        return INVALID_ORDER_ID;
+    }
+
+    if (order.price == price && qty == order.quantity) {
+        stageDone(STAGE_REPLACE, stageStart);
+        return id;
+    }
+    if (order.price == price && qty < order.quantity) {
+        Quantity reducedBy = order.quantity - qty;
+        (isBid ? bids : asks).reduce(slot, reducedBy, pool);
+        unreserve(order.account, isBid, price, reducedBy, false);
+        report(EVENT_REDUCED, REJECT_NONE, isBid, id, order.account, price, reducedBy, qty);
+        stageDone(STAGE_REPLACE, stageStart);
+        return id;
+    }
+
+    AccountId account = order.account;
+    report(EVENT_CANCELLED, REJECT_NONE, isBid, id, account, order.price, order.quantity, 0);
+    removeOrder(slot);
+    stageDone(STAGE_REPLACE, stageStart);
+    Journal *replaceJournal = journal; // the replace record above stands for the new order too
+    journal = nullptr;
+    OrderId entered = isBid ? addBid(account, price, qty) : addAsk(account, price, qty);
+    journal = replaceJournal;
+    return entered;
+}
+
+/**
+ * @brief Runs a batch of orders, cancels, reduces and replaces in order
+ *
+ * @details Every command behaves exactly as the single call it names (addOrder with the
+ *          command's order type, cancel, reduce, replace): same checks, same matching, same reports, journal
+ *          records and sequence numbers, in the same order. What the batch saves is the
+ *          per-command work around the engine: with a journal attached the records of the
+ *          whole batch are staged and handed to the journal thread under one lock (see
+ *          Journal::hold), and the caller gets every outcome in one packed array instead
+ *          of one call and return value per command.
+ *
+ * @param commands The commands, executed first to last
+ * @param count How many
+ * @param results Receives one BookResult per command, in command order
+ *
+ * @return size_t How many commands went through (result reason REJECT_NONE)
+ *
+ * @note A command of unknown type or order type is refused with REJECT_UNKNOWN_COMMAND in its result only:
+ *       it never reaches the book, so it is neither reported nor journaled
+ */
+size_t OrderBook::submitBatch(const BookCommand* commands, size_t count, BookResult* results) {
+    Journal *heldJournal = journal;
+    if (heldJournal != nullptr) {
+        heldJournal->hold();
+    }
+    size_t done = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const BookCommand &command = commands[i];
+        BookResult &result = results[i];
+        memset(&result, 0, sizeof(result));
+        bool ok;
+        unsigned char type = command.orderType < ORDER_TYPES ? command.type : 0; // an unknown order type makes an unknown command
+        switch (type) {
+            case BOOK_BID:
+            case BOOK_ASK:
+                result.orderId = addOrder(type == BOOK_BID ? SIDE_BID : SIDE_ASK, (OrderType)command.orderType, command.account, command.price, command.quantity);
+                ok = result.orderId != INVALID_ORDER_ID;
+                break;
+            case BOOK_CANCEL: ok = cancel(command.orderId); break;
+            case BOOK_REDUCE: ok = reduce(command.orderId, command.quantity); break;
+            case BOOK_REPLACE:
+                result.orderId = replace(command.orderId, command.price, command.quantity);
+                ok = result.orderId != INVALID_ORDER_ID;
+                break;
+            default:
+                lastReason = REJECT_UNKNOWN_COMMAND;
+                ok = false;
+                break;
+        }
+        if ((command.type == BOOK_CANCEL || command.type == BOOK_REDUCE) && ok) {
+            result.orderId = command.orderId;
+        }
+        result.reason = (unsigned char)(ok ? REJECT_NONE : lastReason);
+        done += ok ? 1 : 0;
+    }
+    if (heldJournal != nullptr) {
+        heldJournal->release();
+    }
+    return done;
+}
+
+/**
+ * @brief Retrieves current market quote for buying and selling specified quantity
  * 
  * @details Quote generation process:
- * 1. Sorts ask orders by price (ascending) and time priority
+ * 1. Walks ask levels from the best (lowest) price, one line per level
  * 2. Accumulates available quantities at each price level
  * 3. Shows all price levels needed to fulfill requested quantity
+ * 4. Summarises both sides from the cumulative index: VWAP, worst price and slippage
  * 
  * @param qty The quantity of stocks to get quote for
  * 
@@ -398,116 +896,256 @@ void OrderBook::cancelAsk(std::string Username, double Price, int Quantity) {
  * - Prints quote details to console
  * - Does not actually execute any trades
  */
-string OrderBook::getQuote(int qty) {
-    // Implementation of getQuote
-    // We will need to find lowest ask prices till the qty passed in is met we keep displaying lowest ask prices
+string OrderBook::getQuote(Quantity qty) {
+    Quantity remaining = qty;
+    for (Price levelPrice = asks.best(); levelPrice != NO_PRICE && remaining > 0; levelPrice = asks.nextWorse(levelPrice)) {
+        Quantity take = asks.level(levelPrice).quantity < remaining ? asks.level(levelPrice).quantity : remaining;
+        cout << instrument.symbol << "-> "
+             << "Quantity available: " << instrument.formatQuantity(take) << " at " << instrument.formatPrice(levelPrice) << " " << ledger->assetName(quoteAsset) << endl; // make the output look better
+        remaining -= take;
+    }
 
-    stable_sort(asks.begin(), asks.end(), [](const Order &a, const Order &b) {
-        // If prices are equal, maintain the original order
-        if (a.price == b.price) {
-            return a.insertionOrderAsk < b.insertionOrderAsk; // Compare based on the order of insertion
-        }
-        return a.price < b.price;   // Otherwise, sort by price
-    });
-
-    for (auto it = asks.begin(); it != asks.end(); ++it){
-        if (qty > 0 && qty <= it->quantity) {
-            cout << TICKER << "-> "
-                 << "Quantity available: " << qty << " at " << it->price << " USD" << endl; // make the output look better
-            return "Quote retrieved successfully.";
-        } else if (qty > 0 && qty > it->quantity) {
-            cout << TICKER << "-> "
-                 << "Quantity available: " << it->quantity << " at " << it->price << " USD" << endl;
-            qty -= it->quantity;
-        } else {
-            return "Quote retrieved successfully.";
+    const char *sideNames[2] = {"Buy", "Sell"};
+    for (int side = 0; side < 2; ++side) {
+        SweepQuote quote = quoteSweep(side == 0, qty);
+        cout << instrument.symbol << "-> " << sideNames[side] << " " << instrument.formatQuantity(qty) << ": ";
+        if (quote.quantity == 0) {
+            cout << "nothing available" << endl;
+            continue;
         }
+        cout << instrument.formatQuantity(quote.quantity) << " over " << quote.levels << " levels, VWAP "
+             << formatAtoms((Amount)(quote.averagePrice() * instrument.tickSize + 0.5), instrument.priceDecimals + 2) << ", worst "
+             << instrument.formatPrice(quote.worstPrice) << " " << ledger->assetName(quoteAsset) << ", slippage " << fixed << setprecision(1)
+             << quote.slippageBps() << " bps" << defaultfloat << endl;
     }
 
     cout << "Quote retrieved successfully." << endl;
     return "Quote retrieved successfully.";
 }
 
+/**
+ * @brief Prices a buy of the given quantity against the resting asks without printing
+ * 
+ * @details The cost of the ask sweep from quoteSweep(), so O(log ticks) with the
+ *          cumulative index. Used by the replay driver.
+ * 
+ * @param qty The quantity to buy, in lots
+ * @param available Set to the quantity the asks can actually supply (at most qty)
+ * 
+ * @return Amount USD atoms the available quantity would cost
+ */
+Amount OrderBook::quoteBuy(Quantity qty, Quantity& available) const {
+    SweepQuote quote = quoteSweep(true, qty);
+    available = quote.quantity;
+    return quote.notional;
+}
+
+/**
+ * @brief Prices taking qty from one side of the book, best price first
+ * 
+ * @details A buy sweeps the asks upwards and a sell sweeps the bids downwards. With
+ *          BookConfig::cumulativeDepth this is one descent of the side's Fenwick index,
+ *          however many levels and orders the sweep crosses.
+ * 
+ * @param buy true to buy from the asks, false to sell into the bids
+ * @param qty The quantity, in lots
+ * 
+ * @return SweepQuote Quantity available (at most qty), its notional in ticks and quote
+ *         atoms, best and worst price touched and levels crossed; averagePrice() and
+ *         slippageBps() derive the VWAP and its distance from the best price
+ */
+SweepQuote OrderBook::quoteSweep(bool buy, Quantity qty) const {
+    SweepQuote quote = (buy ? asks : bids).sweep(qty);
+    quote.notional = quote.notionalTicks * instrument.tickLotValue;
+    return quote;
+}
+
+/**
+ * @brief Prices taking everything within bps basis points of the best price
+ * 
+ * @details The limit is the best ask raised (buy) or the best bid lowered (sell) by bps,
+ *          rounded towards the best price onto the tick grid, so nothing past it is counted.
+ * 
+ * @param buy true to buy from the asks, false to sell into the bids
+ * @param bps Distance from the best price, in basis points
+ * 
+ * @return SweepQuote Everything resting between the best price and the limit; quantity 0
+ *         when the side is empty
+ */
+SweepQuote OrderBook::quoteWithin(bool buy, double bps) const {
+    const BookSide &side = buy ? asks : bids;
+    SweepQuote quote = {0, 0, 0, NO_PRICE, NO_PRICE, 0};
+    if (side.empty() || bps < 0) {
+        return quote;
+    }
+    Price offset = (Price)floor(side.best() * bps / 10000.0 + 1e-9);
+    quote = side.sweepTo(buy ? side.best() + offset : side.best() - offset);
+    quote.notional = quote.notionalTicks * instrument.tickLotValue;
+    return quote;
+}
+
+/**
+ * @brief Checksums the resting orders of both sides
+ * 
+ * @details Bids best to worst, then asks best to worst, each level oldest order first.
+ *          Every order contributes its ID, price, quantity and account, so two books
+ *          only match if they hold the same orders in the same queue positions.
+ * 
+ * @return unsigned long long The checksum
+ */
+unsigned long long OrderBook::bookChecksum() const {
+    unsigned long long hash = CHECKSUM_SEED;
+    const BookSide *sides[2] = {&bids, &asks};
+    for (const BookSide *side : sides) {
+        for (Price levelPrice = side->best(); levelPrice != NO_PRICE; levelPrice = side->nextWorse(levelPrice)) {
+            for (OrderIndex slot = side->level(levelPrice).head; slot != NO_ORDER; slot = pool.at(slot).next) {
+                const Order &order = pool.at(slot);
+                hash = mixChecksum(hash, pool.idOf(slot));
+                hash = mixChecksum(hash, (unsigned long long)order.price);
+                hash = mixChecksum(hash, (unsigned long long)order.quantity);
+                hash = mixChecksum(hash, order.account);
+            }
+        }
+        hash = mixChecksum(hash, (unsigned long long)NO_PRICE); // side separator
+    }
+    return hash;
+}
+
+/**
+ * @brief Checksums every balance in the ledger
+ * 
+ * @return unsigned long long The checksum over all accounts and assets, in ID order
+ * 
+ * @note Covers what each account owns, available plus held; how much of it is held
+ *       follows from the resting orders, which bookChecksum() covers
+ */
+unsigned long long OrderBook::balanceChecksum() const {
+    unsigned long long hash = CHECKSUM_SEED;
+    for (AccountId account = 0; account < ledger->accountCount(); ++account) {
+        for (AssetId asset = 0; asset < ledger->assetCount(); ++asset) {
+            hash = mixChecksum(hash, (unsigned long long)ledger->total(account, asset));
+        }
+    }
+    return hash;
+}
+
 /**
  * @brief Displays the full order book depth (all bids and asks)
  * 
  * @details Display format:
- * 1. Sorts asks by price (descending)
- * 2. Sorts bids by price (descending)
+ * 1. Walks ask levels from the highest price down to the best ask
+ * 2. Walks bid levels from the best bid down to the lowest price
  * 3. Shows asks above market (in red)
  * 4. Shows bids below market (in green)
- * 5. Each line shows price and quantity
+ * 5. Each line shows one price level: its total quantity and how many orders make it up
  * 
  * @return string Formatted order book depth string
  * 
  * @note 
- * - Uses ANSI color codes for better visibility
+ * - Uses ANSI color codes for better visibility, once per side
  * - Red for asks (selling)
  * - Green for bids (buying)
- * - Shows full depth of market
- * - Prints to console and returns as string
+ * - Shows full depth of market, aggregated per price; the level totals are kept by the
+ *   book, so no order is visited
+ * - Returns the text without printing it, so it can be timed and logged
  */
 string OrderBook::getDepth() {
-    // Sort asks in descending order of price
-    sort(asks.begin(), asks.end(), [](const Order &a, const Order &b) { 
-        return a.price > b.price; 
-    });
-
-    // Sort bids in descending order of price
-    sort(bids.begin(), bids.end(), [](const Order &a, const Order &b) { 
-        return a.price > b.price; 
-    });
+    unsigned long long stageStart = stageClock();
+    string depthString = instrument.symbol + " Depth:\n";
+    depthString.reserve(64);
 
-    string depthString = TICKER + " Depth:\n";
+    auto addLevel = [this, &depthString](Price levelPrice, const PriceLevel& level) {
+        depthString += "Price: ";
+        depthString += instrument.formatPrice(levelPrice);
+        depthString += ", Quantity: ";
+        depthString += instrument.formatQuantity(level.quantity);
+        depthString += level.orders == 1 ? " (1 order)\n" : " (" + std::to_string(level.orders) + " orders)\n";
+    };
 
-    for (const auto &ask : asks) {
-        depthString += "\x1b[31m"; // Set color to red
-        depthString += "Price: " + std::to_string(ask.price) + ", Quantity: " + std::to_string(ask.quantity) + "\n";
-        depthString += "\x1b[0m"; // Reset color to default
+    // Asks are stored lowest price first, so walk them in reverse to print highest price on top
+    depthString += "\x1b[31m"; // Set color to red
+    for (Price levelPrice = asks.worst(); levelPrice != NO_PRICE; levelPrice = asks.nextBetter(levelPrice)) {
+        addLevel(levelPrice, asks.level(levelPrice));
     }
+    depthString += "\x1b[0m"; // Reset color to default
 
     depthString += "Asks above:\n";
     depthString += "Bids below:\n";
 
-    for (const auto &bid : bids) {
-        depthString += "\x1b[32m"; // Set color to green
-        depthString += "Price: " + std::to_string(bid.price) + ", Quantity: " + std::to_string(bid.quantity) + "\n";
-        depthString += "\x1b[0m"; // Reset color to default
-    }
-
-    cout << depthString << endl;
+    depthString += "\x1b[32m"; // Set color to green
+    bids.forEachLevel(addLevel, (size_t)-1);
+    depthString += "\x1b[0m"; // Reset color to default
+    stageDone(STAGE_DEPTH, stageStart);
     return depthString;
 }
 
+/**
+ * @brief Copies the aggregated top of both sides into a reusable snapshot
+ * 
+ * @param snapshot Receives the levels and the book sequence; its vectors keep their capacity
+ * @param maxLevels Most levels per side
+ * 
+ * @return size_t Levels copied, both sides together
+ * 
+ * @note O(maxLevels): every level already carries its quantity and order count
+ */
+size_t OrderBook::snapshotDepth(DepthSnapshot& snapshot, size_t maxLevels) const {
+    snapshot.sequence = getBookSequence();
+    snapshot.bids.clear();
+    snapshot.asks.clear();
+    const BookSide *sides[2] = {&bids, &asks};
+    std::vector<LevelSummary> *outputs[2] = {&snapshot.bids, &snapshot.asks};
+    for (int s = 0; s < 2; ++s) {
+        std::vector<LevelSummary> &out = *outputs[s];
+        sides[s]->forEachLevel([&out](Price levelPrice, const PriceLevel& level) {
+            LevelSummary summary = {levelPrice, level.quantity, level.orders};
+            out.push_back(summary);
+        }, maxLevels);
+    }
+    return snapshot.bids.size() + snapshot.asks.size();
+}
+
 /**
  * @brief Retrieves and displays all balances for a user
  * 
  * @details Balance display:
  * 1. Checks if user exists
- * 2. Shows all currency/stock balances
- * 3. Formats numbers with 2 decimal places
+ * 2. Shows all currency/stock balances, available and held by open orders
+ * 3. Shows the open orders and notional against the account's limits
+ * 4. Formats amounts with the full 8 decimal ledger precision
  * 
- * @param username The username whose balance to check
+ * @param account The account whose balance to check
  * 
  * @return string Status message:
  *         - "Balance retrieved successfully" if user exists
- *         - "User {username} does not exist" if not found
+ *         - "Account {account} does not exist" if not found
  * 
  * @note 
  * - Shows all assets (USD, GOOGL, etc.)
- * - Uses fixed precision (2 decimals)
+ * - Balances are exact integers (atoms), printed with 8 decimals
  * - Prints balances to console
  */
-string OrderBook::getBalance(std::string username) {
-    if (users.find(username) != users.end()) {
+string OrderBook::getBalance(AccountId account) {
+    if (ledger->isAccount(account)) {
         cout << "User found" << endl;
         cout << "User balance is as follows: " << endl;
-        for (auto it = users[username].userBalance.balance.begin(); it != users[username].userBalance.balance.end(); ++it) {
-            cout << it->first << ": " << fixed << setprecision(2) << it->second << endl;
+        for (AssetId asset = 0; asset < ledger->assetCount(); ++asset) {
+            cout << ledger->assetName(asset) << ": " << formatAtoms(ledger->balance(account, asset)) << " available, "
+                 << formatAtoms(ledger->held(account, asset)) << " held" << endl;
+        }
+        const AccountRisk &risk = ledger->risk(account);
+        cout << "Open orders: " << risk.openOrders;
+        if (risk.maxOpenOrders != NO_ORDER_LIMIT) {
+            cout << " of " << risk.maxOpenOrders;
         }
+        cout << ", open notional: " << formatAtoms(risk.openNotional);
+        if (risk.maxOpenNotional != NO_NOTIONAL_LIMIT) {
+            cout << " of " << formatAtoms(risk.maxOpenNotional);
+        }
+        cout << " " << ledger->assetName(quoteAsset) << endl;
         return "Balance retrieved successfully.";
     } else {
-        return "User " + username + " does not exist.";
+        return "Account " + std::to_string(account) + " does not exist.";
     }
 }
 
@@ -516,156 +1154,289 @@ string OrderBook::getBalance(std::string username) {
  * 
  * @details Balance addition process:
  * 1. Validates user existence
- * 2. Adds specified value to the market balance
- * 3. Creates new balance entry if market doesn't exist
+ * 2. Looks up the market's asset ID, registering the asset if it is new
+ * 3. Adds specified value to the market balance
  * 
- * @param Username The username to add balance to
+ * @param account The account to add balance to
  * @param market The market/currency to add (e.g., "USD", "GOOGL")
- * @param value The amount to add to the balance
+ * @param value The amount to add to the balance, in atoms (1e-8 units)
  * 
  * @return string Status message:
  *         - "Balance added successfully" if successful
  *         - "User not found" if user doesn't exist
+ *         - an explanation if the value is not positive, would overflow the balance or the
+ *           ledger has no free asset column
  * 
  * @note 
  * - Can add both USD and stock balances
  * - Creates new market balance if not existing
- * - Prints status message to console
+ * - Only ever adds: a value of zero or less is refused, it would take from the balance
  */
-string OrderBook::addBalance(std::string Username, std::string market, int value) {
-    if (users.find(Username) != users.end()) {
-        users[Username].userBalance.addBalances(market, value);
-        cout << "Balance added successfully" << endl;
+string OrderBook::addBalance(AccountId account, std::string market, Amount value) {
+    if (journal != nullptr) {
+        journal->recordName(JOURNAL_DEPOSIT, account, value, market);
+    }
+    if (value <= 0) {
+        return "Balance value must be positive";
+    }
+    if (ledger->isAccount(account)) {
+        AssetId asset = ledger->addAsset(market);
+        if (asset == INVALID_ASSET) {
+            return "Cannot add balance in " + market + ", the ledger already holds " + std::to_string(ledger->maxAssets()) + " assets.";
+        }
+        if (value > MAX_AMOUNT - ledger->balance(account, asset)) {
+            return "Cannot add balance in " + market + ", it would exceed " + formatAtoms(MAX_AMOUNT);
+        }
+        ledger->balance(account, asset) += value;
         return "Balance added successfully";
     }
 
-    cout << "User not found!! Please enter the right Username to add balance!" << endl;
     return "User not found";
 }
 
 /**
- * @brief Main function implementing the trading platform interface
+ * @brief Returns the available balance of one asset of an account
  * 
- * @details Menu options:
- * 1. Sign Up User - Create new trading account
- * 2. Add Balance - Add funds/stocks to user account
- * 3. Check Market Prices - View order book depth
- * 4. Add Bid - Place buy order
- * 5. Add Ask - Place sell order
- * 6. Get Quote - Check price for quantity
- * 7. Check Balance - View user balances
- * 8. Cancel Bid - Cancel buy order
- * 9. Cancel Ask - Cancel sell order
- * 10. Exit - Close platform
+ * @param account The account to look at
+ * @param market The asset name (e.g., "USD", "GOOGL")
  * 
- * @return int Exit status (0 for normal exit)
+ * @return Amount Balance in atoms not held by open orders, 0 if the account or asset is unknown
+ */
+Amount OrderBook::balanceOf(AccountId account, const std::string& market) const {
+    AssetId asset = ledger->findAsset(market);
+    if (!ledger->isAccount(account) || asset == INVALID_ASSET) {
+        return 0;
+    }
+    return readBalance(account, asset);
+}
+
+/**
+ * @brief Returns the balance of one asset an account's open orders hold
  * 
- * @note 
- * - Creates initial market makers on startup
- * - Runs in continuous loop until exit
- * - Handles all user input validation
- */
-int main() {
-    OrderBook EXCH;
-
-    string market;
-    int choice;
-    string username;
-    int price, quantity;
-
-    cout << "\n=========== " <<"WELCOME TO THE " << TICKER << " MARKET " << " =========== \n\n" << endl;
-    cout << "\n=========== " << "CURRENT MARKET PRICES " << " =========== " << endl;
-    EXCH.getDepth(); // getDepth() is called to display the current market
-
-    while (true) {
-        cout << "\n=========== " << TICKER << " Trading Platform ===========\n\n";
-        cout << "\n========== Trading Platform Menu ==========\n";
-        cout << "1. Sign Up User\n";
-        cout << "2. Add Balance to User Account\n";
-        cout << "3. Check Current Market Prices\n";
-        cout << "4. Add Bid to " << TICKER << " v USD market\n";
-        cout << "5. Sell your stocks in " << TICKER << " v USD Market\n";
-        cout << "6. Get Current Quote to buy " << TICKER << " stocks\n";
-        cout << "7. Check your current User Balance\n";
-        cout << "8. Cancel Bid\n";
-        cout << "9. Cancel Ask\n";
-        cout << "10. Exit\n\n";
-        cout << "Enter your choice: ";
-
-        cin >> choice;
-
-        switch (choice) {
-            case 1:
-                cout << "Enter username for new user: \n";
-                cin >> username;
-                EXCH.makeUser(username);
-                break;
-            case 2:
-                cout << "Enter username to add balance: \n";
-                cin >> username;
-                cout << "Enter market (e.g., USD): \n";
-                cin >> market;
-                cout << "Enter balance value: \n";
-                int value;
-                cin >> value;
-                EXCH.addBalance(username, market, value);
-                break;
-            case 3:
-                EXCH.getDepth();
-                break;
-            case 4:
-                cout << "Enter username for bid: \n";
-                cin >> username;
-                cout << "Enter bid price: \n";
-                cin >> price;
-                cout << "Enter bid quantity: \n";
-                cin >> quantity;
-                EXCH.addBid(username, price, quantity);
-                break;
-            case 5:
-                cout << "Enter username for ask: \n";
-                cin >> username;
-                cout << "Enter ask price: \n";
-                cin >> price;
-                cout << "Enter ask quantity: \n";
-                cin >> quantity;
-                EXCH.addAsk(username, price, quantity);
-                break;
-            case 6:
-                cout << "Enter quantity for quote: \n";
-                cin >> quantity;
-                EXCH.getQuote(quantity);
-                break;
-            case 7:
-                cout << "Enter username to get balance: \n";
-                cin >> username;
-                EXCH.getBalance(username);
-                break;
-            case 8:
-                cout << "Enter username to cancel bid: \n";
-                cin >> username;
-                cout << "Enter bid price: \n";
-                cin >> price;
-                cout << "Enter bid quantity: \n";
-                cin >> quantity;
-                EXCH.cancelBid(username, price, quantity);
-                break;
-            case 9:
-                cout << "Enter username to cancel ask: \n";
-                cin >> username;
-                cout << "Enter ask price: \n";
-                cin >> price;
-                cout << "Enter ask quantity: \n";
-                cin >> quantity;
-                EXCH.cancelAsk(username, price, quantity);
-                break;
-            case 10:
-                cout << "Exiting the trading platform. Goodbye!\n\n";
-                return 0;
-            default:
-                cout << "Invalid choice. Please try again.\n\n";
+ * @param account The account to look at
+ * @param market The asset name (e.g., "USD", "GOOGL")
+ * 
+ * @return Amount Held atoms, 0 if the account or asset is unknown
+ */
+Amount OrderBook::heldOf(AccountId account, const std::string& market) const {
+    AssetId asset = ledger->findAsset(market);
+    if (!ledger->isAccount(account) || asset == INVALID_ASSET) {
+        return 0;
+    }
+    return sharedLedger ? ledger->heldBalance(account, asset) : ledger->held(account, asset);
+}
+
+/**
+ * @brief Sets the pre-trade limits of an account
+ * 
+ * @details Checked on every new order: the account may have at most maxOpenOrders orders
+ *          open, and their open quantity at their limit prices may come to at most
+ *          maxOpenNotional quote atoms, over every book sharing the ledger. Orders already
+ *          open are left alone, even if they are now past the limits.
+ * 
+ * @param account The account to limit
+ * @param maxOpenOrders Most open orders, NO_ORDER_LIMIT for no limit
+ * @param maxOpenNotional Most open notional in quote atoms, NO_NOTIONAL_LIMIT for no limit
+ * 
+ * @return bool false if the account does not exist or a limit is negative
+ * 
+ * @note On an exchange whose books quote in different assets the open notional adds up
+ *       atoms of each; give such accounts limits in terms of the quote assets they use
+ */
+bool OrderBook::setLimits(AccountId account, unsigned int maxOpenOrders, Amount maxOpenNotional) {
+    if (journal != nullptr) {
+        journal->record(JOURNAL_SET_LIMITS, account, (Price)maxOpenOrders, maxOpenNotional, INVALID_ORDER_ID);
+    }
+    if (!ledger->isAccount(account) || maxOpenNotional < 0) {
+        return false;
+    }
+    ledger->setLimits(account, maxOpenOrders, maxOpenNotional);
+    return true;
+}
+
+/**
+ * @brief Writes the whole state of the book to a snapshot
+ * 
+ * @details Ledger names, balances (available and held) and account limits, the order pool as it is (slots, links, generations
+ *          and free list, so every order keeps its ID and the next IDs handed out are the
+ *          same), the occupied levels of both sides and the sequence counters. Nothing is
+ *          allocated, so a forked child can call this; see SnapshotWriter.
+ * 
+ * @param sink Where the bytes go
+ * @param journalSequence Last journal record the book reflects, stored for recovery
+ * 
+ * @return bool false if the book shares its ledger (other books own part of its state)
+ *         or the sink failed
+ */
+bool OrderBook::writeSnapshot(SnapshotSink& sink, unsigned long long journalSequence) const {
+    if (sharedLedger) {
+        return false;
+    }
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    memcpy(header.symbol, instrument.symbol.data(), instrument.symbol.size() < sizeof(header.symbol) ? instrument.symbol.size() : sizeof(header.symbol));
+    header.tickSize = instrument.tickSize;
+    header.lotSize = instrument.lotSize;
+    header.poolCapacity = pool.capacity();
+    header.minPrice = bids.lowestPrice();
+    header.maxPrice = bids.highestPrice();
+    header.journalSequence = journalSequence;
+    header.eventSequence = eventSequence;
+    header.bidChanges = bids.changeCount();
+    header.askChanges = asks.changeCount();
+    header.accounts = ledger->accountCount();
+    header.assets = ledger->assetCount();
+    header.maxAssets = ledger->maxAssets();
+    header.freeHead = pool.freeList();
+    header.inUse = pool.size();
+    header.highWater = pool.peak();
+    auto countLevel = [](Price, const PriceLevel&) {};
+    header.bidLevels = bids.forEachLevel(countLevel, (size_t)-1);
+    header.askLevels = asks.forEachLevel(countLevel, (size_t)-1);
+    sink.put(&header, sizeof(header));
+
+    auto putName = [&sink](const std::string& name) {
+        unsigned int length = (unsigned int)name.size();
+        sink.put(&length, sizeof(length));
+        sink.put(name.data(), length);
+    };
+    for (AssetId asset = 0; asset < ledger->assetCount(); ++asset) {
+        putName(ledger->assetName(asset));
+    }
+    for (AccountId account = 0; account < ledger->accountCount(); ++account) {
+        putName(ledger->accountName(account));
+    }
+    if (ledger->accountCount() > 0) {
+        sink.put(&ledger->balance(0, 0), ledger->accountCount() * ledger->maxAssets() * sizeof(Amount)); // rows are contiguous
+        sink.put(&ledger->held(0, 0), ledger->accountCount() * ledger->maxAssets() * sizeof(Amount));
+        sink.put(&ledger->risk(0), ledger->accountCount() * sizeof(AccountRisk));
+    }
+
+    sink.put(pool.orderData(), pool.capacity() * sizeof(Order));
+    sink.put(pool.linkData(), pool.capacity() * sizeof(OrderLinks));
+    auto putLevel = [&sink](Price levelPrice, const PriceLevel& level) {
+        SnapshotLevel saved = {levelPrice, level.quantity, level.head, level.tail, level.orders, 0};
+        sink.put(&saved, sizeof(saved));
+    };
+    bids.forEachLevel(putLevel, (size_t)-1);
+    asks.forEachLevel(putLevel, (size_t)-1);
+    sink.put(SNAPSHOT_END_MAGIC, sizeof(SNAPSHOT_END_MAGIC));
+    return sink.ok();
+}
+
+/**
+ * @brief Replaces the whole state of the book with a snapshot
+ * 
+ * @details The book must have been constructed with the same instrument and BookConfig
+ *          as the one the snapshot was taken of. Levels are put back directly, so loading
+ *          is a few bulk reads plus O(levels), however many orders rest.
+ * 
+ * @param source The snapshot, positioned at its start
+ * @param journalSequence Set to the last journal record the snapshot reflects
+ * @param error Set to the reason on failure
+ * 
+ * @return bool false if the snapshot does not fit this book or is damaged; once the
+ *         checks on the header have passed, a failure leaves the book unusable
+ */
+bool OrderBook::readSnapshot(SnapshotSource& source, unsigned long long& journalSequence, string& error) {
+    SnapshotHeader header;
+    if (sharedLedger) {
+        error = "a book on a shared ledger cannot be restored on its own";
+        return false;
+    }
+    if (!source.get(&header, sizeof(header)) || memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+        error = "not a snapshot";
+        return false;
+    }
+    string symbol(header.symbol, strnlen(header.symbol, sizeof(header.symbol)));
+    if (symbol != instrument.symbol || header.tickSize != instrument.tickSize || header.lotSize != instrument.lotSize) {
+        error = "snapshot of " + symbol + ", not of " + instrument.symbol;
+        return false;
+    }
+    if (header.poolCapacity != pool.capacity() || header.minPrice != bids.lowestPrice() || header.maxPrice != bids.highestPrice()
+        || header.maxAssets != ownLedger.maxAssets() || header.inUse > header.poolCapacity) {
+        error = "snapshot taken with a different order capacity, price band or asset count";
+        return false;
+    }
+    // The counts are not trusted: what they size is only allocated once the file is known
+    // to be long enough to hold it
+    unsigned long long bandLevels = (unsigned long long)(bids.highestPrice() - bids.lowestPrice() + 1);
+    if (header.assets > header.maxAssets || header.accounts >= INVALID_ACCOUNT || header.bidLevels > bandLevels || header.askLevels > bandLevels) {
+        error = "damaged snapshot header";
+        return false;
+    }
+    unsigned long long accountBytes = sizeof(unsigned int) + 2 * header.maxAssets * sizeof(Amount) + sizeof(AccountRisk); // name length, balances, holds, risk
+    unsigned long long otherBytes = header.assets * sizeof(unsigned int) + header.poolCapacity * (sizeof(Order) + sizeof(OrderLinks)) +
+                                    (header.bidLevels + header.askLevels) * sizeof(SnapshotLevel) + sizeof(SNAPSHOT_END_MAGIC);
+    long long remaining = source.remaining();
+    if (remaining >= 0 && (otherBytes > (unsigned long long)remaining || header.accounts > ((unsigned long long)remaining - otherBytes) / accountBytes)) {
+        error = "truncated snapshot";
+        return false;
+    }
+
+    Ledger restored(header.maxAssets);
+    restored.reserveAccounts(header.accounts);
+    std::string name;
+    auto getName = [&source, &name]() {
+        unsigned int length = 0;
+        if (!source.get(&length, sizeof(length)) || length > (1u << 20)) {
+            return false;
+        }
+        name.resize(length);
+        return length == 0 || source.get(&name[0], length);
+    };
+    for (unsigned long long i = 0; i < header.assets; ++i) {
+        if (!getName() || restored.addAsset(name) != (AssetId)i) {
+            error = "damaged asset table";
+            return false;
         }
     }
+    for (unsigned long long i = 0; i < header.accounts; ++i) {
+        if (!getName() || restored.addAccount(name) != (AccountId)i) {
+            error = "damaged account table";
+            return false;
+        }
+    }
+    if (header.accounts > 0 && (!source.get(&restored.balance(0, 0), header.accounts * header.maxAssets * sizeof(Amount)) ||
+                                !source.get(&restored.held(0, 0), header.accounts * header.maxAssets * sizeof(Amount)) ||
+                                !source.get(&restored.risk(0), header.accounts * sizeof(AccountRisk)))) {
+        error = "truncated balance table";
+        return false;
+    }
 
-    return 0;
-}
\ No newline at end of file
+    // From here on the book is overwritten
+    if (!source.get(pool.orderData(), pool.capacity() * sizeof(Order)) || !source.get(pool.linkData(), pool.capacity() * sizeof(OrderLinks))) {
+        error = "truncated order pool";
+        return false;
+    }
+    pool.restoreState((OrderIndex)header.freeHead, header.inUse, header.highWater);
+    BookSide *sides[2] = {&bids, &asks};
+    unsigned long long counts[2] = {header.bidLevels, header.askLevels};
+    for (int s = 0; s < 2; ++s) {
+        BookSide &side = *sides[s];
+        side.init(s == 0, side.lowestPrice(), side.highestPrice(), side.isIndexed());
+        for (unsigned long long i = 0; i < counts[s]; ++i) {
+            SnapshotLevel saved;
+            if (!source.get(&saved, sizeof(saved)) || !side.inBand(saved.price) || saved.head >= pool.capacity() || saved.tail >= pool.capacity()) {
+                error = "damaged price levels";
+                return false;
+            }
+            PriceLevel level = {saved.head, saved.tail, saved.orders, saved.quantity};
+            side.restoreLevel(saved.price, level);
+        }
+    }
+    char end[sizeof(SNAPSHOT_END_MAGIC)];
+    if (!source.get(end, sizeof(end)) || memcmp(end, SNAPSHOT_END_MAGIC, sizeof(end)) != 0) {
+        error = "truncated snapshot";
+        return false;
+    }
+    bids.restoreChangeCount(header.bidChanges);
+    asks.restoreChangeCount(header.askChanges);
+    ownLedger = std::move(restored);
+    quoteAsset = ownLedger.findAsset("USD");
+    baseAsset = ownLedger.findAsset(instrument.symbol);
+    eventSequence = header.eventSequence;
+    journalSequence = header.journalSequence;
+    return true;
+}
@@ -2,96 +2,224 @@
 #define ORDERBOOK_HPP
 
 #include <string>
-#include <unordered_map>
 #include <vector>
+#include "checksum.hpp"
+#include "engineMetrics.hpp"
+#include "fixedPoint.hpp"
+#include "executionEvents.hpp"
+#include "ledger.hpp"
+#include "orderPool.hpp"
+#include "priceLadder.hpp"
+
+class Journal; // persistence.hpp
+class SnapshotSink;
+class SnapshotSource;
+
+// ticker of the stock traded by the default, self-contained book
+const std::string TICKER = "GOOGL";
+
+// Sizes everything the book preallocates, so the matching path never has to grow anything
+struct BookConfig {
+    size_t orderCapacity; // how many orders can rest at once (rounded up to a power of two)
+    Price minPrice; // lowest price accepted, in ticks
+    Price maxPrice; // highest price accepted, in ticks
+    bool cumulativeDepth; // keep a Fenwick index per side so sweep quotes are O(log ticks)
+
+    BookConfig() {
+        orderCapacity = 1 << 16;
+        minPrice = 1; // 0.01 USD
+        maxPrice = 100000; // 1000.00 USD
+        cumulativeDepth = true;
+    }
+};
 
-// ticker for the stock being traded
-std::string TICKER = "GOOGL";
+// Best bid and ask with their level totals, stamped with the book's sequence number
+struct BookTop {
+    LevelSummary bid; // price NO_PRICE when there are no bids
+    LevelSummary ask; // price NO_PRICE when there are no asks
+    unsigned long long sequence; // OrderBook::getBookSequence() when taken
+};
 
-struct Balance {
-    std::unordered_map<std::string, double> balance; // STORES USD : VALUE, GOOGL : VALUE
+// Aggregated depth of both sides, best level first. Reuse one across snapshots so taking
+// a snapshot only copies levels.
+struct DepthSnapshot {
+    unsigned long long sequence; // OrderBook::getBookSequence() when taken
+    std::vector<LevelSummary> bids;
+    std::vector<LevelSummary> asks;
+};
 
-    Balance() {
-        balance["USD"] = 0.0;
-        balance[TICKER] = 0.0;
-    }
+// Side of an order; the matching kernel is compiled once per side
+enum Side {
+    SIDE_BID,
+    SIDE_ASK
+};
 
-    Balance(std::string stock, double value) {
-        balance[stock] = value;
+// How long an order may live and at what price it trades; the matching kernel is compiled
+// once per type
+enum OrderType {
+    ORDER_LIMIT, // trades up to its limit price, the rest rests in the book
+    ORDER_IOC, // immediate or cancel: trades up to its limit price, the rest is cancelled
+    ORDER_FOK, // fill or kill: trades its whole quantity up to its limit price, or is refused
+    ORDER_MARKET // trades against whatever rests, the rest is cancelled; the price is ignored
+};
+const unsigned int ORDER_TYPES = ORDER_MARKET + 1;
+
+// Name of an order type as the text front ends spell it
+inline const char* orderTypeText(OrderType type) {
+    switch (type) {
+        case ORDER_LIMIT: return "limit";
+        case ORDER_IOC: return "ioc";
+        case ORDER_FOK: return "fok";
+        case ORDER_MARKET: return "market";
     }
-
-    std::string addBalances(std::string stock, double value) {
-        // if balance map contains the stock, add the value to the balance
-        if (balance.find(stock) != balance.end()) {
-            balance[stock] += value;
-            return "Balance added successfully";
+    return "unknown";
+}
+
+// Order type from its name, false if there is no such type
+inline bool parseOrderType(const std::string& text, OrderType& type) {
+    for (unsigned int candidate = 0; candidate < ORDER_TYPES; ++candidate) {
+        if (text == orderTypeText((OrderType)candidate)) {
+            type = (OrderType)candidate;
+            return true;
         }
-        balance[stock] = value;
-        return "Balance added successfully";
     }
+    return false;
+}
+
+// Commands of OrderBook::submitBatch
+enum BookCommandType {
+    BOOK_BID = 1,
+    BOOK_ASK,
+    BOOK_CANCEL,
+    BOOK_REDUCE,
+    BOOK_REPLACE
 };
 
-struct User {
-    std::string userName;
-    Balance userBalance;
-
-    User(){};
-
-    User(std::string name, Balance b) {
-        userName = name;
-        userBalance = b;
-    }
-
-    User(std::string name) {
-        userName = name;
-        userBalance = Balance(); // default balance is 1000 USD and 0 GOOGL    
-    }
+// One command of a batch; the fields each type uses are those of the single-order call
+struct BookCommand {
+    unsigned char type; // BookCommandType
+    unsigned char orderType; // OrderType of a bid or ask, ORDER_LIMIT (0) otherwise
+    unsigned char reserved[2];
+    AccountId account; // bid, ask
+    Price price; // bid, ask, replace
+    Quantity quantity; // bid, ask, reduce, replace
+    OrderId orderId; // cancel, reduce, replace
 };
 
-struct Order {
-    std::string userName;
-    std::string orderType; // BID or ASK
-    double price;
-    int quantity;
-    
-    static int orderCounterBid; // Declare a static counter to keep track of the order number
-    static int orderCounterAsk; // Declare a static counter to keep track of the order number
-    int insertionOrderBid; // To keep track of the insertion order for BID orders. Order in which the order was inserted into the order book
-    int insertionOrderAsk; // To keep track of the insertion order for ASK orders. Order in which the order was inserted into the order book
-
-    Order(std::string user, std::string type, double p, int q) {
-        userName = user;
-        orderType = type;
-        price = p;
-        quantity = q;
-        if (orderType == "BID") {
-            insertionOrderBid = orderCounterBid++; // Increment the counter and assign it to the order
-        } else if (orderType == "ASK") {
-            insertionOrderAsk = orderCounterAsk++; // Increment the counter and assign it to the order
-        }
-    }
+// What one command of a batch came to, packed so a batch's results fit a few cache lines
+struct BookResult {
+    OrderId orderId; // ID returned by addBid/addAsk/replace, the ID itself for a cancel or reduce; INVALID_ORDER_ID if refused
+    unsigned char reason; // RejectReason of the refusal, REJECT_NONE when the command went through
+    unsigned char reserved[7];
 };
 
 class OrderBook {
     private:
-    std::vector<Order> bids; // stores all the BID orders
-    std::vector<Order> asks; // stores all the ASK orders
-    std::unordered_map<std::string, User> users; // stores all the users
-    void flipBalance(const std::string& userId1, const std::string& userId2, double quantity, double price);
+    InstrumentSpec instrument; // symbol, tick and lot size of the traded instrument
+    OrderPool pool; // storage for every resting order, its slots double as order IDs
+    BookSide bids; // stores all the BID orders grouped by price level
+    BookSide asks; // stores all the ASK orders grouped by price level
+    Ledger ownLedger; // accounts and balances of a self-contained book, unused when the ledger is shared
+    Ledger* ledger; // accounts and their balances, ownLedger or one shared by many books
+    bool sharedLedger; // balances are settled with atomic operations, other threads may be settling too
+    AssetId quoteAsset; // asset paid for the instrument (USD)
+    AssetId baseAsset; // the instrument itself (TICKER)
+    ExecutionListener* listener; // receives execution reports, none by default
+    unsigned long long eventSequence; // sequence number of the last execution report
+    RejectReason lastReason; // reason of the last report, tells a batch why a command was refused
+    Journal* journal; // every command is appended here before it runs, none by default
+    EngineMetrics* metrics; // stage latencies and counters, none by default; only used when METRICS_ENABLED
+    bool flipBalance(AccountId buyer, AccountId seller, Quantity quantity, Price price, Price buyerLimit, Price sellerLimit); // settles a fill from held funds
+    RejectReason reserve(AccountId account, bool isBid, Price price, Quantity qty); // risk checks and holds for an incoming order
+    void unreserve(AccountId account, bool isBid, Price price, Quantity qty, bool closes); // gives back what qty of an open order held
+    void closeOrder(AccountId account) { // an open order filled completely
+        if (sharedLedger) {
+            ledger->closeOpen(account, 1, 0);
+        } else {
+            --ledger->risk(account).openOrders;
+        }
+    }
+    void report(EventType type, RejectReason reason, bool isBid, OrderId id, AccountId account, Price price, Quantity qty, Quantity leaves,
+                OrderId contraId = INVALID_ORDER_ID, AccountId contraAccount = INVALID_ACCOUNT); // emits one execution report
+    OrderId restOrder(BookSide& side, AccountId account, Price price, Quantity qty); // rests an order without matching, used to seed the book
+    void removeOrder(OrderIndex slot); // unlinks a resting order, drops its level if empty and frees the slot
+    template <Side side, OrderType type>
+    OrderId submitOrder(AccountId account, Price price, Quantity qty); // the matching kernel, one instance per side and type
+    unsigned long long stageClock() const { return METRICS_ENABLED && metrics != nullptr ? readTimestamp() : 0; } // start of a timed stage
+    unsigned long long stageDone(MetricsStage stage, unsigned long long start) { // records a stage, returns the start of the next one
+        if (!METRICS_ENABLED || metrics == nullptr) {
+            return 0;
+        }
+        unsigned long long now = readTimestamp();
+        metrics->recordStage(stage, start, now);
+        return now;
+    }
+    void noteDepth() { // refreshes the depth gauges after a command
+        if (METRICS_ENABLED && metrics != nullptr) {
+            metrics->setDepth(pool.size(), bids.levelCount(), asks.levelCount());
+        }
+    }
+    Amount readBalance(AccountId account, AssetId asset) const { // one balance cell, read atomically on a shared ledger
+        return sharedLedger ? ledger->availableBalance(account, asset) : ledger->balance(account, asset);
+    }
 
     public:
-    OrderBook(); 
+    OrderBook(const BookConfig& config = BookConfig()); // the GOOGL/USD book, seeded with three market makers
+    OrderBook(const InstrumentSpec& spec, Ledger& shared, AssetId base, AssetId quote, const BookConfig& config = BookConfig()); // empty book on a shared ledger
+    OrderBook(const OrderBook&) = delete; // ledger may point into the book itself
+    OrderBook& operator=(const OrderBook&) = delete;
     ~OrderBook() {}; 
 
-    std::string addBid(std::string Username, double Price, int Quantity); // adds a bid or ask to the order book
-    std::string addAsk(std::string Username, double Price, int Quantity); // adds a bid or ask to the order book
-    void cancelBid(std::string Username, double Price, int Quantity); // cancels a bid or ask from the order book
-    void cancelAsk(std::string Username, double Price, int Quantity); // cancels a bid or ask from the order book
-    std::string getBalance(std::string username); // returns the balance of a user
-    std::string getQuote(int qty); // returns the best bid and ask prices and quantities
-    std::string getDepth(); // returns the entire order book and shows all bids and asks
-    std::string makeUser(std::string); // creates a new user for people trying to join the market
-    std::string addBalance(std::string Username, std::string market, int value); // adds balance to a user
+    // Prices are in ticks and quantities in lots of the instrument, see getInstrument()
+    OrderId addBid(AccountId account, Price price, Quantity qty); // adds a bid to the order book, returns its ID
+    OrderId addAsk(AccountId account, Price price, Quantity qty); // adds an ask to the order book, returns its ID
+    OrderId addOrder(Side side, OrderType type, AccountId account, Price price, Quantity qty); // any side and type, returns its ID
+    bool cancelBid(AccountId account, Price price, Quantity qty); // cancels a bid or ask from the order book
+    bool cancelAsk(AccountId account, Price price, Quantity qty); // cancels a bid or ask from the order book
+    bool cancel(OrderId id); // removes a resting order by ID
+    bool reduce(OrderId id, Quantity qty); // reduces a resting order by ID, keeping its time priority
+    OrderId replace(OrderId id, Price price, Quantity qty); // changes price/quantity of a resting order by ID
+    size_t submitBatch(const BookCommand* commands, size_t count, BookResult* results); // runs commands in order, one result each
+    std::string getBalance(AccountId account); // returns the balance of a user
+    std::string getQuote(Quantity qty); // returns the best bid and ask prices and quantities
+    std::string getDepth(); // returns the entire order book, all bids and asks, one line per price level
+    unsigned long long getBookSequence() const { return bids.changeCount() + asks.changeCount(); } // grows with every change to a level
+    BookTop getTop() const { // best bid and ask, O(1)
+        BookTop top = {bids.bestLevel(), asks.bestLevel(), getBookSequence()};
+        return top;
+    }
+    size_t snapshotDepth(DepthSnapshot& snapshot, size_t maxLevels) const; // top maxLevels levels of each side, O(maxLevels)
+    const BookSide& getBids() const { return bids; } // zero-copy level view, see BookSide::forEachLevel
+    const BookSide& getAsks() const { return asks; }
+    Amount quoteBuy(Quantity qty, Quantity& available) const; // USD atoms to buy qty from the asks, without printing
+    SweepQuote quoteSweep(bool buy, Quantity qty) const; // VWAP, worst price and slippage to buy or sell qty, O(log ticks)
+    SweepQuote quoteWithin(bool buy, double bps) const; // everything tradable within bps of the best price, O(log ticks)
+    unsigned long long bookChecksum() const; // checksum of every resting order in priority order
+    unsigned long long balanceChecksum() const; // checksum of every balance cell of the ledger
+    AccountId makeUser(std::string); // creates a new user for people trying to join the market, returns its account ID
+    AccountId findUser(const std::string& username) const { return ledger->findAccount(username); } // account ID of a user name
+    std::string addBalance(AccountId account, std::string market, Amount value); // adds balance (in atoms) to a user
+    Amount balanceOf(AccountId account, const std::string& market) const; // available balance of one asset, in atoms
+    Amount heldOf(AccountId account, const std::string& market) const; // balance of one asset held by open orders, in atoms
+    bool setLimits(AccountId account, unsigned int maxOpenOrders, Amount maxOpenNotional); // pre-trade limits of an account, NO_*_LIMIT for none
+    AccountRisk getRisk(AccountId account) const { return ledger->risk(account); } // open orders, open notional and limits of a valid account
+    const InstrumentSpec& getInstrument() const { return instrument; } // tick/lot size used to convert prices and quantities
+    void setListener(ExecutionListener* eventListener) { listener = eventListener; } // where execution reports go, nullptr to drop them
+    ExecutionListener* getListener() const { return listener; }
+    const std::string& getUserName(AccountId account) const { return ledger->accountName(account); } // user name of a valid account
+    AssetId getBaseAsset() const { return baseAsset; }
+    AssetId getQuoteAsset() const { return quoteAsset; }
+    const OrderPool& getPool() const { return pool; } // occupancy of the preallocated order storage
+    AccountId ownerOf(OrderId id) const { // account of a resting order, INVALID_ACCOUNT if it is not resting
+        OrderIndex slot = pool.find(id);
+        return slot == NO_ORDER ? INVALID_ACCOUNT : pool.at(slot).account;
+    }
+    void setJournal(Journal* commandJournal) { journal = commandJournal; } // where commands are journaled, nullptr to stop
+    Journal* getJournal() const { return journal; }
+    void setMetrics(EngineMetrics* engineMetrics) { metrics = engineMetrics; } // where stages and counters go, nullptr to stop; a no-op without ORDERBOOK_METRICS
+    EngineMetrics* getMetrics() const { return metrics; }
+    bool writeSnapshot(SnapshotSink& sink, unsigned long long journalSequence) const; // the whole state, without allocating
+    bool readSnapshot(SnapshotSource& source, unsigned long long& journalSequence, std::string& error); // replaces the whole state
 };
 
 #endif // ORDERBOOK_HPP
\ No newline at end of file
@@ -0,0 +1,337 @@
+#include "benchmarkSupport.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Book depths to measure at and the shape of the flow that keeps them there
+struct BenchmarkConfig {
+    vector<size_t> depths; // resting orders to build the book up to before measuring
+    size_t operations; // timed operations per scenario
+    Price levels; // price levels per side the resting orders are spread over
+    int aggressivePercent; // share of aggressive orders in the mixed scenario
+    bool cumulativeDepth; // BookConfig::cumulativeDepth of the books under test
+    unsigned long long seed;
+
+    BenchmarkConfig() {
+        depths = {10, 1000, 100000, 1000000};
+        operations = 200000;
+        levels = 1000;
+        aggressivePercent = 20;
+        cumulativeDepth = true;
+        seed = 42;
+    }
+};
+
+// Latencies of one scenario, in nanoseconds
+struct LatencySample {
+    vector<unsigned int> nanos;
+
+    void add(chrono::steady_clock::time_point start, chrono::steady_clock::time_point end) {
+        nanos.push_back((unsigned int)chrono::duration_cast<chrono::nanoseconds>(end - start).count());
+    }
+
+    unsigned int percentile(double p) {
+        size_t rank = (size_t)(p / 100.0 * (nanos.size() - 1));
+        nth_element(nanos.begin(), nanos.begin() + rank, nanos.end());
+        return nanos[rank];
+    }
+};
+
+/**
+ * @brief A book filled to a given depth plus the state needed to keep it there
+ *
+ * @details Passive bids rest on the `levels` ticks below BENCHMARK_MID_PRICE and passive
+ *          asks on the `levels` ticks above it, so a passive order never crosses and an
+ *          aggressive order priced at the far end of the other side always does.
+ */
+class BenchmarkBook {
+    public:
+    unique_ptr<OrderBook> ownedBook;
+    OrderBook& book; // *ownedBook
+    AccountId bidder; // places every bid
+    AccountId asker; // places every ask
+    vector<OrderId> resting; // IDs of the orders placed by the benchmark (some may have been filled)
+    mt19937_64 random;
+    Price levels;
+
+    BenchmarkBook(size_t depth, const BenchmarkConfig& config)
+        : ownedBook(makeBenchmarkBook(depth + config.operations + 1024, config.cumulativeDepth)), book(*ownedBook), random(config.seed), levels(config.levels) {
+        bidder = book.makeUser("BenchmarkBidder");
+        asker = book.makeUser("BenchmarkAsker");
+        book.addBalance(bidder, "USD", 1000000000LL * ATOMS_PER_UNIT);
+        book.addBalance(asker, TICKER, 1000000000LL * ATOMS_PER_UNIT);
+        resting.reserve(depth + config.operations);
+        for (size_t i = 0; i < depth; ++i) {
+            addPassive(); // on top of the market makers' seed orders
+        }
+    }
+
+    Quantity randomQuantity() { return 1 + (Quantity)(random() % 10); }
+    bool randomSide() { return (random() & 1) != 0; }
+
+    // Non-crossing order on a random level of a random side
+    OrderId addPassive() {
+        Price offset = 1 + (Price)(random() % levels);
+        OrderId id = randomSide() ? book.addBid(bidder, BENCHMARK_MID_PRICE - offset, randomQuantity()) : book.addAsk(asker, BENCHMARK_MID_PRICE + offset, randomQuantity());
+        resting.push_back(id);
+        return id;
+    }
+
+    // Order priced through the whole opposite side, so it fills against the best levels
+    void addAggressive(bool buy, Quantity qty) {
+        if (buy) {
+            book.addBid(bidder, BENCHMARK_MID_PRICE + levels, qty);
+        } else {
+            book.addAsk(asker, BENCHMARK_MID_PRICE - levels, qty);
+        }
+    }
+
+    // Removes a random benchmark order from the tracking list and returns its ID
+    OrderId takeRandomResting() {
+        size_t index = (size_t)(random() % resting.size());
+        OrderId id = resting[index];
+        resting[index] = resting.back();
+        resting.pop_back();
+        return id;
+    }
+};
+
+// Prints one result line
+void printResult(const string& scenario, size_t depth, LatencySample& sample, double seconds) {
+    size_t ops = sample.nanos.size();
+    cout << left << setw(10) << scenario << right << setw(10) << depth << setw(10) << ops
+         << setw(14) << (unsigned long long)(seconds > 0 ? ops / seconds : 0)
+         << setw(10) << sample.percentile(50) << setw(10) << sample.percentile(99) << setw(10) << sample.percentile(99.9) << endl;
+}
+
+/**
+ * @brief Runs every scenario against a book of the given depth
+ *
+ * @details Scenarios, each on a freshly built book and each keeping the depth roughly constant:
+ * - add: passive add (timed), then the order is cancelled again (untimed)
+ * - cancel: cancel of a random resting order by ID (timed), then a new passive order (untimed)
+ * - match: aggressive order of 1-10 lots against the best levels (timed), then the
+ *   same quantity is added back passively (untimed)
+ * - mixed: aggressive orders with the configured probability, otherwise a passive
+ *   add or a cancel, all timed
+ * - quote: price a 100 lot buy against the asks
+ * - sweep: VWAP/worst price of a buy or sell of up to a tenth of the book, then
+ *   everything within 50 bps of the best price, after a passive add (untimed)
+ * - top10: aggregated snapshot of the best 10 levels of each side, after a passive add
+ *   (untimed) so consecutive snapshots differ
+ * - depth: render the full depth (at most 100 times, 10 from 100k orders up, it walks every level)
+ *
+ * @param depth Resting orders in the book
+ * @param config Benchmark settings
+ */
+void runDepth(size_t depth, const BenchmarkConfig& config) {
+    chrono::steady_clock::time_point runStart, start, end;
+
+    {
+        BenchmarkBook bench(depth, config);
+        LatencySample sample;
+        sample.nanos.reserve(config.operations);
+        double seconds = 0;
+        for (size_t op = 0; op < config.operations; ++op) {
+            Price offset = 1 + (Price)(bench.random() % bench.levels);
+            Quantity qty = bench.randomQuantity();
+            bool bid = bench.randomSide();
+            start = chrono::steady_clock::now();
+            OrderId id = bid ? bench.book.addBid(bench.bidder, BENCHMARK_MID_PRICE - offset, qty) : bench.book.addAsk(bench.asker, BENCHMARK_MID_PRICE + offset, qty);
+            end = chrono::steady_clock::now();
+            sample.add(start, end);
+            seconds += chrono::duration<double>(end - start).count();
+            bench.book.cancel(id);
+        }
+        printResult("add", depth, sample, seconds);
+    }
+
+    {
+        BenchmarkBook bench(depth, config);
+        LatencySample sample;
+        sample.nanos.reserve(config.operations);
+        double seconds = 0;
+        for (size_t op = 0; op < config.operations; ++op) {
+            OrderId id = bench.takeRandomResting();
+            start = chrono::steady_clock::now();
+            bench.book.cancel(id);
+            end = chrono::steady_clock::now();
+            sample.add(start, end);
+            seconds += chrono::duration<double>(end - start).count();
+            bench.addPassive();
+        }
+        printResult("cancel", depth, sample, seconds);
+    }
+
+    {
+        BenchmarkBook bench(depth, config);
+        LatencySample sample;
+        sample.nanos.reserve(config.operations);
+        double seconds = 0;
+        for (size_t op = 0; op < config.operations; ++op) {
+            bool buy = bench.randomSide();
+            Quantity qty = bench.randomQuantity();
+            start = chrono::steady_clock::now();
+            bench.addAggressive(buy, qty);
+            end = chrono::steady_clock::now();
+            sample.add(start, end);
+            seconds += chrono::duration<double>(end - start).count();
+            Price offset = 1 + (Price)(bench.random() % bench.levels);
+            bench.resting.push_back(buy ? bench.book.addAsk(bench.asker, BENCHMARK_MID_PRICE + offset, qty) : bench.book.addBid(bench.bidder, BENCHMARK_MID_PRICE - offset, qty));
+        }
+        printResult("match", depth, sample, seconds);
+    }
+
+    {
+        BenchmarkBook bench(depth, config);
+        LatencySample sample;
+        sample.nanos.reserve(config.operations);
+        runStart = chrono::steady_clock::now();
+        for (size_t op = 0; op < config.operations; ++op) {
+            start = chrono::steady_clock::now();
+            if ((int)(bench.random() % 100) < config.aggressivePercent) {
+                bench.addAggressive(bench.randomSide(), bench.randomQuantity());
+            } else if (bench.randomSide() || bench.resting.empty()) {
+                bench.addPassive();
+            } else {
+                bench.book.cancel(bench.takeRandomResting());
+            }
+            end = chrono::steady_clock::now();
+            sample.add(start, end);
+        }
+        printResult("mixed", depth, sample, chrono::duration<double>(end - runStart).count());
+    }
+
+    {
+        BenchmarkBook bench(depth, config);
+        LatencySample sample;
+        sample.nanos.reserve(config.operations);
+        double seconds = 0;
+        Amount checksum = 0;
+        for (size_t op = 0; op < config.operations; ++op) {
+            Quantity available;
+            start = chrono::steady_clock::now();
+            checksum += bench.book.quoteBuy(100, available);
+            end = chrono::steady_clock::now();
+            sample.add(start, end);
+            seconds += chrono::duration<double>(end - start).count();
+        }
+        printResult("quote", depth, sample, seconds);
+        if (checksum == 0) {
+            cout << "(no asks to quote)" << endl; // also keeps the quotes from being optimized away
+        }
+    }
+
+    {
+        BenchmarkBook bench(depth, config);
+        LatencySample sample;
+        sample.nanos.reserve(config.operations);
+        double seconds = 0;
+        long long checksum = 0;
+        Quantity largest = (Quantity)(depth / 2 + 10); // about a tenth of the lots resting on either side
+        for (size_t op = 0; op < config.operations; ++op) {
+            bench.book.cancel(bench.takeRandomResting());
+            bench.addPassive();
+            bool buy = bench.randomSide();
+            Quantity qty = 1 + (Quantity)(bench.random() % largest);
+            start = chrono::steady_clock::now();
+            checksum += bench.book.quoteSweep(buy, qty).notionalTicks + bench.book.quoteWithin(buy, 50).quantity;
+            end = chrono::steady_clock::now();
+            sample.add(start, end);
+            seconds += chrono::duration<double>(end - start).count();
+        }
+        printResult("sweep", depth, sample, seconds);
+        if (checksum == 0) {
+            cout << "(empty book)" << endl; // also keeps the quotes from being optimized away
+        }
+    }
+
+    {
+        BenchmarkBook bench(depth, config);
+        LatencySample sample;
+        sample.nanos.reserve(config.operations);
+        double seconds = 0;
+        DepthSnapshot snapshot;
+        snapshot.bids.reserve(10);
+        snapshot.asks.reserve(10);
+        unsigned long long checksum = 0;
+        for (size_t op = 0; op < config.operations; ++op) {
+            bench.book.cancel(bench.takeRandomResting());
+            bench.addPassive();
+            start = chrono::steady_clock::now();
+            checksum += bench.book.snapshotDepth(snapshot, 10);
+            end = chrono::steady_clock::now();
+            sample.add(start, end);
+            seconds += chrono::duration<double>(end - start).count();
+        }
+        printResult("top10", depth, sample, seconds);
+        if (checksum == 0) {
+            cout << "(empty book)" << endl; // also keeps the snapshots from being optimized away
+        }
+    }
+
+    {
+        BenchmarkBook bench(depth, config);
+        LatencySample sample;
+        double seconds = 0;
+        size_t rounds = min(config.operations, (size_t)(depth >= 100000 ? 10 : 100));
+        size_t rendered = 0;
+        for (size_t op = 0; op < rounds; ++op) {
+            start = chrono::steady_clock::now();
+            rendered += bench.book.getDepth().size();
+            end = chrono::steady_clock::now();
+            sample.add(start, end);
+            seconds += chrono::duration<double>(end - start).count();
+        }
+        printResult("depth", depth, sample, seconds);
+        if (rendered == 0) {
+            cout << "(nothing rendered)" << endl; // also keeps the rendering from being optimized away
+        }
+    }
+}
+
+/**
+ * @brief Benchmarks add/match/cancel/quote/sweep/top10/depth of OrderBook at several book depths
+ *
+ * @details Options:
+ * - --depths 10,1000,100000,1000000   resting orders per run
+ * - --ops 200000                      timed operations per scenario
+ * - --levels 1000                     price levels per side
+ * - --aggressive 20                   percent of aggressive orders in the mixed scenario
+ * - --cumulative 1                    0 to run without the cumulative depth index
+ * - --seed 42
+ *
+ * @return int 0, or 1 on a bad option
+ */
+int main(int argc, char* argv[]) {
+    BenchmarkConfig config;
+    BenchmarkOptions options("orderBookBenchmark");
+    options.add("--depths", config.depths, "N,N,...");
+    options.add("--ops", config.operations);
+    options.add("--levels", config.levels);
+    options.add("--aggressive", config.aggressivePercent);
+    options.add("--cumulative", config.cumulativeDepth, "0|1");
+    options.add("--seed", config.seed);
+    if (!options.parse(argc, argv)) {
+        return 1;
+    }
+    if (config.operations == 0 || config.levels <= 0 || config.levels >= BENCHMARK_MID_PRICE) {
+        cerr << "--ops must be positive and --levels between 1 and " << BENCHMARK_MID_PRICE - 1 << endl;
+        return 1;
+    }
+
+    cout << "ops/sec is per timed operation; latencies in ns. Mixed flow: " << config.aggressivePercent << "% aggressive" << endl;
+    cout << left << setw(10) << "scenario" << right << setw(10) << "depth" << setw(10) << "ops"
+         << setw(14) << "ops/sec" << setw(10) << "p50" << setw(10) << "p99" << setw(10) << "p99.9" << endl;
+    for (size_t depth : config.depths) {
+        runDepth(depth, config);
+    }
+    return 0;
+}
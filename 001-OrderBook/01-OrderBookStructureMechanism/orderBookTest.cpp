@@ -0,0 +1,911 @@
+#include "exchange.hpp"
+#include "orderBook.hpp"
+#include "orderFlow.hpp"
+#include "orderGateway.hpp"
+#include "persistence.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+// Behaviour checks of the engine: matching, order changes, risk holds, depth snapshots,
+// sweep quotes, IOC, FOK and market orders, recovery, order flow files, the gateway's
+// report routing and the exchange's instruments, shards and order changes. Each check
+// that fails prints its line and expression; the run fails if any did.
+
+int failures = 0;
+
+#define CHECK(condition)                                                                \
+    do {                                                                                \
+        if (!(condition)) {                                                             \
+            cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << endl; \
+            ++failures;                                                                 \
+        }                                                                               \
+    } while (0)
+
+// Keeps every execution report, in order
+class EventLog : public ExecutionListener {
+    public:
+    vector<ExecutionEvent> events;
+
+    void onEvent(const ExecutionEvent& event) { events.push_back(event); }
+
+    // Reports of one type, in order
+    vector<ExecutionEvent> ofType(EventType type) const {
+        vector<ExecutionEvent> matching;
+        for (const ExecutionEvent &event : events) {
+            if (event.type == type) {
+                matching.push_back(event);
+            }
+        }
+        return matching;
+    }
+};
+
+// USD atoms of qty lots at a price in ticks of the default book (0.01 USD tick, 1 share lot)
+Amount usd(Price price, Quantity qty) {
+    return price * qty * (ATOMS_PER_UNIT / 100);
+}
+
+AccountId fundedUser(OrderBook& book, const string& name, Amount usdUnits, Amount stockUnits) {
+    AccountId account = book.makeUser(name);
+    book.addBalance(account, "USD", usdUnits * ATOMS_PER_UNIT);
+    book.addBalance(account, TICKER, stockUnits * ATOMS_PER_UNIT);
+    return account;
+}
+
+// A crossing bid fills the best price first and, within a price, the oldest order first
+void testMatchingPriceTime() {
+    OrderBook book;
+    EventLog log;
+    book.setListener(&log);
+    AccountId buyer = fundedUser(book, "Buyer", 100000, 0);
+    AccountId first = fundedUser(book, "First", 0, 100);
+    AccountId second = fundedUser(book, "Second", 0, 100);
+    AccountId better = fundedUser(book, "Better", 0, 100);
+    Amount buyerUsd = book.balanceOf(buyer, "USD");
+
+    OrderId firstId = book.addAsk(first, 11400, 5);
+    OrderId secondId = book.addAsk(second, 11400, 5);
+    OrderId betterId = book.addAsk(better, 11350, 3);
+    CHECK(firstId != INVALID_ORDER_ID && secondId != INVALID_ORDER_ID && betterId != INVALID_ORDER_ID);
+    CHECK(book.getAsks().best() == 11350);
+
+    log.events.clear();
+    OrderId bidId = book.addBid(buyer, 11400, 10);
+    CHECK(bidId != INVALID_ORDER_ID);
+    vector<ExecutionEvent> fills;
+    for (const ExecutionEvent &event : log.events) {
+        if ((event.type == EVENT_FILL || event.type == EVENT_PARTIAL_FILL) && event.orderId == bidId) {
+            fills.push_back(event);
+        }
+    }
+    CHECK(fills.size() == 3);
+    if (fills.size() == 3) {
+        CHECK(fills[0].contraOrderId == betterId && fills[0].price == 11350 && fills[0].quantity == 3);
+        CHECK(fills[1].contraOrderId == firstId && fills[1].price == 11400 && fills[1].quantity == 5);
+        CHECK(fills[2].contraOrderId == secondId && fills[2].price == 11400 && fills[2].quantity == 2);
+        CHECK(fills[2].type == EVENT_FILL && fills[2].leavesQuantity == 0);
+    }
+    CHECK(log.ofType(EVENT_RESTED).empty());
+
+    // Second keeps its place with what is left; the buyer paid the resting prices
+    CHECK(book.getAsks().best() == 11400 && book.getAsks().level(11400).quantity == 3);
+    CHECK(book.balanceOf(buyer, "USD") == buyerUsd - usd(11350, 3) - usd(11400, 7));
+    CHECK(book.balanceOf(buyer, TICKER) == 10 * ATOMS_PER_UNIT);
+    CHECK(book.heldOf(buyer, "USD") == 0 && book.getRisk(buyer).openOrders == 0 && book.getRisk(buyer).openNotional == 0);
+    CHECK(book.balanceOf(better, "USD") == usd(11350, 3) && book.heldOf(better, TICKER) == 0);
+    CHECK(book.heldOf(second, TICKER) == 3 * ATOMS_PER_UNIT && book.getRisk(second).openOrders == 1);
+
+    // A bid that does not cross rests
+    log.events.clear();
+    OrderId restingId = book.addBid(buyer, 11300, 4);
+    CHECK(log.events.size() == 2 && log.events[1].type == EVENT_RESTED && log.events[1].orderId == restingId);
+    CHECK(book.getBids().best() == 11300 && book.heldOf(buyer, "USD") == usd(11300, 4));
+}
+
+// Reduce keeps the order, replace re-enters it unless only the quantity goes down, and
+// what the order holds follows along
+void testCancelReduceReplace() {
+    OrderBook book;
+    EventLog log;
+    book.setListener(&log);
+    AccountId trader = fundedUser(book, "Trader", 10000, 0);
+    Amount before = book.balanceOf(trader, "USD");
+
+    OrderId id = book.addBid(trader, 11300, 10);
+    CHECK(id != INVALID_ORDER_ID && book.heldOf(trader, "USD") == usd(11300, 10));
+    CHECK(book.getRisk(trader).openOrders == 1 && book.getRisk(trader).openNotional == usd(11300, 10));
+
+    log.events.clear();
+    CHECK(book.reduce(id, 4));
+    CHECK(log.events.size() == 1 && log.events[0].type == EVENT_REDUCED && log.events[0].quantity == 4 && log.events[0].leavesQuantity == 6);
+    CHECK(book.getBids().level(11300).quantity == 6 && book.heldOf(trader, "USD") == usd(11300, 6));
+    CHECK(!book.reduce(id, 7));
+    CHECK(book.getBids().level(11300).quantity == 6);
+
+    // Unchanged price and quantity: nothing happens, nothing is reported
+    log.events.clear();
+    CHECK(book.replace(id, 11300, 6) == id);
+    CHECK(log.events.empty());
+    CHECK(book.getBids().level(11300).quantity == 6 && book.heldOf(trader, "USD") == usd(11300, 6));
+
+    // Lower quantity at the same price: same ID, same place in the queue
+    CHECK(book.replace(id, 11300, 2) == id);
+    CHECK(book.heldOf(trader, "USD") == usd(11300, 2) && book.getRisk(trader).openNotional == usd(11300, 2));
+
+    // New price: the order is cancelled and entered again under a new ID
+    OrderId moved = book.replace(id, 11310, 2);
+    CHECK(moved != INVALID_ORDER_ID && moved != id);
+    CHECK(!book.cancel(id));
+    CHECK(book.getBids().level(11300).quantity == 0 && book.getBids().level(11310).quantity == 2);
+    CHECK(book.heldOf(trader, "USD") == usd(11310, 2) && book.getRisk(trader).openOrders == 1);
+
+    log.events.clear();
+    CHECK(book.replace(moved, 11310, 0) == INVALID_ORDER_ID);
+    CHECK(log.events.size() == 1 && log.events[0].reason == REJECT_INVALID_QUANTITY);
+
+    CHECK(book.cancel(moved));
+    CHECK(!book.cancel(moved));
+    CHECK(book.heldOf(trader, "USD") == 0 && book.balanceOf(trader, "USD") == before);
+    CHECK(book.getRisk(trader).openOrders == 0 && book.getRisk(trader).openNotional == 0);
+}
+
+// Cancelling by account, price and quantity takes part or all of an order off, and refuses
+// a quantity that is not positive or larger than the order, leaving order and hold alone
+void testCancelByPrice() {
+    OrderBook book;
+    EventLog log;
+    book.setListener(&log);
+    AccountId buyer = fundedUser(book, "Buyer", 10000, 0);
+    AccountId seller = fundedUser(book, "Seller", 0, 100);
+    CHECK(book.addBid(buyer, 11300, 5) != INVALID_ORDER_ID);
+    CHECK(book.addAsk(seller, 11600, 4) != INVALID_ORDER_ID);
+
+    log.events.clear();
+    CHECK(!book.cancelBid(buyer, 11300, -20));
+    CHECK(log.events.size() == 1 && log.events[0].type == EVENT_REJECTED && log.events[0].reason == REJECT_INVALID_QUANTITY);
+    CHECK(!book.cancelBid(buyer, 11300, 0));
+    CHECK(!book.cancelAsk(seller, 11600, -1));
+    CHECK(book.getBids().level(11300).quantity == 5 && book.heldOf(buyer, "USD") == usd(11300, 5));
+    CHECK(book.balanceOf(buyer, "USD") == 10000 * ATOMS_PER_UNIT - usd(11300, 5));
+    CHECK(book.getAsks().level(11600).quantity == 4 && book.heldOf(seller, TICKER) == 4 * ATOMS_PER_UNIT);
+
+    log.events.clear();
+    CHECK(!book.cancelBid(buyer, 11300, 6));
+    CHECK(log.events.size() == 1 && log.events[0].reason == REJECT_QUANTITY_TOO_LARGE);
+    CHECK(book.cancelBid(buyer, 11300, 2));
+    CHECK(book.getBids().level(11300).quantity == 3 && book.heldOf(buyer, "USD") == usd(11300, 3));
+    CHECK(book.cancelBid(buyer, 11300, 3));
+    CHECK(book.cancelAsk(seller, 11600, 4));
+    CHECK(book.heldOf(buyer, "USD") == 0 && book.balanceOf(buyer, "USD") == 10000 * ATOMS_PER_UNIT);
+    CHECK(book.heldOf(seller, TICKER) == 0 && book.getRisk(seller).openOrders == 0);
+}
+
+// Accepting an order holds what it can cost, limits and balances refuse what does not fit,
+// and fills and cancels give the hold back
+void testRiskHolds() {
+    OrderBook book;
+    EventLog log;
+    book.setListener(&log);
+    AccountId buyer = fundedUser(book, "Buyer", 1000, 0);
+    AccountId seller = fundedUser(book, "Seller", 0, 100);
+
+    OrderId held = book.addBid(buyer, 11300, 8);
+    CHECK(held != INVALID_ORDER_ID);
+    CHECK(book.heldOf(buyer, "USD") == usd(11300, 8) && book.balanceOf(buyer, "USD") == 1000 * ATOMS_PER_UNIT - usd(11300, 8));
+
+    log.events.clear();
+    CHECK(book.addBid(buyer, 11300, 1) == INVALID_ORDER_ID);
+    CHECK(log.events.size() == 1 && log.events[0].reason == REJECT_INSUFFICIENT_BALANCE);
+    log.events.clear();
+    CHECK(book.addAsk(buyer, 11600, 1) == INVALID_ORDER_ID);
+    CHECK(log.events.size() == 1 && log.events[0].reason == REJECT_INSUFFICIENT_BALANCE);
+
+    CHECK(book.setLimits(buyer, 1, NO_NOTIONAL_LIMIT));
+    log.events.clear();
+    CHECK(book.addBid(buyer, 1000, 1) == INVALID_ORDER_ID);
+    CHECK(log.events.size() == 1 && log.events[0].reason == REJECT_OPEN_ORDER_LIMIT);
+
+    CHECK(book.setLimits(buyer, 5, usd(11300, 8) + usd(1000, 1) - 1));
+    log.events.clear();
+    CHECK(book.addBid(buyer, 1000, 1) == INVALID_ORDER_ID);
+    CHECK(log.events.size() == 1 && log.events[0].reason == REJECT_NOTIONAL_LIMIT);
+    CHECK(book.getRisk(buyer).openOrders == 1 && book.getRisk(buyer).openNotional == usd(11300, 8));
+
+    // A fill at the bid's own price uses up exactly what was held
+    CHECK(book.addAsk(seller, 11300, 8) != INVALID_ORDER_ID);
+    CHECK(book.heldOf(buyer, "USD") == 0 && book.getRisk(buyer).openOrders == 0 && book.getRisk(buyer).openNotional == 0);
+    CHECK(book.balanceOf(buyer, TICKER) == 8 * ATOMS_PER_UNIT && book.balanceOf(seller, "USD") == usd(11300, 8));
+    CHECK(book.heldOf(seller, TICKER) == 0 && book.getRisk(seller).openOrders == 0);
+}
+
+// An order whose notional or base amount would not fit in an Amount is refused before any
+// risk arithmetic, and leaves balances, limits and the book as they were
+void testAmountOverflow() {
+    OrderBook book;
+    EventLog log;
+    book.setListener(&log);
+    AccountId trader = fundedUser(book, "x", 100, 0);
+    unsigned long long books = book.bookChecksum();
+    unsigned long long balances = book.balanceChecksum();
+
+    CHECK(book.addBid(trader, 11000, 1000000000) == INVALID_ORDER_ID); // 1.1e19 USD atoms
+    CHECK(log.events.size() == 1 && log.events[0].type == EVENT_REJECTED && log.events[0].reason == REJECT_INVALID_QUANTITY);
+    log.events.clear();
+    CHECK(book.addAsk(trader, 11600, 100000000000LL) == INVALID_ORDER_ID); // 1e19 GOOGL atoms
+    CHECK(log.events.size() == 1 && log.events[0].reason == REJECT_INVALID_QUANTITY);
+    log.events.clear();
+    CHECK(book.addOrder(SIDE_BID, ORDER_MARKET, trader, 0, 1000000000000LL) == INVALID_ORDER_ID); // priced at the worst ask
+    CHECK(log.events.size() == 1 && log.events[0].reason == REJECT_INVALID_QUANTITY);
+    CHECK(book.balanceOf(trader, "USD") == 100 * ATOMS_PER_UNIT && book.heldOf(trader, "USD") == 0);
+    CHECK(book.getRisk(trader).openOrders == 0 && book.getRisk(trader).openNotional == 0);
+    CHECK(book.bookChecksum() == books && book.balanceChecksum() == balances);
+
+    // Large but representable: the usual balance check refuses it
+    log.events.clear();
+    CHECK(book.addBid(trader, 11000, 1000000) == INVALID_ORDER_ID);
+    CHECK(log.events.size() == 1 && log.events[0].reason == REJECT_INSUFFICIENT_BALANCE);
+
+    // A limit lowered below what is already open refuses any more notional
+    CHECK(book.addBid(trader, 1000, 1) != INVALID_ORDER_ID);
+    CHECK(book.setLimits(trader, 5, 0));
+    log.events.clear();
+    CHECK(book.addBid(trader, 1000, 1) == INVALID_ORDER_ID);
+    CHECK(log.events.size() == 1 && log.events[0].reason == REJECT_NOTIONAL_LIMIT);
+}
+
+// The top of the book and depth snapshots show the seeded levels best first, with their
+// totals and order counts, and move with the book's sequence number
+void testDepthSnapshot() {
+    OrderBook book;
+    AccountId trader = fundedUser(book, "Trader", 10000, 0);
+    BookTop top = book.getTop();
+    CHECK(top.bid.price == 11200 && top.bid.quantity == 8 && top.bid.orders == 1);
+    CHECK(top.ask.price == 11500 && top.ask.quantity == 5 && top.ask.orders == 1);
+
+    DepthSnapshot snapshot;
+    CHECK(book.snapshotDepth(snapshot, 3) == 6 && snapshot.sequence == top.sequence);
+    CHECK(snapshot.bids.size() == 3 && snapshot.asks.size() == 3);
+    if (snapshot.bids.size() == 3 && snapshot.asks.size() == 3) {
+        CHECK(snapshot.bids[0].price == 11200 && snapshot.bids[1].price == 11100 && snapshot.bids[2].price == 11000);
+        CHECK(snapshot.bids[2].quantity == 10 && snapshot.bids[2].orders == 1);
+        CHECK(snapshot.asks[0].price == 11500 && snapshot.asks[1].price == 11900 && snapshot.asks[2].price == 12000);
+        CHECK(snapshot.asks[1].quantity == 12);
+    }
+    CHECK(book.snapshotDepth(snapshot, 100) == 10 && snapshot.bids.back().price == 10500 && snapshot.asks.back().price == 12500);
+
+    // Joining the best bid changes its totals and the sequence, leaving the ask alone
+    OrderId id = book.addBid(trader, 11200, 2);
+    BookTop joined = book.getTop();
+    CHECK(joined.bid.price == 11200 && joined.bid.quantity == 10 && joined.bid.orders == 2);
+    CHECK(joined.ask.price == 11500 && joined.sequence > top.sequence);
+    CHECK(book.snapshotDepth(snapshot, 1) == 2 && snapshot.bids[0].quantity == 10 && snapshot.sequence == joined.sequence);
+    CHECK(book.cancel(id) && book.getTop().bid.quantity == 8 && book.getTop().bid.orders == 1);
+}
+
+// Sweep quotes price taking a quantity, or everything within a distance of the best price,
+// level by level; a buy that then sweeps the asks pays exactly what was quoted
+void testSweepQuotes() {
+    OrderBook book;
+    AccountId buyer = fundedUser(book, "Buyer", 10000, 0);
+
+    SweepQuote buy = book.quoteSweep(true, 10); // 5 at 115.00, 5 of 12 at 119.00
+    CHECK(buy.quantity == 10 && buy.notionalTicks == 11500 * 5 + 11900 * 5 && buy.notional == usd(11500, 5) + usd(11900, 5));
+    CHECK(buy.bestPrice == 11500 && buy.worstPrice == 11900 && buy.levels == 2);
+    CHECK(buy.averagePrice() == 11700 && buy.slippageBps() > 173.9 && buy.slippageBps() < 174.0);
+    SweepQuote all = book.quoteSweep(true, 1000);
+    CHECK(all.quantity == 34 && all.worstPrice == 12500 && all.levels == 4);
+    SweepQuote sell = book.quoteSweep(false, 20); // 8 at 112.00, 8 at 111.00, 4 of 10 at 110.00
+    CHECK(sell.quantity == 20 && sell.notionalTicks == 11200 * 8 + 11100 * 8 + 11000 * 4 && sell.worstPrice == 11000 && sell.levels == 3);
+
+    // 400 bps above 115.00 is 119.60: the 119.00 level is in, 120.00 is not
+    SweepQuote within = book.quoteWithin(true, 400);
+    CHECK(within.quantity == 17 && within.worstPrice == 11900 && within.levels == 2);
+    within = book.quoteWithin(false, 100); // down to 110.88
+    CHECK(within.quantity == 16 && within.worstPrice == 11100);
+    CHECK(book.quoteWithin(true, 0).quantity == 5 && book.quoteWithin(true, -1).quantity == 0);
+
+    Amount before = book.balanceOf(buyer, "USD");
+    CHECK(book.addOrder(SIDE_BID, ORDER_MARKET, buyer, 0, 10) != INVALID_ORDER_ID);
+    CHECK(before - book.balanceOf(buyer, "USD") == buy.notional && book.heldOf(buyer, "USD") == 0);
+    CHECK(book.quoteSweep(true, 10).bestPrice == 11900 && book.quoteSweep(true, 10).quantity == 10);
+}
+
+// Immediate orders never rest: IOC cancels what it cannot fill at once, FOK fills in full
+// or is refused without touching the book, and a market order takes whatever rests
+void testOrderTypes() {
+    OrderBook book;
+    EventLog log;
+    book.setListener(&log);
+    AccountId buyer = fundedUser(book, "Buyer", 100000, 0);
+    AccountId seller = fundedUser(book, "Seller", 0, 100);
+    Amount buyerUsd = book.balanceOf(buyer, "USD");
+
+    OrderId ioc = book.addOrder(SIDE_BID, ORDER_IOC, buyer, 11500, 8); // only 5 rest at 115.00
+    CHECK(ioc != INVALID_ORDER_ID && log.ofType(EVENT_RESTED).empty());
+    vector<ExecutionEvent> cancelled = log.ofType(EVENT_CANCELLED);
+    CHECK(cancelled.size() == 1 && cancelled[0].orderId == ioc && cancelled[0].quantity == 3);
+    CHECK(book.balanceOf(buyer, TICKER) == 5 * ATOMS_PER_UNIT && book.balanceOf(buyer, "USD") == buyerUsd - usd(11500, 5));
+    CHECK(book.heldOf(buyer, "USD") == 0 && book.getRisk(buyer).openOrders == 0 && book.getAsks().best() == 11900);
+
+    log.events.clear();
+    unsigned long long before = book.bookChecksum();
+    CHECK(book.addOrder(SIDE_BID, ORDER_FOK, buyer, 11900, 13) == INVALID_ORDER_ID); // 12 up to 119.00
+    CHECK(log.events.size() == 1 && log.events[0].type == EVENT_REJECTED && log.events[0].reason == REJECT_NOT_FILLABLE);
+    CHECK(book.bookChecksum() == before && book.heldOf(buyer, "USD") == 0);
+    CHECK(book.addOrder(SIDE_BID, ORDER_FOK, buyer, 12000, 20) != INVALID_ORDER_ID);
+    CHECK(book.balanceOf(buyer, TICKER) == 25 * ATOMS_PER_UNIT);
+    CHECK(book.balanceOf(buyer, "USD") == buyerUsd - usd(11500, 5) - usd(11900, 12) - usd(12000, 8));
+    CHECK(book.getAsks().best() == 12000 && book.getAsks().level(12000).quantity == 4 && book.heldOf(buyer, "USD") == 0);
+
+    // The price of a market order is ignored; it sweeps the bids down to what it needs
+    CHECK(book.addOrder(SIDE_ASK, ORDER_MARKET, seller, 99999, 30) != INVALID_ORDER_ID);
+    CHECK(book.balanceOf(seller, "USD") == usd(11200, 8) + usd(11100, 8) + usd(11000, 10) + usd(10900, 4));
+    CHECK(book.getBids().best() == 10900 && book.getBids().level(10900).quantity == 6);
+    log.events.clear();
+    CHECK(book.addOrder(SIDE_ASK, ORDER_MARKET, seller, 0, 60) != INVALID_ORDER_ID); // 26 left on the bids
+    cancelled = log.ofType(EVENT_CANCELLED);
+    CHECK(cancelled.size() == 1 && cancelled[0].quantity == 34 && book.getBids().empty());
+    CHECK(book.balanceOf(seller, TICKER) == 44 * ATOMS_PER_UNIT && book.heldOf(seller, TICKER) == 0);
+    CHECK(book.addOrder(SIDE_ASK, ORDER_MARKET, seller, 0, 1) == INVALID_ORDER_ID && log.events.back().reason == REJECT_NOT_FILLABLE);
+}
+
+// Prices and quantities parse onto the instrument's grid, and only when positive
+void testParseGrid() {
+    InstrumentSpec spec(TICKER, ATOMS_PER_UNIT / 100, ATOMS_PER_UNIT);
+    Price price = 0;
+    Quantity qty = 0;
+    CHECK(spec.parsePrice("113.05", price) && price == 11305);
+    CHECK(spec.parseQuantity("20", qty) && qty == 20);
+    CHECK(!spec.parsePrice("113.005", price) && !spec.parseQuantity("2.5", qty));
+    CHECK(!spec.parsePrice("-113.00", price) && !spec.parsePrice("0", price));
+    CHECK(!spec.parseQuantity("-20", qty) && !spec.parseQuantity("0.00", qty) && !spec.parseQuantity("-0", qty));
+
+    OrderFlow flow;
+    string error;
+    istringstream negative("bid alice 113.00 -3\n");
+    CHECK(!readOrderFlowText(negative, spec, flow, error) && flow.commands.empty());
+}
+
+// A deposit only ever adds to a balance: from a flow file or from the book, nothing that is
+// not positive or would overflow the balance gets through
+void testDeposits() {
+    InstrumentSpec spec(TICKER, ATOMS_PER_UNIT / 100, ATOMS_PER_UNIT);
+    OrderFlow flow;
+    string error;
+    istringstream negative("deposit alice USD -5000\n");
+    CHECK(!readOrderFlowText(negative, spec, flow, error));
+    istringstream zero("deposit alice USD 0\n");
+    CHECK(!readOrderFlowText(zero, spec, flow, error));
+
+    OrderBook book;
+    AccountId trader = fundedUser(book, "Trader", 100, 0);
+    CHECK(book.addBalance(trader, "USD", -50 * ATOMS_PER_UNIT) != "Balance added successfully");
+    CHECK(book.addBalance(trader, "USD", 0) != "Balance added successfully");
+    CHECK(book.addBalance(trader, "USD", MAX_AMOUNT) != "Balance added successfully");
+    CHECK(book.balanceOf(trader, "USD") == 100 * ATOMS_PER_UNIT);
+    CHECK(book.addBalance(trader, "USD", 1) == "Balance added successfully");
+    CHECK(book.balanceOf(trader, "USD") == 100 * ATOMS_PER_UNIT + 1);
+}
+
+// Reads from a string through a buffer that cannot seek, like a pipe
+class OneWayBuffer : public streambuf {
+    public:
+    explicit OneWayBuffer(string& bytes) { setg(&bytes[0], &bytes[0], &bytes[0] + bytes.size()); }
+};
+
+// A binary flow reads back as written, and a command count the file cannot hold is refused
+// before anything is allocated for it, from a file or from a stream of unknown size
+void testOrderFlowCounts() {
+    OrderFlow flow;
+    string error;
+    istringstream text("deposit alice USD 1000\nbid alice 113.00 3\nask bob 114.00 2 ioc\ncancel 5\nquote 10\n");
+    CHECK(readOrderFlowText(text, InstrumentSpec(TICKER, ATOMS_PER_UNIT / 100, ATOMS_PER_UNIT), flow, error));
+    ostringstream out;
+    CHECK(writeOrderFlowBinary(out, flow));
+    string bytes = out.str();
+
+    OrderFlow back;
+    istringstream whole(bytes);
+    CHECK(readOrderFlowBinary(whole, back, error));
+    CHECK(back.users == flow.users && back.commands.size() == flow.commands.size());
+    CHECK(back.commands.size() == 5 && memcmp(back.commands.data(), flow.commands.data(), 5 * sizeof(FlowCommand)) == 0);
+    OneWayBuffer pipe(bytes);
+    istream piped(&pipe);
+    back = OrderFlow();
+    CHECK(readOrderFlowBinary(piped, back, error) && back.commands.size() == 5);
+
+    size_t countAt = bytes.size() - flow.commands.size() * sizeof(FlowCommand) - sizeof(unsigned long long);
+    string lying = bytes;
+    unsigned long long huge = 1ULL << 60;
+    memcpy(&lying[countAt], &huge, sizeof(huge));
+    istringstream lyingFile(lying);
+    error.clear();
+    CHECK(!readOrderFlowBinary(lyingFile, back, error) && error == "truncated command records");
+    OneWayBuffer lyingPipe(lying);
+    istream lyingPiped(&lyingPipe);
+    error.clear();
+    CHECK(!readOrderFlowBinary(lyingPiped, back, error) && error == "truncated command records");
+
+    istringstream cut(bytes.substr(0, bytes.size() - 1));
+    CHECK(!readOrderFlowBinary(cut, back, error));
+    string manyUsers = bytes;
+    unsigned int users = 0xFFFFFFFFu;
+    memcpy(&manyUsers[sizeof(ORDER_FLOW_MAGIC)], &users, sizeof(users));
+    OneWayBuffer usersPipe(manyUsers);
+    istream usersPiped(&usersPipe);
+    CHECK(!readOrderFlowBinary(usersPiped, back, error));
+}
+
+// Polls a session until it has count more reports, or gives up after a few seconds
+vector<GatewayReport> awaitReports(GatewaySession& session, size_t count) {
+    vector<GatewayReport> reports;
+    GatewayReport report;
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::seconds(5);
+    while (reports.size() < count && chrono::steady_clock::now() < deadline) {
+        if (session.poll(report)) {
+            reports.push_back(report);
+        } else {
+            this_thread::yield();
+        }
+    }
+    return reports;
+}
+
+// The first report about an order, or an empty one with INVALID_ORDER_ID
+GatewayReport reportAbout(const vector<GatewayReport>& reports, OrderId id) {
+    for (const GatewayReport &report : reports) {
+        if (report.event.orderId == id) {
+            return report;
+        }
+    }
+    GatewayReport none;
+    memset(&none, 0, sizeof(none));
+    none.event.orderId = INVALID_ORDER_ID;
+    return none;
+}
+
+// A session only acts for the accounts attached to it. Its requests are answered in it;
+// what they do to other resting orders reaches their owners' sessions untagged
+void testGatewayRouting() {
+    OrderBook book; // the market makers' accounts are attached nowhere
+    AccountId owner = fundedUser(book, "Owner", 0, 100); // attached to the first session
+    AccountId buyer = fundedUser(book, "Buyer", 100000, 0); // attached to the second
+    OrderGateway gateway(book, 8);
+    GatewaySession &first = gateway.openSession();
+    GatewaySession &second = gateway.openSession();
+    gateway.attachAccount(owner, first);
+    gateway.attachAccount(buyer, second);
+    gateway.start();
+
+    // The second session cannot place an order for the first session's account
+    unsigned long long request = second.ask(owner, 11400, 5);
+    vector<GatewayReport> answers = awaitReports(second, 1);
+    CHECK(answers.size() == 1 && answers[0].event.type == EVENT_REJECTED && answers[0].event.reason == REJECT_NOT_PERMITTED);
+    CHECK(answers.size() == 1 && answers[0].requestId == request);
+    GatewayReport stray;
+    CHECK(!first.poll(stray));
+
+    request = first.ask(owner, 11400, 5);
+    answers = awaitReports(first, 2);
+    CHECK(answers.size() == 2 && answers[0].event.type == EVENT_ACCEPTED && answers[1].event.type == EVENT_RESTED);
+    CHECK(answers.size() == 2 && answers[0].requestId == request && answers[1].requestId == request);
+    OrderId restingAsk = answers.empty() ? INVALID_ORDER_ID : answers[0].event.orderId;
+
+    // Nor cancel, reduce or replace that account's order
+    second.cancel(restingAsk);
+    GatewayRequest change = {GATEWAY_REDUCE, ORDER_LIMIT, {0, 0}, INVALID_ACCOUNT, 0, 1, restingAsk, 0};
+    second.submit(change);
+    change.type = GATEWAY_REPLACE;
+    change.price = 11500;
+    second.submit(change);
+    answers = awaitReports(second, 3);
+    CHECK(answers.size() == 3);
+    for (const GatewayReport &answer : answers) {
+        CHECK(answer.event.type == EVENT_REJECTED && answer.event.reason == REJECT_NOT_PERMITTED && answer.event.orderId == restingAsk);
+    }
+
+    // The second session's bid crosses the ask: its answers are tagged, the owner hears of
+    // the passive fill untagged
+    request = second.bid(buyer, 11400, 2);
+    answers = awaitReports(second, 2);
+    CHECK(answers.size() == 2 && answers[1].event.type == EVENT_FILL && answers[0].requestId == request && answers[1].requestId == request);
+    answers = awaitReports(first, 1);
+    CHECK(answers.size() == 1 && answers[0].event.orderId == restingAsk && answers[0].event.type == EVENT_PARTIAL_FILL && answers[0].requestId == 0);
+
+    request = first.cancel(restingAsk);
+    answers = awaitReports(first, 1);
+    CHECK(answers.size() == 1 && answers[0].event.type == EVENT_CANCELLED && answers[0].event.quantity == 3 && answers[0].requestId == request);
+    second.cancel(restingAsk); // gone: the book, not the gateway, refuses it
+    answers = awaitReports(second, 1);
+    CHECK(answers.size() == 1 && answers[0].event.reason == REJECT_ORDER_NOT_FOUND);
+
+    // A fill of a market maker's order has no session to go to
+    second.bid(buyer, 11500, 1);
+    CHECK(awaitReports(second, 2).size() == 2);
+    gateway.stop();
+    CHECK(gateway.getStats().unrouted == 1);
+    CHECK(!first.poll(stray) && !second.poll(stray));
+    CHECK(book.getAsks().level(11400).quantity == 0 && book.balanceOf(owner, "USD") == usd(11400, 2));
+}
+
+// A session that stops reading loses the fills others cause past its ring and overflow,
+// instead of the matching thread growing memory for it
+void testGatewayOverflowBound() {
+    OrderBook book;
+    AccountId owner = fundedUser(book, "Owner", 0, 100);
+    AccountId buyer = fundedUser(book, "Buyer", 100000, 0);
+    OrderGateway gateway(book, 4); // rings of 4 requests and 16 reports
+    GatewaySession &slow = gateway.openSession();
+    GatewaySession &fast = gateway.openSession();
+    gateway.attachAccount(owner, slow);
+    gateway.attachAccount(buyer, fast);
+    gateway.start();
+
+    const Quantity asks = 40;
+    for (Quantity i = 0; i < asks; ++i) {
+        slow.ask(owner, 11301 + i, 1);
+        CHECK(awaitReports(slow, 2).size() == 2);
+    }
+    // From here the slow session reads nothing while its asks are taken 4 at a time
+    for (Quantity i = 0; i < asks; i += 4) {
+        fast.bid(buyer, 11304 + i, 4);
+        CHECK(awaitReports(fast, 5).size() == 5);
+    }
+    gateway.stop();
+
+    const GatewayStats &stats = gateway.getStats();
+    CHECK(stats.overflowed > 0 && stats.dropped > 0 && stats.dropped == slow.droppedCount());
+    CHECK(fast.droppedCount() == 0);
+    vector<GatewayReport> delivered;
+    GatewayReport report;
+    while (slow.poll(report)) { // all there is once the gateway has stopped
+        delivered.push_back(report);
+    }
+    CHECK(!delivered.empty() && delivered.size() + stats.overflowed + stats.dropped == (size_t)asks);
+    for (const GatewayReport &fill : delivered) {
+        CHECK(fill.event.type == EVENT_FILL && fill.event.account == owner && fill.requestId == 0);
+    }
+}
+
+// A request that answers with more reports than its session's ring and overflow hold
+// loses none of them, even while the session reads nothing
+void testGatewayAnswersKept() {
+    OrderBook book;
+    AccountId owner = fundedUser(book, "Owner", 0, 100);
+    AccountId buyer = fundedUser(book, "Buyer", 100000, 0);
+    OrderGateway gateway(book, 4); // rings of 4 requests and 16 reports
+    GatewaySession &maker = gateway.openSession();
+    GatewaySession &taker = gateway.openSession();
+    gateway.attachAccount(owner, maker);
+    gateway.attachAccount(buyer, taker);
+    gateway.start();
+
+    const Quantity asks = 40;
+    for (Quantity i = 0; i < asks; ++i) {
+        maker.ask(owner, 11301 + i, 1);
+        CHECK(awaitReports(maker, 2).size() == 2);
+    }
+    unsigned long long request = taker.bid(buyer, 11300 + asks, asks); // sweeps every ask
+    this_thread::sleep_for(chrono::milliseconds(100)); // long done before the taker reads
+    vector<GatewayReport> answers = awaitReports(taker, asks + 1);
+    gateway.stop();
+
+    CHECK(gateway.getStats().overflowed >= (size_t)asks + 1 - 16);
+    CHECK(taker.droppedCount() == 0 && gateway.getStats().dropped == maker.droppedCount());
+    CHECK(answers.size() == (size_t)asks + 1 && answers[0].event.type == EVENT_ACCEPTED);
+    for (const GatewayReport &answer : answers) {
+        CHECK(answer.requestId == request && answer.event.account == buyer);
+    }
+    CHECK(answers.back().event.type == EVENT_FILL && answers.back().event.leavesQuantity == 0);
+}
+
+// An instrument is only listed on a price and quantity grid whose tick-lot notional is a
+// whole, non-zero number of atoms
+void testExchangeInstruments() {
+    Exchange exchange;
+    AssetId usdAsset = exchange.addAsset("USD");
+    AssetId stock = exchange.addAsset(TICKER);
+    CHECK(exchange.addInstrument("ZERO", stock, usdAsset, 0, ATOMS_PER_UNIT) == INVALID_INSTRUMENT);
+    CHECK(exchange.addInstrument("NEGATIVE", stock, usdAsset, ATOMS_PER_UNIT / 100, -ATOMS_PER_UNIT) == INVALID_INSTRUMENT);
+    CHECK(exchange.addInstrument("FINE", stock, usdAsset, ATOMS_PER_UNIT / 100, 10) == INVALID_INSTRUMENT); // 0.1 atom per tick-lot
+    CHECK(exchange.addInstrument("ODD", stock, usdAsset, 3, ATOMS_PER_UNIT / 2) == INVALID_INSTRUMENT); // 1.5 atoms
+    CHECK(exchange.addInstrument("HUGE", stock, usdAsset, MAX_AMOUNT / 2, 4) == INVALID_INSTRUMENT);
+    CHECK(exchange.instrumentCount() == 0);
+
+    InstrumentId listed = exchange.addInstrument(TICKER, stock, usdAsset, ATOMS_PER_UNIT / 100, ATOMS_PER_UNIT);
+    CHECK(listed != INVALID_INSTRUMENT && exchange.book(listed).getInstrument().tickLotValue == ATOMS_PER_UNIT / 100);
+    CHECK(exchange.addInstrument("CENTS", stock, usdAsset, 1, ATOMS_PER_UNIT) != INVALID_INSTRUMENT); // one atom per tick-lot
+}
+
+// Instruments spread over the shards round robin; each shard matches its own books while
+// every trade settles on the one shared ledger, which neither creates nor loses atoms
+void testExchangeShards() {
+    ExchangeConfig exchangeConfig;
+    exchangeConfig.shards = 2;
+    exchangeConfig.pinThreads = false;
+    Exchange exchange(exchangeConfig);
+    AssetId usdAsset = exchange.addAsset("USD");
+    const char *symbols[4] = {"AAA", "BBB", "CCC", "DDD"};
+    InstrumentId instruments[4];
+    AccountId buyer = exchange.addAccount("Buyer");
+    AccountId seller = exchange.addAccount("Seller");
+    CHECK(exchange.deposit(buyer, usdAsset, 100000 * ATOMS_PER_UNIT));
+    for (int i = 0; i < 4; ++i) {
+        AssetId base = exchange.addAsset(symbols[i]);
+        instruments[i] = exchange.addInstrument(symbols[i], base, usdAsset, ATOMS_PER_UNIT / 100, ATOMS_PER_UNIT);
+        CHECK(instruments[i] == (InstrumentId)i && exchange.shardOf(instruments[i]) == (unsigned int)i % 2);
+        CHECK(exchange.deposit(seller, base, 100 * ATOMS_PER_UNIT));
+    }
+    CHECK(exchange.shardCount() == 2 && exchange.instrumentCount() == 4);
+
+    exchange.start();
+    CHECK(exchange.isRunning() && exchange.addInstrument("LATE", usdAsset, 1, ATOMS_PER_UNIT / 100, ATOMS_PER_UNIT) == INVALID_INSTRUMENT);
+    vector<ExchangeCommand> flow;
+    for (int i = 0; i < 4; ++i) {
+        flow.push_back({EXCHANGE_ASK, ORDER_LIMIT, {0, 0}, instruments[i], seller, 10000 + 100 * i, 10, INVALID_ORDER_ID});
+        flow.push_back({EXCHANGE_BID, ORDER_LIMIT, {0, 0}, instruments[i], buyer, 10000 + 100 * i, 6, INVALID_ORDER_ID});
+    }
+    flow.push_back({EXCHANGE_BID, ORDER_LIMIT, {0, 0}, 99, buyer, 10000, 1, INVALID_ORDER_ID});
+    exchange.submit(flow.data(), flow.size());
+    exchange.drain();
+    exchange.stop();
+
+    CHECK(exchange.shardStats(0).commands == 5 && exchange.shardStats(1).commands == 4);
+    CHECK(exchange.shardStats(0).unknownInstrument == 1 && exchange.shardStats(1).unknownInstrument == 0);
+    CHECK(exchange.shardStats(0).trades == 2 && exchange.shardStats(1).trades == 2);
+    CHECK(exchange.shardStats(0).rejects == 0 && exchange.shardStats(1).rejects == 0);
+    const Ledger &ledger = exchange.getLedger();
+    Amount paid = 0;
+    for (int i = 0; i < 4; ++i) {
+        OrderBook &book = exchange.book(instruments[i]);
+        CHECK(book.getTop().ask.price == 10000 + 100 * i && book.getTop().ask.quantity == 4 && book.getTop().bid.price == NO_PRICE);
+        CHECK(ledger.balance(buyer, book.getBaseAsset()) == 6 * ATOMS_PER_UNIT);
+        CHECK(ledger.total(seller, book.getBaseAsset()) == 94 * ATOMS_PER_UNIT);
+        paid += (10000 + 100 * i) * 6 * (ATOMS_PER_UNIT / 100);
+    }
+    CHECK(ledger.total(buyer, usdAsset) == 100000 * ATOMS_PER_UNIT - paid && ledger.total(seller, usdAsset) == paid);
+}
+
+// Cancels, reduces and replaces through the exchange reach the book only for the account
+// that owns the order, and deposits only ever add
+void testExchangeOrderChanges() {
+    Exchange exchange;
+    AssetId usdAsset = exchange.addAsset("USD");
+    AssetId stock = exchange.addAsset(TICKER);
+    InstrumentId listed = exchange.addInstrument(TICKER, stock, usdAsset, ATOMS_PER_UNIT / 100, ATOMS_PER_UNIT);
+    AccountId owner = exchange.addAccount("Owner");
+    AccountId other = exchange.addAccount("Other");
+    CHECK(exchange.deposit(owner, usdAsset, 1000 * ATOMS_PER_UNIT));
+    CHECK(!exchange.deposit(owner, usdAsset, 0) && !exchange.deposit(owner, usdAsset, -ATOMS_PER_UNIT));
+    CHECK(exchange.getLedger().balance(owner, usdAsset) == 1000 * ATOMS_PER_UNIT);
+
+    OrderBook &book = exchange.book(listed);
+    OrderId id = book.addBid(owner, 11000, 5);
+    ExchangeCommand cancelByOther = {EXCHANGE_CANCEL, ORDER_LIMIT, {0, 0}, listed, other, 0, 0, id};
+    ExchangeCommand reduceByOther = {EXCHANGE_REDUCE, ORDER_LIMIT, {0, 0}, listed, other, 0, 2, id};
+    ExchangeCommand replaceByOther = {EXCHANGE_REPLACE, ORDER_LIMIT, {0, 0}, listed, other, 10900, 5, id};
+    exchange.submit(&cancelByOther, 1);
+    exchange.submit(&reduceByOther, 1);
+    exchange.submit(&replaceByOther, 1);
+    CHECK(exchange.shardStats(0).rejects == 3 && book.ownerOf(id) == owner);
+    CHECK(book.getTop().bid.price == 11000 && book.getTop().bid.quantity == 5);
+
+    ExchangeCommand reduce = {EXCHANGE_REDUCE, ORDER_LIMIT, {0, 0}, listed, owner, 0, 2, id};
+    exchange.submit(&reduce, 1);
+    CHECK(book.getTop().bid.price == 11000 && book.getTop().bid.quantity == 3);
+    ExchangeCommand replace = {EXCHANGE_REPLACE, ORDER_LIMIT, {0, 0}, listed, owner, 10900, 4, id};
+    exchange.submit(&replace, 1);
+    CHECK(book.ownerOf(id) == INVALID_ACCOUNT && book.getTop().bid.price == 10900 && book.getTop().bid.quantity == 4);
+    OrderId moved = book.getPool().idOf(book.getBids().level(10900).head);
+    ExchangeCommand cancel = {EXCHANGE_CANCEL, ORDER_LIMIT, {0, 0}, listed, owner, 0, 0, moved};
+    exchange.submit(&cancel, 1);
+    CHECK(book.getTop().bid.price == NO_PRICE && exchange.shardStats(0).rejects == 3);
+    CHECK(exchange.getLedger().balance(owner, usdAsset) == 1000 * ATOMS_PER_UNIT);
+}
+
+// Commands of every kind, journaled while the book runs
+void runJournaledFlow(OrderBook& book, AccountId buyer, AccountId seller) {
+    OrderId resting = book.addBid(buyer, 11300, 10);
+    book.addAsk(seller, 11400, 6);
+    book.addOrder(SIDE_BID, ORDER_IOC, buyer, 11600, 8);
+    book.addOrder(SIDE_BID, ORDER_FOK, buyer, 11900, 30);
+    book.addOrder(SIDE_ASK, ORDER_MARKET, seller, 0, 12);
+    book.reduce(resting, 3);
+    OrderId moved = book.replace(resting, 11250, 5);
+    book.setLimits(buyer, 3, NO_NOTIONAL_LIMIT);
+    book.addBid(buyer, 11000, 1);
+    book.addBid(buyer, 11000, 1);
+    book.addBid(buyer, 11000, 1);
+    book.cancel(moved);
+    book.addAsk(seller, 11000, 2);
+}
+
+// A book recovered from its journal, and from a snapshot plus the journal after it, ends
+// up with the same orders and balances as the book that wrote them
+void testJournalRecovery() {
+    string directory = "orderBookTest-state";
+    filesystem::remove_all(directory);
+    PersistenceConfig persistenceConfig;
+    persistenceConfig.directory = directory;
+    persistenceConfig.snapshotEvery = 0;
+    string error;
+
+    unique_ptr<OrderBook> live(new OrderBook());
+    {
+        BookPersistence persistence(persistenceConfig);
+        CHECK(persistence.open(*live, error));
+        AccountId buyer = fundedUser(*live, "Buyer", 100000, 0);
+        AccountId seller = fundedUser(*live, "Seller", 0, 1000);
+        runJournaledFlow(*live, buyer, seller);
+        CHECK(persistence.close());
+    }
+
+    {
+        unique_ptr<OrderBook> recovered(new OrderBook());
+        BookPersistence persistence(persistenceConfig);
+        CHECK(persistence.open(*recovered, error));
+        CHECK(persistence.recovery().replayed == 19); // one record per command, the re-entering replace included
+        CHECK(recovered->bookChecksum() == live->bookChecksum());
+        CHECK(recovered->balanceChecksum() == live->balanceChecksum());
+
+        // Snapshot, more commands on top, then recover again
+        CHECK(persistence.snapshot());
+        AccountId buyer = recovered->findUser("Buyer");
+        AccountId seller = recovered->findUser("Seller");
+        runJournaledFlow(*recovered, buyer, seller);
+        CHECK(persistence.close());
+        runJournaledFlow(*live, live->findUser("Buyer"), live->findUser("Seller"));
+    }
+
+    {
+        unique_ptr<OrderBook> recovered(new OrderBook());
+        BookPersistence persistence(persistenceConfig);
+        CHECK(persistence.open(*recovered, error));
+        CHECK(recovered->bookChecksum() == live->bookChecksum());
+        CHECK(recovered->balanceChecksum() == live->balanceChecksum());
+        CHECK(persistence.close());
+    }
+    if (!error.empty()) {
+        cerr << error << endl;
+    }
+    filesystem::remove_all(directory);
+}
+
+// A snapshot that fails leaves the journal whole, so the book still recovers from it; the
+// next snapshot that makes it to disk lets the segments before it go
+void testFailedSnapshot() {
+    string directory = "orderBookTest-failed";
+    filesystem::remove_all(directory);
+    PersistenceConfig persistenceConfig;
+    persistenceConfig.directory = directory;
+    persistenceConfig.snapshotEvery = 0;
+    string error;
+
+    unique_ptr<OrderBook> live(new OrderBook());
+    {
+        BookPersistence persistence(persistenceConfig);
+        CHECK(persistence.open(*live, error));
+        AccountId buyer = fundedUser(*live, "Buyer", 100000, 0);
+        AccountId seller = fundedUser(*live, "Seller", 0, 1000);
+        runJournaledFlow(*live, buyer, seller);
+        filesystem::create_directories(directory + "/snapshot.bin.tmp"); // the child cannot write its file
+        CHECK(persistence.snapshot());
+        CHECK(!persistence.getSnapshots().wait() && persistence.getSnapshots().completedSequence() == 0);
+        runJournaledFlow(*live, buyer, seller);
+        CHECK(persistence.close());
+        filesystem::remove_all(directory + "/snapshot.bin.tmp");
+    }
+    CHECK(listJournalSegments(directory).size() == 1 && !filesystem::exists(directory + "/snapshot.bin"));
+
+    {
+        unique_ptr<OrderBook> recovered(new OrderBook());
+        BookPersistence persistence(persistenceConfig);
+        CHECK(persistence.open(*recovered, error));
+        CHECK(!persistence.recovery().snapshotLoaded);
+        CHECK(recovered->bookChecksum() == live->bookChecksum() && recovered->balanceChecksum() == live->balanceChecksum());
+        CHECK(persistence.snapshot());
+        CHECK(persistence.close());
+    }
+    CHECK(listJournalSegments(directory).size() == 1);
+
+    {
+        unique_ptr<OrderBook> recovered(new OrderBook());
+        BookPersistence persistence(persistenceConfig);
+        CHECK(persistence.open(*recovered, error));
+        CHECK(persistence.recovery().snapshotLoaded && persistence.recovery().replayed == 0);
+        CHECK(recovered->bookChecksum() == live->bookChecksum() && recovered->balanceChecksum() == live->balanceChecksum());
+        CHECK(persistence.close());
+    }
+    filesystem::remove_all(directory);
+}
+
+// Writes the book's snapshot to path, returns its bytes
+string writeSnapshotFile(const OrderBook& book, const string& path) {
+    vector<char> buffer(1 << 16);
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    SnapshotSink sink(fd, buffer.data(), buffer.size());
+    CHECK(book.writeSnapshot(sink, 7) && sink.flush());
+    ::close(fd);
+    ifstream in(path, ios::binary);
+    return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
+
+// Restores a fresh default book from the snapshot bytes, error set on failure
+bool readSnapshotBytes(const string& bytes, const string& path, string& error) {
+    ofstream(path, ios::binary | ios::trunc) << bytes;
+    SnapshotSource source;
+    unsigned long long journalSequence = 0;
+    unique_ptr<OrderBook> book(new OrderBook());
+    return source.open(path) && book->readSnapshot(source, journalSequence, error) && journalSequence == 7;
+}
+
+// A snapshot restores, and one whose header counts more accounts, assets or levels than
+// the book or the file can hold is refused before anything is sized from them
+void testSnapshotCounts() {
+    string path = "orderBookTest-snapshot.bin";
+    OrderBook book;
+    fundedUser(book, "Trader", 1000, 10);
+    string bytes = writeSnapshotFile(book, path);
+    string error;
+    CHECK(readSnapshotBytes(bytes, path, error));
+
+    unsigned long long many = 1ULL << 30; // valid account IDs, ~16 GiB of balance rows
+    string lying = bytes;
+    memcpy(&lying[offsetof(SnapshotHeader, accounts)], &many, sizeof(many));
+    CHECK(!readSnapshotBytes(lying, path, error) && error == "truncated snapshot");
+    unsigned long long huge = 1ULL << 40;
+    lying = bytes;
+    memcpy(&lying[offsetof(SnapshotHeader, assets)], &huge, sizeof(huge));
+    CHECK(!readSnapshotBytes(lying, path, error) && error == "damaged snapshot header");
+    lying = bytes;
+    memcpy(&lying[offsetof(SnapshotHeader, bidLevels)], &huge, sizeof(huge));
+    CHECK(!readSnapshotBytes(lying, path, error) && error == "damaged snapshot header");
+    CHECK(!readSnapshotBytes(bytes.substr(0, sizeof(SnapshotHeader) + 64), path, error) && error == "truncated snapshot");
+    filesystem::remove(path);
+}
+
+/**
+ * @brief Runs every check of the engine's behaviour
+ *
+ * @return int 0 if all checks passed, 1 otherwise
+ */
+int main() {
+    testMatchingPriceTime();
+    testCancelReduceReplace();
+    testCancelByPrice();
+    testRiskHolds();
+    testAmountOverflow();
+    testDepthSnapshot();
+    testSweepQuotes();
+    testOrderTypes();
+    testParseGrid();
+    testDeposits();
+    testOrderFlowCounts();
+    testGatewayRouting();
+    testGatewayOverflowBound();
+    testGatewayAnswersKept();
+    testExchangeInstruments();
+    testExchangeShards();
+    testExchangeOrderChanges();
+    testJournalRecovery();
+    testFailedSnapshot();
+    testSnapshotCounts();
+    if (failures > 0) {
+        cerr << failures << " checks failed" << endl;
+        return 1;
+    }
+    cout << "All checks passed" << endl;
+    return 0;
+}
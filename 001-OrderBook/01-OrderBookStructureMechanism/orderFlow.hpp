@@ -0,0 +1,358 @@
+#ifndef ORDERFLOW_HPP
+#define ORDERFLOW_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include "orderBook.hpp"
+
+// Order flow files drive an OrderBook without the interactive menu, e.g. to replay
+// recorded production flow and check that two engine builds end in the same state.
+//
+// Text format, one command per line, '#' starts a comment:
+//     bid <user> <price> <quantity> [limit|ioc|fok]
+//     ask <user> <price> <quantity> [limit|ioc|fok]
+//     bid <user> market <quantity>
+//     ask <user> market <quantity>
+//     cancel <order id>
+//     deposit <user> <asset> <amount>     (asset is USD or the instrument symbol)
+//     quote <quantity>
+// Prices, quantities and amounts are positive decimals, prices and quantities on the
+// instrument's tick and lot grid.
+// Users are created on first use. Order IDs are the ones the engine hands out, which
+// are deterministic for a given flow.
+//
+// Binary format (native byte order):
+//     8 bytes   ORDER_FLOW_MAGIC
+//     u32       number of users, then per user: u32 name length, name bytes
+//     u64       number of commands, then the FlowCommand records back to back
+
+const char ORDER_FLOW_MAGIC[8] = {'O', 'B', 'F', 'L', 'O', 'W', '1', '\0'};
+
+enum FlowCommandType {
+    FLOW_ADD_BID = 1,
+    FLOW_ADD_ASK,
+    FLOW_CANCEL,
+    FLOW_DEPOSIT_QUOTE, // deposit USD
+    FLOW_DEPOSIT_BASE, // deposit the traded stock
+    FLOW_QUOTE
+};
+
+// One command, 32 bytes so a binary file is a flat array that loads with a single read
+struct FlowCommand {
+    unsigned char type; // FlowCommandType
+    unsigned char orderType; // OrderType (bid, ask), ORDER_LIMIT (0) otherwise
+    unsigned char reserved[2];
+    unsigned int user; // index into OrderFlow::users
+    Price price; // ticks (bid, ask)
+    Quantity quantity; // lots (bid, ask, quote) or atoms (deposit)
+    OrderId orderId; // cancel
+};
+
+static_assert(std::is_trivially_copyable<FlowCommand>::value, "FlowCommand is written to files as is");
+static_assert(sizeof(FlowCommand) == 32, "FlowCommand layout is part of the binary format");
+
+// A whole order flow held in memory, so replay timing does not include file I/O or parsing
+struct OrderFlow {
+    std::vector<std::string> users; // user names, referenced by FlowCommand::user
+    std::vector<FlowCommand> commands;
+
+    // Index of a user name, added on first use
+    unsigned int userIndex(const std::string& name, std::unordered_map<std::string, unsigned int>& lookup) {
+        auto it = lookup.find(name);
+        if (it != lookup.end()) {
+            return it->second;
+        }
+        unsigned int index = (unsigned int)users.size();
+        users.push_back(name);
+        lookup[name] = index;
+        return index;
+    }
+};
+
+/**
+ * @brief Parses a text order flow
+ *
+ * @param in Stream holding the text format described above
+ * @param spec Instrument used to convert prices and quantities to ticks and lots
+ * @param flow Receives the users and commands
+ * @param error Set to "line N: reason" when parsing fails
+ *
+ * @return bool true if every line parsed
+ */
+inline bool readOrderFlowText(std::istream& in, const InstrumentSpec& spec, OrderFlow& flow, std::string& error) {
+    std::unordered_map<std::string, unsigned int> lookup;
+    std::string line;
+    size_t lineNumber = 0;
+
+    while (std::getline(in, line)) {
+        ++lineNumber;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+        std::istringstream fields(line);
+        std::string verb, first, second, third, extra, more;
+        if (!(fields >> verb)) {
+            continue; // blank line
+        }
+        fields >> first >> second >> third >> extra >> more;
+
+        FlowCommand command;
+        std::memset(&command, 0, sizeof(command));
+        bool ok = false;
+        if (verb == "bid" || verb == "ask") {
+            command.type = verb == "bid" ? FLOW_ADD_BID : FLOW_ADD_ASK;
+            OrderType orderType = ORDER_LIMIT;
+            if (second == orderTypeText(ORDER_MARKET)) {
+                orderType = ORDER_MARKET;
+                ok = !first.empty() && extra.empty() && spec.parseQuantity(third, command.quantity);
+            } else {
+                ok = !first.empty() && (extra.empty() || (parseOrderType(extra, orderType) && orderType != ORDER_MARKET)) && more.empty() &&
+                     spec.parsePrice(second, command.price) && spec.parseQuantity(third, command.quantity);
+            }
+            command.orderType = (unsigned char)orderType;
+            if (ok) {
+                command.user = flow.userIndex(first, lookup);
+            }
+        } else if (verb == "cancel") {
+            command.type = FLOW_CANCEL;
+            char *end = nullptr;
+            command.orderId = std::strtoull(first.c_str(), &end, 10);
+            ok = !first.empty() && *end == '\0' && second.empty();
+        } else if (verb == "deposit") {
+            command.type = second == spec.symbol ? FLOW_DEPOSIT_BASE : FLOW_DEPOSIT_QUOTE;
+            ok = !first.empty() && (second == "USD" || second == spec.symbol) && extra.empty() && parseAtoms(third, command.quantity) && command.quantity > 0;
+            if (ok) {
+                command.user = flow.userIndex(first, lookup);
+            }
+        } else if (verb == "quote") {
+            command.type = FLOW_QUOTE;
+            ok = spec.parseQuantity(first, command.quantity) && second.empty();
+        }
+
+        if (!ok) {
+            error = "line " + std::to_string(lineNumber) + ": cannot parse '" + line + "'";
+            return false;
+        }
+        flow.commands.push_back(command);
+    }
+    return true;
+}
+
+// Bytes left between the stream's position and its end, -1 if the stream cannot tell
+inline long long remainingBytes(std::istream& in) {
+    std::streampos here = in.tellg();
+    if (here < 0 || !in.seekg(0, std::ios::end)) {
+        in.clear();
+        return -1;
+    }
+    std::streampos end = in.tellg();
+    in.seekg(here);
+    return end < here ? -1 : (long long)(end - here);
+}
+
+/**
+ * @brief Parses a binary order flow
+ *
+ * @details The counts in the file are not trusted: nothing is allocated for records the
+ *          file does not hold. A seekable stream's command count is checked against what
+ *          is left of it before reading; any other stream is read in chunks.
+ *
+ * @param in Stream positioned at the magic bytes
+ * @param flow Receives the users and commands
+ * @param error Set to a reason when the file is malformed or truncated
+ *
+ * @return bool true if the whole file was read
+ */
+inline bool readOrderFlowBinary(std::istream& in, OrderFlow& flow, std::string& error) {
+    char magic[sizeof(ORDER_FLOW_MAGIC)];
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, ORDER_FLOW_MAGIC, sizeof(magic)) != 0) {
+        error = "not a binary order flow file";
+        return false;
+    }
+
+    unsigned int userCount = 0;
+    if (!in.read((char*)&userCount, sizeof(userCount))) {
+        error = "truncated user table";
+        return false;
+    }
+    flow.users.clear();
+    for (unsigned int i = 0; i < userCount; ++i) {
+        unsigned int length = 0;
+        if (!in.read((char*)&length, sizeof(length)) || length > 4096) {
+            error = "truncated user table";
+            return false;
+        }
+        std::string name(length, '\0');
+        if (length > 0 && !in.read(&name[0], length)) {
+            error = "truncated user table";
+            return false;
+        }
+        flow.users.push_back(name);
+    }
+
+    unsigned long long commandCount = 0;
+    if (!in.read((char*)&commandCount, sizeof(commandCount))) {
+        error = "truncated command count";
+        return false;
+    }
+    long long remaining = remainingBytes(in);
+    if (remaining >= 0 && commandCount > (unsigned long long)remaining / sizeof(FlowCommand)) {
+        error = "truncated command records";
+        return false;
+    }
+    const size_t chunk = 65536; // commands read at a time when the stream cannot tell its size
+    flow.commands.clear();
+    while (flow.commands.size() < commandCount) {
+        size_t done = flow.commands.size();
+        size_t count = (size_t)(remaining >= 0 ? commandCount - done : std::min<unsigned long long>(commandCount - done, chunk));
+        flow.commands.resize(done + count);
+        if (!in.read((char*)(flow.commands.data() + done), (std::streamsize)(count * sizeof(FlowCommand)))) {
+            error = "truncated command records";
+            return false;
+        }
+    }
+    for (const FlowCommand &command : flow.commands) {
+        if (command.type < FLOW_ADD_BID || command.type > FLOW_QUOTE || command.orderType >= ORDER_TYPES || (command.type != FLOW_CANCEL && command.type != FLOW_QUOTE && command.user >= userCount)) {
+            error = "invalid command record";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Writes a flow in the binary format, returns false if the stream failed
+inline bool writeOrderFlowBinary(std::ostream& out, const OrderFlow& flow) {
+    out.write(ORDER_FLOW_MAGIC, sizeof(ORDER_FLOW_MAGIC));
+    unsigned int userCount = (unsigned int)flow.users.size();
+    out.write((const char*)&userCount, sizeof(userCount));
+    for (const std::string &name : flow.users) {
+        unsigned int length = (unsigned int)name.size();
+        out.write((const char*)&length, sizeof(length));
+        out.write(name.data(), length);
+    }
+    unsigned long long commandCount = flow.commands.size();
+    out.write((const char*)&commandCount, sizeof(commandCount));
+    out.write((const char*)flow.commands.data(), (std::streamsize)(commandCount * sizeof(FlowCommand)));
+    return (bool)out;
+}
+
+// Loads a flow file, picking the binary or text parser from the first bytes
+inline bool loadOrderFlow(const std::string& path, const InstrumentSpec& spec, OrderFlow& flow, std::string& error) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+    char magic[sizeof(ORDER_FLOW_MAGIC)] = {0};
+    file.read(magic, sizeof(magic));
+    bool binary = file.gcount() == (std::streamsize)sizeof(magic) && std::memcmp(magic, ORDER_FLOW_MAGIC, sizeof(magic)) == 0;
+    file.clear();
+    file.seekg(0);
+    return binary ? readOrderFlowBinary(file, flow, error) : readOrderFlowText(file, spec, flow, error);
+}
+
+// Counts execution reports and folds them into a checksum, the replay's event listener
+class EventChecksum : public ExecutionListener {
+    public:
+    unsigned long long count;
+    unsigned long long fills; // fill and partial fill reports (two per trade)
+    unsigned long long rejects;
+    unsigned long long hash;
+
+    EventChecksum() : count(0), fills(0), rejects(0), hash(CHECKSUM_SEED) {};
+
+    void onEvent(const ExecutionEvent& event) {
+        ++count;
+        fills += (event.type == EVENT_FILL || event.type == EVENT_PARTIAL_FILL);
+        rejects += (event.type == EVENT_REJECTED || event.type == EVENT_SETTLEMENT_FAILED);
+        hash = mixChecksum(hash, ((unsigned long long)event.type << 8) | event.reason);
+        hash = mixChecksum(hash, event.orderId);
+        hash = mixChecksum(hash, event.contraOrderId);
+        hash = mixChecksum(hash, (unsigned long long)event.price);
+        hash = mixChecksum(hash, (unsigned long long)event.quantity);
+        hash = mixChecksum(hash, (unsigned long long)event.leavesQuantity);
+    }
+};
+
+// What a replay did and how long it took
+struct ReplayResult {
+    size_t commands; // commands executed
+    double seconds; // wall time of the command loop only
+    EventChecksum events; // execution reports produced
+    Amount quotedAmount; // sum of every quote's cost, so quotes take part in the checksums
+    unsigned long long bookChecksum; // OrderBook::bookChecksum() at the end
+    unsigned long long balanceChecksum; // OrderBook::balanceChecksum() at the end
+};
+
+/**
+ * @brief Runs an order flow through a book as fast as it can
+ *
+ * @details Users of the flow are resolved to accounts first (existing users such as
+ *          the market makers are reused, others are created). Only the command loop is
+ *          timed; nothing is printed while it runs.
+ *
+ * @param book The book to drive, its listener is replaced for the run
+ * @param flow The commands to execute
+ *
+ * @return ReplayResult Throughput numbers and end-of-run checksums
+ */
+inline ReplayResult replayOrderFlow(OrderBook& book, const OrderFlow& flow) {
+    std::vector<AccountId> accounts(flow.users.size());
+    for (size_t i = 0; i < flow.users.size(); ++i) {
+        accounts[i] = book.findUser(flow.users[i]);
+        if (accounts[i] == INVALID_ACCOUNT) {
+            accounts[i] = book.makeUser(flow.users[i]);
+        }
+    }
+    const std::string quoteMarket = "USD";
+    const std::string baseMarket = book.getInstrument().symbol;
+
+    ReplayResult result;
+    result.commands = flow.commands.size();
+    result.quotedAmount = 0;
+    book.setListener(&result.events);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (const FlowCommand &command : flow.commands) {
+        switch (command.type) {
+            case FLOW_ADD_BID:
+                book.addOrder(SIDE_BID, (OrderType)command.orderType, accounts[command.user], command.price, command.quantity);
+                break;
+            case FLOW_ADD_ASK:
+                book.addOrder(SIDE_ASK, (OrderType)command.orderType, accounts[command.user], command.price, command.quantity);
+                break;
+            case FLOW_CANCEL:
+                book.cancel(command.orderId);
+                break;
+            case FLOW_DEPOSIT_QUOTE:
+                book.addBalance(accounts[command.user], quoteMarket, command.quantity);
+                break;
+            case FLOW_DEPOSIT_BASE:
+                book.addBalance(accounts[command.user], baseMarket, command.quantity);
+                break;
+            case FLOW_QUOTE: {
+                Quantity available;
+                result.quotedAmount += book.quoteBuy(command.quantity, available);
+                break;
+            }
+        }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    book.setListener(nullptr);
+    result.bookChecksum = book.bookChecksum();
+    result.balanceChecksum = book.balanceChecksum();
+    return result;
+}
+
+#endif // ORDERFLOW_HPP
@@ -0,0 +1,202 @@
+#include "orderGateway.hpp"
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+using namespace std;
+
+GatewaySession& OrderGateway::openSession() {
+    sessions.push_back(unique_ptr<GatewaySession>(new GatewaySession(queueCapacity)));
+    return *sessions.back();
+}
+
+void OrderGateway::attachAccount(AccountId account, GatewaySession& session) {
+    if (account >= accountSessions.size()) {
+        accountSessions.resize((size_t)account + 1, nullptr);
+    }
+    accountSessions[account] = &session;
+}
+
+/**
+ * @brief Whether the executing session may act for the account a request is about
+ *
+ * @details A bid or ask acts for the account it names, a cancel, reduce or replace for the
+ *          account of the order it names. Either must be attached to the sending session.
+ *          An order that is no longer resting has no account to check; the book reports it
+ *          as not found.
+ */
+bool OrderGateway::permits(const GatewayRequest& request) const {
+    bool entersOrder = request.type == GATEWAY_BID || request.type == GATEWAY_ASK;
+    AccountId account = entersOrder ? request.account : book.ownerOf(request.orderId);
+    if (!entersOrder && account == INVALID_ACCOUNT) {
+        return true;
+    }
+    return account < accountSessions.size() && accountSessions[account] == current;
+}
+
+// Answers a request the book never saw with an EVENT_REJECTED report
+void OrderGateway::refuse(const GatewayRequest& request, RejectReason reason) {
+    ExecutionEvent event;
+    std::memset(&event, 0, sizeof(event));
+    event.orderId = request.orderId;
+    event.account = request.account;
+    event.contraAccount = INVALID_ACCOUNT;
+    event.price = request.price;
+    event.quantity = request.quantity;
+    event.type = EVENT_REJECTED;
+    event.reason = reason;
+    event.isBid = request.type == GATEWAY_BID;
+    onEvent(event);
+}
+
+/**
+ * @brief Runs one request on the book
+ *
+ * @note Matching thread only. Every request gets an answer: a malformed one is refused with
+ *       REJECT_UNKNOWN_COMMAND, one for an account of another session with REJECT_NOT_PERMITTED.
+ */
+void OrderGateway::execute(const GatewayRequest& request) {
+    ++stats.requests;
+    if (request.type < GATEWAY_BID || request.type > GATEWAY_REPLACE) {
+        refuse(request, REJECT_UNKNOWN_COMMAND);
+        return;
+    }
+    if (!permits(request)) {
+        refuse(request, REJECT_NOT_PERMITTED);
+        return;
+    }
+    switch (request.type) {
+        case GATEWAY_BID: book.addOrder(SIDE_BID, (OrderType)request.orderType, request.account, request.price, request.quantity); break;
+        case GATEWAY_ASK: book.addOrder(SIDE_ASK, (OrderType)request.orderType, request.account, request.price, request.quantity); break;
+        case GATEWAY_CANCEL: book.cancel(request.orderId); break;
+        case GATEWAY_REDUCE: book.reduce(request.orderId, request.quantity); break;
+        case GATEWAY_REPLACE: book.replace(request.orderId, request.price, request.quantity); break;
+    }
+}
+
+/**
+ * @brief Routes one execution report to its session
+ *
+ * @details A report about the executing request's own order, or its acceptance or
+ *          rejection, answers the request: it goes to the session that sent it, tagged
+ *          with its ID. Anything else is about a resting order the request traded against
+ *          and goes to the session that order's account is attached to, untagged. A full
+ *          report ring parks the report in the session's overflow, which keeps the order of
+ *          its reports. An answer is always parked, growing the overflow past its reserve if
+ *          one sweep answers with more reports than that; an untagged report that finds the
+ *          reserve used up is dropped.
+ */
+void OrderGateway::onEvent(const ExecutionEvent& event) {
+    bool answers = current != nullptr && (event.type == EVENT_ACCEPTED || event.type == EVENT_REJECTED ||
+                                         (event.orderId == currentOrder && currentOrder != INVALID_ORDER_ID));
+    if (answers && event.type == EVENT_ACCEPTED) {
+        currentOrder = event.orderId; // a new order, or the one a replace re-entered
+    }
+    GatewaySession *target = answers ? current : event.account < accountSessions.size() ? accountSessions[event.account] : nullptr;
+    if (target == nullptr) {
+        ++stats.unrouted;
+        return;
+    }
+    GatewayReport report;
+    report.event = event;
+    report.requestId = answers ? currentRequest : 0;
+    if (target->overflow.empty() && target->reports.tryPush(report)) {
+        return;
+    }
+    if (answers || target->overflow.size() < target->reports.capacity()) {
+        target->overflow.push_back(report);
+        ++stats.overflowed;
+    } else {
+        target->dropped.fetch_add(1, memory_order_release);
+        ++stats.dropped;
+    }
+}
+
+bool OrderGateway::flushOverflow(GatewaySession& session) {
+    size_t sent = 0;
+    while (sent < session.overflow.size() && session.reports.tryPush(session.overflow[sent])) {
+        ++sent;
+    }
+    session.overflow.erase(session.overflow.begin(), session.overflow.begin() + sent);
+    return session.overflow.empty();
+}
+
+/**
+ * @brief Body of the matching thread
+ *
+ * @details Visits every session in turn and drains a batch of its requests in place. When a
+ *          whole pass finds nothing it backs off (spin, then yield). After stop() it keeps
+ *          going until a pass finds nothing, so everything submitted before stop() is matched.
+ *
+ * @param core Core to pin the thread to, negative for none
+ */
+void OrderGateway::run(int core) {
+#ifdef __linux__
+    if (core >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(core, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+#else
+    (void)core;
+#endif
+    Backoff backoff;
+    while (true) {
+        bool finishing = stopping.load(memory_order_acquire);
+        size_t done = 0;
+        for (unique_ptr<GatewaySession> &session : sessions) {
+            if (!session->overflow.empty() && !flushOverflow(*session)) {
+                ++stats.deferred; // its client is behind on reports, leave its requests queued
+                continue;
+            }
+            current = session.get();
+            size_t count = session->requests.consume([this](const GatewayRequest& request) {
+                currentRequest = request.requestId;
+                currentOrder = request.type == GATEWAY_BID || request.type == GATEWAY_ASK ? INVALID_ORDER_ID : request.orderId;
+                execute(request);
+            }, batchSize);
+            stats.batches += count > 0 ? 1 : 0;
+            done += count;
+        }
+        current = nullptr;
+        if (done > 0) {
+            backoff.reset();
+        } else if (finishing) {
+            return;
+        } else {
+            ++stats.idleRounds;
+            backoff.pause();
+        }
+    }
+}
+
+/**
+ * @brief Launches the matching thread and routes the book's reports through the gateway
+ *
+ * @param core Core to pin the matching thread to, negative to leave it to the scheduler
+ */
+void OrderGateway::start(int core) {
+    if (matcher.joinable()) {
+        return;
+    }
+    stopping.store(false, memory_order_relaxed);
+    previousListener = book.getListener();
+    book.setListener(this);
+    matcher = thread(&OrderGateway::run, this, core);
+}
+
+/**
+ * @brief Stops the matching thread once it has drained every request ring
+ *
+ * @note Requests of a session whose reports are parked stay queued if its client never
+ *       reads them; everything else submitted before stop() is matched
+ */
+void OrderGateway::stop() {
+    if (!matcher.joinable()) {
+        return;
+    }
+    stopping.store(true, memory_order_release);
+    matcher.join();
+    book.setListener(previousListener);
+}
@@ -0,0 +1,194 @@
+#ifndef ORDERGATEWAY_HPP
+#define ORDERGATEWAY_HPP
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "orderBook.hpp"
+#include "spscQueue.hpp"
+
+enum GatewayCommandType {
+    GATEWAY_BID = 1,
+    GATEWAY_ASK,
+    GATEWAY_CANCEL,
+    GATEWAY_REDUCE,
+    GATEWAY_REPLACE
+};
+
+// One command of a client session
+struct GatewayRequest {
+    unsigned char type; // GatewayCommandType
+    unsigned char orderType; // OrderType (bid, ask), ORDER_LIMIT (0) otherwise
+    unsigned char reserved[2];
+    AccountId account; // bid, ask
+    Price price; // bid, ask, replace
+    Quantity quantity; // bid, ask, reduce, replace
+    OrderId orderId; // cancel, reduce, replace
+    unsigned long long requestId; // set by the session, echoed in the reports it causes
+};
+
+// An execution report on its way back to a session
+struct GatewayReport {
+    ExecutionEvent event;
+    unsigned long long requestId; // request of this session it answers, 0 for what other requests did to this session's resting orders
+};
+
+class OrderGateway;
+
+/**
+ * @brief One client session: a request queue into the matching thread and a report queue
+ *        back out of it
+ *
+ * @details Both queues are single-producer single-consumer rings, so a session belongs to
+ *          one client thread: only that thread may submit and poll. A request may only
+ *          act for the accounts attached to the session: orders for another account, and
+ *          cancels, reduces and replaces of its orders, are refused with
+ *          REJECT_NOT_PERMITTED. Reports of the session's own requests come back in request
+ *          order; fills of resting orders of the accounts attached to it that other
+ *          requests caused come back with requestId 0.
+ *
+ *          Reports that find the ring full are parked in an overflow as large as the ring,
+ *          allocated up front. Answers to the session's own requests are never lost: when
+ *          one request answers with more reports than ring and overflow hold, the overflow
+ *          grows. Untagged reports past the overflow are dropped and counted, see
+ *          droppedCount().
+ */
+class GatewaySession {
+    friend class OrderGateway;
+
+    private:
+    SpscQueue<GatewayRequest> requests; // client -> matching thread
+    SpscQueue<GatewayReport> reports; // matching thread -> client
+    std::vector<GatewayReport> overflow; // reports that did not fit, matching thread only, grows past the ring's size for answers only
+    std::atomic<unsigned long long> dropped; // untagged reports lost because the overflow was full too, written by the matching thread
+    unsigned long long lastRequestId; // client thread only
+    unsigned long long refused; // client thread only, pushes refused because the ring was full
+
+    public:
+    GatewaySession(size_t queueCapacity) : requests(queueCapacity), reports(queueCapacity * 4), dropped(0), lastRequestId(0), refused(0) {
+        overflow.reserve(reports.capacity());
+    };
+
+    /**
+     * @brief Queues a request for the matching thread
+     *
+     * @param request The command; its requestId is filled in
+     * @param wait true to spin (then yield) while the queue is full, false to give up
+     *
+     * @return unsigned long long The request ID, or 0 if the queue was full and wait is false
+     */
+    unsigned long long submit(GatewayRequest request, bool wait = true) {
+        request.requestId = lastRequestId + 1;
+        Backoff backoff;
+        while (!requests.tryPush(request)) {
+            if (!wait) {
+                ++refused;
+                return 0;
+            }
+            backoff.pause();
+        }
+        return ++lastRequestId;
+    }
+
+    unsigned long long order(Side side, OrderType type, AccountId account, Price price, Quantity qty, bool wait = true) {
+        GatewayRequest request = {(unsigned char)(side == SIDE_BID ? GATEWAY_BID : GATEWAY_ASK), (unsigned char)type, {0, 0}, account, price, qty, INVALID_ORDER_ID, 0};
+        return submit(request, wait);
+    }
+    unsigned long long bid(AccountId account, Price price, Quantity qty, bool wait = true) { return order(SIDE_BID, ORDER_LIMIT, account, price, qty, wait); }
+    unsigned long long ask(AccountId account, Price price, Quantity qty, bool wait = true) { return order(SIDE_ASK, ORDER_LIMIT, account, price, qty, wait); }
+    unsigned long long cancel(OrderId id, bool wait = true) {
+        GatewayRequest request = {GATEWAY_CANCEL, ORDER_LIMIT, {0, 0}, INVALID_ACCOUNT, 0, 0, id, 0};
+        return submit(request, wait);
+    }
+
+    // Takes the next report, false if none is waiting
+    bool poll(GatewayReport& report) { return reports.tryPop(report); }
+
+    unsigned long long refusedCount() const { return refused; }
+    unsigned long long droppedCount() const { return dropped.load(std::memory_order_acquire); } // reports this session never got
+    unsigned long long submittedCount() const { return lastRequestId; }
+};
+
+// What the matching thread did, read after stop()
+struct GatewayStats {
+    unsigned long long requests; // commands executed
+    unsigned long long batches; // non-empty drains of a session's queue
+    unsigned long long idleRounds; // passes over all sessions that found nothing to do
+    unsigned long long deferred; // times a session was skipped because its reports did not fit
+    unsigned long long overflowed; // reports parked because a session's report ring was full
+    unsigned long long dropped; // untagged reports lost because a session's ring and overflow were both full
+    unsigned long long unrouted; // reports with no session to go to
+};
+
+/**
+ * @brief Feeds one OrderBook from many client sessions through lock-free queues on a
+ *        dedicated (optionally pinned) matching thread
+ *
+ * @details The matching thread visits the sessions round robin and drains up to
+ *          batchSize requests from each per visit, so nothing on the order path takes a
+ *          lock and a busy session cannot starve the others. The reports a request causes
+ *          about its own order (accept or reject, fills, rest, cancel, reduce, and the new
+ *          order of a replace) answer it in the session that sent it, with its request ID.
+ *          A session only acts for the accounts attached to it, see GatewaySession.
+ *          Fills of the resting orders it traded against go to the session their account
+ *          is attached to, with requestId 0, and are counted as unrouted when there is none.
+ *
+ *          Backpressure: a full request ring refuses (or delays) submits. A full report ring
+ *          parks the reports and the session's requests are not drained again until its
+ *          client has read them, so a slow reader holds back only its own flow. The matching
+ *          thread never waits for a client, and only allocates for one when a single batch
+ *          of its requests answers with more reports than its ring and overflow hold: a
+ *          session that stops reading while others trade against its orders loses what
+ *          does not fit, never the answers to its own requests.
+ *
+ *          Open sessions and attach accounts before start(). While running, the book belongs
+ *          to the matching thread and must not be touched from elsewhere.
+ */
+class OrderGateway : public ExecutionListener {
+    private:
+    OrderBook& book;
+    size_t queueCapacity;
+    size_t batchSize;
+    std::vector<std::unique_ptr<GatewaySession>> sessions;
+    std::vector<GatewaySession*> accountSessions; // indexed by AccountId, null when not attached
+    GatewaySession* current; // session whose request is executing
+    unsigned long long currentRequest;
+    OrderId currentOrder; // order the executing request is about, known once it is accepted
+    ExecutionListener* previousListener; // restored by stop()
+    std::atomic<bool> stopping;
+    std::thread matcher;
+    GatewayStats stats;
+
+    bool permits(const GatewayRequest& request) const; // the executing session may act for the request's account
+    void refuse(const GatewayRequest& request, RejectReason reason); // answers a request the book never sees
+    void execute(const GatewayRequest& request);
+    bool flushOverflow(GatewaySession& session); // true once nothing is parked for the session
+    void run(int core);
+
+    public:
+    /**
+     * @param orderBook The book to drive; it must outlive the gateway
+     * @param sessionQueueCapacity Requests each session can have in flight (reports get 4x)
+     * @param requestsPerBatch Most requests drained from one session before moving on
+     */
+    OrderGateway(OrderBook& orderBook, size_t sessionQueueCapacity = 4096, size_t requestsPerBatch = 64)
+        : book(orderBook), queueCapacity(sessionQueueCapacity), batchSize(requestsPerBatch), current(nullptr), currentRequest(0), currentOrder(INVALID_ORDER_ID),
+          previousListener(nullptr), stopping(false) {
+        std::memset(&stats, 0, sizeof(stats));
+    };
+    ~OrderGateway() { stop(); }
+
+    GatewaySession& openSession(); // before start()
+    void attachAccount(AccountId account, GatewaySession& session); // before start(), the session acts for it and gets fills of its resting orders
+
+    void start(int core = -1); // launches the matching thread, pinned to core unless it is negative
+    void stop(); // matches everything already submitted, then joins the thread
+    bool isRunning() const { return matcher.joinable(); }
+    const GatewayStats& getStats() const { return stats; }
+
+    void onEvent(const ExecutionEvent& event); // routes the book's reports, matching thread only
+};
+
+#endif // ORDERGATEWAY_HPP
@@ -0,0 +1,132 @@
+#ifndef ORDERPOOL_HPP
+#define ORDERPOOL_HPP
+
+#include <type_traits>
+#include <vector>
+#include "fixedPoint.hpp"
+#include "ledger.hpp"
+
+// Unique ID handed back for every accepted order, used to cancel or modify it later
+typedef unsigned long long OrderId;
+const OrderId INVALID_ORDER_ID = 0; // returned when an order is rejected
+
+typedef unsigned int OrderIndex; // slot of an order in the OrderPool
+const OrderIndex NO_ORDER = 0xFFFFFFFFu; // end of a list / no slot available
+
+// A resting order, 32 bytes. The fields read by every match come first.
+// The order's side is implied by the price level it rests in.
+struct Order {
+    Quantity quantity; // remaining quantity in lots, 0 while the slot is free
+    Price price; // in ticks
+    OrderIndex next; // next order in the same price level (or next free slot)
+    AccountId account; // account that placed the order
+    unsigned int generation; // how many times this slot has been reused, part of the order ID
+};
+
+// Fields only needed to cancel or modify an order, kept out of the matching loop's cache lines
+struct OrderLinks {
+    OrderIndex prev; // previous order in the same level, not maintained for the head of a level
+    bool isBid; // which side the order rests on
+};
+
+static_assert(std::is_trivially_copyable<Order>::value, "Order must stay a plain record");
+static_assert(sizeof(Order) == 32, "Order should fill exactly half a cache line");
+
+// Fixed-size pool of resting orders, sized once at startup.
+// Slots are recycled through a free list, so order entry, matching and cancels never touch
+// the heap. Order IDs encode the slot and its generation, which makes lookup by ID a mask
+// and a compare instead of a hash table probe.
+class OrderPool {
+    private:
+    std::vector<Order> orders; // hot part of every slot
+    std::vector<OrderLinks> links; // cold part of every slot
+    OrderIndex freeHead; // first free slot, linked through Order::next
+    unsigned int capacityBits; // capacity == 1 << capacityBits
+    size_t inUse; // slots currently holding an order
+    size_t highWater; // most slots ever in use at once
+
+    public:
+    OrderPool() : freeHead(NO_ORDER), capacityBits(0), inUse(0), highWater(0) {};
+
+    // Allocates room for at least minCapacity orders (rounded up to a power of two)
+    void reserve(size_t minCapacity) {
+        capacityBits = 0;
+        while (((size_t)1 << capacityBits) < minCapacity) {
+            ++capacityBits;
+        }
+        size_t capacity = (size_t)1 << capacityBits;
+        orders.assign(capacity, Order());
+        links.assign(capacity, OrderLinks());
+        for (size_t i = 0; i < capacity; ++i) {
+            orders[i].next = (i + 1 < capacity) ? (OrderIndex)(i + 1) : NO_ORDER;
+        }
+        freeHead = 0;
+        inUse = 0;
+        highWater = 0;
+    }
+
+    // Takes a slot off the free list, returns NO_ORDER when the pool is exhausted
+    OrderIndex allocate() {
+        OrderIndex slot = freeHead;
+        if (slot != NO_ORDER) {
+            freeHead = orders[slot].next;
+            orders[slot].next = NO_ORDER;
+            if (++inUse > highWater) {
+                highWater = inUse;
+            }
+        }
+        return slot;
+    }
+
+    // Returns a slot to the free list. Bumping the generation invalidates its old order ID.
+    void release(OrderIndex slot) {
+        Order &order = orders[slot];
+        order.quantity = 0;
+        order.generation++;
+        order.next = freeHead;
+        freeHead = slot;
+        --inUse;
+    }
+
+    // ID of the order currently held in a slot. The first use of each slot gives IDs 1, 2, 3...
+    OrderId idOf(OrderIndex slot) const {
+        return ((OrderId)orders[slot].generation << capacityBits) + slot + 1;
+    }
+
+    // Slot holding a live order with this ID, or NO_ORDER if it was filled, cancelled or never existed
+    OrderIndex find(OrderId id) const {
+        if (id == INVALID_ORDER_ID) {
+            return NO_ORDER;
+        }
+        OrderIndex slot = (OrderIndex)((id - 1) & (((OrderId)1 << capacityBits) - 1));
+        const Order &order = orders[slot];
+        if (order.quantity <= 0 || order.generation != ((id - 1) >> capacityBits)) {
+            return NO_ORDER;
+        }
+        return slot;
+    }
+
+    Order& at(OrderIndex slot) { return orders[slot]; }
+    const Order& at(OrderIndex slot) const { return orders[slot]; }
+    OrderLinks& linksAt(OrderIndex slot) { return links[slot]; }
+    const OrderLinks& linksAt(OrderIndex slot) const { return links[slot]; }
+
+    // Raw slot arrays and free list, for snapshots. restoreState() takes over what was
+    // copied into the arrays from a pool of the same capacity.
+    Order* orderData() { return orders.data(); }
+    const Order* orderData() const { return orders.data(); }
+    OrderLinks* linkData() { return links.data(); }
+    const OrderLinks* linkData() const { return links.data(); }
+    OrderIndex freeList() const { return freeHead; }
+    void restoreState(OrderIndex head, size_t used, size_t peak) {
+        freeHead = head;
+        inUse = used;
+        highWater = peak;
+    }
+
+    size_t capacity() const { return orders.size(); }
+    size_t size() const { return inUse; }
+    size_t peak() const { return highWater; }
+};
+
+#endif // ORDERPOOL_HPP
@@ -0,0 +1,899 @@
+#include "persistence.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Writes all of data, retrying short writes and interrupted calls
+static bool writeFully(int fd, const char* data, size_t bytes) {
+    while (bytes > 0) {
+        ssize_t written = ::write(fd, data, bytes);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        bytes -= (size_t)written;
+    }
+    return true;
+}
+
+// Flushes a file's data to the device; metadata only as far as needed to read it back
+static bool syncData(int fd) {
+#ifdef __linux__
+    return ::fdatasync(fd) == 0;
+#else
+    return ::fsync(fd) == 0;
+#endif
+}
+
+// Makes files created in or renamed into a directory survive a crash
+static bool syncDirectory(const string& directory) {
+    int fd = ::open(directory.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+static string systemError(const string& what) {
+    return what + ": " + strerror(errno);
+}
+
+// Folds one word into a record checksum; a word at a time, since the journal thread checks every record
+static inline unsigned long long mixWord(unsigned long long hash, unsigned long long value) {
+    hash = (hash ^ value) * 0x9E3779B97F4A7C15ULL;
+    return hash ^ (hash >> 29);
+}
+
+unsigned long long journalCheck(const JournalRecord& record, const char* name) {
+    unsigned long long hash = CHECKSUM_SEED;
+    hash = mixWord(hash, record.sequence);
+    hash = mixWord(hash, ((unsigned long long)record.orderType << 24) | ((unsigned long long)record.type << 16) | record.nameLength);
+    hash = mixWord(hash, record.account);
+    hash = mixWord(hash, (unsigned long long)record.price);
+    hash = mixWord(hash, (unsigned long long)record.quantity);
+    hash = mixWord(hash, record.orderId);
+    for (size_t at = 0; at < record.nameLength; at += 8) {
+        unsigned long long chunk = 0;
+        memcpy(&chunk, name + at, record.nameLength - at < 8 ? record.nameLength - at : 8);
+        hash = mixWord(hash, chunk);
+    }
+    return hash;
+}
+
+/**
+ * @brief Constructor for the Journal class
+ *
+ * @param journalConfig Buffer size and sync policy
+ *
+ * @note The buffers are reserved here, so appends do not allocate
+ */
+Journal::Journal(const JournalConfig& journalConfig)
+    : config(journalConfig), fd(-1), holding(false), pruneUpTo(0), nextSequence(1), queuedSequence(0), durable(0), stopping(false), writerIdle(false), writeFailed(false) {
+    pending.reserve(config.bufferBytes);
+    writing.reserve(config.bufferBytes);
+    staged.reserve(64 * 1024);
+    memset(&stats, 0, sizeof(stats));
+}
+
+/**
+ * @brief Opens the journal of a state directory for appending and starts its thread
+ *
+ * @details The last existing segment loses a torn tail, if the previous run crashed in
+ *          the middle of a write, and is left as it is otherwise; appends go to a new
+ *          segment that starts right after the last record on disk, or after `after`
+ *          if a snapshot already covers more than the journal holds.
+ *
+ * @param stateDirectory Directory of the segments, created if missing
+ * @param after Last sequence already reflected in the book (RecoveryResult::lastSequence)
+ *
+ * @return bool false (see error()) if the directory or segment cannot be written
+ */
+bool Journal::open(const string& stateDirectory, unsigned long long after) {
+    if (isOpen()) {
+        return false;
+    }
+    directory = stateDirectory;
+    error_code failure;
+    filesystem::create_directories(directory, failure);
+    if (failure) {
+        lastError = "cannot create " + directory + ": " + failure.message();
+        return false;
+    }
+
+    unsigned long long last = after;
+    vector<JournalSegment> segments = listJournalSegments(directory);
+    if (!segments.empty()) {
+        JournalReader reader;
+        if (!reader.open(segments.back().path)) {
+            ::unlink(segments.back().path.c_str()); // created, but the crash came before its header was on disk
+        } else {
+            JournalRecord record;
+            string name;
+            unsigned long long inFile = reader.firstSequence() - 1;
+            while (reader.next(record, name)) {
+                inFile = record.sequence;
+            }
+            if (reader.tornTail() && ::truncate(segments.back().path.c_str(), (off_t)reader.validBytes()) != 0) {
+                lastError = systemError("cannot cut the torn tail of " + segments.back().path);
+                return false;
+            }
+            last = inFile > last ? inFile : last;
+        }
+    }
+
+    nextSequence = last + 1;
+    queuedSequence = last;
+    durable.store(last, memory_order_release);
+    stopping = false;
+    writeFailed = false;
+    string failureText;
+    if (!startSegment(nextSequence, failureText)) {
+        lastError = failureText;
+        return false;
+    }
+    writer = thread(&Journal::run, this);
+    return true;
+}
+
+/**
+ * @brief Writes and syncs everything appended so far, then stops the journal thread
+ *
+ * @return bool false if any record could not be made durable
+ */
+bool Journal::close() {
+    release(); // a burst still held is written too
+    if (writer.joinable()) {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+            writerIdle = false;
+        }
+        wake.notify_one();
+        writer.join();
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    lock_guard<mutex> guard(lock);
+    return !writeFailed;
+}
+
+/**
+ * @brief Appends one command to the pending batch
+ *
+ * @details Holds the lock for a copy. Only waits when the batch is full, and only wakes
+ *          the journal thread when it is asleep, so a busy journal costs no system call.
+ */
+void Journal::append(JournalCommandType type, OrderType orderType, AccountId account, Price price, Quantity qty, OrderId id, const string* name) {
+    size_t nameLength = name == nullptr ? 0 : (name->size() < MAX_JOURNAL_NAME ? name->size() : MAX_JOURNAL_NAME);
+    size_t bytes = journalRecordBytes(nameLength);
+    JournalRecord record;
+    record.sequence = nextSequence++;
+    record.type = (unsigned char)type;
+    record.orderType = (unsigned char)orderType;
+    record.nameLength = (unsigned short)nameLength;
+    record.account = account;
+    record.price = price;
+    record.quantity = qty;
+    record.orderId = id;
+    record.check = 0;
+
+    if (holding) {
+        size_t at = staged.size();
+        staged.resize(at + bytes); // zero fills the name padding
+        memcpy(&staged[at], &record, sizeof(record));
+        if (nameLength > 0) {
+            memcpy(&staged[at + sizeof(record)], name->data(), nameLength);
+        }
+        return;
+    }
+
+    unique_lock<mutex> guard(lock);
+    if (!pending.empty() && pending.size() + bytes > config.bufferBytes) {
+        ++stats.waits;
+        drained.wait(guard, [this, bytes] { return pending.empty() || pending.size() + bytes <= config.bufferBytes; });
+    }
+    size_t at = pending.size();
+    pending.resize(at + bytes); // zero fills the name padding
+    memcpy(&pending[at], &record, sizeof(record));
+    if (nameLength > 0) {
+        memcpy(&pending[at + sizeof(record)], name->data(), nameLength);
+    }
+    queuedSequence = record.sequence;
+    if (writerIdle) {
+        writerIdle = false;
+        guard.unlock();
+        wake.notify_one();
+    }
+}
+
+/**
+ * @brief Stages the appends that follow in a private buffer, without taking the lock
+ *
+ * @details For a burst of commands (OrderBook::submitBatch): their records get their
+ *          sequence numbers as usual, and release() hands them to the journal thread under
+ *          one lock. Nothing staged can become durable before release(), so do not
+ *          waitDurable() on it in between.
+ */
+void Journal::hold() {
+    holding = true;
+}
+
+/**
+ * @brief Queues the records staged since hold() for the journal thread in one go
+ *
+ * @note Waits only if the pending batch cannot take them; a burst larger than the whole
+ *       buffer is queued once the buffer is empty and grows it
+ */
+void Journal::release() {
+    holding = false;
+    if (staged.empty()) {
+        return;
+    }
+    unsigned long long lastSequence = nextSequence - 1;
+    unique_lock<mutex> guard(lock);
+    if (!pending.empty() && pending.size() + staged.size() > config.bufferBytes) {
+        ++stats.waits;
+        drained.wait(guard, [this] { return pending.empty() || pending.size() + staged.size() <= config.bufferBytes; });
+    }
+    pending.insert(pending.end(), staged.begin(), staged.end());
+    queuedSequence = lastSequence;
+    staged.clear();
+    if (writerIdle) {
+        writerIdle = false;
+        guard.unlock();
+        wake.notify_one();
+    }
+}
+
+/**
+ * @brief Makes the next record start a new segment
+ *
+ * @note Called when a snapshot is taken, so the segments before it can be deleted once
+ *       the snapshot is on disk
+ */
+void Journal::rotate() {
+    lock_guard<mutex> guard(lock);
+    rotations.push_back(nextSequence);
+    if (writerIdle) {
+        writerIdle = false;
+        wake.notify_one();
+    }
+}
+
+/**
+ * @brief Lets the journal thread delete segments whose records are all at or below upTo
+ *
+ * @note The segment being written is never deleted
+ */
+void Journal::requestPrune(unsigned long long upTo) {
+    lock_guard<mutex> guard(lock);
+    pruneUpTo = upTo > pruneUpTo ? upTo : pruneUpTo;
+    if (writerIdle) {
+        writerIdle = false;
+        wake.notify_one();
+    }
+}
+
+/**
+ * @brief Blocks until the record with this sequence has been written and synced
+ *
+ * @return bool false if the journal failed before getting there
+ */
+bool Journal::waitDurable(unsigned long long sequence) {
+    unique_lock<mutex> guard(lock);
+    drained.wait(guard, [this, sequence] { return durable.load(memory_order_acquire) >= sequence || writeFailed || !writer.joinable(); });
+    return durable.load(memory_order_acquire) >= sequence;
+}
+
+bool Journal::failed() {
+    lock_guard<mutex> guard(lock);
+    return writeFailed;
+}
+
+string Journal::error() {
+    lock_guard<mutex> guard(lock);
+    return lastError;
+}
+
+/**
+ * @brief Syncs and closes the current segment and starts a new one
+ *
+ * @param firstSequence Sequence of the new segment's first record, part of its name
+ * @param error Set to the reason on failure
+ *
+ * @return bool false if the new segment cannot be created
+ */
+bool Journal::startSegment(unsigned long long firstSequence, string& error) {
+    if (fd >= 0) {
+        if (config.sync && !syncData(fd)) {
+            error = systemError("cannot sync a journal segment");
+            return false;
+        }
+        ::close(fd);
+        fd = -1;
+    }
+    char fileName[64];
+    snprintf(fileName, sizeof(fileName), "journal-%020llu.log", firstSequence);
+    string path = directory + "/" + fileName;
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        error = systemError("cannot create " + path);
+        return false;
+    }
+    JournalFileHeader header;
+    memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+    header.firstSequence = firstSequence;
+    if (!writeFully(fd, (const char*)&header, sizeof(header)) || (config.sync && (!syncData(fd) || !syncDirectory(directory)))) {
+        error = systemError("cannot write " + path);
+        return false;
+    }
+    ++stats.segments;
+    stats.bytes += sizeof(header);
+    return true;
+}
+
+/**
+ * @brief Checksums the swapped-out batch and writes it, starting new segments where
+ *        rotations were asked for, then syncs once
+ *
+ * @param segmentStarts Sequences at which a new segment starts, ascending
+ * @param error Set to the reason on failure
+ *
+ * @return bool true if the whole batch is durable
+ */
+bool Journal::writeBatch(const vector<unsigned long long>& segmentStarts, string& error) {
+    size_t nextStart = 0;
+    size_t begin = 0; // first byte not written yet
+    size_t at = 0;
+    while (at < writing.size()) {
+        JournalRecord record;
+        memcpy(&record, &writing[at], sizeof(record));
+        if (nextStart < segmentStarts.size() && record.sequence >= segmentStarts[nextStart]) {
+            if (!writeFully(fd, &writing[begin], at - begin)) {
+                error = systemError("cannot write the journal");
+                return false;
+            }
+            stats.bytes += at - begin;
+            begin = at;
+            while (nextStart + 1 < segmentStarts.size() && record.sequence >= segmentStarts[nextStart + 1]) {
+                ++nextStart; // several rotations with no record in between: only the last segment is needed
+            }
+            if (!startSegment(segmentStarts[nextStart++], error)) {
+                return false;
+            }
+        }
+        record.check = journalCheck(record, &writing[at + sizeof(record)]);
+        memcpy(&writing[at], &record, sizeof(record));
+        at += journalRecordBytes(record.nameLength);
+        ++stats.records;
+    }
+    if (!writeFully(fd, &writing[begin], at - begin)) {
+        error = systemError("cannot write the journal");
+        return false;
+    }
+    stats.bytes += at - begin;
+    if (nextStart < segmentStarts.size() && !startSegment(segmentStarts.back(), error)) {
+        return false; // rotated after the last record: open the next segment now
+    }
+    if (config.sync && !syncData(fd)) {
+        error = systemError("cannot sync the journal");
+        return false;
+    }
+    ++stats.batches;
+    return true;
+}
+
+/**
+ * @brief Deletes the segments whose every record is at or below upTo
+ *
+ * @details Segment i holds the records from its first sequence up to the next segment's
+ *          first sequence minus one, so it can go once that is covered by a snapshot.
+ */
+void Journal::prune(unsigned long long upTo) {
+    vector<JournalSegment> segments = listJournalSegments(directory);
+    for (size_t i = 0; i + 1 < segments.size(); ++i) {
+        if (segments[i + 1].firstSequence - 1 <= upTo) {
+            ::unlink(segments[i].path.c_str());
+        }
+    }
+}
+
+/**
+ * @brief Body of the journal thread
+ *
+ * @details Sleeps until there is work, swaps the pending batch out under the lock and
+ *          writes it with the lock released, so appends only ever wait for a vector swap.
+ *          Whatever piles up during a write and sync becomes the next batch, which is what
+ *          groups the commits. After a failure batches are dropped: durableSequence()
+ *          stops moving and failed() reports it.
+ */
+void Journal::run() {
+    vector<unsigned long long> segmentStarts;
+    unique_lock<mutex> guard(lock);
+    while (true) {
+        if (pending.empty() && rotations.empty() && pruneUpTo == 0) {
+            if (stopping) {
+                return;
+            }
+            writerIdle = true;
+            wake.wait(guard, [this] { return !writerIdle; });
+            continue;
+        }
+        writing.swap(pending);
+        segmentStarts.swap(rotations);
+        rotations.clear();
+        unsigned long long upTo = pruneUpTo;
+        pruneUpTo = 0;
+        unsigned long long last = queuedSequence;
+        bool dead = writeFailed;
+        guard.unlock();
+        drained.notify_all(); // room in pending again
+
+        string failure;
+        bool ok = dead || writeBatch(segmentStarts, failure);
+        if (ok && !dead && upTo > 0) {
+            prune(upTo);
+        }
+        writing.clear();
+        segmentStarts.clear();
+
+        guard.lock();
+        if (!ok) {
+            writeFailed = true;
+            lastError = failure;
+        } else if (!dead) {
+            durable.store(last, memory_order_release);
+        }
+        drained.notify_all();
+    }
+}
+
+/**
+ * @brief Lists the journal segments of a state directory
+ *
+ * @return vector<JournalSegment> Segments by ascending first sequence, empty if the
+ *         directory does not exist
+ */
+vector<JournalSegment> listJournalSegments(const string& stateDirectory) {
+    vector<JournalSegment> segments;
+    error_code failure;
+    for (filesystem::directory_iterator it(stateDirectory, failure), end; !failure && it != end; it.increment(failure)) {
+        string fileName = it->path().filename().string();
+        if (fileName.size() != 32 || fileName.compare(0, 8, "journal-") != 0 || fileName.compare(28, 4, ".log") != 0) {
+            continue;
+        }
+        char *stop = nullptr;
+        unsigned long long first = strtoull(fileName.c_str() + 8, &stop, 10);
+        if (stop != fileName.c_str() + 28) {
+            continue;
+        }
+        JournalSegment segment = {first, it->path().string()};
+        segments.push_back(segment);
+    }
+    sort(segments.begin(), segments.end(), [](const JournalSegment& a, const JournalSegment& b) { return a.firstSequence < b.firstSequence; });
+    return segments;
+}
+
+bool JournalReader::open(const string& path) {
+    close();
+    torn = false;
+    lastError.clear();
+    file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        lastError = systemError("cannot open " + path);
+        return false;
+    }
+    setvbuf(file, nullptr, _IOFBF, 1 << 20);
+    JournalFileHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, JOURNAL_MAGIC, sizeof(header.magic)) != 0) {
+        lastError = path + " is not a journal segment";
+        close();
+        return false;
+    }
+    first = header.firstSequence;
+    expected = header.firstSequence;
+    offset = sizeof(header);
+    return true;
+}
+
+/**
+ * @brief Reads the next record and its name
+ *
+ * @return bool false at the end of the segment or at the first torn record
+ */
+bool JournalReader::next(JournalRecord& record, string& name) {
+    if (file == nullptr || torn) {
+        return false;
+    }
+    size_t got = fread(&record, 1, sizeof(record), file);
+    if (got == 0 && feof(file)) {
+        return false;
+    }
+    if (got != sizeof(record) || record.sequence != expected || record.type < JOURNAL_MAKE_USER || record.type > JOURNAL_SET_LIMITS ||
+        record.orderType >= ORDER_TYPES) {
+        torn = true;
+        return false;
+    }
+    size_t padded = journalRecordBytes(record.nameLength) - sizeof(record);
+    if (nameBuffer.size() < padded + 1) {
+        nameBuffer.resize(padded + 1);
+    }
+    if (padded > 0 && fread(nameBuffer.data(), 1, padded, file) != padded) {
+        torn = true;
+        return false;
+    }
+    if (journalCheck(record, nameBuffer.data()) != record.check) {
+        torn = true;
+        return false;
+    }
+    name.assign(nameBuffer.data(), record.nameLength);
+    offset += sizeof(record) + padded;
+    ++expected;
+    return true;
+}
+
+void JournalReader::close() {
+    if (file != nullptr) {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+bool SnapshotSink::writeAll(const char* data, size_t bytes) {
+    good = good && writeFully(fd, data, bytes);
+    return good;
+}
+
+bool SnapshotSink::put(const void* data, size_t bytes) {
+    total += bytes;
+    if (used + bytes > capacity) {
+        flush();
+        if (bytes >= capacity) {
+            return writeAll((const char*)data, bytes);
+        }
+    }
+    memcpy(buffer + used, data, bytes);
+    used += bytes;
+    return good;
+}
+
+bool SnapshotSink::flush() {
+    if (used > 0) {
+        writeAll(buffer, used);
+        used = 0;
+    }
+    return good;
+}
+
+bool SnapshotSource::open(const string& path) {
+    close();
+    file = fopen(path.c_str(), "rb");
+    if (file != nullptr) {
+        setvbuf(file, nullptr, _IOFBF, 1 << 20);
+    }
+    return file != nullptr;
+}
+
+bool SnapshotSource::get(void* data, size_t bytes) {
+    return file != nullptr && fread(data, 1, bytes, file) == bytes;
+}
+
+long long SnapshotSource::remaining() {
+    if (file == nullptr) {
+        return -1;
+    }
+    off_t here = ftello(file);
+    if (here < 0 || fseeko(file, 0, SEEK_END) != 0) {
+        return -1;
+    }
+    off_t end = ftello(file);
+    if (fseeko(file, here, SEEK_SET) != 0 || end < here) {
+        return -1;
+    }
+    return (long long)(end - here);
+}
+
+void SnapshotSource::close() {
+    if (file != nullptr) {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+/**
+ * @brief Forks a child that writes a snapshot of the book as it is right now
+ *
+ * @param book The book, frozen for the child by the fork
+ * @param journalSequence Last journal record the book reflects (Journal::lastSequence())
+ * @param stateDirectory Where snapshot.bin goes
+ *
+ * @return bool false if a snapshot is still being written or fork() failed
+ *
+ * @note pauseSeconds() tells how long the caller was held, which is the fork itself
+ */
+bool SnapshotWriter::start(const OrderBook& book, unsigned long long journalSequence, const string& stateDirectory) {
+    if (busy() && running()) {
+        lastError = "a snapshot is still being written";
+        return false;
+    }
+    target = stateDirectory + "/snapshot.bin";
+    string temporary = target + ".tmp";
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Child: a private copy of the book; write it out without allocating and leave
+        int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        SnapshotSink sink(fd, buffer.data(), buffer.size());
+        bool ok = book.writeSnapshot(sink, journalSequence) && sink.flush() && ::fsync(fd) == 0;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        ok = ok && ::rename(temporary.c_str(), target.c_str()) == 0 && syncDirectory(stateDirectory);
+        _exit(ok ? 0 : 1);
+    }
+    pause = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    if (pid < 0) {
+        lastError = systemError("cannot fork the snapshot writer");
+        return false;
+    }
+    child = pid;
+    pendingSequence = journalSequence;
+    return true;
+}
+
+bool SnapshotWriter::finish(bool ok) {
+    child = 0;
+    if (ok) {
+        completed = pendingSequence;
+        lastError.clear();
+    } else {
+        lastError = "cannot write " + target;
+    }
+    return ok;
+}
+
+bool SnapshotWriter::running() {
+    if (child == 0) {
+        return false;
+    }
+    int status = 0;
+    pid_t done = waitpid((pid_t)child, &status, WNOHANG);
+    if (done == 0) {
+        return true;
+    }
+    finish(done == (pid_t)child && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    return false;
+}
+
+bool SnapshotWriter::wait() {
+    if (child == 0) {
+        return true;
+    }
+    int status = 0;
+    pid_t done;
+    do {
+        done = waitpid((pid_t)child, &status, 0);
+    } while (done < 0 && errno == EINTR);
+    return finish(done == (pid_t)child && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+// Runs one journaled command against the book, exactly as it first ran
+static void applyRecord(OrderBook& book, const JournalRecord& record, const string& name) {
+    switch (record.type) {
+        case JOURNAL_MAKE_USER: book.makeUser(name); break;
+        case JOURNAL_DEPOSIT: book.addBalance(record.account, name, record.quantity); break;
+        case JOURNAL_ADD_BID: book.addOrder(SIDE_BID, (OrderType)record.orderType, record.account, record.price, record.quantity); break;
+        case JOURNAL_ADD_ASK: book.addOrder(SIDE_ASK, (OrderType)record.orderType, record.account, record.price, record.quantity); break;
+        case JOURNAL_CANCEL_BID: book.cancelBid(record.account, record.price, record.quantity); break;
+        case JOURNAL_CANCEL_ASK: book.cancelAsk(record.account, record.price, record.quantity); break;
+        case JOURNAL_CANCEL: book.cancel(record.orderId); break;
+        case JOURNAL_REDUCE: book.reduce(record.orderId, record.quantity); break;
+        case JOURNAL_REPLACE: book.replace(record.orderId, record.price, record.quantity); break;
+        case JOURNAL_SET_LIMITS: book.setLimits(record.account, (unsigned int)record.price, record.quantity); break;
+    }
+}
+
+/**
+ * @brief Restores a book from a state directory: the latest snapshot, then every
+ *        journal record after it
+ *
+ * @details Without a snapshot the journal is replayed on top of the book as constructed,
+ *          which is the state it was first recorded against. Segments wholly covered by
+ *          the snapshot are not even opened. The records must continue the sequence
+ *          without a gap; only the last segment may end in a torn record, which is what a
+ *          crash mid-write leaves and is dropped. Nothing is reported to the book's
+ *          listener or journaled again while replaying.
+ *
+ * @param book A freshly constructed book with the configuration the state was saved with
+ * @param stateDirectory Directory holding snapshot.bin and the journal segments
+ * @param result Receives what was loaded and replayed, and how long it took
+ * @param error Set to the reason on failure
+ *
+ * @return bool false if the snapshot or journal cannot be used; the book is then in an
+ *         unspecified state and must not be used
+ */
+bool recoverBook(OrderBook& book, const string& stateDirectory, RecoveryResult& result, string& error) {
+    result = RecoveryResult();
+    ExecutionListener *listener = book.getListener();
+    Journal *journal = book.getJournal();
+    book.setListener(nullptr);
+    book.setJournal(nullptr);
+    struct Reattach {
+        OrderBook &book;
+        ExecutionListener *listener;
+        Journal *journal;
+        ~Reattach() {
+            book.setListener(listener);
+            book.setJournal(journal);
+        }
+    } reattach = {book, listener, journal};
+
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    string snapshotPath = stateDirectory + "/snapshot.bin";
+    SnapshotSource source;
+    if (source.open(snapshotPath)) {
+        string failure;
+        if (!book.readSnapshot(source, result.snapshotSequence, failure)) {
+            error = snapshotPath + ": " + failure;
+            return false;
+        }
+        result.snapshotLoaded = true;
+    }
+    source.close();
+    chrono::steady_clock::time_point loaded = chrono::steady_clock::now();
+    result.snapshotSeconds = chrono::duration<double>(loaded - begin).count();
+
+    unsigned long long last = result.snapshotSequence;
+    vector<JournalSegment> segments = listJournalSegments(stateDirectory);
+    JournalReader reader;
+    JournalRecord record;
+    string name;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        bool isLast = i + 1 == segments.size();
+        if (!isLast && segments[i + 1].firstSequence <= last + 1) {
+            continue; // every record in it is already in the book
+        }
+        if (!reader.open(segments[i].path)) {
+            if (isLast) {
+                result.tornTail = true; // created, but the crash came before its header was on disk
+                break;
+            }
+            error = reader.error();
+            return false;
+        }
+        ++result.segments;
+        while (reader.next(record, name)) {
+            if (record.sequence <= last) {
+                continue;
+            }
+            if (record.sequence != last + 1) {
+                error = segments[i].path + ": journal continues at record " + to_string(record.sequence) + ", record " + to_string(last + 1) + " is missing";
+                return false;
+            }
+            applyRecord(book, record, name);
+            last = record.sequence;
+            ++result.replayed;
+        }
+        if (reader.tornTail()) {
+            if (!isLast) {
+                error = segments[i].path + ": damaged record " + to_string(reader.validBytes()) + " bytes in, with newer segments after it";
+                return false;
+            }
+            result.tornTail = true;
+        }
+        reader.close();
+    }
+    result.lastSequence = last;
+    result.replaySeconds = chrono::duration<double>(chrono::steady_clock::now() - loaded).count();
+    return true;
+}
+
+/**
+ * @brief Recovers the book from the state directory and starts journaling its commands
+ *
+ * @param target A freshly constructed book; it must outlive close()
+ * @param error Set to the reason on failure
+ *
+ * @return bool false if recovery failed or the journal cannot be written
+ */
+bool BookPersistence::open(OrderBook& target, string& error) {
+    if (book != nullptr) {
+        error = "already open";
+        return false;
+    }
+    error_code failure;
+    filesystem::create_directories(config.directory, failure);
+    if (failure) {
+        error = "cannot create " + config.directory + ": " + failure.message();
+        return false;
+    }
+    if (!recoverBook(target, config.directory, recovered, error)) {
+        return false;
+    }
+    if (!journal.open(config.directory, recovered.lastSequence)) {
+        error = journal.error();
+        return false;
+    }
+    book = &target;
+    book->setJournal(&journal);
+    lastSnapshotSequence = recovered.snapshotSequence;
+    attemptedSequence = recovered.snapshotSequence;
+    return true;
+}
+
+/**
+ * @brief Takes in a snapshot that made it to disk: the journal starts a new segment and
+ *        the segments it covers may go
+ *
+ * @note Nothing moves for a snapshot that failed, in the child or at fork(), so the
+ *       journal keeps everything since the last snapshot that is on disk
+ */
+void BookPersistence::adoptSnapshot() {
+    if (snapshots.completedSequence() > lastSnapshotSequence) {
+        lastSnapshotSequence = snapshots.completedSequence();
+        journal.rotate();
+        journal.requestPrune(lastSnapshotSequence);
+    }
+}
+
+/**
+ * @brief Housekeeping between two commands: reaps a finished snapshot, prunes the journal
+ *        behind it and starts the next snapshot when snapshotEvery records have passed
+ *        since the last one was started
+ *
+ * @note A system call only every 1024 polls while a snapshot is being written, none otherwise
+ */
+void BookPersistence::poll() {
+    if (book == nullptr) {
+        return;
+    }
+    if (snapshots.busy()) {
+        if (++polls < 1024 || snapshots.running()) {
+            return;
+        }
+        polls = 0;
+    }
+    adoptSnapshot();
+    if (config.snapshotEvery > 0 && journal.lastSequence() - attemptedSequence >= config.snapshotEvery) {
+        snapshot();
+    }
+}
+
+bool BookPersistence::snapshot() {
+    if (book == nullptr || (snapshots.busy() && snapshots.running())) {
+        return false;
+    }
+    adoptSnapshot();
+    attemptedSequence = journal.lastSequence(); // a failed attempt is retried snapshotEvery records later
+    polls = 0;
+    return snapshots.start(*book, attemptedSequence, config.directory);
+}
+
+bool BookPersistence::close() {
+    if (book == nullptr) {
+        return true;
+    }
+    bool ok = snapshots.wait();
+    adoptSnapshot();
+    ok = journal.close() && ok;
+    book->setJournal(nullptr);
+    book = nullptr;
+    return ok;
+}
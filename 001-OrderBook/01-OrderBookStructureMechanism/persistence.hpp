@@ -0,0 +1,396 @@
+#ifndef PERSISTENCE_HPP
+#define PERSISTENCE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "orderBook.hpp"
+
+// Crash recovery for a book that owns its ledger (the default OrderBook).
+//
+// Every command that can change the book is appended to a write-ahead journal before it
+// runs. The journal is a series of segment files, each named after the sequence number of
+// its first record; a background thread writes and fsyncs whatever commands have piled up
+// since its last sync in one go (group commit), so the matching thread never waits for
+// the disk. Now and then the whole state (ledger, order pool, price levels) is written to
+// a snapshot by a forked child, which sees a frozen copy-on-write image of the book while
+// matching carries on in the parent. Restarting loads the latest snapshot and replays the
+// journal records that came after it; the engine is deterministic, so the book ends up
+// exactly as it was, order IDs included.
+//
+// State directory:
+//     snapshot.bin                    latest complete snapshot (written to .tmp, then renamed)
+//     journal-<first sequence>.log    journal segments, a new one starts once a snapshot is on disk
+//
+// Journal segment (native byte order): JournalFileHeader, then JournalRecord after
+// JournalRecord, each followed by nameLength name bytes padded to a multiple of 8.
+//
+// Snapshot (native byte order): SnapshotHeader; per asset then per account a u32 name
+// length and the name; the available then the held balance table (accounts x maxAssets
+// atoms each); an AccountRisk per account; the pool's Order and OrderLinks arrays;
+// bidLevels then askLevels SnapshotLevel records, best first; SNAPSHOT_END_MAGIC.
+
+const char JOURNAL_MAGIC[8] = {'O', 'B', 'J', 'R', 'N', 'L', '1', '\0'};
+const char SNAPSHOT_MAGIC[8] = {'O', 'B', 'S', 'N', 'A', 'P', '2', '\0'};
+const char SNAPSHOT_END_MAGIC[8] = {'O', 'B', 'S', 'N', 'A', 'P', 'E', '\0'};
+const size_t MAX_JOURNAL_NAME = 0xFFFF; // longest user or asset name a record carries, longer names are cut
+
+enum JournalCommandType {
+    JOURNAL_MAKE_USER = 1, // name
+    JOURNAL_DEPOSIT, // account, quantity (atoms), name (asset)
+    JOURNAL_ADD_BID, // account, price, quantity, orderType
+    JOURNAL_ADD_ASK,
+    JOURNAL_CANCEL_BID, // account, price, quantity
+    JOURNAL_CANCEL_ASK,
+    JOURNAL_CANCEL, // orderId
+    JOURNAL_REDUCE, // orderId, quantity
+    JOURNAL_REPLACE, // orderId, price, quantity
+    JOURNAL_SET_LIMITS // account, price (max open orders), quantity (max open notional, atoms)
+};
+
+// One journaled command, 48 bytes, followed by its name bytes (if any)
+struct JournalRecord {
+    unsigned long long sequence; // 1, 2, 3... over the life of the book, never reused
+    unsigned char type; // JournalCommandType
+    unsigned char orderType; // OrderType of an added order, ORDER_LIMIT (0) otherwise
+    unsigned short nameLength; // name bytes after the record, before padding
+    AccountId account;
+    Price price; // ticks
+    Quantity quantity; // lots, atoms for a deposit
+    OrderId orderId;
+    unsigned long long check; // checksum of the fields above and the name, filled in by the journal thread
+};
+
+struct JournalFileHeader {
+    char magic[8]; // JOURNAL_MAGIC
+    unsigned long long firstSequence; // sequence of the segment's first record, also in its file name
+};
+
+static_assert(std::is_trivially_copyable<JournalRecord>::value, "JournalRecord is written to files as is");
+static_assert(sizeof(JournalRecord) == 48, "JournalRecord layout is part of the journal format");
+static_assert(sizeof(JournalFileHeader) == 16, "JournalFileHeader layout is part of the journal format");
+
+// Checksum a journal record is stored with, over its fields and name
+unsigned long long journalCheck(const JournalRecord& record, const char* name);
+
+// Bytes a record with nameLength name bytes takes in a segment
+inline size_t journalRecordBytes(size_t nameLength) {
+    return sizeof(JournalRecord) + ((nameLength + 7) & ~(size_t)7);
+}
+
+struct JournalConfig {
+    size_t bufferBytes; // commands buffered between two syncs before the matching thread has to wait
+    bool sync; // fsync every batch; off only for benchmarks that must not measure the disk
+
+    JournalConfig() {
+        bufferBytes = 4 << 20;
+        sync = true;
+    }
+};
+
+// What the journal thread did, read while it is idle or after close()
+struct JournalStats {
+    unsigned long long records; // commands written
+    unsigned long long bytes; // bytes written, headers included
+    unsigned long long batches; // writes, one sync each
+    unsigned long long segments; // segment files started
+    unsigned long long waits; // appends that found the buffer full and had to wait
+};
+
+/**
+ * @brief Append-only, group-committed journal of the commands of one book
+ *
+ * @details The matching thread appends records to a pending buffer under a mutex held
+ *          for a copy only. The journal thread swaps the whole buffer out, checksums and
+ *          writes it with one write() and one fsync, then publishes the highest sequence
+ *          now on disk; while it syncs, the next batch piles up. The matching thread only
+ *          blocks when bufferBytes of commands are waiting, which is the backpressure that
+ *          keeps a slow disk from eating all memory.
+ *
+ *          Execution reports go out before their command is durable; a front-end that
+ *          must not acknowledge anything it could lose waits for durableSequence() first.
+ */
+class Journal {
+    private:
+    JournalConfig config;
+    std::string directory; // where the segments live
+    int fd; // current segment, journal thread only once started
+    std::mutex lock;
+    std::condition_variable wake; // pending has records, a rotation or prune was asked for, or stopping
+    std::condition_variable drained; // the journal thread took pending or made records durable
+    std::vector<char> pending; // appended by the matching thread under lock
+    std::vector<char> writing; // swapped out of pending and written by the journal thread
+    std::vector<char> staged; // matching thread: records appended while held, moved to pending by release()
+    bool holding; // matching thread: appends go to staged
+    std::vector<unsigned long long> rotations; // under lock: start a new segment at these sequences
+    unsigned long long pruneUpTo; // under lock: delete segments holding only records up to this sequence
+    unsigned long long nextSequence; // matching thread: sequence of the next record
+    unsigned long long queuedSequence; // under lock: last sequence in pending
+    std::atomic<unsigned long long> durable; // last sequence written and synced
+    bool stopping; // under lock
+    bool writerIdle; // under lock: the journal thread is waiting for work, wake it on append
+    bool writeFailed; // under lock: a write or sync failed, nothing after durable is on disk
+    std::string lastError; // under lock
+    JournalStats stats; // journal thread only, but waits is counted by appends under lock
+    std::thread writer;
+
+    void append(JournalCommandType type, OrderType orderType, AccountId account, Price price, Quantity qty, OrderId id, const std::string* name);
+    bool startSegment(unsigned long long firstSequence, std::string& error); // journal thread (or open): closes fd, opens a new segment
+    bool writeBatch(const std::vector<unsigned long long>& segmentStarts, std::string& error); // journal thread: checksums and writes `writing`
+    void prune(unsigned long long upTo); // journal thread: deletes segments made obsolete by a snapshot
+    void run(); // body of the journal thread
+
+    public:
+    Journal(const JournalConfig& journalConfig = JournalConfig());
+    ~Journal() { close(); }
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    bool open(const std::string& stateDirectory, unsigned long long after); // new segment after sequence `after`, starts the thread
+    bool close(); // writes and syncs everything appended, joins the thread; false if anything was lost
+
+    // Matching thread: journal one command, before running it
+    void record(JournalCommandType type, AccountId account, Price price, Quantity qty, OrderId id) { append(type, ORDER_LIMIT, account, price, qty, id, nullptr); }
+    void recordOrder(JournalCommandType type, OrderType orderType, AccountId account, Price price, Quantity qty) { append(type, orderType, account, price, qty, INVALID_ORDER_ID, nullptr); }
+    void recordName(JournalCommandType type, AccountId account, Amount value, const std::string& name) { append(type, ORDER_LIMIT, account, 0, value, INVALID_ORDER_ID, &name); }
+    void hold(); // matching thread: stage appends without the lock until release()
+    void release(); // matching thread: queues everything staged under one lock
+    void rotate(); // matching thread: the next record starts a new segment
+    void requestPrune(unsigned long long upTo); // any thread: segments wholly at or below upTo may go
+
+    unsigned long long lastSequence() const { return nextSequence - 1; } // matching thread: last record appended
+    unsigned long long durableSequence() const { return durable.load(std::memory_order_acquire); } // last record on disk
+    bool waitDurable(unsigned long long sequence); // blocks until sequence is on disk, false if the journal failed
+    bool failed();
+    std::string error();
+    const JournalStats& getStats() const { return stats; } // only while idle or closed
+    bool isOpen() const { return writer.joinable(); }
+};
+
+// A journal segment found in a state directory
+struct JournalSegment {
+    unsigned long long firstSequence;
+    std::string path;
+};
+
+std::vector<JournalSegment> listJournalSegments(const std::string& stateDirectory); // oldest first
+
+/**
+ * @brief Reads the records of one journal segment in order
+ *
+ * @details Stops at the first record that is cut short, fails its checksum or does not
+ *          continue the sequence; a crash mid-write leaves exactly such a torn tail, which
+ *          tornTail() reports together with validBytes() (where the next record would go).
+ */
+class JournalReader {
+    private:
+    std::FILE* file;
+    unsigned long long first; // sequence of the segment's first record, from its header
+    unsigned long long expected; // sequence the next record must have
+    unsigned long long offset; // bytes of valid records read so far, header included
+    bool torn; // the segment ends in a record that is not whole and valid
+    std::string lastError;
+    std::vector<char> nameBuffer;
+
+    public:
+    JournalReader() : file(nullptr), first(0), expected(0), offset(0), torn(false) {};
+    ~JournalReader() { close(); }
+    JournalReader(const JournalReader&) = delete;
+    JournalReader& operator=(const JournalReader&) = delete;
+
+    bool open(const std::string& path); // checks the header
+    bool next(JournalRecord& record, std::string& name); // false at the end or at a torn record
+    void close();
+    unsigned long long firstSequence() const { return first; }
+    unsigned long long validBytes() const { return offset; }
+    bool tornTail() const { return torn; }
+    const std::string& error() const { return lastError; }
+};
+
+// Fixed part at the start of a snapshot, 160 bytes
+struct SnapshotHeader {
+    char magic[8]; // SNAPSHOT_MAGIC
+    char symbol[16]; // instrument, NUL padded; must match the book restored into
+    Amount tickSize;
+    Amount lotSize;
+    unsigned long long poolCapacity; // BookConfig::orderCapacity after rounding
+    Price minPrice; // price band
+    Price maxPrice;
+    unsigned long long journalSequence; // last journal record reflected in the snapshot
+    unsigned long long eventSequence; // sequence of the last execution report
+    unsigned long long bidChanges; // BookSide::changeCount() of each side
+    unsigned long long askChanges;
+    unsigned long long accounts;
+    unsigned long long assets;
+    unsigned long long maxAssets; // balance columns per account
+    unsigned long long freeHead; // first free pool slot
+    unsigned long long inUse; // pool slots holding an order
+    unsigned long long highWater; // pool peak
+    unsigned long long bidLevels; // occupied levels per side
+    unsigned long long askLevels;
+};
+
+// One occupied price level; the orders themselves are linked through the pool arrays
+struct SnapshotLevel {
+    Price price;
+    Quantity quantity;
+    OrderIndex head;
+    OrderIndex tail;
+    unsigned int orders;
+    unsigned int reserved;
+};
+
+static_assert(sizeof(SnapshotHeader) == 160, "SnapshotHeader layout is part of the snapshot format");
+static_assert(sizeof(SnapshotLevel) == 32, "SnapshotLevel layout is part of the snapshot format");
+static_assert(sizeof(AccountRisk) == 24, "AccountRisk layout is part of the snapshot format");
+
+/**
+ * @brief Buffered writer over a raw file descriptor that never allocates, so a forked
+ *        child can serialize a book without touching the heap
+ */
+class SnapshotSink {
+    private:
+    int fd;
+    char* buffer; // preallocated by the parent
+    size_t capacity;
+    size_t used;
+    unsigned long long total; // bytes accepted
+    bool good;
+
+    bool writeAll(const char* data, size_t bytes);
+
+    public:
+    SnapshotSink(int fileDescriptor, char* writeBuffer, size_t bufferBytes) : fd(fileDescriptor), buffer(writeBuffer), capacity(bufferBytes), used(0), total(0), good(fileDescriptor >= 0) {};
+
+    bool put(const void* data, size_t bytes); // large blocks bypass the buffer
+    bool flush();
+    bool ok() const { return good; }
+    unsigned long long bytes() const { return total; }
+};
+
+// Reads a snapshot file back, section by section
+class SnapshotSource {
+    private:
+    std::FILE* file;
+
+    public:
+    SnapshotSource() : file(nullptr) {};
+    ~SnapshotSource() { close(); }
+    SnapshotSource(const SnapshotSource&) = delete;
+    SnapshotSource& operator=(const SnapshotSource&) = delete;
+
+    bool open(const std::string& path);
+    bool get(void* data, size_t bytes); // false when the file ends first
+    long long remaining(); // bytes left to read, -1 if the file cannot tell
+    void close();
+};
+
+/**
+ * @brief Takes snapshots of a book in a forked child, so matching only stops for the fork
+ *
+ * @details start() forks; the child serializes its copy-on-write image of the book to
+ *          snapshot.bin.tmp, fsyncs it and renames it over snapshot.bin, so the state
+ *          directory always holds one complete snapshot. The parent goes straight back to
+ *          matching and reaps the child through running() or wait(). Pages the parent
+ *          changes meanwhile are copied by the kernel on first write, which spreads the
+ *          remaining cost over the following commands.
+ *
+ * @note Needs POSIX fork(); the child never allocates, so other threads holding locks
+ *       at the moment of the fork cannot block it
+ */
+class SnapshotWriter {
+    private:
+    std::vector<char> buffer; // the child's write buffer, allocated before forking
+    long child; // pid of the running child, 0 when none
+    std::string target; // snapshot.bin of the running snapshot
+    unsigned long long pendingSequence; // journal sequence of the running snapshot
+    unsigned long long completed; // journal sequence of the last snapshot that made it to disk
+    double pause; // seconds the last start() held the caller
+    std::string lastError;
+
+    bool finish(bool ok); // records the outcome of the snapshot that just ended
+
+    public:
+    SnapshotWriter() : buffer(1 << 20), child(0), pendingSequence(0), completed(0), pause(0) {};
+    ~SnapshotWriter() { wait(); }
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    bool start(const OrderBook& book, unsigned long long journalSequence, const std::string& stateDirectory); // false if one is running or it failed
+    bool busy() const { return child != 0; } // a child was started and not reaped yet, no system call
+    bool running(); // reaps a finished child without blocking
+    bool wait(); // blocks until the running snapshot (if any) is done, false if it failed
+    unsigned long long completedSequence() const { return completed; }
+    double pauseSeconds() const { return pause; }
+    const std::string& error() const { return lastError; }
+};
+
+// What recoverBook() found and did
+struct RecoveryResult {
+    bool snapshotLoaded; // a snapshot was found and loaded
+    unsigned long long snapshotSequence; // journal sequence the snapshot reflects, 0 without one
+    unsigned long long replayed; // journal records replayed on top of it
+    unsigned long long lastSequence; // last journal record reflected in the book now
+    unsigned long long segments; // journal segments read
+    bool tornTail; // the last segment ended in a partial record (a crash mid-write), dropped
+    double snapshotSeconds; // time to load the snapshot
+    double replaySeconds; // time to replay the journal
+};
+
+bool recoverBook(OrderBook& book, const std::string& stateDirectory, RecoveryResult& result, std::string& error);
+
+// Where persistence keeps its files and how often it snapshots
+struct PersistenceConfig {
+    std::string directory; // state directory, created if missing
+    unsigned long long snapshotEvery; // journal records between snapshots, 0 for snapshot() calls only
+    JournalConfig journal;
+
+    PersistenceConfig() {
+        directory = "orderbook-state";
+        snapshotEvery = 1000000;
+    }
+};
+
+/**
+ * @brief Journal, snapshots and recovery of one book, wired together
+ *
+ * @details open() recovers the book from the state directory and attaches the journal;
+ *          from then on the thread driving the book calls poll() between commands, which
+ *          starts a snapshot every snapshotEvery records and, once one is on disk, starts
+ *          a new journal segment and lets the journal thread delete the segments it made
+ *          obsolete. A snapshot that fails changes nothing; the next one is tried
+ *          snapshotEvery records later.
+ */
+class BookPersistence {
+    private:
+    PersistenceConfig config;
+    Journal journal;
+    SnapshotWriter snapshots;
+    OrderBook* book;
+    RecoveryResult recovered;
+    unsigned long long lastSnapshotSequence; // journal sequence of the last snapshot on disk (or recovered)
+    unsigned long long attemptedSequence; // journal sequence of the last snapshot started, schedules the next
+    unsigned int polls; // poll() calls since the running snapshot was last checked on
+
+    void adoptSnapshot(); // rotates and prunes the journal once a new snapshot is on disk
+
+    public:
+    BookPersistence(const PersistenceConfig& persistenceConfig = PersistenceConfig()) : config(persistenceConfig), journal(persistenceConfig.journal), book(nullptr), recovered(), lastSnapshotSequence(0), attemptedSequence(0), polls(0) {};
+    ~BookPersistence() { close(); }
+
+    bool open(OrderBook& target, std::string& error); // recovers the book, then journals its commands
+    void poll(); // thread driving the book, between commands
+    bool snapshot(); // starts a snapshot now, false if one is still running or the fork failed
+    bool close(); // waits for a running snapshot, syncs and closes the journal, detaches from the book
+
+    const RecoveryResult& recovery() const { return recovered; }
+    Journal& getJournal() { return journal; }
+    SnapshotWriter& getSnapshots() { return snapshots; }
+};
+
+#endif // PERSISTENCE_HPP
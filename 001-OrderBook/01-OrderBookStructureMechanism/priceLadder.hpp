@@ -0,0 +1,404 @@
+#ifndef PRICELADDER_HPP
+#define PRICELADDER_HPP
+
+#include <vector>
+#include "depthIndex.hpp"
+#include "fixedPoint.hpp"
+#include "orderPool.hpp"
+
+const Price NO_PRICE = -1; // returned when a side has no (further) price level
+
+// One bit per tick, set while the level holds orders. A second, coarser layer has one bit
+// per 64-bit word so the next occupied level is found in a handful of word scans even
+// when the book is sparse.
+class LevelBitmap {
+    private:
+    std::vector<unsigned long long> words; // bit i%64 of words[i/64] is level i
+    std::vector<unsigned long long> summary; // bit w%64 of summary[w/64] is set while words[w] != 0
+
+    public:
+    static const size_t NONE = (size_t)-1;
+
+    void resize(size_t bits) {
+        words.assign((bits + 63) / 64, 0);
+        summary.assign((words.size() + 63) / 64, 0);
+    }
+
+    void set(size_t i) {
+        words[i >> 6] |= 1ULL << (i & 63);
+        summary[i >> 12] |= 1ULL << ((i >> 6) & 63);
+    }
+
+    void clear(size_t i) {
+        size_t w = i >> 6;
+        words[w] &= ~(1ULL << (i & 63));
+        if (words[w] == 0) {
+            summary[w >> 6] &= ~(1ULL << (w & 63));
+        }
+    }
+
+    // Lowest set bit >= i, or NONE
+    size_t nextSet(size_t i) const {
+        size_t w = i >> 6;
+        if (w >= words.size()) {
+            return NONE;
+        }
+        unsigned long long bits = words[w] & (~0ULL << (i & 63));
+        if (bits != 0) {
+            return (w << 6) + __builtin_ctzll(bits);
+        }
+        // find the next non-empty word through the summary layer
+        size_t sw = (w + 1) >> 6;
+        if (sw >= summary.size()) {
+            return NONE;
+        }
+        unsigned long long sbits = ((w + 1) & 63) ? summary[sw] & (~0ULL << ((w + 1) & 63)) : summary[sw];
+        while (sbits == 0) {
+            if (++sw >= summary.size()) {
+                return NONE;
+            }
+            sbits = summary[sw];
+        }
+        w = (sw << 6) + __builtin_ctzll(sbits);
+        return (w << 6) + __builtin_ctzll(words[w]);
+    }
+
+    // Highest set bit <= i, or NONE
+    size_t prevSet(size_t i) const {
+        if (words.empty()) {
+            return NONE;
+        }
+        if (i >= words.size() * 64) {
+            i = words.size() * 64 - 1;
+        }
+        size_t w = i >> 6;
+        unsigned long long bits = words[w] & (~0ULL >> (63 - (i & 63)));
+        if (bits != 0) {
+            return (w << 6) + 63 - __builtin_clzll(bits);
+        }
+        if (w == 0) {
+            return NONE;
+        }
+        size_t prevWord = w - 1;
+        size_t sw = prevWord >> 6;
+        unsigned long long sbits = summary[sw] & (~0ULL >> (63 - (prevWord & 63)));
+        while (sbits == 0) {
+            if (sw == 0) {
+                return NONE;
+            }
+            sbits = summary[--sw];
+        }
+        w = (sw << 6) + 63 - __builtin_clzll(sbits);
+        return (w << 6) + 63 - __builtin_clzll(words[w]);
+    }
+};
+
+// FIFO queue of the orders resting at one price, linked through the OrderPool, with the
+// level's totals kept up to date as orders rest, fill and cancel
+struct PriceLevel {
+    OrderIndex head; // oldest order, matched first
+    OrderIndex tail; // newest order
+    unsigned int orders; // orders resting at this price
+    Quantity quantity; // their remaining quantity, in lots
+};
+
+// Aggregated view of one price level, as published in depth snapshots
+struct LevelSummary {
+    Price price; // NO_PRICE for a missing level
+    Quantity quantity;
+    unsigned int orders;
+};
+
+// One side of the book as a ladder of levels indexed directly by tick offset from the
+// bottom of the price band. Everything is allocated when the book is created; adding,
+// matching and cancelling only relink pool slots and flip bitmap bits (and, when the
+// cumulative index is on, update it in O(log ticks)).
+class BookSide {
+    private:
+    std::vector<PriceLevel> levels; // levels[price - minPrice]
+    LevelBitmap occupied; // which levels hold orders
+    Price minPrice; // lowest price of the band, in ticks
+    Price maxPrice; // highest price of the band, in ticks
+    Price bestPrice; // highest bid / lowest ask, NO_PRICE when empty
+    bool isBid; // bids improve upwards, asks downwards
+    unsigned long long changes; // times any level of this side changed
+    size_t levelsInUse; // levels holding at least one order
+    bool indexed; // keep the cumulative index below
+    CumulativeDepth cumulative; // running quantity / notional / level count over the ticks
+
+    Price toPrice(size_t offset) const { return offset == LevelBitmap::NONE ? NO_PRICE : minPrice + (Price)offset; }
+
+    // Adds qty lots at price to the cumulative index, levelDelta +1/-1 when the level fills/empties
+    void indexAdd(Price price, Quantity qty, int levelDelta) {
+        if (indexed && (qty != 0 || levelDelta != 0)) {
+            cumulative.add((size_t)(price - minPrice), price, qty, levelDelta);
+        }
+    }
+
+    // Marks a level empty and moves the best price on if it was the best level
+    void clearLevel(Price price) {
+        occupied.clear((size_t)(price - minPrice));
+        --levelsInUse;
+        if (price == bestPrice) {
+            bestPrice = nextWorse(price);
+        }
+    }
+
+    public:
+    BookSide() : minPrice(0), maxPrice(-1), bestPrice(NO_PRICE), isBid(true), changes(0), levelsInUse(0), indexed(false) {};
+
+    void init(bool bidSide, Price low, Price high, bool withIndex = true) {
+        isBid = bidSide;
+        minPrice = low;
+        maxPrice = high;
+        bestPrice = NO_PRICE;
+        changes = 0;
+        levelsInUse = 0;
+        indexed = withIndex;
+        PriceLevel emptyLevel = {NO_ORDER, NO_ORDER, 0, 0};
+        levels.assign((size_t)(high - low + 1), emptyLevel);
+        occupied.resize(levels.size());
+        cumulative.init(indexed ? levels.size() : 0);
+    }
+
+    bool inBand(Price price) const { return price >= minPrice && price <= maxPrice; }
+    bool empty() const { return bestPrice == NO_PRICE; }
+    Price best() const { return bestPrice; } // O(1)
+    PriceLevel& level(Price price) { return levels[(size_t)(price - minPrice)]; }
+    const PriceLevel& level(Price price) const { return levels[(size_t)(price - minPrice)]; }
+    unsigned long long changeCount() const { return changes; }
+    size_t levelCount() const { return levelsInUse; } // occupied levels, O(1)
+    bool isIndexed() const { return indexed; }
+    Price lowestPrice() const { return minPrice; } // price band
+    Price highestPrice() const { return maxPrice; }
+
+    // Puts back a level saved from a side with the same band; its orders must already be
+    // linked in the pool. Used to load snapshots, after init().
+    void restoreLevel(Price price, const PriceLevel& saved) {
+        level(price) = saved;
+        occupied.set((size_t)(price - minPrice));
+        ++levelsInUse;
+        indexAdd(price, saved.quantity, 1);
+        if (bestPrice == NO_PRICE || (isBid ? price > bestPrice : price < bestPrice)) {
+            bestPrice = price;
+        }
+    }
+    void restoreChangeCount(unsigned long long count) { changes = count; }
+
+    SweepQuote sweep(Quantity qty) const;
+    SweepQuote sweepTo(Price limit) const;
+
+    // Totals of the best level, price NO_PRICE when the side is empty; O(1)
+    LevelSummary bestLevel() const {
+        LevelSummary summary = {NO_PRICE, 0, 0};
+        if (bestPrice != NO_PRICE) {
+            const PriceLevel &lvl = level(bestPrice);
+            summary.price = bestPrice;
+            summary.quantity = lvl.quantity;
+            summary.orders = lvl.orders;
+        }
+        return summary;
+    }
+
+    // Calls visit(price, level) for up to maxLevels occupied levels, best first, without
+    // copying anything; returns how many levels were visited
+    template <class Visitor>
+    size_t forEachLevel(Visitor visit, size_t maxLevels) const {
+        size_t visited = 0;
+        for (Price price = bestPrice; price != NO_PRICE && visited < maxLevels; price = nextWorse(price), ++visited) {
+            visit(price, level(price));
+        }
+        return visited;
+    }
+
+    // Next occupied price after `price` moving away from the best price, NO_PRICE if none
+    Price nextWorse(Price price) const {
+        if (isBid) {
+            return price <= minPrice ? NO_PRICE : toPrice(occupied.prevSet((size_t)(price - 1 - minPrice)));
+        }
+        return price >= maxPrice ? NO_PRICE : toPrice(occupied.nextSet((size_t)(price + 1 - minPrice)));
+    }
+
+    // Next occupied price after `price` moving towards the best price, NO_PRICE if none
+    Price nextBetter(Price price) const {
+        if (isBid) {
+            return price >= maxPrice ? NO_PRICE : toPrice(occupied.nextSet((size_t)(price + 1 - minPrice)));
+        }
+        return price <= minPrice ? NO_PRICE : toPrice(occupied.prevSet((size_t)(price - 1 - minPrice)));
+    }
+
+    // Occupied price furthest from the best price, NO_PRICE when empty
+    Price worst() const {
+        if (isBid) {
+            return toPrice(occupied.nextSet(0));
+        }
+        return toPrice(occupied.prevSet(levels.size() - 1));
+    }
+
+    // Appends an order at the back of its level (price must be in band)
+    void append(OrderIndex slot, OrderPool& pool) {
+        Order &order = pool.at(slot);
+        PriceLevel &lvl = level(order.price);
+        lvl.quantity += order.quantity;
+        ++lvl.orders;
+        ++changes;
+        indexAdd(order.price, order.quantity, lvl.tail == NO_ORDER ? 1 : 0);
+        order.next = NO_ORDER;
+        pool.linksAt(slot).prev = lvl.tail;
+        pool.linksAt(slot).isBid = isBid;
+        if (lvl.tail == NO_ORDER) {
+            lvl.head = slot;
+            occupied.set((size_t)(order.price - minPrice));
+            ++levelsInUse;
+            if (bestPrice == NO_PRICE || (isBid ? order.price > bestPrice : order.price < bestPrice)) {
+                bestPrice = order.price;
+            }
+        } else {
+            pool.at(lvl.tail).next = slot;
+        }
+        lvl.tail = slot;
+    }
+
+    // Unlinks an order from anywhere in its level in O(1); the slot itself is not released
+    void unlink(OrderIndex slot, OrderPool& pool) {
+        Order &order = pool.at(slot);
+        PriceLevel &lvl = level(order.price);
+        lvl.quantity -= order.quantity;
+        --lvl.orders;
+        ++changes;
+        OrderIndex prev = pool.linksAt(slot).prev;
+        if (lvl.head == slot) {
+            lvl.head = order.next;
+        } else {
+            pool.at(prev).next = order.next;
+        }
+        if (lvl.tail == slot) {
+            lvl.tail = (lvl.head == NO_ORDER) ? NO_ORDER : prev;
+        } else {
+            pool.linksAt(order.next).prev = prev;
+        }
+        indexAdd(order.price, -order.quantity, lvl.head == NO_ORDER ? -1 : 0);
+        if (lvl.head == NO_ORDER) {
+            clearLevel(order.price);
+        }
+    }
+
+    // Takes qty off a resting order (a fill or a reduction) and off its level's total
+    void reduce(OrderIndex slot, Quantity qty, OrderPool& pool) {
+        Order &order = pool.at(slot);
+        order.quantity -= qty;
+        level(order.price).quantity -= qty;
+        ++changes;
+        indexAdd(order.price, -qty, 0);
+    }
+
+    // Removes the oldest order of a level, used by matching. Does not read the cold links.
+    void popFront(Price price, OrderPool& pool) {
+        PriceLevel &lvl = level(price);
+        const Order &front = pool.at(lvl.head);
+        lvl.quantity -= front.quantity;
+        --lvl.orders;
+        ++changes;
+        lvl.head = front.next;
+        indexAdd(price, -front.quantity, lvl.head == NO_ORDER ? -1 : 0);
+        if (lvl.head == NO_ORDER) {
+            lvl.tail = NO_ORDER;
+            clearLevel(price);
+        }
+    }
+};
+
+/**
+ * @brief Quote for taking up to qty lots from this side, best price first
+ *
+ * @details With the cumulative index one descent of the Fenwick tree finds the level where
+ *          the running quantity reaches qty: from the bottom of the band for asks, and for
+ *          bids, where the best prices are at the top, the level where the running quantity
+ *          goes above everything but qty. Without it the levels are walked.
+ *
+ * @return SweepQuote Quantity is short of qty when the side runs out
+ */
+inline SweepQuote BookSide::sweep(Quantity qty) const {
+    SweepQuote quote = {0, 0, 0, NO_PRICE, NO_PRICE, 0};
+    if (qty <= 0 || bestPrice == NO_PRICE) {
+        return quote;
+    }
+    quote.bestPrice = bestPrice;
+    if (!indexed) {
+        for (Price price = bestPrice; price != NO_PRICE && quote.quantity < qty; price = nextWorse(price)) {
+            Quantity take = level(price).quantity < qty - quote.quantity ? level(price).quantity : qty - quote.quantity;
+            quote.quantity += take;
+            quote.notionalTicks += price * take;
+            quote.worstPrice = price;
+            ++quote.levels;
+        }
+        return quote;
+    }
+    const DepthTotals &total = cumulative.total();
+    if (total.quantity <= qty) {
+        quote.quantity = total.quantity;
+        quote.notionalTicks = total.notionalTicks;
+        quote.worstPrice = worst();
+        quote.levels = (unsigned int)total.levels;
+        return quote;
+    }
+    DepthTotals below;
+    quote.quantity = qty;
+    if (!isBid) {
+        quote.worstPrice = toPrice(cumulative.findAbove(qty, below, true));
+        quote.notionalTicks = below.notionalTicks + (qty - below.quantity) * quote.worstPrice;
+        quote.levels = (unsigned int)below.levels + 1;
+    } else {
+        quote.worstPrice = toPrice(cumulative.findAbove(total.quantity - qty, below, false));
+        Quantity atWorst = level(quote.worstPrice).quantity;
+        Quantity better = total.quantity - below.quantity - atWorst; // lots strictly above the worst level, < qty
+        quote.notionalTicks = total.notionalTicks - below.notionalTicks - quote.worstPrice * atWorst + (qty - better) * quote.worstPrice;
+        quote.levels = (unsigned int)(total.levels - below.levels);
+    }
+    return quote;
+}
+
+/**
+ * @brief Quote for taking everything resting at limit or better: at or below it for asks,
+ *        at or above it for bids
+ *
+ * @details O(log ticks) with the cumulative index, a walk of the levels without it.
+ */
+inline SweepQuote BookSide::sweepTo(Price limit) const {
+    SweepQuote quote = {0, 0, 0, NO_PRICE, NO_PRICE, 0};
+    if (bestPrice == NO_PRICE || (isBid ? limit > bestPrice : limit < bestPrice)) {
+        return quote;
+    }
+    limit = limit < minPrice ? minPrice : (limit > maxPrice ? maxPrice : limit);
+    quote.bestPrice = bestPrice;
+    if (!indexed) {
+        for (Price price = bestPrice; price != NO_PRICE && (isBid ? price >= limit : price <= limit); price = nextWorse(price)) {
+            quote.quantity += level(price).quantity;
+            quote.notionalTicks += price * level(price).quantity;
+            quote.worstPrice = price;
+            ++quote.levels;
+        }
+        return quote;
+    }
+    size_t offset = (size_t)(limit - minPrice);
+    DepthTotals taken;
+    if (!isBid) {
+        taken = cumulative.upTo(offset);
+        quote.worstPrice = toPrice(occupied.prevSet(offset));
+    } else {
+        taken = cumulative.total();
+        if (offset > 0) {
+            DepthTotals below = cumulative.upTo(offset - 1);
+            taken.quantity -= below.quantity;
+            taken.notionalTicks -= below.notionalTicks;
+            taken.levels -= below.levels;
+        }
+        quote.worstPrice = toPrice(occupied.nextSet(offset));
+    }
+    quote.quantity = taken.quantity;
+    quote.notionalTicks = taken.notionalTicks;
+    quote.levels = (unsigned int)taken.levels;
+    return quote;
+}
+
+#endif // PRICELADDER_HPP
@@ -0,0 +1,191 @@
+#include "benchmarkSupport.hpp"
+#include "persistence.hpp"
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Size of the journaled book, the flow run on it and where its state goes
+struct RecoveryBenchmarkConfig {
+    size_t orders; // orders resting when the snapshot is taken
+    size_t commands; // mixed commands after the snapshot, half while it is written, half after
+    size_t accounts;
+    string directory; // state directory, only its snapshot and journal files are ever deleted
+    bool sync; // fsync the journal (off to leave the disk out of the numbers)
+    unsigned long long seed;
+
+    RecoveryBenchmarkConfig() {
+        orders = 2000000;
+        commands = 1000000;
+        accounts = 1000;
+        directory = "recovery-state";
+        sync = true;
+        seed = 42;
+    }
+};
+
+const Amount DEPOSIT = 1000000000LL * ATOMS_PER_UNIT; // per account and asset, enough that nothing is rejected for balance
+
+// Wide passive book, large crossing orders: the journal sees every kind of command
+RandomFlowConfig flowConfig(const RecoveryBenchmarkConfig& config) {
+    RandomFlowConfig flow;
+    flow.levels = 5000;
+    flow.maxQuantity = 100;
+    flow.maxAggressiveQuantity = 300;
+    flow.aggressivePercent = 20;
+    flow.reducePercent = 5;
+    flow.seed = config.seed;
+    return flow;
+}
+
+// Deletes the snapshot and journal files of a state directory and nothing else
+void clearState(const string& directory) {
+    filesystem::remove(directory + "/snapshot.bin");
+    filesystem::remove(directory + "/snapshot.bin.tmp");
+    for (const JournalSegment &segment : listJournalSegments(directory)) {
+        filesystem::remove(segment.path);
+    }
+}
+
+// Time per call of work(), in ns
+template <class Work>
+double nsPer(size_t count, Work work) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        work();
+    }
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / (count > 0 ? count : 1);
+}
+
+/**
+ * @brief Journals a large book, snapshots it mid-flow, "crashes" and restores it, then
+ *        checks the restored book is the same book
+ *
+ * @details The same deterministic flow runs twice: on a plain book for the baseline cost
+ *          per command, and on a book with BookPersistence attached. The journaled run
+ *          rests --orders orders, takes a snapshot, runs half of --commands while the
+ *          forked child writes it and the other half after. Then the journal is closed,
+ *          a torn half record is appended to its last segment (what a crash in the middle
+ *          of a write leaves behind) and a fresh book recovers from the directory. Both
+ *          books must agree on every order, balance and the next order ID.
+ *
+ *          Usage: recoveryBenchmark [--orders 2000000] [--commands 1000000]
+ *                                   [--accounts 1000] [--dir recovery-state] [--no-sync] [--seed 42]
+ *
+ * @return int 0, 1 on a bad argument, an I/O error or a restored book that differs
+ */
+int main(int argc, char* argv[]) {
+    RecoveryBenchmarkConfig config;
+    BenchmarkOptions options("recoveryBenchmark");
+    options.add("--orders", config.orders);
+    options.add("--commands", config.commands);
+    options.add("--accounts", config.accounts);
+    options.add("--dir", config.directory, "DIR");
+    options.addFlag("--no-sync", config.sync, false);
+    options.add("--seed", config.seed);
+    if (!options.parse(argc, argv)) {
+        return 1;
+    }
+    if (config.accounts == 0) {
+        config.accounts = 1;
+    }
+    size_t firstHalf = config.commands / 2;
+    cout << fixed << setprecision(1);
+
+    // Baseline: the same flow without a journal
+    double plainRest, plainStep;
+    {
+        unique_ptr<OrderBook> plain = makeBenchmarkBook(config.orders + config.commands + 1024);
+        RandomFlow flow(flowConfig(config), fundTraders(*plain, "Trader", config.accounts, DEPOSIT, DEPOSIT));
+        plainRest = nsPer(config.orders, [&] { flow.rest(*plain); });
+        plainStep = nsPer(config.commands, [&] { flow.step(*plain); });
+    }
+
+    clearState(config.directory);
+    PersistenceConfig persistenceConfig;
+    persistenceConfig.directory = config.directory;
+    persistenceConfig.snapshotEvery = 0; // the snapshot is taken by hand below
+    persistenceConfig.journal.sync = config.sync;
+    unique_ptr<OrderBook> live = makeBenchmarkBook(config.orders + config.commands + 1024);
+    string error;
+    unique_ptr<BookPersistence> persistence(new BookPersistence(persistenceConfig));
+    if (!persistence->open(*live, error)) {
+        cerr << error << endl;
+        return 1;
+    }
+    RandomFlow flow(flowConfig(config), fundTraders(*live, "Trader", config.accounts, DEPOSIT, DEPOSIT)); // journaled like any other command
+    double journaledRest = nsPer(config.orders, [&] { flow.rest(*live); });
+    if (!persistence->snapshot()) {
+        cerr << persistence->getSnapshots().error() << endl;
+        return 1;
+    }
+    double pauseMs = persistence->getSnapshots().pauseSeconds() * 1e3;
+    chrono::steady_clock::time_point snapshotStart = chrono::steady_clock::now();
+    double journaledStep = nsPer(firstHalf, [&] {
+        flow.step(*live);
+        persistence->poll();
+    });
+    bool snapshotOk = persistence->getSnapshots().wait();
+    double snapshotSeconds = chrono::duration<double>(chrono::steady_clock::now() - snapshotStart).count();
+    journaledStep = (journaledStep * firstHalf + nsPer(config.commands - firstHalf, [&] {
+        flow.step(*live);
+        persistence->poll();
+    }) * (config.commands - firstHalf)) / (config.commands > 0 ? config.commands : 1);
+    unsigned long long lastSequence = persistence->getJournal().lastSequence();
+    bool closed = persistence->close();
+    JournalStats journalStats = persistence->getJournal().getStats();
+    if (!snapshotOk || !closed) {
+        cerr << "Persistence failed: " << persistence->getSnapshots().error() << " " << persistence->getJournal().error() << endl;
+        return 1;
+    }
+
+    // A crash in the middle of a write leaves half a record at the end of the last segment
+    vector<JournalSegment> segments = listJournalSegments(config.directory);
+    if (!segments.empty()) {
+        FILE *tail = fopen(segments.back().path.c_str(), "ab");
+        char torn[sizeof(JournalRecord) / 2] = {0};
+        torn[0] = 1;
+        if (tail != nullptr) {
+            fwrite(torn, 1, sizeof(torn), tail);
+            fclose(tail);
+        }
+    }
+
+    unique_ptr<OrderBook> restored = makeBenchmarkBook(config.orders + config.commands + 1024);
+    BookPersistence restart(persistenceConfig);
+    chrono::steady_clock::time_point restartBegin = chrono::steady_clock::now();
+    if (!restart.open(*restored, error)) {
+        cerr << "Recovery failed: " << error << endl;
+        return 1;
+    }
+    double restartSeconds = chrono::duration<double>(chrono::steady_clock::now() - restartBegin).count();
+    const RecoveryResult &recovery = restart.recovery();
+
+    bool sameBook = live->bookChecksum() == restored->bookChecksum();
+    bool sameBalances = live->balanceChecksum() == restored->balanceChecksum();
+    bool sameSequence = recovery.lastSequence == lastSequence;
+    AccountId maker = live->findUser("Trader0");
+    Price below = flowConfig(config).mid - flowConfig(config).levels - 1; // under every passive bid
+    bool sameIds = live->addBid(maker, below, 1) == restored->addBid(maker, below, 1);
+    restart.close();
+    clearState(config.directory);
+
+    cout << "Orders resting at the snapshot: " << config.orders << ", commands after it: " << config.commands << ", journal records: " << lastSequence << endl;
+    cout << "Rest an order:  " << plainRest << " ns plain, " << journaledRest << " ns journaled" << endl;
+    cout << "Mixed command:  " << plainStep << " ns plain, " << journaledStep << " ns journaled (snapshot running for the first half)" << endl;
+    cout << "Journal: " << journalStats.batches << " synced writes" << (config.sync ? "" : " (fsync off)") << ", "
+         << (journalStats.batches > 0 ? (double)journalStats.records / journalStats.batches : 0.0) << " records per write, "
+         << journalStats.bytes / 1048576.0 << " MiB, " << journalStats.waits << " appends waited for room" << endl;
+    cout << "Snapshot: matching paused " << setprecision(2) << pauseMs << " ms for the fork, written in " << snapshotSeconds * 1e3 << " ms" << setprecision(1) << endl;
+    cout << "Restart: " << restartSeconds * 1e3 << " ms (snapshot " << recovery.snapshotSeconds * 1e3 << " ms, " << recovery.replayed << " records from "
+         << recovery.segments << " segments in " << recovery.replaySeconds * 1e3 << " ms" << (recovery.tornTail ? ", torn tail dropped" : "") << ")" << endl;
+    cout << "Restored book " << (sameBook ? "matches" : "DIFFERS") << ", balances " << (sameBalances ? "match" : "DIFFER") << ", journal sequence "
+         << (sameSequence ? "matches" : "DIFFERS") << ", next order ID " << (sameIds ? "matches" : "DIFFERS") << endl;
+    return sameBook && sameBalances && sameSequence && sameIds && recovery.tornTail ? 0 : 1;
+}
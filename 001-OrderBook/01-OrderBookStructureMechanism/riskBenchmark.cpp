@@ -0,0 +1,154 @@
+#include "benchmarkSupport.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// How many traders, how tight their limits and how little they start with
+struct RiskBenchmarkConfig {
+    size_t accounts; // traders, every other one with limits
+    size_t commands; // timed commands
+    unsigned int maxOrders; // open order limit of the limited traders
+    long long maxNotionalUsd; // open notional limit of the limited traders, whole USD
+    Amount deposit; // USD and stock atoms each trader starts with, small enough to run out
+    unsigned long long seed;
+
+    RiskBenchmarkConfig() {
+        accounts = 1000;
+        commands = 1000000;
+        maxOrders = 30;
+        maxNotionalUsd = 25000;
+        deposit = 50000LL * ATOMS_PER_UNIT;
+        seed = 42;
+    }
+};
+
+// Counts execution reports by type and reject reason
+class ReportCounter : public ExecutionListener {
+    public:
+    unsigned long long events[EVENT_SETTLEMENT_FAILED + 1];
+    unsigned long long rejects[REJECT_NOT_PERMITTED + 1];
+
+    ReportCounter() {
+        fill(begin(events), end(events), 0);
+        fill(begin(rejects), end(rejects), 0);
+    }
+
+    void onEvent(const ExecutionEvent& event) {
+        ++events[event.type];
+        rejects[event.reason] += event.type == EVENT_REJECTED ? 1 : 0;
+    }
+};
+
+// Many traders resting, crossing, cancelling, reducing and replacing, more than their
+// balances and limits allow
+RandomFlowConfig flowConfig(const RiskBenchmarkConfig& config) {
+    RandomFlowConfig flow;
+    flow.levels = 500;
+    flow.maxQuantity = 20;
+    flow.maxReduce = 5;
+    flow.seed = config.seed;
+    return flow;
+}
+
+// Sum of every account's available plus held balance of one asset
+Amount totalOf(const OrderBook& book, const string& asset, AccountId accounts) {
+    Amount total = 0;
+    for (AccountId account = 0; account < accounts; ++account) {
+        total += book.balanceOf(account, asset) + book.heldOf(account, asset);
+    }
+    return total;
+}
+
+/**
+ * @brief Runs many traders against their balances and limits and checks every account's
+ *        held balances and open counters against the orders actually resting
+ *
+ * @details Traders start with a small deposit, every other one with an open order and an
+ *          open notional limit, and send a seeded mix of passive and crossing orders,
+ *          cancels, reduces and replaces. Afterwards the resting orders are walked and, per
+ *          account, their held USD and stock, their count and their notional must equal
+ *          what the ledger's counters say, limited accounts must be within their limits,
+ *          no settlement may have failed and no atom may have been created or lost.
+ *
+ *          Usage: riskBenchmark [--accounts 1000] [--commands 1000000] [--max-orders 30]
+ *                               [--max-notional 25000] [--seed 42]
+ *
+ * @return int 0, 1 on a bad argument or if any counter is off
+ */
+int main(int argc, char* argv[]) {
+    RiskBenchmarkConfig config;
+    BenchmarkOptions options("riskBenchmark");
+    options.add("--accounts", config.accounts);
+    options.add("--commands", config.commands);
+    options.add("--max-orders", config.maxOrders);
+    options.add("--max-notional", config.maxNotionalUsd, "USD");
+    options.add("--seed", config.seed);
+    if (!options.parse(argc, argv)) {
+        return 1;
+    }
+    if (config.accounts == 0 || config.maxNotionalUsd < 0 || config.maxNotionalUsd > NO_NOTIONAL_LIMIT / ATOMS_PER_UNIT) {
+        cerr << "--accounts must be positive and --max-notional between 0 and " << NO_NOTIONAL_LIMIT / ATOMS_PER_UNIT << endl;
+        return 1;
+    }
+
+    unique_ptr<OrderBook> book = makeBenchmarkBook(config.commands + 1024);
+    vector<AccountId> traders = fundTraders(*book, "RiskTrader", config.accounts, config.deposit, config.deposit / BENCHMARK_MID_PRICE * 100);
+    for (size_t i = 0; i < traders.size(); i += 2) {
+        book->setLimits(traders[i], config.maxOrders, config.maxNotionalUsd * ATOMS_PER_UNIT);
+    }
+    RandomFlow flow(flowConfig(config), traders);
+    flow.reserve(config.commands);
+    AccountId accounts = (AccountId)(traders.back() + 1);
+    Amount usdBefore = totalOf(*book, "USD", accounts);
+    Amount stockBefore = totalOf(*book, TICKER, accounts);
+    ReportCounter reports;
+    book->setListener(&reports);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (size_t i = 0; i < config.commands; ++i) {
+        flow.step(*book);
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    book->setListener(nullptr);
+
+    // What the resting orders should account for, per account
+    const InstrumentSpec &instrument = book->getInstrument();
+    const OrderPool &pool = book->getPool();
+    vector<Amount> heldUsd(accounts, 0), heldStock(accounts, 0), notional(accounts, 0);
+    vector<unsigned int> open(accounts, 0);
+    const BookSide *sides[2] = {&book->getBids(), &book->getAsks()};
+    for (int s = 0; s < 2; ++s) {
+        sides[s]->forEachLevel([&](Price, const PriceLevel& level) {
+            for (OrderIndex slot = level.head; slot != NO_ORDER; slot = pool.at(slot).next) {
+                const Order &order = pool.at(slot);
+                (s == 0 ? heldUsd : heldStock)[order.account] += s == 0 ? instrument.notional(order.price, order.quantity) : instrument.baseAmount(order.quantity);
+                notional[order.account] += instrument.notional(order.price, order.quantity);
+                ++open[order.account];
+            }
+        }, (size_t)-1);
+    }
+    size_t mismatched = 0, overLimit = 0;
+    for (AccountId account = 0; account < accounts; ++account) {
+        AccountRisk risk = book->getRisk(account);
+        mismatched += book->heldOf(account, "USD") != heldUsd[account] || book->heldOf(account, TICKER) != heldStock[account] ||
+                      risk.openOrders != open[account] || risk.openNotional != notional[account] || book->balanceOf(account, "USD") < 0 ||
+                      book->balanceOf(account, TICKER) < 0;
+        overLimit += risk.openOrders > risk.maxOpenOrders || risk.openNotional > risk.maxOpenNotional;
+    }
+    bool conserved = totalOf(*book, "USD", accounts) == usdBefore && totalOf(*book, TICKER, accounts) == stockBefore;
+
+    cout << config.accounts << " traders, " << config.commands << " commands, " << pool.size() << " orders resting" << endl;
+    cout << fixed << setprecision(1) << "Command: " << seconds * 1e9 / (config.commands > 0 ? config.commands : 1) << " ns" << endl;
+    cout << "Accepted " << reports.events[EVENT_ACCEPTED] << ", rejected " << reports.events[EVENT_REJECTED] << ": insufficient balance "
+         << reports.rejects[REJECT_INSUFFICIENT_BALANCE] << ", open order limit " << reports.rejects[REJECT_OPEN_ORDER_LIMIT] << ", notional limit "
+         << reports.rejects[REJECT_NOTIONAL_LIMIT] << "; settlements failed " << reports.events[EVENT_SETTLEMENT_FAILED] << endl;
+    bool ok = mismatched == 0 && overLimit == 0 && conserved && reports.events[EVENT_SETTLEMENT_FAILED] == 0;
+    cout << "Held balances and open counters " << (mismatched == 0 ? "match the resting orders" : "DO NOT MATCH") << " (" << mismatched
+         << " accounts off), " << overLimit << " accounts over their limits, balances " << (conserved ? "conserved" : "NOT CONSERVED") << endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,123 @@
+#ifndef SPSCQUEUE_HPP
+#define SPSCQUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+const size_t CACHE_LINE = 64;
+
+// Tells the core we are spinning, so a sibling hyperthread gets the pipeline meanwhile
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#endif
+}
+
+// Spins a little, then gives the core away; for waits that should be short but may not be
+struct Backoff {
+    unsigned int spins;
+
+    Backoff() : spins(0) {};
+    void pause() {
+        if (spins++ < 64) {
+            cpuRelax();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    void reset() { spins = 0; }
+};
+
+/**
+ * @brief Bounded lock-free queue for exactly one producer thread and one consumer thread
+ *
+ * @details A power-of-two ring indexed by two ever-growing counters. The producer only
+ *          writes tail and the consumer only writes head, each on its own cache line, and
+ *          each side keeps a private copy of the other's counter so it only touches the
+ *          shared line when the ring looks full (or empty). A full ring refuses the push,
+ *          which is how backpressure reaches the producer.
+ */
+template <class T>
+class SpscQueue {
+    private:
+    std::vector<T> slots;
+    size_t mask;
+    alignas(CACHE_LINE) std::atomic<unsigned long long> head; // next slot to read, written by the consumer
+    unsigned long long cachedTail; // consumer's last view of tail
+    alignas(CACHE_LINE) std::atomic<unsigned long long> tail; // next slot to write, written by the producer
+    unsigned long long cachedHead; // producer's last view of head (the class is padded to whole cache lines)
+
+    public:
+    SpscQueue(size_t minCapacity = 4096) : head(0), cachedTail(0), tail(0), cachedHead(0) {
+        size_t capacity = 1;
+        while (capacity < minCapacity) {
+            capacity <<= 1;
+        }
+        slots.resize(capacity);
+        mask = capacity - 1;
+    }
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer: appends value, false if the ring is full
+    bool tryPush(const T& value) {
+        unsigned long long position = tail.load(std::memory_order_relaxed);
+        if (position - cachedHead == slots.size()) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (position - cachedHead == slots.size()) {
+                return false;
+            }
+        }
+        slots[position & mask] = value;
+        tail.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: removes the oldest value, false if the ring is empty
+    bool tryPop(T& value) {
+        unsigned long long position = head.load(std::memory_order_relaxed);
+        if (position == cachedTail) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (position == cachedTail) {
+                return false;
+            }
+        }
+        value = slots[position & mask];
+        head.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Consumer: hands up to limit values to visit in order, in place, then frees
+     *        their slots with a single store
+     *
+     * @return size_t How many values were visited
+     */
+    template <class Visitor>
+    size_t consume(Visitor visit, size_t limit) {
+        unsigned long long position = head.load(std::memory_order_relaxed);
+        if (position == cachedTail) {
+            cachedTail = tail.load(std::memory_order_acquire);
+        }
+        size_t count = (size_t)(cachedTail - position);
+        count = count < limit ? count : limit;
+        for (size_t i = 0; i < count; ++i) {
+            visit(slots[(position + i) & mask]);
+        }
+        if (count > 0) {
+            head.store(position + count, std::memory_order_release);
+        }
+        return count;
+    }
+
+    size_t capacity() const { return slots.size(); }
+    // Values waiting; exact from either side while the other is idle, a snapshot otherwise
+    size_t size() const { return (size_t)(tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire)); }
+};
+
+#endif // SPSCQUEUE_HPP
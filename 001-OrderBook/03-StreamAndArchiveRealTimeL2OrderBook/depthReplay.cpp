@@ -0,0 +1,132 @@
+#include "depthStream.hpp"
+#include "l2Archive.hpp"
+#include "l2Book.hpp"
+#include "allocationCounter.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Running totals of a replay
+struct ReplayTotals {
+    unsigned long long messages;
+    unsigned long long levels;
+    unsigned long long bytes;
+};
+
+// Applies every message of an open reader (text or columnar archive) to the books
+template <class Reader>
+bool replayMessages(Reader& reader, const string& fileSymbol, L2BookSet& books, DepthMessage& message, ReplayTotals& totals) {
+    while (reader.next(message)) {
+        books.bookFor(message.symbol[0] != '\0' ? message.symbol : fileSymbol.c_str()).apply(message);
+        ++totals.messages;
+        totals.levels += message.bids.size() + message.asks.size();
+    }
+    return !reader.failed();
+}
+
+/**
+ * @brief Replays archived Binance depth files into per-symbol L2 books
+ *
+ * @details Files are read in the order given; pass each symbol's snapshot before its
+ *          updates. The line-delimited .txt archives, the pretty-printed .json archives
+ *          and columnar .l2a archives (see l2Archive.hpp) are accepted. Updates are routed by their symbol, snapshots by the
+ *          symbol in their file name, and every book follows the snapshot + delta rules of
+ *          L2Book. Prints throughput and, per symbol, its sync state, the top of book and a
+ *          checksum of the final book.
+ *
+ *          Usage: depthReplay [--repeat N] [--tick PRICE] snapshot.txt updates.txt [more files...]
+ *          --repeat replays the file list N times (for throughput on small samples).
+ *          --tick gives the symbols' price step (e.g. 0.001); without it each book learns
+ *          its step from the snapshots.
+ *
+ * @return int 0 on success, 1 on a bad argument or malformed file
+ */
+int main(int argc, char* argv[]) {
+    vector<string> paths;
+    int repeat = 1;
+    Amount tick = 0;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--repeat" && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else if (arg == "--tick" && i + 1 < argc) {
+            string text = argv[++i];
+            if (!parseAtoms(text.data(), text.data() + text.size(), tick) || tick <= 0) {
+                tick = -1;
+            }
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty() || repeat < 1 || tick < 0) {
+        cerr << "Usage: depthReplay [--repeat N] [--tick PRICE] snapshot.txt updates.txt [more files...]" << endl;
+        return 1;
+    }
+
+    vector<string> fileSymbols;
+    vector<bool> columnar;
+    for (const string &path : paths) {
+        fileSymbols.push_back(symbolFromFileName(path));
+        columnar.push_back(isL2Archive(path));
+    }
+
+    DepthFileReader reader;
+    L2ArchiveReader archive;
+    DepthMessage message;
+    L2BookSet books(1 << 15, tick);
+    ReplayTotals totals = {0, 0, 0};
+    unsigned long long allocationsBefore = 0;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int pass = 0; pass < repeat; ++pass) {
+        if (pass == 1) {
+            allocationsBefore = heapAllocationCount.load(); // books and buffers exist after the first pass
+        }
+        for (size_t file = 0; file < paths.size(); ++file) {
+            bool ok;
+            if (columnar[file]) {
+                ok = archive.open(paths[file]) && replayMessages(archive, fileSymbols[file], books, message, totals);
+                totals.bytes += archive.bytes();
+                archive.close();
+            } else {
+                unsigned long long bytesBefore = reader.bytes();
+                ok = reader.open(paths[file]) && replayMessages(reader, fileSymbols[file], books, message, totals);
+                totals.bytes += reader.bytes() - bytesBefore;
+            }
+            if (!ok) {
+                cerr << paths[file] << ": " << (columnar[file] ? archive.error() : reader.error()) << endl;
+                return 1;
+            }
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "Messages: " << totals.messages << ", levels: " << totals.levels << ", bytes: " << totals.bytes << endl;
+    cout << "Time: " << seconds * 1e3 << " ms, "
+         << (unsigned long long)(seconds > 0 ? totals.messages / seconds : 0) << " messages/sec, "
+         << (unsigned long long)(seconds > 0 ? totals.levels / seconds : 0) << " levels/sec, "
+         << (seconds > 0 ? totals.bytes / seconds / 1e6 : 0) << " MB/s" << endl;
+    if (repeat > 1) {
+        cout << "Heap allocations after the first pass: " << heapAllocationCount.load() - allocationsBefore << endl;
+    }
+    for (size_t i = 0; i < books.size(); ++i) {
+        const L2Book &book = books.bookAt(i);
+        const L2SyncStats &stats = book.getStats();
+        cout << books.symbolAt(i) << ": " << (book.inSync() ? "in sync" : "OUT OF SYNC, waiting for a snapshot")
+             << ", last update ID " << book.getLastUpdateId() << endl;
+        cout << "  snapshots " << stats.snapshots << ", applied " << stats.applied << ", stale " << stats.stale
+             << ", gaps " << stats.gaps << ", buffered " << stats.buffered << " (" << stats.bufferDropped << " dropped)" << endl;
+        cout << "  bid levels " << book.getBids().size() << ", ask levels " << book.getAsks().size()
+             << ", off-ladder levels " << book.getBids().overflowSize() + book.getAsks().overflowSize() << endl;
+        if (!book.getBids().empty() && !book.getAsks().empty()) {
+            cout << "  best bid " << formatAtoms(book.getBids().best().price) << " x " << formatAtoms(book.getBids().best().quantity)
+                 << ", best ask " << formatAtoms(book.getAsks().best().price) << " x " << formatAtoms(book.getAsks().best().quantity) << endl;
+        }
+        cout << hex << "  book checksum " << book.checksum() << dec << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,403 @@
+#ifndef DEPTHSTREAM_HPP
+#define DEPTHSTREAM_HPP
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "fixedPoint.hpp"
+
+// One aggregated price level as Binance sends it, e.g. ["5.30300000", "1208.59000000"].
+// Both fields are in atoms (1e-8), so every Binance price and size is held exactly.
+struct L2Level {
+    Amount price;
+    Amount quantity; // 0 means the level was removed
+};
+
+// One parsed message: either a depthUpdate event from the websocket stream or a REST
+// depth snapshot. The level vectors are reused from message to message, so once they
+// have grown to the largest message parsing no longer allocates.
+struct DepthMessage {
+    bool isSnapshot; // REST snapshot (lastUpdateId, bids, asks) rather than a depthUpdate
+    bool isCheckpoint; // snapshot an archiver wrote from its own book, not one received from Binance
+    unsigned long long eventTime; // E, event time in ms (0 for snapshots)
+    unsigned long long firstUpdateId; // U, first update ID in the event (lastUpdateId for snapshots)
+    unsigned long long finalUpdateId; // u, last update ID in the event (lastUpdateId for snapshots)
+    char symbol[16]; // s, e.g. "UNIUSDT", empty for snapshots
+    std::vector<L2Level> bids; // b / bids
+    std::vector<L2Level> asks; // a / asks
+
+    DepthMessage() : isSnapshot(false), isCheckpoint(false), eventTime(0), firstUpdateId(0), finalUpdateId(0) {
+        symbol[0] = '\0';
+        bids.reserve(1024);
+        asks.reserve(1024);
+    }
+
+    void clear() {
+        isSnapshot = false;
+        isCheckpoint = false;
+        eventTime = 0;
+        firstUpdateId = 0;
+        finalUpdateId = 0;
+        symbol[0] = '\0';
+        bids.clear(); // keeps the capacity
+        asks.clear();
+    }
+};
+
+enum ParseStatus {
+    PARSE_OK,
+    PARSE_INCOMPLETE, // the buffer ends inside the message, feed more bytes and retry
+    PARSE_ERROR
+};
+
+// Streaming parser for Binance depth messages. It walks the bytes once and only looks at
+// the fields it knows (e, E, s, U, u, b, a, lastUpdateId, bids, asks); anything else is
+// skipped without being decoded. Decimal strings go straight to atoms through parseAtoms,
+// no double and no std::string in between.
+class DepthParser {
+    private:
+    const char* end; // end of the bytes available for the current message
+    bool hitEnd; // a helper ran into `end`, i.e. the message is incomplete rather than malformed
+
+    static bool isSpace(char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; }
+
+    const char* skipSpace(const char* p) {
+        while (p != end && isSpace(*p)) {
+            ++p;
+        }
+        if (p == end) {
+            hitEnd = true;
+        }
+        return p;
+    }
+
+    // Skips whitespace and one expected character, nullptr if something else is there
+    const char* expect(const char* p, char c) {
+        p = skipSpace(p);
+        return (p != end && *p == c) ? p + 1 : nullptr;
+    }
+
+    // Reads a string value without unescaping it, [first, last) is its content
+    const char* readString(const char* p, const char*& first, const char*& last) {
+        p = skipSpace(p);
+        if (p == end || *p != '"') {
+            return nullptr;
+        }
+        first = ++p;
+        while (p != end && *p != '"') {
+            if (*p == '\\' && ++p == end) {
+                break;
+            }
+            ++p;
+        }
+        if (p == end) {
+            hitEnd = true;
+            return nullptr;
+        }
+        last = p;
+        return p + 1;
+    }
+
+    const char* readUnsigned(const char* p, unsigned long long& value) {
+        p = skipSpace(p);
+        const char *start = p;
+        value = 0;
+        while (p != end && *p >= '0' && *p <= '9') {
+            value = value * 10 + (unsigned long long)(*p - '0');
+            ++p;
+        }
+        if (p == end) {
+            hitEnd = true; // the number may continue in the next chunk
+            return nullptr;
+        }
+        return p == start ? nullptr : p;
+    }
+
+    // Skips any JSON value: string, number, literal, or a nested object/array
+    const char* skipValue(const char* p) {
+        p = skipSpace(p);
+        if (p == end) {
+            return nullptr;
+        }
+        if (*p == '"') {
+            const char *first, *last;
+            return readString(p, first, last);
+        }
+        if (*p != '{' && *p != '[') {
+            while (p != end && *p != ',' && *p != '}' && *p != ']' && !isSpace(*p)) {
+                ++p;
+            }
+            if (p == end) {
+                hitEnd = true;
+                return nullptr;
+            }
+            return p;
+        }
+        int depth = 0;
+        while (p != end) {
+            if (*p == '"') {
+                const char *first, *last;
+                p = readString(p, first, last);
+                if (p == nullptr) {
+                    return nullptr;
+                }
+                continue;
+            }
+            if (*p == '{' || *p == '[') {
+                ++depth;
+            } else if (*p == '}' || *p == ']') {
+                if (--depth == 0) {
+                    return p + 1;
+                }
+            }
+            ++p;
+        }
+        hitEnd = true;
+        return nullptr;
+    }
+
+    // Reads [["price","qty"],...] into levels
+    const char* readLevels(const char* p, std::vector<L2Level>& levels) {
+        if ((p = expect(p, '[')) == nullptr) {
+            return nullptr;
+        }
+        p = skipSpace(p);
+        if (p != end && *p == ']') {
+            return p + 1;
+        }
+        while (true) {
+            const char *first, *last;
+            L2Level level;
+            if ((p = expect(p, '[')) == nullptr || (p = readString(p, first, last)) == nullptr || !parseAtoms(first, last, level.price)) {
+                return nullptr;
+            }
+            if ((p = expect(p, ',')) == nullptr || (p = readString(p, first, last)) == nullptr || !parseAtoms(first, last, level.quantity)) {
+                return nullptr;
+            }
+            p = skipSpace(p);
+            while (p != end && *p == ',') { // tolerate extra fields in a level
+                if ((p = skipValue(p + 1)) == nullptr) {
+                    return nullptr;
+                }
+                p = skipSpace(p);
+            }
+            if ((p = expect(p, ']')) == nullptr) {
+                return nullptr;
+            }
+            levels.push_back(level);
+            p = skipSpace(p);
+            if (p == end) {
+                return nullptr;
+            }
+            if (*p == ']') {
+                return p + 1;
+            }
+            if (*p != ',') {
+                return nullptr;
+            }
+            ++p;
+        }
+    }
+
+    static bool keyIs(const char* first, const char* last, const char* name) {
+        size_t length = std::strlen(name);
+        return (size_t)(last - first) == length && std::memcmp(first, name, length) == 0;
+    }
+
+    public:
+    DepthParser() : end(nullptr), hitEnd(false) {};
+
+    /**
+     * @brief Parses the next message starting at cursor
+     *
+     * @details Leading whitespace (newlines between line-delimited or pretty-printed
+     *          messages) is skipped, so .txt and .json archives parse the same way.
+     *
+     * @param cursor Start of the message, moved past it on PARSE_OK
+     * @param limit End of the available bytes
+     * @param message Receives the message, cleared first
+     *
+     * @return ParseStatus PARSE_INCOMPLETE if the bytes end inside the message
+     */
+    ParseStatus parse(const char*& cursor, const char* limit, DepthMessage& message) {
+        end = limit;
+        hitEnd = false;
+        message.clear();
+
+        const char *p = expect(cursor, '{');
+        bool sawSnapshotId = false;
+        p = p ? skipSpace(p) : nullptr;
+        if (p != nullptr && p != end && *p == '}') {
+            p = p + 1;
+        } else {
+            while (p != nullptr) {
+                const char *keyFirst, *keyLast;
+                if ((p = readString(p, keyFirst, keyLast)) == nullptr || (p = expect(p, ':')) == nullptr) {
+                    break;
+                }
+                if (keyIs(keyFirst, keyLast, "b") || keyIs(keyFirst, keyLast, "bids")) {
+                    p = readLevels(p, message.bids);
+                } else if (keyIs(keyFirst, keyLast, "a") || keyIs(keyFirst, keyLast, "asks")) {
+                    p = readLevels(p, message.asks);
+                } else if (keyIs(keyFirst, keyLast, "U")) {
+                    p = readUnsigned(p, message.firstUpdateId);
+                } else if (keyIs(keyFirst, keyLast, "u")) {
+                    p = readUnsigned(p, message.finalUpdateId);
+                } else if (keyIs(keyFirst, keyLast, "E")) {
+                    p = readUnsigned(p, message.eventTime);
+                } else if (keyIs(keyFirst, keyLast, "lastUpdateId")) {
+                    p = readUnsigned(p, message.finalUpdateId);
+                    message.firstUpdateId = message.finalUpdateId;
+                    sawSnapshotId = true;
+                } else if (keyIs(keyFirst, keyLast, "s")) {
+                    const char *first, *last;
+                    if ((p = readString(p, first, last)) != nullptr) {
+                        size_t length = (size_t)(last - first) < sizeof(message.symbol) - 1 ? (size_t)(last - first) : sizeof(message.symbol) - 1;
+                        std::memcpy(message.symbol, first, length);
+                        message.symbol[length] = '\0';
+                    }
+                } else {
+                    p = skipValue(p);
+                }
+                if (p == nullptr) {
+                    break;
+                }
+                p = skipSpace(p);
+                if (p != end && *p == '}') {
+                    ++p;
+                    break;
+                }
+                if (p == end || *p != ',') {
+                    p = nullptr;
+                    break;
+                }
+                ++p;
+            }
+        }
+
+        if (p == nullptr) {
+            return hitEnd ? PARSE_INCOMPLETE : PARSE_ERROR;
+        }
+        message.isSnapshot = sawSnapshotId;
+        cursor = p;
+        return PARSE_OK;
+    }
+};
+
+// Reads depth messages from an archive file in large chunks. Messages may span chunk
+// boundaries; the unread tail is moved to the front of the buffer and topped up.
+// The buffer only grows if a single message is larger than it.
+class DepthFileReader {
+    private:
+    std::FILE* file;
+    std::vector<char> buffer;
+    size_t begin; // first unparsed byte in buffer
+    size_t filled; // bytes of buffer holding file data
+    bool eof;
+    unsigned long long bytesRead;
+    unsigned long long messageCount;
+    std::string errorText;
+    DepthParser parser;
+
+    // Moves the unparsed tail to the front and reads more; false if nothing new arrived
+    bool refill() {
+        if (eof) {
+            return false;
+        }
+        if (begin > 0) {
+            std::memmove(buffer.data(), buffer.data() + begin, filled - begin);
+            filled -= begin;
+            begin = 0;
+        }
+        if (filled == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+        size_t got = std::fread(buffer.data() + filled, 1, buffer.size() - filled, file);
+        filled += got;
+        bytesRead += got;
+        if (got == 0) {
+            eof = true;
+        }
+        return got > 0;
+    }
+
+    public:
+    DepthFileReader(size_t chunkSize = 1 << 22) : file(nullptr), buffer(chunkSize), begin(0), filled(0), eof(true), bytesRead(0), messageCount(0) {};
+    ~DepthFileReader() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+        file = std::fopen(path.c_str(), "rb");
+        if (file == nullptr) {
+            errorText = "cannot open " + path;
+            return false;
+        }
+        begin = 0;
+        filled = 0;
+        eof = false;
+        errorText.clear();
+        return true;
+    }
+
+    void close() {
+        if (file != nullptr) {
+            std::fclose(file);
+            file = nullptr;
+        }
+    }
+
+    /**
+     * @brief Parses the next message of the file
+     *
+     * @param message Receives the message
+     *
+     * @return bool false at the end of the file or on a malformed message (see error())
+     */
+    bool next(DepthMessage& message) {
+        while (true) {
+            const char *cursor = buffer.data() + begin;
+            const char *limit = buffer.data() + filled;
+            ParseStatus status = parser.parse(cursor, limit, message);
+            if (status == PARSE_OK) {
+                begin = (size_t)(cursor - buffer.data());
+                ++messageCount;
+                return true;
+            }
+            if (status == PARSE_ERROR) {
+                errorText = "malformed message after " + std::to_string(messageCount) + " messages";
+                return false;
+            }
+            if (!refill()) {
+                // only whitespace left is a clean end of file
+                for (size_t i = begin; i < filled; ++i) {
+                    if (!std::strchr(" \n\r\t", buffer[i])) {
+                        errorText = "file ends inside a message after " + std::to_string(messageCount) + " messages";
+                        return false;
+                    }
+                }
+                return false;
+            }
+        }
+    }
+
+    bool failed() const { return !errorText.empty(); }
+    const std::string& error() const { return errorText; }
+    unsigned long long bytes() const { return bytesRead; }
+};
+
+// Symbol an archive file belongs to, taken from its name: REST snapshots carry no symbol.
+// <pair>_orderbook_snapshot_<date>.txt -> PAIR
+inline std::string symbolFromFileName(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    std::string name = path.substr(slash == std::string::npos ? 0 : slash + 1);
+    name = name.substr(0, name.find('_'));
+    for (char &c : name) {
+        if (c >= 'a' && c <= 'z') {
+            c = (char)(c - 'a' + 'A');
+        }
+    }
+    return name;
+}
+
+#endif // DEPTHSTREAM_HPP
@@ -0,0 +1,690 @@
+#ifndef L2ARCHIVE_HPP
+#define L2ARCHIVE_HPP
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "depthStream.hpp"
+#include "l2Book.hpp"
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+// Compact columnar archive of one symbol's depth messages (snapshots and depthUpdates).
+//
+// File layout:
+//     L2ArchiveHeader
+//     blocks, each an L2BlockHeader followed by storedSize bytes of payload
+//     index, one L2IndexEntry per block (optional, absent in files that were not closed)
+//     L2IndexTrailer (only when the index is present)
+//
+// Every block decodes on its own. Every so often the writer ends a block early and starts
+// the next one with a checkpoint: a full copy of the book as a snapshot message. The index
+// maps event time and update ID to block offsets, so a reader can rebuild the book at any
+// point from the nearest checkpoint instead of from the start of the file.
+//
+// A block holds up to L2ArchiveHeader::blockMessages messages. Its payload is six varint
+// columns back to back (sizes in L2BlockHeader::columnSize), optionally deflated:
+//     L2_COL_TIME      event time, zigzag delta from the previous message
+//     L2_COL_FIRST_ID  U, zigzag delta from the previous message's u
+//     L2_COL_SPAN      u - U
+//     L2_COL_SHAPE     per message: flags (bit 0 = snapshot, bit 1 = checkpoint), bid count, ask count
+//     L2_COL_PRICE     per level: price / priceScale, zigzag delta from the previous level
+//                      of the same side (the first level of a side from the same side's
+//                      first level in the previous message)
+//     L2_COL_QUANTITY  per level: quantity / quantityScale
+// priceScale and quantityScale are the largest steps dividing every value of the block,
+// so prices become ticks and sizes become lots without the archive knowing the symbol.
+// Integers are stored in the writer's native byte order.
+
+const char L2_ARCHIVE_MAGIC[8] = {'L', '2', 'A', 'R', 'C', 'H', '1', '\0'};
+const unsigned int L2_BLOCK_MAGIC = 0x4B4C4232; // "2BLK"
+const char L2_INDEX_MAGIC[8] = {'L', '2', 'I', 'N', 'D', 'E', 'X', '1'};
+
+enum L2Column {
+    L2_COL_TIME,
+    L2_COL_FIRST_ID,
+    L2_COL_SPAN,
+    L2_COL_SHAPE,
+    L2_COL_PRICE,
+    L2_COL_QUANTITY,
+    L2_COLUMN_COUNT
+};
+
+enum L2Compression {
+    L2_COMPRESSION_NONE = 0,
+    L2_COMPRESSION_ZLIB = 1
+};
+
+struct L2ArchiveHeader {
+    char magic[8]; // L2_ARCHIVE_MAGIC
+    unsigned int version; // 1
+    unsigned int blockMessages; // most messages per block
+    char symbol[16];
+    unsigned long long reserved[4];
+};
+
+struct L2BlockHeader {
+    unsigned int magic; // L2_BLOCK_MAGIC
+    unsigned int messageCount;
+    unsigned int levelCount;
+    unsigned int compression; // L2Compression
+    unsigned int rawSize; // payload bytes before compression
+    unsigned int storedSize; // payload bytes in the file
+    unsigned int columnSize[L2_COLUMN_COUNT]; // raw bytes of each column
+    Amount priceScale;
+    Amount quantityScale;
+    unsigned long long firstEventTime; // event time the first delta is taken from
+    unsigned long long firstUpdateId; // update ID the first U delta is taken from
+};
+
+const unsigned int L2_INDEX_CHECKPOINT = 1; // L2IndexEntry::flags: the block starts with a checkpoint
+
+struct L2IndexEntry {
+    unsigned long long offset; // of the block header
+    unsigned long long eventTime; // E of the block's first message (the checkpoint's for checkpoint blocks)
+    unsigned long long updateId; // U of the block's first message (the checkpoint's lastUpdateId)
+    unsigned int messageCount;
+    unsigned int flags; // L2_INDEX_CHECKPOINT
+};
+
+struct L2IndexTrailer {
+    unsigned long long indexOffset; // first L2IndexEntry
+    unsigned long long entryCount;
+    char magic[8]; // L2_INDEX_MAGIC, the last bytes of the file
+};
+
+static_assert(sizeof(L2IndexEntry) == 32, "L2IndexEntry layout is part of the file format");
+static_assert(sizeof(L2IndexTrailer) == 24, "L2IndexTrailer layout is part of the file format");
+static_assert(sizeof(L2ArchiveHeader) == 64, "L2ArchiveHeader layout is part of the file format");
+static_assert(sizeof(L2BlockHeader) == 80, "L2BlockHeader layout is part of the file format");
+
+inline void putVarint(std::vector<unsigned char>& out, unsigned long long value) {
+    while (value >= 0x80) {
+        out.push_back((unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((unsigned char)value);
+}
+
+inline unsigned long long zigzag(long long value) { return ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63); }
+inline long long unzigzag(unsigned long long value) { return (long long)(value >> 1) ^ -(long long)(value & 1); }
+
+// Reads one varint, false if the column ends first
+inline bool getVarint(const unsigned char*& p, const unsigned char* end, unsigned long long& value) {
+    value = 0;
+    for (int shift = 0; p != end && shift < 64; shift += 7) {
+        unsigned char byte = *p++;
+        value |= (unsigned long long)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Writes depth messages of one symbol to a columnar archive
+ *
+ * @details Messages are collected until a block is full, then the block's scales are
+ *          worked out, its columns encoded and (with zlib) deflated and written.
+ *          The writer keeps its own L2Book of the stream; every checkpointMessages
+ *          messages or checkpointMillis of event time (while that book is in sync) it ends
+ *          the block and starts the next one with a checkpoint of the book.
+ *          Call close() to flush the last block and write the index.
+ */
+class L2ArchiveWriter {
+    private:
+    std::FILE* file;
+    unsigned int blockMessages;
+    bool compress;
+    // pending block, kept as flat arrays
+    std::vector<unsigned long long> times, firstIds, finalIds;
+    std::vector<unsigned int> bidCounts, askCounts;
+    std::vector<unsigned char> flags; // shape flags of each message
+    std::vector<L2Level> levels; // bids then asks of each message
+    std::vector<unsigned char> columns[L2_COLUMN_COUNT];
+    std::vector<unsigned char> payload;
+    std::vector<unsigned char> packed;
+    unsigned long long lastEventTime; // previous block's last message, the next block's deltas start here
+    unsigned long long lastUpdateId;
+    unsigned long long rawBytes;
+    unsigned long long storedBytes;
+    unsigned long long fileOffset; // where the next block goes
+    std::vector<L2IndexEntry> index;
+    L2Book book; // the stream's book, source of the checkpoints
+    DepthMessage checkpoint;
+    unsigned int checkpointMessages;
+    unsigned long long checkpointMillis;
+    unsigned long long sinceCheckpoint; // messages since the last checkpoint
+    unsigned long long checkpointTime; // event time of the last checkpoint
+    unsigned long long latestTime; // latest non-zero event time seen
+    unsigned long long checkpointCount;
+
+    void append(const DepthMessage& message) {
+        times.push_back(message.eventTime);
+        firstIds.push_back(message.firstUpdateId);
+        finalIds.push_back(message.finalUpdateId);
+        flags.push_back((unsigned char)((message.isSnapshot ? 1 : 0) | (message.isCheckpoint ? 2 : 0)));
+        bidCounts.push_back((unsigned int)message.bids.size());
+        askCounts.push_back((unsigned int)message.asks.size());
+        levels.insert(levels.end(), message.bids.begin(), message.bids.end());
+        levels.insert(levels.end(), message.asks.begin(), message.asks.end());
+    }
+
+    // Starts a new block with a full copy of the writer's book
+    bool writeCheckpoint() {
+        if (!flushBlock()) {
+            return false;
+        }
+        checkpoint.clear();
+        checkpoint.isSnapshot = true;
+        checkpoint.isCheckpoint = true;
+        checkpoint.eventTime = latestTime;
+        checkpoint.firstUpdateId = book.getLastUpdateId();
+        checkpoint.finalUpdateId = book.getLastUpdateId();
+        book.getBids().forEachFromBest([this](const L2Level& level) { checkpoint.bids.push_back(level); });
+        book.getAsks().forEachFromBest([this](const L2Level& level) { checkpoint.asks.push_back(level); });
+        append(checkpoint);
+        sinceCheckpoint = 0;
+        checkpointTime = latestTime;
+        ++checkpointCount;
+        return true;
+    }
+
+    static Amount gcd(Amount a, Amount b) {
+        a = a < 0 ? -a : a;
+        b = b < 0 ? -b : b;
+        while (b != 0) {
+            Amount t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+
+    bool flushBlock() {
+        if (times.empty()) {
+            return true;
+        }
+        L2BlockHeader header;
+        std::memset(&header, 0, sizeof(header));
+        header.magic = L2_BLOCK_MAGIC;
+        header.messageCount = (unsigned int)times.size();
+        header.levelCount = (unsigned int)levels.size();
+        header.firstEventTime = lastEventTime;
+        header.firstUpdateId = lastUpdateId;
+        header.priceScale = 0;
+        header.quantityScale = 0;
+        L2IndexEntry entry;
+        entry.offset = fileOffset;
+        entry.eventTime = times[0] != 0 ? times[0] : lastEventTime;
+        entry.updateId = firstIds[0];
+        entry.messageCount = header.messageCount;
+        entry.flags = (flags[0] & 2) ? L2_INDEX_CHECKPOINT : 0;
+        index.push_back(entry);
+
+        for (const L2Level &level : levels) {
+            header.priceScale = gcd(header.priceScale, level.price);
+            header.quantityScale = gcd(header.quantityScale, level.quantity);
+        }
+        header.priceScale = header.priceScale == 0 ? 1 : header.priceScale;
+        header.quantityScale = header.quantityScale == 0 ? 1 : header.quantityScale;
+
+        for (std::vector<unsigned char> &column : columns) {
+            column.clear();
+        }
+        unsigned long long previousTime = lastEventTime;
+        unsigned long long previousId = lastUpdateId;
+        long long firstBid = 0, firstAsk = 0; // previous message's first level of each side, in scaled units
+        size_t next = 0;
+        for (size_t i = 0; i < times.size(); ++i) {
+            putVarint(columns[L2_COL_TIME], zigzag((long long)(times[i] - previousTime)));
+            putVarint(columns[L2_COL_FIRST_ID], zigzag((long long)(firstIds[i] - previousId)));
+            putVarint(columns[L2_COL_SPAN], finalIds[i] - firstIds[i]);
+            putVarint(columns[L2_COL_SHAPE], flags[i]);
+            putVarint(columns[L2_COL_SHAPE], bidCounts[i]);
+            putVarint(columns[L2_COL_SHAPE], askCounts[i]);
+            previousTime = times[i];
+            previousId = finalIds[i];
+            for (int side = 0; side < 2; ++side) {
+                unsigned int count = side == 0 ? bidCounts[i] : askCounts[i];
+                long long &first = side == 0 ? firstBid : firstAsk;
+                long long previous = first;
+                for (unsigned int j = 0; j < count; ++j, ++next) {
+                    long long price = levels[next].price / header.priceScale;
+                    putVarint(columns[L2_COL_PRICE], zigzag(price - previous));
+                    putVarint(columns[L2_COL_QUANTITY], (unsigned long long)(levels[next].quantity / header.quantityScale));
+                    if (j == 0) {
+                        first = price;
+                    }
+                    previous = price;
+                }
+            }
+        }
+        lastEventTime = previousTime;
+        lastUpdateId = previousId;
+
+        payload.clear();
+        for (int c = 0; c < L2_COLUMN_COUNT; ++c) {
+            header.columnSize[c] = (unsigned int)columns[c].size();
+            payload.insert(payload.end(), columns[c].begin(), columns[c].end());
+        }
+        header.rawSize = (unsigned int)payload.size();
+        const unsigned char *stored = payload.data();
+        header.storedSize = header.rawSize;
+        header.compression = L2_COMPRESSION_NONE;
+#ifdef HAVE_ZLIB
+        if (compress) {
+            uLongf packedSize = compressBound((uLong)payload.size());
+            packed.resize(packedSize);
+            if (compress2(packed.data(), &packedSize, payload.data(), (uLong)payload.size(), 6) == Z_OK && packedSize < payload.size()) {
+                stored = packed.data();
+                header.storedSize = (unsigned int)packedSize;
+                header.compression = L2_COMPRESSION_ZLIB;
+            }
+        }
+#endif
+        rawBytes += header.rawSize;
+        storedBytes += header.storedSize;
+        fileOffset += sizeof(header) + header.storedSize;
+
+        times.clear();
+        firstIds.clear();
+        finalIds.clear();
+        bidCounts.clear();
+        askCounts.clear();
+        flags.clear();
+        levels.clear();
+        return std::fwrite(&header, sizeof(header), 1, file) == 1 && std::fwrite(stored, 1, header.storedSize, file) == header.storedSize;
+    }
+
+    public:
+    /**
+     * @param messagesPerBlock Messages per block; larger blocks compress better, smaller
+     *        ones let a reader skip to a position with less decoding
+     * @param useCompression Deflate blocks when the build has zlib (HAVE_ZLIB)
+     * @param messagesPerCheckpoint Most messages between checkpoints, 0 for none
+     * @param millisPerCheckpoint Most event time between checkpoints, 0 for no time limit
+     */
+    L2ArchiveWriter(unsigned int messagesPerBlock = 4096, bool useCompression = true, unsigned int messagesPerCheckpoint = 16384,
+                    unsigned long long millisPerCheckpoint = 60000)
+        : file(nullptr), blockMessages(messagesPerBlock), compress(useCompression), lastEventTime(0), lastUpdateId(0), rawBytes(0), storedBytes(0),
+          fileOffset(0), checkpointMessages(messagesPerCheckpoint), checkpointMillis(millisPerCheckpoint), sinceCheckpoint(0), checkpointTime(0),
+          latestTime(0), checkpointCount(0) {};
+    ~L2ArchiveWriter() { close(); }
+
+    bool open(const std::string& path, const std::string& symbol) {
+        close();
+        file = std::fopen(path.c_str(), "wb");
+        if (file == nullptr) {
+            return false;
+        }
+        L2ArchiveHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, L2_ARCHIVE_MAGIC, sizeof(header.magic));
+        header.version = 1;
+        header.blockMessages = blockMessages;
+        std::strncpy(header.symbol, symbol.c_str(), sizeof(header.symbol) - 1);
+        lastEventTime = 0;
+        lastUpdateId = 0;
+        rawBytes = 0;
+        storedBytes = 0;
+        fileOffset = sizeof(header);
+        index.clear();
+        book.reset();
+        sinceCheckpoint = 0;
+        checkpointTime = 0;
+        latestTime = 0;
+        checkpointCount = 0;
+        return std::fwrite(&header, sizeof(header), 1, file) == 1;
+    }
+
+    // Appends one message, false if writing a block failed
+    bool add(const DepthMessage& message) {
+        if (message.isCheckpoint) {
+            return true; // checkpoints of another archive, this writer makes its own
+        }
+        append(message);
+        book.apply(message);
+        ++sinceCheckpoint;
+        if (message.eventTime != 0) {
+            latestTime = message.eventTime;
+            if (checkpointTime == 0) {
+                checkpointTime = latestTime;
+            }
+        }
+        bool due = (checkpointMessages > 0 && sinceCheckpoint >= checkpointMessages)
+                || (checkpointMillis > 0 && latestTime - checkpointTime >= checkpointMillis);
+        if (due && book.inSync() && book.bufferedCount() == 0) { // a checkpoint cannot carry buffered updates
+            return writeCheckpoint();
+        }
+        return times.size() < blockMessages || flushBlock();
+    }
+
+    // Writes the last block and the index and closes the file, false if anything failed to write
+    bool close() {
+        if (file == nullptr) {
+            return true;
+        }
+        bool ok = flushBlock();
+        L2IndexTrailer trailer;
+        trailer.indexOffset = fileOffset;
+        trailer.entryCount = index.size();
+        std::memcpy(trailer.magic, L2_INDEX_MAGIC, sizeof(trailer.magic));
+        ok = ok && (index.empty() || std::fwrite(index.data(), sizeof(L2IndexEntry), index.size(), file) == index.size());
+        ok = ok && std::fwrite(&trailer, sizeof(trailer), 1, file) == 1;
+        ok = std::fclose(file) == 0 && ok;
+        file = nullptr;
+        return ok;
+    }
+
+    unsigned long long checkpoints() const { return checkpointCount; }
+
+    unsigned long long encodedBytes() const { return rawBytes; } // column bytes before compression
+    unsigned long long compressedBytes() const { return storedBytes; } // column bytes written
+};
+
+/**
+ * @brief Iterates the messages of a columnar archive straight out of a memory mapping
+ *
+ * @details The file is mapped read-only. Uncompressed blocks are decoded in place; a
+ *          compressed block is inflated once into a reused buffer. Messages are decoded
+ *          into a caller-provided DepthMessage whose vectors are reused. Checkpoints are
+ *          skipped by next() unless setIncludeCheckpoints(true), so a plain read returns the
+ *          stream as it was recorded. seekTime() and seekUpdateId() rebuild a book at a point
+ *          of the stream from the nearest checkpoint before it and leave next() after it.
+ */
+class L2ArchiveReader {
+    private:
+    const unsigned char* data; // the mapping
+    size_t size;
+    size_t offset; // next block header
+    size_t blocksEnd; // where the index starts, or the file size without one
+    const unsigned char* indexEntries; // unaligned L2IndexEntry array, null without an index
+    size_t entryCount;
+    bool includeCheckpoints;
+    bool holding; // held is the next message, decoded by the last seek
+    DepthMessage held;
+    L2ArchiveHeader header;
+    L2BlockHeader block; // current block
+    const unsigned char* cursor[L2_COLUMN_COUNT]; // read position of each column
+    const unsigned char* columnEnd[L2_COLUMN_COUNT];
+    unsigned int messagesLeft; // in the current block
+    unsigned long long previousTime;
+    unsigned long long previousId;
+    long long firstBid, firstAsk;
+    std::vector<unsigned char> inflated;
+    std::string errorText;
+
+    bool fail(const std::string& text) {
+        errorText = text;
+        return false;
+    }
+
+    // Positions the column cursors on the block at offset
+    bool loadBlock() {
+        if (offset + sizeof(L2BlockHeader) > blocksEnd) {
+            return offset == blocksEnd ? false : fail("truncated block header");
+        }
+        std::memcpy(&block, data + offset, sizeof(block));
+        if (block.magic != L2_BLOCK_MAGIC || offset + sizeof(block) + block.storedSize > blocksEnd) {
+            return fail("corrupt block at byte " + std::to_string(offset));
+        }
+        const unsigned char *payload = data + offset + sizeof(block);
+        if (block.compression == L2_COMPRESSION_ZLIB) {
+#ifdef HAVE_ZLIB
+            inflated.resize(block.rawSize);
+            uLongf rawSize = block.rawSize;
+            if (uncompress(inflated.data(), &rawSize, payload, block.storedSize) != Z_OK || rawSize != block.rawSize) {
+                return fail("cannot inflate block at byte " + std::to_string(offset));
+            }
+            payload = inflated.data();
+#else
+            return fail("archive is compressed but this build has no zlib");
+#endif
+        } else if (block.compression != L2_COMPRESSION_NONE) {
+            return fail("unknown compression");
+        }
+        size_t columnOffset = 0;
+        for (int c = 0; c < L2_COLUMN_COUNT; ++c) {
+            cursor[c] = payload + columnOffset;
+            columnOffset += block.columnSize[c];
+            columnEnd[c] = payload + columnOffset;
+        }
+        if (columnOffset != block.rawSize) {
+            return fail("corrupt column sizes at byte " + std::to_string(offset));
+        }
+        offset += sizeof(block) + block.storedSize;
+        messagesLeft = block.messageCount;
+        previousTime = block.firstEventTime;
+        previousId = block.firstUpdateId;
+        firstBid = 0;
+        firstAsk = 0;
+        return true;
+    }
+
+    bool readLevels(std::vector<L2Level>& levels, unsigned long long count, long long& first) {
+        long long price = first;
+        for (unsigned long long j = 0; j < count; ++j) {
+            unsigned long long delta, quantity;
+            if (!getVarint(cursor[L2_COL_PRICE], columnEnd[L2_COL_PRICE], delta) || !getVarint(cursor[L2_COL_QUANTITY], columnEnd[L2_COL_QUANTITY], quantity)) {
+                return fail("level columns end early");
+            }
+            price += unzigzag(delta);
+            if (j == 0) {
+                first = price;
+            }
+            L2Level level = {price * block.priceScale, (Amount)quantity * block.quantityScale};
+            levels.push_back(level);
+        }
+        return true;
+    }
+
+    // Decodes the next message of the file, checkpoints included
+    bool decode(DepthMessage& message) {
+        if (messagesLeft == 0 && !loadBlock()) {
+            return false;
+        }
+        --messagesLeft;
+        message.clear();
+        unsigned long long time, firstId, span, flags, bidCount, askCount;
+        if (!getVarint(cursor[L2_COL_TIME], columnEnd[L2_COL_TIME], time) || !getVarint(cursor[L2_COL_FIRST_ID], columnEnd[L2_COL_FIRST_ID], firstId)
+            || !getVarint(cursor[L2_COL_SPAN], columnEnd[L2_COL_SPAN], span) || !getVarint(cursor[L2_COL_SHAPE], columnEnd[L2_COL_SHAPE], flags)
+            || !getVarint(cursor[L2_COL_SHAPE], columnEnd[L2_COL_SHAPE], bidCount) || !getVarint(cursor[L2_COL_SHAPE], columnEnd[L2_COL_SHAPE], askCount)) {
+            return fail("message columns end early");
+        }
+        message.isSnapshot = (flags & 1) != 0;
+        message.isCheckpoint = (flags & 2) != 0;
+        message.eventTime = previousTime + (unsigned long long)unzigzag(time);
+        message.firstUpdateId = previousId + (unsigned long long)unzigzag(firstId);
+        message.finalUpdateId = message.firstUpdateId + span;
+        std::memcpy(message.symbol, header.symbol, sizeof(message.symbol));
+        message.symbol[sizeof(message.symbol) - 1] = '\0';
+        previousTime = message.eventTime;
+        previousId = message.finalUpdateId;
+        return readLevels(message.bids, bidCount, firstBid) && readLevels(message.asks, askCount, firstAsk);
+    }
+
+    // Finds the index and checks that it fits between the blocks and the trailer
+    void loadIndex() {
+        blocksEnd = size;
+        indexEntries = nullptr;
+        entryCount = 0;
+        if (size < sizeof(L2ArchiveHeader) + sizeof(L2IndexTrailer)) {
+            return;
+        }
+        L2IndexTrailer trailer;
+        std::memcpy(&trailer, data + size - sizeof(trailer), sizeof(trailer));
+        if (std::memcmp(trailer.magic, L2_INDEX_MAGIC, sizeof(trailer.magic)) != 0 || trailer.indexOffset < sizeof(L2ArchiveHeader)
+            || trailer.indexOffset > size - sizeof(trailer) || (size - sizeof(trailer) - trailer.indexOffset) / sizeof(L2IndexEntry) != trailer.entryCount
+            || (size - sizeof(trailer) - trailer.indexOffset) % sizeof(L2IndexEntry) != 0) {
+            return; // a file that was never closed, read it without an index
+        }
+        blocksEnd = (size_t)trailer.indexOffset;
+        indexEntries = data + blocksEnd;
+        entryCount = (size_t)trailer.entryCount;
+    }
+
+    /**
+     * @brief Rebuilds book up to a point of the stream and holds the first message past it
+     *
+     * @param byTime Compare event times if true, update IDs otherwise
+     * @param target Last event time or update ID to include
+     */
+    bool seek(bool byTime, unsigned long long target, L2Book& book, bool useIndex) {
+        book.reset();
+        errorText.clear();
+        holding = false;
+        offset = sizeof(header);
+        messagesLeft = 0;
+        if (data == nullptr) {
+            return fail("no archive open");
+        }
+        if (useIndex) {
+            // blocks are in stream order, so the last checkpoint at or before target is the closest
+            for (size_t i = 0; i < entryCount; ++i) {
+                L2IndexEntry entry = indexEntry(i);
+                if ((entry.flags & L2_INDEX_CHECKPOINT) == 0) {
+                    continue;
+                }
+                if ((byTime ? entry.eventTime : entry.updateId) > target) {
+                    break;
+                }
+                offset = (size_t)entry.offset;
+            }
+        }
+        while (decode(held)) {
+            // snapshots recorded with no event time are never past a time
+            if (byTime ? held.eventTime > target : held.firstUpdateId > target) {
+                holding = true;
+                return true;
+            }
+            book.apply(held);
+        }
+        return !failed();
+    }
+
+    public:
+    L2ArchiveReader()
+        : data(nullptr), size(0), offset(0), blocksEnd(0), indexEntries(nullptr), entryCount(0), includeCheckpoints(false), holding(false),
+          messagesLeft(0), previousTime(0), previousId(0), firstBid(0), firstAsk(0) {
+        std::memset(&header, 0, sizeof(header));
+    };
+    ~L2ArchiveReader() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+        errorText.clear();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return fail("cannot open " + path);
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(L2ArchiveHeader)) {
+            ::close(fd);
+            return fail(path + " is not an L2 archive");
+        }
+        size = (size_t)info.st_size;
+        void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            size = 0;
+            return fail("cannot map " + path);
+        }
+        data = (const unsigned char*)mapping;
+        madvise(mapping, size, MADV_SEQUENTIAL);
+        std::memcpy(&header, data, sizeof(header));
+        if (std::memcmp(header.magic, L2_ARCHIVE_MAGIC, sizeof(header.magic)) != 0 || header.version != 1) {
+            close();
+            return fail(path + " is not an L2 archive");
+        }
+        offset = sizeof(header);
+        messagesLeft = 0;
+        holding = false;
+        loadIndex();
+        return true;
+    }
+
+    void close() {
+        if (data != nullptr) {
+            munmap((void*)data, size);
+            data = nullptr;
+            size = 0;
+        }
+    }
+
+    /**
+     * @brief Decodes the next message
+     *
+     * @param message Receives the message; its symbol is the archive's symbol
+     *
+     * @return bool false at the end of the archive or on corrupt data (see error())
+     */
+    bool next(DepthMessage& message) {
+        if (holding) {
+            holding = false;
+            std::swap(message, held);
+            if (includeCheckpoints || !message.isCheckpoint) {
+                return true;
+            }
+        }
+        do {
+            if (!decode(message)) {
+                return false;
+            }
+        } while (message.isCheckpoint && !includeCheckpoints);
+        return true;
+    }
+
+    /**
+     * @brief Rebuilds the book as it was at an event time
+     *
+     * @details Starts from the last checkpoint at or before time (or from the start of the
+     *          file when useIndex is false or there is none) and applies every message up to
+     *          and including time. next() then returns the first message after it.
+     *
+     * @param time Event time in milliseconds
+     * @param book Receives the book; it is reset first
+     * @param useIndex false to replay from the start of the file, for checking the index
+     *
+     * @return bool false on corrupt data (see error())
+     */
+    bool seekTime(unsigned long long time, L2Book& book, bool useIndex = true) { return seek(true, time, book, useIndex); }
+
+    // As seekTime(), applying every message whose first update ID is at most updateId
+    bool seekUpdateId(unsigned long long updateId, L2Book& book, bool useIndex = true) { return seek(false, updateId, book, useIndex); }
+
+    void setIncludeCheckpoints(bool include) { includeCheckpoints = include; }
+    size_t indexSize() const { return entryCount; } // 0 for archives without an index
+    L2IndexEntry indexEntry(size_t i) const {
+        L2IndexEntry entry;
+        std::memcpy(&entry, indexEntries + i * sizeof(entry), sizeof(entry));
+        return entry;
+    }
+
+    bool failed() const { return !errorText.empty(); }
+    const std::string& error() const { return errorText; }
+    const char* symbol() const { return header.symbol; }
+    size_t bytes() const { return size; }
+};
+
+// true if the file at path starts with the archive magic
+inline bool isL2Archive(const std::string& path) {
+    char magic[sizeof(L2_ARCHIVE_MAGIC)] = {0};
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    size_t got = std::fread(magic, 1, sizeof(magic), file);
+    std::fclose(file);
+    return got == sizeof(magic) && std::memcmp(magic, L2_ARCHIVE_MAGIC, sizeof(magic)) == 0;
+}
+
+#endif // L2ARCHIVE_HPP
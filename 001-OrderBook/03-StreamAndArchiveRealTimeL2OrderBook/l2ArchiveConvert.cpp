@@ -0,0 +1,99 @@
+#include "depthStream.hpp"
+#include "l2Archive.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Converts archived Binance depth files (.txt or .json) into one columnar archive
+ *
+ * @details Inputs are appended in the order given, so pass the snapshot first. The
+ *          archive's symbol is taken from the first input's file name unless --symbol
+ *          is given. A checkpoint of the book is written every --checkpoint-messages
+ *          messages (default 16384) or --checkpoint-seconds of event time (default 60),
+ *          whichever comes first; 0 turns either off. Prints the input size, the encoded
+ *          size and the compression ratio.
+ *
+ *          Usage: l2ArchiveConvert [--symbol S] [--block N] [--no-compress] [--checkpoint-messages N]
+ *                                  [--checkpoint-seconds S] out.l2a in.txt [more inputs...]
+ *
+ * @return int 0 on success, 1 on a bad argument or a read/write error
+ */
+int main(int argc, char* argv[]) {
+    string symbol;
+    unsigned int blockMessages = 4096;
+    bool compress = true;
+    unsigned int checkpointMessages = 16384;
+    double checkpointSeconds = 60;
+    vector<string> paths;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--symbol" && i + 1 < argc) {
+            symbol = argv[++i];
+        } else if (arg == "--block" && i + 1 < argc) {
+            blockMessages = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--checkpoint-messages" && i + 1 < argc) {
+            checkpointMessages = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--checkpoint-seconds" && i + 1 < argc) {
+            checkpointSeconds = atof(argv[++i]);
+        } else if (arg == "--no-compress") {
+            compress = false;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.size() < 2 || blockMessages == 0 || checkpointSeconds < 0) {
+        cerr << "Usage: l2ArchiveConvert [--symbol S] [--block N] [--no-compress] [--checkpoint-messages N] [--checkpoint-seconds S] out.l2a in.txt [more inputs...]"
+             << endl;
+        return 1;
+    }
+    if (symbol.empty()) {
+        symbol = symbolFromFileName(paths[1]);
+    }
+
+    L2ArchiveWriter writer(blockMessages, compress, checkpointMessages, (unsigned long long)(checkpointSeconds * 1000));
+    if (!writer.open(paths[0], symbol)) {
+        cerr << "Cannot write " << paths[0] << endl;
+        return 1;
+    }
+
+    DepthFileReader reader;
+    DepthMessage message;
+    unsigned long long messages = 0;
+    for (size_t i = 1; i < paths.size(); ++i) {
+        if (!reader.open(paths[i])) {
+            cerr << reader.error() << endl;
+            return 1;
+        }
+        while (reader.next(message)) {
+            if (!writer.add(message)) {
+                cerr << "Cannot write " << paths[0] << endl;
+                return 1;
+            }
+            ++messages;
+        }
+        if (reader.failed()) {
+            cerr << paths[i] << ": " << reader.error() << endl;
+            return 1;
+        }
+    }
+    if (!writer.close()) {
+        cerr << "Cannot write " << paths[0] << endl;
+        return 1;
+    }
+
+    unsigned long long inputBytes = reader.bytes();
+    unsigned long long outputBytes = writer.compressedBytes();
+    cout << "Wrote " << messages << " " << symbol << " messages and " << writer.checkpoints() << " checkpoints to " << paths[0] << endl;
+    cout << "Input " << inputBytes << " bytes, columns " << writer.encodedBytes() << " bytes, stored " << outputBytes
+         << " bytes (" << (outputBytes > 0 ? (double)inputBytes / outputBytes : 0) << "x smaller)" << endl;
+#ifndef HAVE_ZLIB
+    if (compress) {
+        cout << "Built without zlib, blocks are stored uncompressed" << endl;
+    }
+#endif
+    return 0;
+}
@@ -0,0 +1,541 @@
+#ifndef L2BOOK_HPP
+#define L2BOOK_HPP
+
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "checksum.hpp"
+#include "depthStream.hpp"
+#include "priceLadder.hpp"
+
+// One side of an aggregated book (total quantity per price).
+// Levels on the tick grid within a band around the market live in a ladder indexed by
+// tick offset, so setting or deleting a level is O(1) and the next best level is found
+// through the same two-level bitmap the matching engine uses. The rare level that is off
+// the grid or outside the band goes to a small sorted overflow array instead.
+class L2Side {
+    private:
+    std::vector<Amount> quantities; // quantities[(price - minPrice) / tickSize], 0 when empty
+    LevelBitmap occupied; // which ladder levels hold quantity
+    std::vector<L2Level> overflow; // levels the ladder cannot hold, worst price first
+    Amount tickSize; // price step of the ladder in atoms, 0 until anchored
+    Amount minPrice; // price of ladder level 0, in atoms
+    size_t bestIndex; // best occupied ladder level, LevelBitmap::NONE when the ladder is empty
+    size_t ladderCount; // occupied ladder levels
+    bool isBid;
+
+    // true if price a is further from the top of the book than price b
+    bool worse(Amount a, Amount b) const { return isBid ? a < b : a > b; }
+
+    // Ladder index of a price, LevelBitmap::NONE if the ladder cannot hold it
+    size_t indexOf(Amount price) const {
+        if (tickSize == 0 || price < minPrice || (price - minPrice) % tickSize != 0) {
+            return LevelBitmap::NONE;
+        }
+        size_t index = (size_t)((price - minPrice) / tickSize);
+        return index < quantities.size() ? index : LevelBitmap::NONE;
+    }
+
+    Amount priceOf(size_t index) const { return minPrice + (Amount)index * tickSize; }
+
+    // Next occupied ladder level after index moving away from the top, NONE if none
+    size_t nextWorse(size_t index) const {
+        if (isBid) {
+            return index == 0 ? LevelBitmap::NONE : occupied.prevSet(index - 1);
+        }
+        return occupied.nextSet(index + 1);
+    }
+
+    void setOverflow(Amount price, Amount quantity) {
+        size_t low = 0;
+        size_t high = overflow.size();
+        while (low < high) {
+            size_t mid = (low + high) / 2;
+            if (worse(overflow[mid].price, price)) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        bool found = low < overflow.size() && overflow[low].price == price;
+        if (quantity == 0) {
+            if (found) {
+                overflow.erase(overflow.begin() + low);
+            }
+        } else if (found) {
+            overflow[low].quantity = quantity;
+        } else {
+            L2Level level = {price, quantity};
+            overflow.insert(overflow.begin() + low, level);
+        }
+    }
+
+    public:
+    L2Side() : tickSize(0), minPrice(0), bestIndex(LevelBitmap::NONE), ladderCount(0), isBid(true) {};
+
+    // Allocates the ladder once; bandLevels is the number of ticks the ladder spans
+    void init(bool bidSide, size_t bandLevels) {
+        isBid = bidSide;
+        quantities.assign(bandLevels, 0);
+        occupied.resize(bandLevels);
+        overflow.clear();
+        overflow.reserve(256);
+        tickSize = 0;
+        bestIndex = LevelBitmap::NONE;
+        ladderCount = 0;
+    }
+
+    // Empties the side; only occupied levels are touched, the ladder is not reallocated
+    void clear() {
+        while (bestIndex != LevelBitmap::NONE) {
+            quantities[bestIndex] = 0;
+            occupied.clear(bestIndex);
+            bestIndex = nextWorse(bestIndex);
+        }
+        ladderCount = 0;
+        overflow.clear();
+    }
+
+    // Empties the side and centres the ladder on a price with the given tick size
+    void anchor(Amount tick, Amount centre) {
+        clear();
+        tickSize = tick;
+        minPrice = (centre / tick - (Amount)quantities.size() / 2) * tick;
+    }
+
+    bool anchored() const { return tickSize != 0; }
+    Amount tick() const { return tickSize; }
+    Amount bandLow() const { return minPrice; }
+    Amount bandHigh() const { return minPrice + (Amount)quantities.size() * tickSize; } // first price above the ladder
+
+    // Sets the total quantity of a level, 0 removes it, and returns what it held before.
+    // O(1) for ladder levels.
+    Amount set(Amount price, Amount quantity) {
+        size_t index = indexOf(price);
+        if (index == LevelBitmap::NONE) {
+            Amount previous = quantityAt(price);
+            setOverflow(price, quantity);
+            return previous;
+        }
+        Amount &level = quantities[index];
+        Amount previous = level;
+        if (quantity == 0) {
+            if (level != 0) {
+                level = 0;
+                occupied.clear(index);
+                --ladderCount;
+                if (index == bestIndex) {
+                    bestIndex = nextWorse(index);
+                }
+            }
+            return previous;
+        }
+        if (level == 0) {
+            occupied.set(index);
+            ++ladderCount;
+            if (bestIndex == LevelBitmap::NONE || (isBid ? index > bestIndex : index < bestIndex)) {
+                bestIndex = index;
+            }
+        }
+        level = quantity;
+        return previous;
+    }
+
+    // Quantity resting at a price, 0 if none
+    Amount quantityAt(Amount price) const {
+        size_t index = indexOf(price);
+        if (index != LevelBitmap::NONE) {
+            return quantities[index];
+        }
+        for (const L2Level &level : overflow) {
+            if (level.price == price) {
+                return level.quantity;
+            }
+        }
+        return 0;
+    }
+
+    // Occupied level with the lowest price above `price`, false if none
+    bool above(Amount price, L2Level& level) const {
+        bool found = false;
+        if (tickSize != 0) {
+            size_t from = price < minPrice ? 0 : (size_t)((price - minPrice) / tickSize + 1);
+            size_t index = occupied.nextSet(from);
+            if (index != LevelBitmap::NONE && index < quantities.size()) {
+                level.price = priceOf(index);
+                level.quantity = quantities[index];
+                found = true;
+            }
+        }
+        for (const L2Level &spill : overflow) { // rarely more than a few entries
+            if (spill.price > price && (!found || spill.price < level.price)) {
+                level = spill;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    // Occupied level with the highest price below `price`, false if none
+    bool below(Amount price, L2Level& level) const {
+        bool found = false;
+        if (tickSize != 0 && price > minPrice) {
+            size_t index = occupied.prevSet((size_t)((price - minPrice - 1) / tickSize));
+            if (index != LevelBitmap::NONE) {
+                level.price = priceOf(index);
+                level.quantity = quantities[index];
+                found = true;
+            }
+        }
+        for (const L2Level &spill : overflow) {
+            if (spill.price < price && (!found || spill.price > level.price)) {
+                level = spill;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    bool empty() const { return ladderCount == 0 && overflow.empty(); }
+    size_t size() const { return ladderCount + overflow.size(); }
+    size_t overflowSize() const { return overflow.size(); }
+
+    // Top of this side, only valid when !empty()
+    L2Level best() const {
+        if (bestIndex == LevelBitmap::NONE || (!overflow.empty() && worse(priceOf(bestIndex), overflow.back().price))) {
+            return overflow.back();
+        }
+        L2Level level = {priceOf(bestIndex), quantities[bestIndex]};
+        return level;
+    }
+
+    // Calls visit(level) for every level from the best price outwards
+    template <class Visitor>
+    void forEachFromBest(Visitor visit) const {
+        size_t index = bestIndex;
+        size_t spill = overflow.size(); // overflow is walked from its back
+        while (index != LevelBitmap::NONE || spill > 0) {
+            if (index != LevelBitmap::NONE && (spill == 0 || !worse(priceOf(index), overflow[spill - 1].price))) {
+                L2Level level = {priceOf(index), quantities[index]};
+                visit(level);
+                index = nextWorse(index);
+            } else {
+                visit(overflow[--spill]);
+            }
+        }
+    }
+
+    unsigned long long checksum(unsigned long long hash) const {
+        forEachFromBest([&hash](const L2Level& level) {
+            hash = mixChecksum(hash, (unsigned long long)level.price);
+            hash = mixChecksum(hash, (unsigned long long)level.quantity);
+        });
+        return hash;
+    }
+};
+
+// Where an L2Book stands in Binance's snapshot + delta synchronization
+enum L2SyncState {
+    L2_WAITING_FOR_SNAPSHOT, // no usable snapshot yet or a gap was seen, updates are buffered
+    L2_IN_SYNC // a snapshot is loaded and every update since then has been applied
+};
+
+// What L2Book::apply did with a message
+enum L2ApplyResult {
+    L2_APPLIED, // update applied
+    L2_SNAPSHOT_LOADED, // snapshot loaded (and buffered updates replayed on top of it)
+    L2_BUFFERED, // update held until the next snapshot
+    L2_STALE, // update already covered by the snapshot, dropped
+    L2_GAP // updates were missed, the book needs a new snapshot
+};
+
+// Told about every level an L2Book changes, e.g. to keep analytics up to date incrementally
+class L2BookListener {
+    public:
+    virtual ~L2BookListener() {}
+    virtual void onLevel(bool isBid, Amount price, Amount previous, Amount quantity) = 0; // after the level changed
+    virtual void onCleared() = 0; // both sides were emptied (a snapshot is about to be loaded, or reset())
+};
+
+// Counters of one book's synchronization
+struct L2SyncStats {
+    unsigned long long applied; // updates applied
+    unsigned long long stale; // updates dropped because u <= lastUpdateId
+    unsigned long long gaps; // times U > lastUpdateId + 1 was seen
+    unsigned long long snapshots; // snapshots loaded
+    unsigned long long buffered; // updates held while waiting for a snapshot
+    unsigned long long bufferDropped; // buffered updates lost because the buffer was full
+};
+
+/**
+ * @brief Aggregated (L2) order book maintained from a Binance snapshot plus depthUpdate deltas
+ *
+ * @details Follows Binance's rules for a local book:
+ * 1. Updates that arrive before the snapshot are buffered
+ * 2. Updates with u <= the snapshot's lastUpdateId are dropped as stale
+ * 3. Each applied update must start at most one past the last applied ID
+ *    (U <= lastUpdateId + 1); anything later is a gap and the book waits for a new snapshot
+ *
+ * A new snapshot resyncs the book in place: only occupied levels are cleared and the
+ * ladder is only re-centred when the market has moved out of the middle of its band.
+ *
+ * The ladder's tick is the instrument's tick size when one is given. Otherwise it is
+ * learnt from the snapshots: the largest step that divides every gap between neighbouring
+ * levels seen so far, so it only ever gets finer and a sparse snapshot cannot fix it too
+ * coarse. Levels off the ladder's grid are still kept, in the overflow.
+ */
+class L2Book {
+    private:
+    L2Side bids;
+    L2Side asks;
+    L2SyncState state;
+    unsigned long long lastUpdateId; // u of the last applied update, or the snapshot's lastUpdateId
+    L2SyncStats stats;
+    L2BookListener* listener; // may be null
+    std::vector<DepthMessage> pending; // ring of updates received while waiting for a snapshot
+    size_t pendingHead; // oldest buffered update
+    size_t pendingCount;
+    Amount configuredTick; // price step of the instrument in atoms, 0 to learn it from the snapshots
+    Amount learnedTick; // step dividing every gap between neighbouring levels seen so far, 0 before any
+
+    static Amount gcd(Amount a, Amount b) {
+        while (b != 0) {
+            Amount t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+
+    // Folds the gaps between neighbouring levels of one side into step
+    static Amount levelStep(const std::vector<L2Level>& levels, Amount step) {
+        for (size_t i = 1; i < levels.size(); ++i) {
+            Amount gap = levels[i].price - levels[i - 1].price;
+            step = gcd(step, gap < 0 ? -gap : gap);
+        }
+        return step;
+    }
+
+    void applyLevels(const DepthMessage& message) {
+        if (listener == nullptr) {
+            for (const L2Level &level : message.bids) {
+                bids.set(level.price, level.quantity);
+            }
+            for (const L2Level &level : message.asks) {
+                asks.set(level.price, level.quantity);
+            }
+            return;
+        }
+        for (const L2Level &level : message.bids) {
+            Amount previous = bids.set(level.price, level.quantity);
+            if (previous != level.quantity) {
+                listener->onLevel(true, level.price, previous, level.quantity);
+            }
+        }
+        for (const L2Level &level : message.asks) {
+            Amount previous = asks.set(level.price, level.quantity);
+            if (previous != level.quantity) {
+                listener->onLevel(false, level.price, previous, level.quantity);
+            }
+        }
+    }
+
+    void buffer(const DepthMessage& message) {
+        if (pending.empty()) {
+            return;
+        }
+        if (pendingCount == pending.size()) {
+            pendingHead = (pendingHead + 1) % pending.size(); // overwrite the oldest
+            --pendingCount;
+            ++stats.bufferDropped;
+        }
+        DepthMessage &slot = pending[(pendingHead + pendingCount) % pending.size()];
+        slot.isSnapshot = false;
+        slot.isCheckpoint = false;
+        slot.eventTime = message.eventTime;
+        slot.firstUpdateId = message.firstUpdateId;
+        slot.finalUpdateId = message.finalUpdateId;
+        std::memcpy(slot.symbol, message.symbol, sizeof(slot.symbol));
+        slot.bids.assign(message.bids.begin(), message.bids.end()); // reuses the slot's capacity
+        slot.asks.assign(message.asks.begin(), message.asks.end());
+        ++pendingCount;
+        ++stats.buffered;
+    }
+
+    // Applies one update to an in-sync book. On a gap the caller decides whether to buffer it.
+    L2ApplyResult applyUpdate(const DepthMessage& message) {
+        if (message.finalUpdateId <= lastUpdateId) {
+            ++stats.stale;
+            return L2_STALE;
+        }
+        if (message.firstUpdateId > lastUpdateId + 1) {
+            ++stats.gaps;
+            state = L2_WAITING_FOR_SNAPSHOT;
+            return L2_GAP;
+        }
+        applyLevels(message);
+        lastUpdateId = message.finalUpdateId;
+        ++stats.applied;
+        return L2_APPLIED;
+    }
+
+    // Replaces the book with a snapshot, re-centring the ladders only when needed
+    void loadSnapshot(const DepthMessage& message) {
+        Amount tick = configuredTick;
+        if (tick == 0) {
+            learnedTick = levelStep(message.asks, levelStep(message.bids, learnedTick));
+            if (!message.bids.empty() && !message.asks.empty() && message.asks.front().price > message.bids.front().price) {
+                learnedTick = gcd(learnedTick, message.asks.front().price - message.bids.front().price);
+            }
+            tick = learnedTick;
+        }
+
+        Amount centre = 0;
+        if (!message.bids.empty() && !message.asks.empty()) {
+            centre = (message.bids.front().price + message.asks.front().price) / 2;
+        } else if (!message.bids.empty() || !message.asks.empty()) {
+            centre = message.bids.empty() ? message.asks.front().price : message.bids.front().price;
+        }
+
+        bool onGrid = bids.anchored() && tick % bids.tick() == 0;
+        Amount quarter = (bids.bandHigh() - bids.bandLow()) / 4;
+        bool centred = onGrid && centre >= bids.bandLow() + quarter && centre < bids.bandHigh() - quarter;
+        if (tick > 0 && !centred) {
+            bids.anchor(tick, centre);
+            asks.anchor(tick, centre);
+        } else {
+            bids.clear();
+            asks.clear();
+        }
+        if (listener != nullptr) {
+            listener->onCleared();
+        }
+
+        applyLevels(message);
+        lastUpdateId = message.finalUpdateId;
+        state = L2_IN_SYNC;
+        ++stats.snapshots;
+    }
+
+    public:
+    /**
+     * @param bandLevels Ticks each side's ladder spans, centred on the snapshot's mid price
+     * @param bufferedUpdates How many updates to hold while waiting for a snapshot
+     * @param tickSize Price step of the instrument in atoms (Binance's PRICE_FILTER tickSize),
+     *        0 to learn it from the snapshots
+     */
+    L2Book(size_t bandLevels = 1 << 15, size_t bufferedUpdates = 64, Amount tickSize = 0)
+        : state(L2_WAITING_FOR_SNAPSHOT), lastUpdateId(0), listener(nullptr), pending(bufferedUpdates), pendingHead(0), pendingCount(0),
+          configuredTick(tickSize), learnedTick(0) {
+        bids.init(true, bandLevels);
+        asks.init(false, bandLevels);
+        std::memset(&stats, 0, sizeof(stats));
+    }
+
+    /**
+     * @brief Applies a snapshot or a depthUpdate following the synchronization rules above
+     *
+     * @param message A parsed depth message
+     *
+     * @return L2ApplyResult What happened to the message
+     */
+    L2ApplyResult apply(const DepthMessage& message) {
+        if (message.isSnapshot) {
+            loadSnapshot(message);
+            // replay what arrived before the snapshot, dropping what it already covers
+            while (pendingCount > 0) {
+                if (applyUpdate(pending[pendingHead]) == L2_GAP) {
+                    break; // keep it buffered, it may bridge the next snapshot
+                }
+                pendingHead = (pendingHead + 1) % pending.size();
+                --pendingCount;
+            }
+            return L2_SNAPSHOT_LOADED;
+        }
+        if (state == L2_WAITING_FOR_SNAPSHOT) {
+            buffer(message);
+            return L2_BUFFERED;
+        }
+        L2ApplyResult result = applyUpdate(message);
+        if (result == L2_GAP) {
+            buffer(message); // may bridge the next snapshot
+        }
+        return result;
+    }
+
+    // Forgets everything, as if newly constructed, without reallocating the ladders
+    void reset() {
+        bids.clear();
+        asks.clear();
+        state = L2_WAITING_FOR_SNAPSHOT;
+        lastUpdateId = 0;
+        pendingHead = 0;
+        pendingCount = 0;
+        learnedTick = 0;
+        std::memset(&stats, 0, sizeof(stats));
+        if (listener != nullptr) {
+            listener->onCleared();
+        }
+    }
+
+    // Price step of the instrument in atoms, 0 to learn it; the ladder adopts it at the next snapshot
+    void setTickSize(Amount tickSize) { configuredTick = tickSize; }
+
+    void setListener(L2BookListener* newListener) { listener = newListener; } // null to detach
+    bool inSync() const { return state == L2_IN_SYNC; }
+    size_t bufferedCount() const { return pendingCount; } // updates held for the next snapshot
+    L2SyncState getState() const { return state; }
+    const L2SyncStats& getStats() const { return stats; }
+    const L2Side& getBids() const { return bids; }
+    const L2Side& getAsks() const { return asks; }
+    unsigned long long getLastUpdateId() const { return lastUpdateId; }
+
+    // Checksum of every level of both sides, best price first
+    unsigned long long checksum() const {
+        return asks.checksum(mixChecksum(bids.checksum(CHECKSUM_SEED), lastUpdateId));
+    }
+};
+
+// L2 books of many symbols, found by the symbol carried in each depthUpdate.
+// Lookups are a short linear scan that starts at the last symbol seen, since archives
+// usually hold long runs of the same symbol.
+class L2BookSet {
+    private:
+    struct Entry {
+        char symbol[16];
+        std::unique_ptr<L2Book> book;
+    };
+    std::vector<Entry> books;
+    size_t lastIndex;
+    size_t bandLevels;
+    Amount tickSize; // of every book created, 0 for each to learn its own
+
+    public:
+    L2BookSet(size_t levelsPerSide = 1 << 15, Amount bookTickSize = 0) : lastIndex(0), bandLevels(levelsPerSide), tickSize(bookTickSize) {};
+
+    // Book of a symbol, created on first use
+    L2Book& bookFor(const char* symbol) {
+        if (lastIndex < books.size() && std::strcmp(books[lastIndex].symbol, symbol) == 0) {
+            return *books[lastIndex].book;
+        }
+        for (size_t i = 0; i < books.size(); ++i) {
+            if (std::strcmp(books[i].symbol, symbol) == 0) {
+                lastIndex = i;
+                return *books[i].book;
+            }
+        }
+        Entry entry;
+        std::strncpy(entry.symbol, symbol, sizeof(entry.symbol) - 1);
+        entry.symbol[sizeof(entry.symbol) - 1] = '\0';
+        entry.book.reset(new L2Book(bandLevels, 64, tickSize));
+        books.push_back(std::move(entry));
+        lastIndex = books.size() - 1;
+        return *books.back().book;
+    }
+
+    size_t size() const { return books.size(); }
+    const char* symbolAt(size_t i) const { return books[i].symbol; }
+    const L2Book& bookAt(size_t i) const { return *books[i].book; }
+};
+
+#endif // L2BOOK_HPP
@@ -0,0 +1,78 @@
+#include "l2Book.hpp"
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+// Behaviour checks of the L2 book's ladder tick. Each check that fails prints its line and
+// expression; the run fails if any did.
+
+int failures = 0;
+
+#define CHECK(condition)                                                                \
+    do {                                                                                \
+        if (!(condition)) {                                                             \
+            cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << endl; \
+            ++failures;                                                                 \
+        }                                                                               \
+    } while (0)
+
+const Amount MILLI = ATOMS_PER_UNIT / 1000; // 0.001, UNIUSDT's tick
+
+// A snapshot (or an update following updateId - 1) with one unit at each price, in thousandths
+DepthMessage depthMessage(bool snapshot, unsigned long long updateId, const vector<Amount>& bidMillis, const vector<Amount>& askMillis) {
+    DepthMessage message;
+    message.isSnapshot = snapshot;
+    message.firstUpdateId = updateId;
+    message.finalUpdateId = updateId;
+    for (Amount price : bidMillis) {
+        message.bids.push_back(L2Level{price * MILLI, ATOMS_PER_UNIT});
+    }
+    for (Amount price : askMillis) {
+        message.asks.push_back(L2Level{price * MILLI, ATOMS_PER_UNIT});
+    }
+    return message;
+}
+
+// A sparse snapshot does not fix the tick: a later, denser one refines it
+void testLearnedTick() {
+    L2Book book;
+    book.apply(depthMessage(true, 100, {5300, 5290}, {5310, 5320}));
+    CHECK(book.getBids().tick() == 10 * MILLI);
+    book.apply(depthMessage(false, 101, {5305}, {}));
+    CHECK(book.getBids().overflowSize() == 1 && book.getBids().best().price == 5305 * MILLI);
+
+    book.apply(depthMessage(true, 200, {5305, 5300, 5299}, {5310}));
+    CHECK(book.getBids().tick() == MILLI && book.getAsks().tick() == MILLI);
+    CHECK(book.getBids().overflowSize() == 0 && book.getBids().size() == 3);
+
+    // A coarser snapshot afterwards keeps the finer tick
+    book.apply(depthMessage(true, 300, {5300, 5200}, {5400}));
+    CHECK(book.getBids().tick() == MILLI);
+}
+
+// The instrument's tick, when given, is used from the first snapshot on
+void testConfiguredTick() {
+    L2Book book(1 << 15, 64, MILLI);
+    book.apply(depthMessage(true, 100, {5300, 5290}, {5310, 5320}));
+    CHECK(book.getBids().tick() == MILLI);
+    book.apply(depthMessage(false, 101, {5305}, {5307}));
+    CHECK(book.getBids().overflowSize() == 0 && book.getAsks().overflowSize() == 0);
+    CHECK(book.getBids().best().price == 5305 * MILLI && book.getAsks().best().price == 5307 * MILLI);
+}
+
+/**
+ * @brief Runs every check of the L2 book
+ *
+ * @return int 0 if all checks passed, 1 otherwise
+ */
+int main() {
+    testLearnedTick();
+    testConfiguredTick();
+    if (failures > 0) {
+        cerr << failures << " checks failed" << endl;
+        return 1;
+    }
+    cout << "All checks passed" << endl;
+    return 0;
+}
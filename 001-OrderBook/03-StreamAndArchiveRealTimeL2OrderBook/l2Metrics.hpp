@@ -0,0 +1,304 @@
+#ifndef L2METRICS_HPP
+#define L2METRICS_HPP
+
+#include <cmath>
+#include <limits>
+#include "l2Book.hpp"
+
+// Sum of quantity x price over levels, in atoms squared; needs more than 64 bits
+typedef __int128 WideAmount;
+
+/**
+ * @brief Running quantity and notional of the best K levels of one side of an L2Book
+ *
+ * @details Keeps the price of the K-th best level (the edge) so that a level change is
+ *          handled without walking the book: a change inside the edge adjusts the sums, a
+ *          new level inside it pushes the edge level out (one step towards the top), and a
+ *          level leaving it pulls in the next level beyond the edge (one step away from the
+ *          top). Each step is a bitmap search of the side's ladder.
+ */
+class TopLevelTracker {
+    private:
+    const L2Side* side;
+    bool isBid;
+    size_t depth; // K
+    size_t count; // levels inside the edge, at most K
+    Amount edge; // price of the worst level counted, meaningless when count == 0
+    Amount quantity; // their total quantity, in atoms
+    WideAmount notional; // their total price x quantity
+
+    bool worse(Amount a, Amount b) const { return isBid ? a < b : a > b; }
+    bool nextWorse(Amount price, L2Level& level) const { return isBid ? side->below(price, level) : side->above(price, level); }
+    bool nextBetter(Amount price, L2Level& level) const { return isBid ? side->above(price, level) : side->below(price, level); }
+
+    void add(Amount price, Amount delta) {
+        quantity += delta;
+        notional += (WideAmount)price * delta;
+    }
+
+    public:
+    TopLevelTracker() : side(nullptr), isBid(true), depth(1), count(0), edge(0), quantity(0), notional(0) {};
+
+    void init(const L2Side& levels, bool bidSide, size_t topLevels) {
+        side = &levels;
+        isBid = bidSide;
+        depth = topLevels > 0 ? topLevels : 1;
+        clear();
+    }
+
+    void clear() {
+        count = 0;
+        edge = 0;
+        quantity = 0;
+        notional = 0;
+    }
+
+    // Call after the side changed a level from previous to current quantity
+    void onLevel(Amount price, Amount previous, Amount current) {
+        bool inside = count > 0 && !worse(price, edge);
+        if (previous != 0 && current != 0) {
+            if (inside) {
+                add(price, current - previous);
+            }
+            return;
+        }
+        L2Level level = {0, 0};
+        if (previous == 0) { // a new level
+            if (count < depth) {
+                add(price, current);
+                if (count == 0 || worse(price, edge)) {
+                    edge = price;
+                }
+                ++count;
+            } else if (!worse(price, edge)) {
+                add(price, current);
+                add(edge, -side->quantityAt(edge));
+                nextBetter(edge, level); // exists: the new level itself is better than the edge
+                edge = level.price;
+            }
+            return;
+        }
+        if (!inside) { // a level beyond the edge went away
+            return;
+        }
+        add(price, -previous);
+        if (nextWorse(edge, level)) { // the first level beyond the edge moves in
+            add(level.price, level.quantity);
+            edge = level.price;
+        } else if (--count == 0) {
+            edge = 0;
+        } else if (price == edge) {
+            nextBetter(edge, level);
+            edge = level.price;
+        }
+    }
+
+    size_t levels() const { return count; }
+    Amount totalQuantity() const { return quantity; }
+    WideAmount totalNotional() const { return notional; }
+    double averagePrice() const { return quantity > 0 ? (double)notional / (double)quantity : 0; } // atoms
+};
+
+// What the metrics engine samples and when
+struct L2MetricsConfig {
+    size_t topLevels; // K of the top-K imbalance and book pressure
+    unsigned long long intervalMillis; // sample on this event time grid, 0 for none
+    unsigned long long intervalUpdates; // also sample after every this many messages, 0 for none
+    Amount referenceQuantity; // size of the size-weighted spread, in atoms of the base asset; 0 for none
+
+    L2MetricsConfig() {
+        topLevels = 10;
+        intervalMillis = 1000;
+        intervalUpdates = 0;
+        referenceQuantity = 0;
+    }
+};
+
+// One row of the metrics time series. Prices are in units of the quote asset; a metric
+// that cannot be computed (an empty side, no trades) is NaN.
+struct L2MetricsSample {
+    unsigned long long time; // sample time, ms since the epoch
+    unsigned long long updateId; // last update ID applied to the book
+    Amount bidPrice, bidQuantity; // best bid in atoms, 0 when there are no bids
+    Amount askPrice, askQuantity; // best ask in atoms, 0 when there are no asks
+    double mid; // (bid + ask) / 2
+    double spread; // quoted spread, ask - bid
+    double spreadBps; // quoted spread in basis points of the mid
+    double microprice; // (bid x askQuantity + ask x bidQuantity) / (bidQuantity + askQuantity)
+    double imbalance; // (bid - ask) / (bid + ask) quantity of the top K levels, in [-1, 1]
+    double pressureBps; // depth-weighted mid of the top K levels minus the mid, basis points; > 0 leans to the ask
+    double effectiveSpreadBps; // quantity-weighted 2|trade price - mid| / mid of the trades since the last sample
+    double sizeSpreadBps; // (VWAP to buy - VWAP to sell) referenceQuantity, over the mid
+    unsigned long long trades; // trades seen since the last sample
+    unsigned long long messages; // messages applied since the last sample
+};
+
+/**
+ * @brief Streaming microstructure metrics of one L2Book: quoted and effective spread,
+ *        top-K imbalance, microprice and book pressure
+ *
+ * @details Attaches to the book as its listener, so every level change costs O(1) (a
+ *          bitmap step at most) and every metric can be read at any time without looking
+ *          at more than the top of the book. Only the size-weighted spread walks levels,
+ *          as many as referenceQuantity needs, and only when a sample is taken.
+ *
+ *          Sampling: before applying a message, drain nextDue() for every point of the
+ *          time grid the message's event time has passed; after applying it, call
+ *          applied(), which samples every intervalUpdates messages. Nothing is sampled
+ *          while the book is out of sync. Trades (from a separate trade stream) go to
+ *          onTrade() for the effective spread.
+ */
+class L2Metrics : public L2BookListener {
+    private:
+    L2Book& book;
+    L2MetricsConfig config;
+    TopLevelTracker topBids;
+    TopLevelTracker topAsks;
+    unsigned long long nextSampleTime; // next point of the time grid, 0 until the first event time
+    unsigned long long messages; // since the last sample
+    unsigned long long trades; // since the last sample
+    double tradeQuantity; // since the last sample
+    double tradeSpread; // sum of quantity x effective spread (bps) since the last sample
+
+    static double units(Amount atoms) { return (double)atoms / ATOMS_PER_UNIT; }
+    static double notANumber() { return std::numeric_limits<double>::quiet_NaN(); }
+
+    // VWAP in atoms to take referenceQuantity from one side, NaN if it is not that deep
+    double sweepPrice(const L2Side& side, bool isBid) const {
+        if (side.empty()) {
+            return notANumber();
+        }
+        L2Level level = side.best();
+        Amount remaining = config.referenceQuantity;
+        WideAmount cost = 0;
+        while (true) {
+            Amount take = level.quantity < remaining ? level.quantity : remaining;
+            cost += (WideAmount)level.price * take;
+            remaining -= take;
+            if (remaining == 0) {
+                return (double)cost / (double)config.referenceQuantity;
+            }
+            if (!(isBid ? side.below(level.price, level) : side.above(level.price, level))) {
+                return notANumber();
+            }
+        }
+    }
+
+    public:
+    L2Metrics(L2Book& l2Book, const L2MetricsConfig& metricsConfig = L2MetricsConfig())
+        : book(l2Book), config(metricsConfig), nextSampleTime(0), messages(0), trades(0), tradeQuantity(0), tradeSpread(0) {
+        topBids.init(book.getBids(), true, config.topLevels);
+        topAsks.init(book.getAsks(), false, config.topLevels);
+        book.setListener(this); // start before the snapshot, the trackers are filled from it
+    }
+    ~L2Metrics() { book.setListener(nullptr); }
+    L2Metrics(const L2Metrics&) = delete;
+    L2Metrics& operator=(const L2Metrics&) = delete;
+
+    void onLevel(bool isBid, Amount price, Amount previous, Amount quantity) {
+        (isBid ? topBids : topAsks).onLevel(price, previous, quantity);
+    }
+
+    void onCleared() {
+        topBids.clear();
+        topAsks.clear();
+    }
+
+    // A trade printed at price; its effective spread is measured against the current mid
+    void onTrade(Amount price, Amount quantity) {
+        if (book.getBids().empty() || book.getAsks().empty() || quantity <= 0) {
+            return;
+        }
+        double mid = (units(book.getBids().best().price) + units(book.getAsks().best().price)) / 2;
+        double qty = units(quantity);
+        tradeSpread += qty * 2 * std::fabs(units(price) - mid) / mid * 10000.0;
+        tradeQuantity += qty;
+        ++trades;
+    }
+
+    /**
+     * @brief Fills a sample of the current state, stamped with time, and starts a new
+     *        sampling interval for the per-interval figures (trades, messages)
+     */
+    void sample(unsigned long long time, L2MetricsSample& out) {
+        const L2Side &bids = book.getBids();
+        const L2Side &asks = book.getAsks();
+        out.time = time;
+        out.updateId = book.getLastUpdateId();
+        out.bidPrice = out.bidQuantity = out.askPrice = out.askQuantity = 0;
+        if (!bids.empty()) {
+            out.bidPrice = bids.best().price;
+            out.bidQuantity = bids.best().quantity;
+        }
+        if (!asks.empty()) {
+            out.askPrice = asks.best().price;
+            out.askQuantity = asks.best().quantity;
+        }
+        out.mid = out.spread = out.spreadBps = out.microprice = out.imbalance = out.pressureBps = out.sizeSpreadBps = notANumber();
+        if (!bids.empty() && !asks.empty()) {
+            double bid = units(out.bidPrice), ask = units(out.askPrice);
+            double bidQty = units(out.bidQuantity), askQty = units(out.askQuantity);
+            out.mid = (bid + ask) / 2;
+            out.spread = ask - bid;
+            out.spreadBps = out.spread / out.mid * 10000.0;
+            out.microprice = (bid * askQty + ask * bidQty) / (bidQty + askQty);
+            double bidDepth = units(topBids.totalQuantity()), askDepth = units(topAsks.totalQuantity());
+            out.imbalance = (bidDepth - askDepth) / (bidDepth + askDepth);
+            double weightedMid = (topBids.averagePrice() * askDepth + topAsks.averagePrice() * bidDepth) / (bidDepth + askDepth) / ATOMS_PER_UNIT;
+            out.pressureBps = (weightedMid - out.mid) / out.mid * 10000.0;
+            if (config.referenceQuantity > 0) {
+                out.sizeSpreadBps = (sweepPrice(asks, false) - sweepPrice(bids, true)) / ATOMS_PER_UNIT / out.mid * 10000.0;
+            }
+        }
+        out.effectiveSpreadBps = tradeQuantity > 0 ? tradeSpread / tradeQuantity : notANumber();
+        out.trades = trades;
+        out.messages = messages;
+        trades = 0;
+        tradeQuantity = 0;
+        tradeSpread = 0;
+        messages = 0;
+    }
+
+    /**
+     * @brief Call before applying a message with the given event time, until it returns
+     *        false: fills one sample for each point of the time grid the event time has
+     *        passed, taken from the book as it stood at that point
+     *
+     * @return bool true if out holds a sample
+     */
+    bool nextDue(unsigned long long eventTime, L2MetricsSample& out) {
+        if (config.intervalMillis == 0 || eventTime == 0) {
+            return false; // no time grid, or a snapshot (no event time)
+        }
+        if (nextSampleTime == 0 || !book.inSync()) {
+            nextSampleTime = (eventTime / config.intervalMillis + 1) * config.intervalMillis;
+            return false;
+        }
+        if (eventTime < nextSampleTime) {
+            return false;
+        }
+        sample(nextSampleTime, out);
+        nextSampleTime += config.intervalMillis;
+        return true;
+    }
+
+    /**
+     * @brief Call after applying a message; samples every intervalUpdates messages
+     *
+     * @return bool true if out holds a sample
+     */
+    bool applied(unsigned long long eventTime, L2MetricsSample& out) {
+        ++messages;
+        if (config.intervalUpdates == 0 || messages < config.intervalUpdates || !book.inSync()) {
+            return false;
+        }
+        sample(eventTime, out);
+        return true;
+    }
+
+    const TopLevelTracker& getTopBids() const { return topBids; }
+    const TopLevelTracker& getTopAsks() const { return topAsks; }
+    const L2MetricsConfig& getConfig() const { return config; }
+};
+
+#endif // L2METRICS_HPP
@@ -0,0 +1,310 @@
+#ifndef LEVELAGGREGATION_HPP
+#define LEVELAGGREGATION_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "depthStream.hpp"
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define LEVEL_AGGREGATION_AVX2 1
+#endif
+
+// Unsigned 32-bit division by a divisor fixed at runtime, as a multiply and shifts (the
+// branch-free round-up method), so it vectorizes where a divide instruction does not.
+// Exact for every 32-bit numerator; divisor 1 is handled by the caller.
+struct FastDivisor {
+    uint32_t divisor;
+    uint32_t magic;
+    uint32_t shift;
+
+    void init(uint32_t d) {
+        divisor = d;
+        uint32_t log2 = 31 - (uint32_t)__builtin_clz(d);
+        if ((d & (d - 1)) == 0) {
+            magic = 0; // power of two: ((n >> 1) >> (log2 - 1))
+            shift = log2 == 0 ? 0 : log2 - 1;
+            return;
+        }
+        uint64_t numerator = (uint64_t)1 << (32 + log2);
+        uint32_t proposed = (uint32_t)(numerator / d);
+        uint32_t remainder = (uint32_t)(numerator - (uint64_t)proposed * d);
+        proposed += proposed;
+        uint32_t twiceRemainder = remainder + remainder;
+        if (twiceRemainder >= d || twiceRemainder < remainder) {
+            proposed += 1;
+        }
+        magic = proposed + 1;
+        shift = log2;
+    }
+
+    uint32_t divide(uint32_t n) const {
+        uint32_t high = (uint32_t)(((uint64_t)n * magic) >> 32);
+        return (high + ((n - high) >> 1)) >> shift;
+    }
+};
+
+// One aggregation of a side: levels merged into buckets of width atoms, best bucket first
+struct LevelBuckets {
+    Amount width; // bucket width in atoms of the quote asset
+    std::vector<L2Level> levels; // bucket price (lower edge for bids, upper edge for asks) and total quantity
+};
+
+/**
+ * @brief Bins price levels into buckets of several widths (0.001, 0.01, 0.1, ...) in one
+ *        pass over a contiguous price / quantity array
+ *
+ * @details Works on blocks of levels small enough to stay in L1. Each block's prices are
+ *          turned into 32-bit tick offsets from an origin aligned to every width once; then,
+ *          for every width, the offsets are divided by the width in ticks with FastDivisor
+ *          (eight at a time with AVX2 when the CPU has it) and runs of equal bucket IDs are
+ *          summed. Bids are binned [lower, upper) and labelled by the lower edge, asks
+ *          (lower, upper] and labelled by the upper edge, as the dashboards do.
+ *
+ *          Levels must come best first (bids descending, asks ascending), which is how both
+ *          the L2 book and the matching engine hand them out; then every bucket is one run
+ *          and the output is best first too. Aggregating allocates only while the output
+ *          vectors grow.
+ */
+class LevelAggregator {
+    private:
+    static const size_t BLOCK = 1024; // levels per block: 8 KB of offsets plus IDs
+
+    Amount tick; // price step of the input, in atoms
+    double inverseTick; // 1 / tick, for a first guess at tick offsets
+    Amount alignment; // least common multiple of the widths, in atoms
+    std::vector<Amount> widths; // bucket widths in atoms
+    std::vector<FastDivisor> divisors; // bucket widths in ticks
+    std::vector<uint32_t> offsets; // tick offsets of the current block
+    std::vector<uint32_t> ids; // bucket IDs of the current block for one width
+    std::vector<uint32_t> starts; // where each bucket but the first starts, for one width
+    std::vector<Amount> cumulative; // cumulative[i] = quantity of levels 0..i-1 of the current block
+    bool vectorized; // AVX2 kernel available
+
+    static Amount gcd(Amount a, Amount b) {
+        while (b != 0) {
+            Amount t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+
+    static Amount floorDiv(Amount a, Amount b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+
+    // Fills starts with every i where ids[i] != ids[i - 1], returns how many
+    size_t boundariesScalar(size_t count) {
+        size_t found = 0;
+        for (size_t i = 1; i < count; ++i) {
+            starts[found] = (uint32_t)i; // written every time, kept only when the ID changes
+            found += ids[i] != ids[i - 1];
+        }
+        return found;
+    }
+
+    void divideScalar(const FastDivisor& by, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            ids[i] = by.divide(offsets[i]);
+        }
+    }
+
+#ifdef LEVEL_AGGREGATION_AVX2
+    __attribute__((target("avx2"))) void divideAvx2(const FastDivisor& by, size_t count) {
+        const __m256i magic = _mm256_set1_epi32((int)by.magic);
+        const __m128i shift = _mm_cvtsi32_si128((int)by.shift);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256i n = _mm256_loadu_si256((const __m256i*)&offsets[i]);
+            __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(n, magic), 32); // high halves of lanes 0, 2, 4, 6
+            __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(n, 32), magic); // lanes 1, 3, 5, 7 in the high halves
+            __m256i high = _mm256_blend_epi32(even, odd, 0xAA);
+            __m256i q = _mm256_srl_epi32(_mm256_add_epi32(high, _mm256_srli_epi32(_mm256_sub_epi32(n, high), 1)), shift);
+            _mm256_storeu_si256((__m256i*)&ids[i], q);
+        }
+        for (; i < count; ++i) {
+            ids[i] = by.divide(offsets[i]);
+        }
+    }
+
+    // Compares eight IDs with their predecessors at a time; only changes cost more
+    __attribute__((target("avx2"))) size_t boundariesAvx2(size_t count) {
+        size_t found = 0;
+        size_t i = 1;
+        for (; i + 8 <= count; i += 8) {
+            __m256i current = _mm256_loadu_si256((const __m256i*)&ids[i]);
+            __m256i previous = _mm256_loadu_si256((const __m256i*)&ids[i - 1]);
+            unsigned int changed = ~(unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(current, previous))) & 0xFF;
+            while (changed != 0) {
+                starts[found++] = (uint32_t)(i + __builtin_ctz(changed));
+                changed &= changed - 1;
+            }
+        }
+        for (; i < count; ++i) {
+            starts[found] = (uint32_t)i;
+            found += ids[i] != ids[i - 1];
+        }
+        return found;
+    }
+#endif
+
+    size_t boundaries(size_t count) {
+#ifdef LEVEL_AGGREGATION_AVX2
+        if (vectorized) {
+            return boundariesAvx2(count);
+        }
+#endif
+        return boundariesScalar(count);
+    }
+
+    void divide(const FastDivisor& by, size_t count) {
+        if (by.divisor == 1) {
+            std::copy(offsets.begin(), offsets.begin() + count, ids.begin());
+            return;
+        }
+#ifdef LEVEL_AGGREGATION_AVX2
+        if (vectorized) {
+            divideAvx2(by, count);
+            return;
+        }
+#endif
+        divideScalar(by, count);
+    }
+
+    // Adds quantity to the open bucket of one output, starting a new bucket when the price changes
+    static void accumulate(LevelBuckets& out, Amount price, Amount quantity) {
+        if (!out.levels.empty() && out.levels.back().price == price) {
+            out.levels.back().quantity += quantity;
+        } else {
+            L2Level level = {price, quantity};
+            out.levels.push_back(level);
+        }
+    }
+
+    public:
+    LevelAggregator() : tick(0), inverseTick(0), alignment(0), offsets(BLOCK), ids(BLOCK), starts(BLOCK), cumulative(BLOCK + 1), vectorized(false) {
+#ifdef LEVEL_AGGREGATION_AVX2
+        vectorized = __builtin_cpu_supports("avx2");
+#endif
+    };
+
+    /**
+     * @param priceTick Price step of the levels to aggregate, in atoms (or 1 for prices in ticks)
+     * @param bucketWidths Bucket widths in the same unit, each a multiple of priceTick
+     *
+     * @return bool false if a width is not a positive multiple of the tick, or is more than
+     *         2^32 ticks, or the widths have no common multiple below 2^62
+     */
+    bool init(Amount priceTick, const std::vector<Amount>& bucketWidths) {
+        if (priceTick <= 0 || bucketWidths.empty()) {
+            return false;
+        }
+        tick = priceTick;
+        inverseTick = 1.0 / (double)priceTick;
+        alignment = priceTick;
+        widths = bucketWidths;
+        divisors.assign(widths.size(), FastDivisor());
+        for (size_t w = 0; w < widths.size(); ++w) {
+            if (widths[w] <= 0 || widths[w] % tick != 0 || widths[w] / tick > 0xFFFFFFFFLL) {
+                return false;
+            }
+            divisors[w].init((uint32_t)(widths[w] / tick));
+            Amount factor = widths[w] / gcd(alignment, widths[w]);
+            if (alignment > ((Amount)1 << 62) / factor) {
+                return false;
+            }
+            alignment *= factor;
+        }
+        return true;
+    }
+
+    void setVectorized(bool enable) { // false forces the scalar kernel, e.g. to compare them
+#ifdef LEVEL_AGGREGATION_AVX2
+        vectorized = enable && __builtin_cpu_supports("avx2");
+#else
+        (void)enable;
+#endif
+    }
+    bool isVectorized() const { return vectorized; }
+    size_t widthCount() const { return widths.size(); }
+
+    /**
+     * @brief Aggregates one side of a book into every width
+     *
+     * @param prices Level prices, best first
+     * @param quantities Level quantities, same order
+     * @param count Number of levels
+     * @param isBid Bids bucket down to the lower edge, asks up to the upper edge
+     * @param out One LevelBuckets per width, in the order given to init(); resized and
+     *        refilled, reusing their capacity
+     */
+    void aggregate(const Amount* prices, const Amount* quantities, size_t count, bool isBid, std::vector<LevelBuckets>& out) {
+        out.resize(widths.size());
+        for (size_t w = 0; w < widths.size(); ++w) {
+            out[w].width = widths[w];
+            out[w].levels.clear();
+        }
+        for (size_t start = 0; start < count; start += BLOCK) {
+            size_t n = count - start < BLOCK ? count - start : BLOCK;
+            const Amount *blockPrices = prices + start;
+            const Amount *blockQuantities = quantities + start;
+            Amount low = isBid ? blockPrices[n - 1] : blockPrices[0];
+            Amount high = isBid ? blockPrices[0] : blockPrices[n - 1];
+            // Origin on an edge of every bucket width and below the block. For asks it is
+            // strictly below, and the offsets are stored minus one, since
+            // ceil(o / m) = floor((o - 1) / m) + 1 for o >= 1.
+            Amount origin = floorDiv(isBid ? low : low - 1, alignment) * alignment;
+            bool fits = (high - origin) / tick < 0xFFFFFFFFLL;
+            for (size_t w = 0; w < widths.size() && !fits; ++w) { // block spans too many ticks: 64-bit division
+                for (size_t i = 0; i < n; ++i) {
+                    Amount bucket = isBid ? floorDiv(blockPrices[i], widths[w]) : -floorDiv(-blockPrices[i], widths[w]);
+                    accumulate(out[w], bucket * widths[w], blockQuantities[i]);
+                }
+            }
+            if (!fits) {
+                continue;
+            }
+            cumulative[0] = 0;
+            for (size_t i = 0; i < n; ++i) {
+                cumulative[i + 1] = cumulative[i] + blockQuantities[i];
+                Amount relative = blockPrices[i] - origin;
+                Amount offset = (Amount)((double)relative * inverseTick); // off by at most one, fixed below
+                if (offset * tick > relative) {
+                    --offset;
+                } else if ((offset + 1) * tick <= relative) {
+                    ++offset;
+                }
+                if (!isBid && offset * tick != relative) {
+                    ++offset; // off the tick grid: asks round up
+                }
+                offsets[i] = (uint32_t)(isBid ? offset : offset - 1);
+            }
+            Amount edge = isBid ? 0 : 1; // bucket ID to the labelled edge
+            for (size_t w = 0; w < widths.size(); ++w) {
+                divide(divisors[w], n);
+                // Bucket totals are differences of the block's running quantity between
+                // consecutive boundaries, so the per-level work is one compare. The first
+                // bucket may continue the last bucket of the previous block.
+                size_t buckets = boundaries(n) + 1;
+                std::vector<L2Level> &levels = out[w].levels;
+                Amount width = widths[w];
+                size_t first = levels.size();
+                Amount carried = 0;
+                if (first > 0 && levels[first - 1].price == origin + ((Amount)ids[0] + edge) * width) {
+                    carried = levels[--first].quantity;
+                }
+                levels.resize(first + buckets);
+                L2Level *target = levels.data() + first;
+                size_t begin = 0;
+                for (size_t k = 0; k < buckets; ++k) {
+                    size_t end = k + 1 < buckets ? starts[k] : n;
+                    target[k].price = origin + ((Amount)ids[begin] + edge) * width;
+                    target[k].quantity = cumulative[end] - cumulative[begin];
+                    begin = end;
+                }
+                target[0].quantity += carried;
+            }
+        }
+    }
+};
+
+#endif // LEVELAGGREGATION_HPP
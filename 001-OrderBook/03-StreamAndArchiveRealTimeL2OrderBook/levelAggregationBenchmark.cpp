@@ -0,0 +1,214 @@
+#include "depthStream.hpp"
+#include "l2Archive.hpp"
+#include "l2Book.hpp"
+#include "levelAggregation.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// One side of a book as contiguous arrays, best level first
+struct SideArrays {
+    vector<Amount> prices;
+    vector<Amount> quantities;
+};
+
+void gatherSide(const L2Side& side, SideArrays& arrays) {
+    arrays.prices.clear();
+    arrays.quantities.clear();
+    side.forEachFromBest([&arrays](const L2Level& level) {
+        arrays.prices.push_back(level.price);
+        arrays.quantities.push_back(level.quantity);
+    });
+}
+
+// A side of `levels` levels every one to three ticks from a mid price, with random quantities
+void syntheticSide(bool isBid, size_t levels, Amount mid, Amount tick, mt19937_64& random, SideArrays& arrays) {
+    Amount price = isBid ? mid - tick : mid + tick;
+    for (size_t i = 0; i < levels; ++i) {
+        arrays.prices.push_back(price);
+        arrays.quantities.push_back(1 + (Amount)(random() % 100000) * 1000000);
+        Amount step = (1 + (Amount)(random() % 3)) * tick;
+        price = isBid ? price - step : price + step;
+    }
+}
+
+// The plain way: every level divided by every width with 64-bit division, one pass per width
+void aggregateReference(const SideArrays& side, bool isBid, const vector<Amount>& widths, vector<LevelBuckets>& out) {
+    out.resize(widths.size());
+    for (size_t w = 0; w < widths.size(); ++w) {
+        out[w].width = widths[w];
+        out[w].levels.clear();
+        for (size_t i = 0; i < side.prices.size(); ++i) {
+            Amount bucket = side.prices[i] / widths[w];
+            if (!isBid && bucket * widths[w] != side.prices[i]) {
+                ++bucket;
+            }
+            Amount price = bucket * widths[w];
+            if (!out[w].levels.empty() && out[w].levels.back().price == price) {
+                out[w].levels.back().quantity += side.quantities[i];
+            } else {
+                L2Level level = {price, side.quantities[i]};
+                out[w].levels.push_back(level);
+            }
+        }
+    }
+}
+
+bool sameBuckets(const vector<LevelBuckets>& a, const vector<LevelBuckets>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t w = 0; w < a.size(); ++w) {
+        if (a[w].levels.size() != b[w].levels.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a[w].levels.size(); ++i) {
+            if (a[w].levels[i].price != b[w].levels[i].price || a[w].levels[i].quantity != b[w].levels[i].quantity) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Runs fn rounds times, returns ns per round
+template <class Function>
+double timeRounds(int rounds, Function fn) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        fn();
+    }
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / rounds;
+}
+
+/**
+ * @brief Measures LevelAggregator on both sides of a book against one 64-bit division pass
+ *        per width, and checks that all of them agree
+ *
+ * @details The book is either replayed from archived depth files (as with depthReplay) or
+ *          made up with --synthetic N levels per side.
+ *
+ *          Usage: levelAggregationBenchmark [--widths 0.001,0.01,0.1,1] [--rounds 2000]
+ *                 [--synthetic 100000] [--tick 0.001] [files...]
+ *          --tick is the price step of a synthetic book; replayed books use the step of
+ *          their snapshot.
+ *
+ * @return int 0, 1 on a bad argument, an unreadable file or a mismatch
+ */
+int main(int argc, char* argv[]) {
+    vector<string> paths;
+    vector<Amount> widths;
+    string widthText = "0.001,0.01,0.1,1";
+    int rounds = 2000;
+    size_t synthetic = 0;
+    Amount tick = ATOMS_PER_UNIT / 1000;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--widths" && i + 1 < argc) {
+            widthText = argv[++i];
+        } else if (arg == "--rounds" && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        } else if (arg == "--synthetic" && i + 1 < argc) {
+            synthetic = (size_t)strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--tick" && i + 1 < argc) {
+            if (!parseAtoms(string(argv[++i]), tick) || tick <= 0) {
+                cerr << "Bad --tick" << endl;
+                return 1;
+            }
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    stringstream list(widthText);
+    string item;
+    while (getline(list, item, ',')) {
+        Amount width;
+        if (!parseAtoms(item, width)) {
+            cerr << "Bad width " << item << endl;
+            return 1;
+        }
+        widths.push_back(width);
+    }
+    if (rounds < 1 || (paths.empty() && synthetic == 0)) {
+        cerr << "Usage: levelAggregationBenchmark [--widths 0.001,0.01,0.1,1] [--rounds N] [--synthetic LEVELS] [--tick T] [files...]" << endl;
+        return 1;
+    }
+
+    SideArrays sides[2]; // bids, asks
+    if (synthetic > 0) {
+        mt19937_64 random(42);
+        Amount mid = 1000 * ATOMS_PER_UNIT + (Amount)synthetic * 3 * tick; // every bid stays positive
+        syntheticSide(true, synthetic, mid, tick, random, sides[0]);
+        syntheticSide(false, synthetic, mid, tick, random, sides[1]);
+    } else {
+        L2Book book(1 << 20);
+        DepthFileReader reader;
+        L2ArchiveReader archive;
+        DepthMessage message;
+        for (const string &path : paths) {
+            bool columnar = isL2Archive(path);
+            bool ok = columnar ? archive.open(path) : reader.open(path);
+            while (ok && (columnar ? archive.next(message) : reader.next(message))) {
+                book.apply(message);
+            }
+            if (!ok || (columnar ? archive.failed() : reader.failed())) {
+                cerr << path << ": " << (columnar ? archive.error() : reader.error()) << endl;
+                return 1;
+            }
+            archive.close();
+        }
+        gatherSide(book.getBids(), sides[0]);
+        gatherSide(book.getAsks(), sides[1]);
+        tick = book.getBids().tick() > 0 ? book.getBids().tick() : 1;
+    }
+
+    LevelAggregator aggregator;
+    if (!aggregator.init(tick, widths)) {
+        cerr << "Every width must be a multiple of the price step " << formatAtoms(tick) << endl;
+        return 1;
+    }
+    bool simd = aggregator.isVectorized();
+    cout << sides[0].prices.size() << " bid and " << sides[1].prices.size() << " ask levels, tick " << formatAtoms(tick) << ", "
+         << widths.size() << " widths, AVX2 " << (simd ? "on" : "not available") << endl;
+
+    bool ok = true;
+    vector<LevelBuckets> out, reference;
+    for (int s = 0; s < 2; ++s) {
+        bool isBid = s == 0;
+        const SideArrays &side = sides[s];
+        if (side.prices.empty()) {
+            continue;
+        }
+        aggregateReference(side, isBid, widths, reference);
+        aggregator.setVectorized(true);
+        aggregator.aggregate(side.prices.data(), side.quantities.data(), side.prices.size(), isBid, out);
+        bool same = sameBuckets(out, reference);
+        aggregator.setVectorized(false);
+        aggregator.aggregate(side.prices.data(), side.quantities.data(), side.prices.size(), isBid, out);
+        same = same && sameBuckets(out, reference);
+        ok = ok && same;
+
+        double referenceNanos = timeRounds(rounds, [&]() { aggregateReference(side, isBid, widths, reference); });
+        double scalarNanos = timeRounds(rounds, [&]() { aggregator.aggregate(side.prices.data(), side.quantities.data(), side.prices.size(), isBid, out); });
+        aggregator.setVectorized(true);
+        double simdNanos = timeRounds(rounds, [&]() { aggregator.aggregate(side.prices.data(), side.quantities.data(), side.prices.size(), isBid, out); });
+
+        cout << (isBid ? "bids" : "asks") << ": buckets per width";
+        for (const LevelBuckets &buckets : out) {
+            cout << " " << formatAtoms(buckets.width) << "=" << buckets.levels.size();
+        }
+        cout << (same ? "" : " (MISMATCH)") << endl;
+        cout << fixed << setprecision(1) << setw(12) << "64-bit div" << setw(12) << "scalar" << setw(12) << "simd" << "   ns per level, all widths" << endl;
+        size_t levels = side.prices.size();
+        cout << setw(12) << referenceNanos / levels << setw(12) << scalarNanos / levels << setw(12) << (simd ? simdNanos / levels : 0) << endl;
+        cout << defaultfloat;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,461 @@
+#ifndef BARBUILDER_HPP
+#define BARBUILDER_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "fixedPoint.hpp"
+
+// What closes a bar
+enum BarType {
+    BAR_TIME = 1, // a fixed interval of trade time, aligned to the epoch (size in ms)
+    BAR_TICK,     // a number of trades (size in trades)
+    BAR_VOLUME,   // a quantity traded (size in atoms of the base asset)
+    BAR_DOLLAR    // a notional traded (size in atoms of the quote asset)
+};
+
+// One resolution a BarBuilder aggregates at, e.g. {BAR_TIME, 60000} for one-minute bars
+struct BarSpec {
+    BarType type;
+    unsigned long long size;
+};
+
+// One finished OHLCV bar. Plain data, written to bar files as is.
+struct Bar {
+    unsigned long long openTime; // ms since the epoch: interval start (time bars) or first trade
+    unsigned long long closeTime; // interval end - 1 ms, like Binance klines (time bars) or last trade
+    Amount open, high, low, close; // atoms of the quote asset
+    Amount volume; // atoms of the base asset traded
+    Amount notional; // atoms of the quote asset traded
+    unsigned long long trades;
+    unsigned long long size; // BarSpec::size of the bar's resolution
+    unsigned char type; // BarType
+    unsigned char reserved[7];
+};
+
+static_assert(std::is_trivially_copyable<Bar>::value, "Bar is written to files as is");
+static_assert(sizeof(Bar) == 88, "Bar layout is part of the bar file format");
+
+// Receives bars as they close
+class BarListener {
+    public:
+    virtual ~BarListener() {};
+    virtual void onBar(const Bar& bar) = 0;
+};
+
+/**
+ * @brief Parses a bar resolution such as "1s", "5m", "1h", "1d", "250ms" (time), "100t"
+ *        (trades), "10v" (base quantity) or "1000000n" (quote notional)
+ *
+ * @details Quantities and notionals are decimals in units of their asset, "0.5v" is half
+ *          a unit of the base asset.
+ *
+ * @return bool false on an unknown suffix, a malformed number or a zero size
+ */
+inline bool parseBarSpec(const std::string& text, BarSpec& spec) {
+    size_t digits = 0;
+    while (digits < text.size() && ((text[digits] >= '0' && text[digits] <= '9') || text[digits] == '.')) {
+        ++digits;
+    }
+    std::string number = text.substr(0, digits);
+    std::string unit = text.substr(digits);
+    if (unit == "v" || unit == "n") {
+        Amount atoms;
+        if (!parseAtoms(number, atoms) || atoms <= 0) {
+            return false;
+        }
+        spec.type = unit == "v" ? BAR_VOLUME : BAR_DOLLAR;
+        spec.size = (unsigned long long)atoms;
+        return true;
+    }
+    if (number.empty() || number.find('.') != std::string::npos) {
+        return false;
+    }
+    unsigned long long count = std::strtoull(number.c_str(), nullptr, 10);
+    unsigned long long scale = 0;
+    if (unit == "t") {
+        spec.type = BAR_TICK;
+        scale = 1;
+    } else {
+        spec.type = BAR_TIME;
+        scale = unit == "ms" ? 1 : unit == "s" ? 1000 : unit == "m" ? 60000 : unit == "h" ? 3600000 : unit == "d" ? 86400000 : 0;
+    }
+    spec.size = count * scale;
+    return spec.size > 0;
+}
+
+// Short name of a bar resolution, the inverse of parseBarSpec (e.g. "60000ms" prints as "1m")
+inline std::string barSpecText(BarType type, unsigned long long size) {
+    switch (type) {
+        case BAR_TIME:
+            if (size % 86400000 == 0) return std::to_string(size / 86400000) + "d";
+            if (size % 3600000 == 0) return std::to_string(size / 3600000) + "h";
+            if (size % 60000 == 0) return std::to_string(size / 60000) + "m";
+            if (size % 1000 == 0) return std::to_string(size / 1000) + "s";
+            return std::to_string(size) + "ms";
+        case BAR_TICK: return std::to_string(size) + "t";
+        case BAR_VOLUME: return formatAtoms((Amount)size, decimalsFor((Amount)size)) + "v";
+        case BAR_DOLLAR: return formatAtoms((Amount)size, decimalsFor((Amount)size)) + "n";
+    }
+    return "?";
+}
+
+/**
+ * @brief Builds bars of one resolution from a stream of trades, O(1) per trade
+ *
+ * @details Time bars close when the first trade of a later interval arrives, or when
+ *          advance() is told the interval is over; intervals without trades make no bar.
+ *          Tick, volume and dollar bars close on the trade that reaches their size; that
+ *          trade stays whole in the bar, so volume and dollar bars may overshoot their size
+ *          by at most one trade.
+ */
+class BarAggregator {
+    private:
+    BarSpec spec;
+    bool building; // a bar has at least one trade
+    Bar bar;
+
+    void start(unsigned long long time, Amount price) {
+        std::memset(&bar, 0, sizeof(bar));
+        bar.type = (unsigned char)spec.type;
+        bar.size = spec.size;
+        bar.openTime = spec.type == BAR_TIME ? time / spec.size * spec.size : time;
+        bar.closeTime = spec.type == BAR_TIME ? bar.openTime + spec.size - 1 : time;
+        bar.open = bar.high = bar.low = price;
+        building = true;
+    }
+
+    bool full() const {
+        switch (spec.type) {
+            case BAR_TICK: return bar.trades >= spec.size;
+            case BAR_VOLUME: return (unsigned long long)bar.volume >= spec.size;
+            case BAR_DOLLAR: return (unsigned long long)bar.notional >= spec.size;
+            default: return false;
+        }
+    }
+
+    public:
+    BarAggregator() : building(false) {
+        spec.type = BAR_TICK;
+        spec.size = 1;
+        std::memset(&bar, 0, sizeof(bar));
+    };
+
+    void init(const BarSpec& barSpec) {
+        spec = barSpec;
+        if (spec.size == 0) {
+            spec.size = 1;
+        }
+        building = false;
+    }
+
+    /**
+     * @brief Adds one trade
+     *
+     * @param time Trade time in ms, not before the previous trade's
+     * @param price Trade price in quote atoms
+     * @param quantity Base atoms traded
+     * @param notional Quote atoms traded
+     * @param out Receives the bar this trade finished, if any
+     *
+     * @return bool true if out holds a finished bar: for a time bar the one before this
+     *         trade's interval, otherwise the bar ending with this trade
+     */
+    bool add(unsigned long long time, Amount price, Amount quantity, Amount notional, Bar& out) {
+        bool closed = false;
+        if (building && spec.type == BAR_TIME && time > bar.closeTime) {
+            out = bar;
+            building = false;
+            closed = true;
+        }
+        if (!building) {
+            start(time, price);
+        }
+        bar.high = price > bar.high ? price : bar.high;
+        bar.low = price < bar.low ? price : bar.low;
+        bar.close = price;
+        bar.volume += quantity;
+        bar.notional += notional;
+        bar.trades += 1;
+        if (spec.type != BAR_TIME) {
+            bar.closeTime = time;
+            if (full()) {
+                out = bar;
+                building = false;
+                closed = true;
+            }
+        }
+        return closed;
+    }
+
+    // Closes a time bar whose interval ended before time, with no trade needed
+    bool advance(unsigned long long time, Bar& out) {
+        if (!building || spec.type != BAR_TIME || time <= bar.closeTime) {
+            return false;
+        }
+        out = bar;
+        building = false;
+        return true;
+    }
+
+    // Closes the bar being built, however far it got (end of a session or of a file)
+    bool flush(Bar& out) {
+        if (!building) {
+            return false;
+        }
+        out = bar;
+        building = false;
+        return true;
+    }
+
+    const BarSpec& getSpec() const { return spec; }
+    bool isBuilding() const { return building; }
+    const Bar& current() const { return bar; } // the bar being built, valid while isBuilding()
+};
+
+/**
+ * @brief Builds bars at several resolutions at once from one trade stream and hands every
+ *        finished bar to a listener
+ *
+ * @details Each trade costs one O(1) update per resolution; nothing is allocated after
+ *          construction. Trades come from engine fills (see FillBars) or from any other
+ *          feed, e.g. the trade stream of an exchange next to its L2 depth, through
+ *          onTrade() with prices and quantities in atoms.
+ */
+class BarBuilder {
+    private:
+    std::vector<BarAggregator> aggregators;
+    BarListener* listener;
+    unsigned long long trades;
+    unsigned long long bars;
+    Bar finished;
+
+    void emit() {
+        ++bars;
+        if (listener != nullptr) {
+            listener->onBar(finished);
+        }
+    }
+
+    public:
+    BarBuilder(const std::vector<BarSpec>& specs, BarListener* barListener = nullptr) : aggregators(specs.size()), listener(barListener), trades(0), bars(0) {
+        for (size_t i = 0; i < specs.size(); ++i) {
+            aggregators[i].init(specs[i]);
+        }
+        std::memset(&finished, 0, sizeof(finished));
+    }
+
+    void setListener(BarListener* barListener) { listener = barListener; }
+
+    // A trade with its notional known exactly, e.g. from InstrumentSpec::notional()
+    void onTrade(unsigned long long time, Amount price, Amount quantity, Amount notional) {
+        ++trades;
+        for (BarAggregator &aggregator : aggregators) {
+            if (aggregator.add(time, price, quantity, notional, finished)) {
+                emit();
+            }
+        }
+    }
+
+    // A trade of quantity base atoms at price quote atoms; the notional is rounded down to an atom
+    void onTrade(unsigned long long time, Amount price, Amount quantity) {
+        onTrade(time, price, quantity, (Amount)((__int128)price * quantity / ATOMS_PER_UNIT));
+    }
+
+    // Closes every time bar whose interval ended before time (call on a timer for live data)
+    void advance(unsigned long long time) {
+        for (BarAggregator &aggregator : aggregators) {
+            if (aggregator.advance(time, finished)) {
+                emit();
+            }
+        }
+    }
+
+    // Closes every bar being built
+    void flush() {
+        for (BarAggregator &aggregator : aggregators) {
+            if (aggregator.flush(finished)) {
+                emit();
+            }
+        }
+    }
+
+    size_t resolutions() const { return aggregators.size(); }
+    const BarAggregator& aggregator(size_t i) const { return aggregators[i]; }
+    unsigned long long tradeCount() const { return trades; }
+    unsigned long long barCount() const { return bars; }
+};
+
+// Bar files: a 32-byte header, then Bar records back to back, appended as bars close.
+//     8 bytes   BAR_FILE_MAGIC
+//     16 bytes  symbol, zero padded
+//     u32       sizeof(Bar), u32 reserved
+// Every record says its own resolution, so one file holds bars of several resolutions
+// interleaved in the order they closed, and later runs may append with other ones.
+const char BAR_FILE_MAGIC[8] = {'O', 'H', 'L', 'C', 'V', 'B', '1', '\0'};
+
+struct BarFileHeader {
+    char magic[8];
+    char symbol[16];
+    unsigned int recordSize;
+    unsigned int reserved;
+};
+
+static_assert(sizeof(BarFileHeader) == 32, "BarFileHeader layout is part of the bar file format");
+
+/**
+ * @brief Appends finished bars to a bar file
+ *
+ * @details Records go through a 64 KiB stdio buffer; call flush() to hand them to the OS
+ *          (e.g. once a second) and close() at the end. An existing file is appended to if
+ *          its header matches the symbol. A crash can at worst leave a torn last record,
+ *          which BarFileReader skips and the next writer overwrites.
+ */
+class BarFileWriter : public BarListener {
+    private:
+    std::FILE* file;
+    unsigned long long written;
+    bool failedWrite;
+    std::string errorText;
+
+    bool fail(const std::string& text) {
+        errorText = text;
+        failedWrite = true;
+        return false;
+    }
+
+    public:
+    BarFileWriter() : file(nullptr), written(0), failedWrite(false) {};
+    ~BarFileWriter() { close(); }
+    BarFileWriter(const BarFileWriter&) = delete;
+    BarFileWriter& operator=(const BarFileWriter&) = delete;
+
+    bool open(const std::string& path, const std::string& symbol) {
+        close();
+        failedWrite = false;
+        written = 0;
+        bool fresh = false;
+        file = std::fopen(path.c_str(), "r+b");
+        if (file == nullptr) {
+            file = std::fopen(path.c_str(), "w+b");
+            fresh = true;
+        }
+        if (file == nullptr) {
+            return fail("cannot open " + path);
+        }
+        std::setvbuf(file, nullptr, _IOFBF, 1 << 16);
+        BarFileHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, BAR_FILE_MAGIC, sizeof(header.magic));
+        std::strncpy(header.symbol, symbol.c_str(), sizeof(header.symbol) - 1);
+        header.recordSize = sizeof(Bar);
+
+        BarFileHeader existing;
+        size_t got = fresh ? 0 : std::fread(&existing, 1, sizeof(existing), file);
+        if (got == 0) {
+            std::fseek(file, 0, SEEK_SET);
+            if (std::fwrite(&header, sizeof(header), 1, file) != 1) {
+                return fail("cannot write the header of " + path);
+            }
+            return true;
+        }
+        if (got != sizeof(existing) || std::memcmp(&existing, &header, sizeof(header)) != 0) {
+            close();
+            return fail(path + " is not a bar file of " + symbol);
+        }
+        // Append after the last whole record, over a torn one left by a crash
+        std::fseek(file, 0, SEEK_END);
+        long records = (std::ftell(file) - (long)sizeof(header)) / (long)sizeof(Bar);
+        std::fseek(file, (long)sizeof(header) + records * (long)sizeof(Bar), SEEK_SET);
+        return true;
+    }
+
+    void onBar(const Bar& bar) {
+        if (file != nullptr && !failedWrite) {
+            if (std::fwrite(&bar, sizeof(bar), 1, file) == 1) {
+                ++written;
+            } else {
+                fail("write failed");
+            }
+        }
+    }
+
+    bool flush() { return file != nullptr && std::fflush(file) == 0; }
+
+    void close() {
+        if (file != nullptr) {
+            std::fclose(file);
+            file = nullptr;
+        }
+    }
+
+    unsigned long long barsWritten() const { return written; }
+    bool failed() const { return failedWrite; }
+    const std::string& error() const { return errorText; }
+};
+
+// Reads the bars of a bar file in the order they were written
+class BarFileReader {
+    private:
+    std::FILE* file;
+    BarFileHeader header;
+    bool torn; // the file ends in part of a record
+    bool failedRead;
+    std::string errorText;
+
+    bool fail(const std::string& text) {
+        errorText = text;
+        failedRead = true;
+        return false;
+    }
+
+    public:
+    BarFileReader() : file(nullptr), torn(false), failedRead(false) { std::memset(&header, 0, sizeof(header)); };
+    ~BarFileReader() { close(); }
+    BarFileReader(const BarFileReader&) = delete;
+    BarFileReader& operator=(const BarFileReader&) = delete;
+
+    bool open(const std::string& path) {
+        close();
+        torn = false;
+        failedRead = false;
+        file = std::fopen(path.c_str(), "rb");
+        if (file == nullptr) {
+            return fail("cannot open " + path);
+        }
+        if (std::fread(&header, sizeof(header), 1, file) != 1 || std::memcmp(header.magic, BAR_FILE_MAGIC, sizeof(header.magic)) != 0) {
+            return fail(path + " is not a bar file");
+        }
+        if (header.recordSize != sizeof(Bar)) {
+            return fail(path + " has records of " + std::to_string(header.recordSize) + " bytes, expected " + std::to_string(sizeof(Bar)));
+        }
+        return true;
+    }
+
+    // Reads the next bar, false at the end of the file (or of its last whole record)
+    bool next(Bar& bar) {
+        if (file == nullptr || failedRead) {
+            return false;
+        }
+        size_t got = std::fread(&bar, 1, sizeof(bar), file);
+        torn = torn || (got > 0 && got < sizeof(bar));
+        return got == sizeof(bar);
+    }
+
+    void close() {
+        if (file != nullptr) {
+            std::fclose(file);
+            file = nullptr;
+        }
+    }
+
+    std::string symbol() const { return std::string(header.symbol, strnlen(header.symbol, sizeof(header.symbol))); }
+    bool tornTail() const { return torn; }
+    bool failed() const { return failedRead; }
+    const std::string& error() const { return errorText; }
+};
+
+#endif // BARBUILDER_HPP
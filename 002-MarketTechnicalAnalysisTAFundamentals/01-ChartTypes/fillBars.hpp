@@ -0,0 +1,50 @@
+#ifndef FILLBARS_HPP
+#define FILLBARS_HPP
+
+#include <chrono>
+#include "barBuilder.hpp"
+#include "executionEvents.hpp"
+
+/**
+ * @brief Feeds the trades of an OrderBook into a BarBuilder, as the book's
+ *        ExecutionListener
+ *
+ * @details Every trade is reported twice by the engine (once per order); it is counted
+ *          once, on the bid's report, like ShardStats does. Prices and quantities are
+ *          converted from ticks and lots to atoms with the book's InstrumentSpec, and the
+ *          notional is the exact amount the ledger settled. Execution reports carry no
+ *          time, so trades are stamped with the wall clock when they arrive, or with the
+ *          time given to setTime() when replaying recorded flow.
+ */
+class FillBars : public ExecutionListener {
+    private:
+    BarBuilder& builder;
+    InstrumentSpec instrument;
+    unsigned long long clock; // ms since the epoch set by setTime()
+    bool manualClock; // use clock rather than the wall clock
+
+    unsigned long long now() const {
+        if (manualClock) {
+            return clock;
+        }
+        return (unsigned long long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    public:
+    FillBars(BarBuilder& barBuilder, const InstrumentSpec& spec) : builder(barBuilder), instrument(spec), clock(0), manualClock(false) {};
+
+    // Stamps the following trades with time (ms since the epoch) instead of the wall clock
+    void setTime(unsigned long long time) {
+        clock = time;
+        manualClock = true;
+    }
+
+    void onEvent(const ExecutionEvent& event) {
+        if ((event.type != EVENT_FILL && event.type != EVENT_PARTIAL_FILL) || !event.isBid) {
+            return;
+        }
+        builder.onTrade(now(), event.price * instrument.tickSize, instrument.baseAmount(event.quantity), instrument.notional(event.price, event.quantity));
+    }
+};
+
+#endif // FILLBARS_HPP
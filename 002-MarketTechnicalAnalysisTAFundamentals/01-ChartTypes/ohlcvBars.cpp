@@ -0,0 +1,276 @@
+#include "barBuilder.hpp"
+#include "fillBars.hpp"
+#include "orderBook.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+const unsigned long long START_TIME = 1762300800000ULL; // 2025-11-05 00:00:00 UTC, the day of the archived depth files
+
+// Totals of the bars of one resolution
+struct ResolutionTotals {
+    unsigned long long bars;
+    unsigned long long trades;
+    Amount volume;
+    Amount notional;
+};
+
+// Counts bars per resolution on their way to the file
+class BarTally : public BarListener {
+    public:
+    vector<BarSpec> specs;
+    vector<ResolutionTotals> totals;
+    BarListener* next;
+
+    BarTally(const vector<BarSpec>& barSpecs, BarListener* forward) : specs(barSpecs), totals(barSpecs.size()), next(forward) {
+        for (ResolutionTotals &total : totals) {
+            total = ResolutionTotals{0, 0, 0, 0};
+        }
+    }
+
+    // Resolution of a bar, or -1 if it is none of ours
+    int find(const Bar& bar) const {
+        for (size_t i = 0; i < specs.size(); ++i) {
+            if (specs[i].type == bar.type && specs[i].size == bar.size) {
+                return (int)i;
+            }
+        }
+        return -1;
+    }
+
+    void add(const Bar& bar) {
+        int i = find(bar);
+        if (i >= 0) {
+            totals[i].bars += 1;
+            totals[i].trades += bar.trades;
+            totals[i].volume += bar.volume;
+            totals[i].notional += bar.notional;
+        }
+    }
+
+    void onBar(const Bar& bar) {
+        add(bar);
+        if (next != nullptr) {
+            next->onBar(bar);
+        }
+    }
+};
+
+// A trade as FillBars passed it on, kept to time the builder on its own
+struct TapeTrade {
+    unsigned long long time;
+    Amount price, quantity, notional;
+};
+
+// Records the engine's trades on their way to FillBars
+class TradeTape : public ExecutionListener {
+    public:
+    vector<TapeTrade> trades;
+    FillBars& fills;
+    InstrumentSpec instrument;
+    unsigned long long time;
+
+    TradeTape(FillBars& fillBars, const InstrumentSpec& spec, size_t capacity) : fills(fillBars), instrument(spec), time(0) {
+        trades.reserve(capacity);
+    }
+
+    void setTime(unsigned long long ms) {
+        time = ms;
+        fills.setTime(ms);
+    }
+
+    void onEvent(const ExecutionEvent& event) {
+        if ((event.type == EVENT_FILL || event.type == EVENT_PARTIAL_FILL) && event.isBid) {
+            trades.push_back(TapeTrade{time, event.price * instrument.tickSize, instrument.baseAmount(event.quantity), instrument.notional(event.price, event.quantity)});
+        }
+        fills.onEvent(event);
+    }
+};
+
+/**
+ * @brief Prints the bars of a bar file as CSV, one row per bar in the order they closed
+ *
+ * @return int 0, 1 if the file cannot be read
+ */
+int dumpBars(const string& path) {
+    BarFileReader reader;
+    if (!reader.open(path)) {
+        cerr << reader.error() << endl;
+        return 1;
+    }
+    cout << "symbol,resolution,openTime,closeTime,open,high,low,close,volume,notional,trades" << endl;
+    Bar bar;
+    unsigned long long count = 0;
+    string symbol = reader.symbol();
+    while (reader.next(bar)) {
+        cout << symbol << "," << barSpecText((BarType)bar.type, bar.size) << "," << bar.openTime << "," << bar.closeTime << "," << formatAtoms(bar.open) << ","
+             << formatAtoms(bar.high) << "," << formatAtoms(bar.low) << "," << formatAtoms(bar.close) << "," << formatAtoms(bar.volume) << ","
+             << formatAtoms(bar.notional) << "," << bar.trades << "\n";
+        ++count;
+    }
+    cerr << count << " bars" << (reader.tornTail() ? ", torn last record skipped" : "") << endl;
+    return 0;
+}
+
+/**
+ * @brief Builds OHLCV bars at several resolutions from the trades of the matching engine
+ *        and appends them to a bar file, or prints a bar file as CSV
+ *
+ * @details The engine trades a random walk (a maker rests an order at the walk's price, a
+ *          taker crosses it) on a simulated clock of 0-250 ms per step, with FillBars as the
+ *          book's listener. Every finished bar goes to the bar file; at the end the open
+ *          bars are flushed, the file is read back and the bars of every resolution must
+ *          account for every trade and every lot exactly once. Finally the recorded trades
+ *          are fed to a fresh BarBuilder alone to show its cost per trade.
+ *
+ *          Usage: ohlcvBars [--bars 1s,1m,5m,100t,50v,500000n] [--trades 1000000]
+ *                           [--out bars.ohlcv] [--seed 42]
+ *                 ohlcvBars --dump bars.ohlcv
+ *          Resolutions: ms, s, m, h, d for time bars, t trades, v base quantity, n quote
+ *          notional (dollar bars), see parseBarSpec().
+ *
+ * @return int 0, 1 on a bad argument, an I/O error or bars that do not add up
+ */
+int main(int argc, char* argv[]) {
+    if (argc == 3 && string(argv[1]) == "--dump") {
+        return dumpBars(argv[2]);
+    }
+    string barsText = "1s,1m,5m,100t,50v,500000n";
+    string outPath = "bars.ohlcv";
+    size_t steps = 1000000;
+    unsigned long long seed = 42;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string arg = argv[i];
+        if (arg == "--bars") {
+            barsText = argv[i + 1];
+        } else if (arg == "--trades") {
+            steps = (size_t)strtoull(argv[i + 1], nullptr, 10);
+        } else if (arg == "--out") {
+            outPath = argv[i + 1];
+        } else if (arg == "--seed") {
+            seed = strtoull(argv[i + 1], nullptr, 10);
+        } else {
+            cerr << "Usage: ohlcvBars [--bars 1s,1m,100t,50v,500000n] [--trades N] [--out bars.ohlcv] [--seed N] | --dump bars.ohlcv" << endl;
+            return 1;
+        }
+    }
+    vector<BarSpec> specs;
+    stringstream list(barsText);
+    string item;
+    while (getline(list, item, ',')) {
+        BarSpec spec;
+        if (!parseBarSpec(item, spec)) {
+            cerr << "Bad bar resolution " << item << endl;
+            return 1;
+        }
+        specs.push_back(spec);
+    }
+    if (specs.empty()) {
+        cerr << "No bar resolutions" << endl;
+        return 1;
+    }
+
+    BookConfig bookConfig;
+    bookConfig.orderCapacity = steps + 1024;
+    OrderBook book(bookConfig);
+    AccountId maker = book.makeUser("BarMaker");
+    AccountId taker = book.makeUser("BarTaker");
+    for (AccountId account : {maker, taker}) {
+        book.addBalance(account, "USD", 1000000000LL * ATOMS_PER_UNIT);
+        book.addBalance(account, TICKER, 1000000000LL * ATOMS_PER_UNIT);
+    }
+
+    BarFileWriter writer;
+    if (!writer.open(outPath, book.getInstrument().symbol)) {
+        cerr << writer.error() << endl;
+        return 1;
+    }
+    BarTally tally(specs, &writer);
+    BarBuilder builder(specs, &tally);
+    FillBars fills(builder, book.getInstrument());
+    TradeTape tape(fills, book.getInstrument(), steps);
+    book.setListener(&tape);
+
+    mt19937_64 random(seed);
+    Price price = 11350;
+    unsigned long long time = START_TIME;
+    Amount volume = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (size_t i = 0; i < steps; ++i) {
+        time += random() % 251;
+        tape.setTime(time);
+        price += (Price)(random() % 5) - 2;
+        price = price < 1000 ? 1000 : (price > 90000 ? 90000 : price);
+        Quantity qty = 1 + (Quantity)(random() % 10);
+        if (random() & 1) {
+            book.addAsk(maker, price, qty);
+            book.addBid(taker, price, qty);
+        } else {
+            book.addBid(maker, price, qty);
+            book.addAsk(taker, price, qty);
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    book.setListener(nullptr);
+    builder.flush();
+    bool written = !writer.failed() && writer.flush();
+    writer.close();
+    if (!written) {
+        cerr << outPath << ": " << writer.error() << endl;
+        return 1;
+    }
+    for (const ResolutionTotals &total : tally.totals) {
+        volume = total.volume > volume ? total.volume : volume;
+    }
+
+    cout << builder.tradeCount() << " trades in " << steps << " steps, " << builder.barCount() << " bars at " << specs.size() << " resolutions, "
+         << fixed << setprecision(1) << seconds * 1e9 / (steps > 0 ? steps : 1) << " ns per step with bars" << defaultfloat << endl;
+
+    // Read back what this run appended (the file may hold bars of earlier runs before it)
+    BarFileReader reader;
+    if (!reader.open(outPath)) {
+        cerr << reader.error() << endl;
+        return 1;
+    }
+    vector<Bar> fileBars;
+    Bar bar;
+    while (reader.next(bar)) {
+        fileBars.push_back(bar);
+    }
+    BarTally fromFile(specs, nullptr);
+    for (size_t i = fileBars.size() - (size_t)writer.barsWritten(); i < fileBars.size(); ++i) {
+        fromFile.add(fileBars[i]);
+    }
+
+    bool ok = writer.barsWritten() == builder.barCount();
+    cout << left << setw(12) << "resolution" << right << setw(10) << "bars" << setw(12) << "trades" << setw(16) << "volume" << setw(20) << "notional" << endl;
+    for (size_t i = 0; i < specs.size(); ++i) {
+        const ResolutionTotals &live = tally.totals[i], &read = fromFile.totals[i];
+        bool same = live.bars == read.bars && live.trades == read.trades && live.volume == read.volume && live.notional == read.notional;
+        bool complete = live.trades == builder.tradeCount() && live.volume == volume;
+        ok = ok && same && complete;
+        cout << left << setw(12) << barSpecText(specs[i].type, specs[i].size) << right << setw(10) << live.bars << setw(12) << live.trades << setw(16)
+             << formatAtoms(live.volume, 0) << setw(20) << formatAtoms(live.notional, 2) << (same && complete ? "" : "  MISMATCH") << endl;
+    }
+    cout << writer.barsWritten() << " bars appended to " << outPath << " (" << fileBars.size() << " in the file)" << endl;
+
+    BarBuilder alone(specs, nullptr);
+    start = chrono::steady_clock::now();
+    for (const TapeTrade &trade : tape.trades) {
+        alone.onTrade(trade.time, trade.price, trade.quantity, trade.notional);
+    }
+    alone.flush();
+    seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    ok = ok && alone.barCount() == builder.barCount();
+    cout << fixed << setprecision(1) << seconds * 1e9 / (tape.trades.empty() ? 1 : tape.trades.size()) << " ns per trade in the BarBuilder alone ("
+         << specs.size() << " resolutions)" << defaultfloat << endl;
+    return ok ? 0 : 1;
+}
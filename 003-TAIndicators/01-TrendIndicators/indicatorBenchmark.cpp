@@ -0,0 +1,346 @@
+#include "orderBook.hpp"
+#include "tradeIndicators.hpp"
+#include "trendBatch.hpp"
+#include "trendIndicators.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Knobs of a benchmark run, all settable from the command line
+struct IndicatorBenchmarkConfig {
+    size_t symbols; // lanes of the per-symbol batch
+    size_t bars; // bars per symbol
+    vector<size_t> periods; // SMA / EMA periods of the parameter sweep
+    size_t trades; // trades to run through the matching engine
+    TrendConfig trend; // indicators kept on the engine's trades
+    unsigned long long seed;
+
+    IndicatorBenchmarkConfig() {
+        symbols = 256;
+        bars = 20000;
+        periods = {5, 10, 12, 20, 26, 50, 100, 128, 200};
+        trades = 200000;
+        trend.tradesPerBar = 10;
+        seed = 42;
+    }
+};
+
+// Random walk bars of one or many symbols
+struct SyntheticBars {
+    SeriesMatrix highs, lows, closes;
+
+    void generate(size_t bars, size_t lanes, mt19937_64& random) {
+        highs.resize(bars, lanes);
+        lows.resize(bars, lanes);
+        closes.resize(bars, lanes);
+        normal_distribution<double> step(0.0, 0.01);
+        uniform_real_distribution<double> range(0.0, 0.01);
+        for (size_t lane = 0; lane < lanes; ++lane) {
+            double close = 100.0 + (double)(random() % 100);
+            for (size_t t = 0; t < bars; ++t) {
+                close *= exp(step(random));
+                closes.at(t, lane) = close;
+                highs.at(t, lane) = close * (1.0 + range(random));
+                lows.at(t, lane) = close * (1.0 - range(random));
+            }
+        }
+    }
+};
+
+bool sameValue(double a, double b) { return a == b || (std::isnan(a) && std::isnan(b)); }
+
+// Number of cells of the first lanes of two matrices that differ
+size_t countMismatches(const SeriesMatrix& a, const SeriesMatrix& b) {
+    size_t mismatches = 0;
+    for (size_t t = 0; t < a.barCount(); ++t) {
+        for (size_t lane = 0; lane < a.laneCount(); ++lane) {
+            mismatches += !sameValue(a.at(t, lane), b.at(t, lane));
+        }
+    }
+    return mismatches;
+}
+
+double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Prints one timing line: ns per bar and lane of the streaming classes and both batch kernels
+void printTimes(const string& name, size_t cells, double streaming, double scalar, double simd, bool hasSimd, size_t mismatches) {
+    double nanos = 1e9 / (double)cells;
+    cout << left << setw(16) << name << right << fixed << setprecision(2) << setw(12) << streaming * nanos << setw(12) << scalar * nanos << setw(12)
+         << (hasSimd ? simd * nanos : 0) << setw(12) << mismatches << defaultfloat << endl;
+}
+
+/**
+ * @brief Runs one indicator in streaming form and in both batch kernels, and checks the
+ *        three agree bit for bit
+ *
+ * @param stream Fills the reference matrix from the streaming classes, one object per lane
+ *        updated bar by bar as live data would arrive
+ * @param batch Fills the output matrix with the batch API
+ *
+ * @return size_t Cells that differ from the streaming reference
+ */
+template <class Stream, class Batch>
+size_t compareModes(const string& name, TrendBatch& trendBatch, size_t bars, size_t lanes, Stream stream, Batch batch) {
+    SeriesMatrix reference(bars, lanes), out;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    stream(reference);
+    double streaming = secondsSince(start);
+
+    trendBatch.setVectorized(false);
+    start = chrono::steady_clock::now();
+    batch(out);
+    double scalar = secondsSince(start);
+    size_t mismatches = countMismatches(reference, out);
+
+    trendBatch.setVectorized(true);
+    bool hasSimd = trendBatch.isVectorized();
+    double simd = 0;
+    if (hasSimd) {
+        start = chrono::steady_clock::now();
+        batch(out);
+        simd = secondsSince(start);
+        mismatches += countMismatches(reference, out);
+    }
+    printTimes(name, bars * lanes, streaming, scalar, simd, hasSimd, mismatches);
+    return mismatches;
+}
+
+/**
+ * @brief Trades against a random walk through an OrderBook and keeps the trend indicators
+ *        on its trade prints
+ *
+ * @details Every step a maker rests an order at the walk's price and a taker crosses it,
+ *          so each step prints at least one trade. The same flow runs without and with
+ *          TradeIndicators as the book's listener, best of three runs each, to show what
+ *          the indicators cost per trade inside the matching loop.
+ */
+void runEngineFeed(const IndicatorBenchmarkConfig& config) {
+    double seconds[2] = {0, 0};
+    TradeIndicators indicators(config.trend);
+    for (int run = 0; run < 6; ++run) {
+        int withIndicators = run & 1;
+        indicators = TradeIndicators(config.trend);
+        BookConfig bookConfig;
+        bookConfig.orderCapacity = config.trades + 1024;
+        OrderBook book(bookConfig);
+        AccountId maker = book.makeUser("IndicatorMaker");
+        AccountId taker = book.makeUser("IndicatorTaker");
+        for (AccountId account : {maker, taker}) {
+            book.addBalance(account, "USD", 1000000000LL * ATOMS_PER_UNIT);
+            book.addBalance(account, TICKER, 1000000000LL * ATOMS_PER_UNIT);
+        }
+        if (withIndicators) {
+            book.setListener(&indicators);
+        }
+        mt19937_64 random(config.seed);
+        Price price = 11350;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (size_t i = 0; i < config.trades; ++i) {
+            price += (Price)(random() % 5) - 2;
+            price = price < 1000 ? 1000 : (price > 90000 ? 90000 : price);
+            Quantity qty = 1 + (Quantity)(random() % 10);
+            if (random() & 1) {
+                book.addAsk(maker, price, qty);
+                book.addBid(taker, price, qty);
+            } else {
+                book.addBid(maker, price, qty);
+                book.addAsk(taker, price, qty);
+            }
+        }
+        double elapsed = secondsSince(start);
+        seconds[withIndicators] = run < 2 || elapsed < seconds[withIndicators] ? elapsed : seconds[withIndicators];
+        book.setListener(nullptr);
+    }
+
+    const TrendSnapshot &last = indicators.latest();
+    cout << "Engine feed: " << indicators.tradeCount() << " trades, " << last.bars << " bars of " << config.trend.tradesPerBar << " trades" << endl;
+    cout << "  last bar high " << last.high << " low " << last.low << " close " << last.close << " (ticks)" << endl;
+    cout << "  SMA(" << config.trend.smaPeriod << ") " << last.sma << ", EMA(" << config.trend.emaPeriod << ") " << last.ema << ", SAR(" << config.trend.sarAcceleration
+         << ", " << config.trend.sarMaximum << ") " << last.sar << (last.sarLong ? " long" : " short") << endl;
+    double trades = indicators.tradeCount() > 0 ? (double)indicators.tradeCount() : 1;
+    cout << fixed << setprecision(1) << "  engine " << seconds[0] * 1e9 / config.trades << " ns per step, with indicators "
+         << seconds[1] * 1e9 / config.trades << " ns per step, " << (seconds[1] - seconds[0]) * 1e9 / trades << " ns per trade for the indicators"
+         << defaultfloat << endl;
+}
+
+/**
+ * @brief Measures the trend indicators in streaming and batch form and feeds them from
+ *        the matching engine's trades
+ *
+ * @details Three parts:
+ *          - engine: a random walk traded through an OrderBook with TradeIndicators
+ *            listening (see runEngineFeed);
+ *          - symbols: SMA, EMA and SAR over --symbols random walks of --bars bars each, bar
+ *            by bar with a streaming object per symbol, then with TrendBatch's ...Symbols()
+ *            kernels;
+ *          - sweep: one random walk through every --periods period (SMA, EMA) and a grid
+ *            of SAR accelerations and caps, streaming then with the ...Sweep() kernels.
+ *
+ *          Times are ns per bar and lane. Every batch result must equal the streaming one
+ *          bit for bit, the mismatch column counts the cells that do not.
+ *
+ *          Usage: indicatorBenchmark [--symbols 256] [--bars 20000] [--periods 5,10,20,50]
+ *                 [--trades 200000] [--trades-per-bar 10] [--sma 20] [--ema 12] [--seed 42]
+ *
+ * @return int 0, 1 on a bad argument or a mismatch
+ */
+int main(int argc, char* argv[]) {
+    IndicatorBenchmarkConfig config;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string arg = argv[i];
+        string value = argv[i + 1];
+        if (arg == "--symbols") {
+            config.symbols = (size_t)strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--bars") {
+            config.bars = (size_t)strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--periods") {
+            config.periods.clear();
+            stringstream list(value);
+            string item;
+            while (getline(list, item, ',')) {
+                config.periods.push_back((size_t)strtoull(item.c_str(), nullptr, 10));
+            }
+        } else if (arg == "--trades") {
+            config.trades = (size_t)strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--trades-per-bar") {
+            config.trend.tradesPerBar = strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--sma") {
+            config.trend.smaPeriod = (size_t)strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--ema") {
+            config.trend.emaPeriod = (size_t)strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--seed") {
+            config.seed = strtoull(value.c_str(), nullptr, 10);
+        } else {
+            cerr << "Unknown option " << arg << endl;
+            return 1;
+        }
+    }
+    if (config.symbols == 0 || config.bars < 2 || config.periods.empty() || config.trend.smaPeriod == 0 || config.trend.emaPeriod == 0) {
+        cerr << "Usage: indicatorBenchmark [--symbols N] [--bars N] [--periods 5,10,20] [--trades N] [--trades-per-bar N] [--sma N] [--ema N] [--seed N]" << endl;
+        return 1;
+    }
+
+    runEngineFeed(config);
+
+    mt19937_64 random(config.seed);
+    SyntheticBars many, one;
+    many.generate(config.bars, config.symbols, random);
+    one.generate(config.bars, 1, random);
+    vector<double> highs(config.bars), lows(config.bars), closes(config.bars);
+    for (size_t t = 0; t < config.bars; ++t) {
+        highs[t] = one.highs.at(t, 0);
+        lows[t] = one.lows.at(t, 0);
+        closes[t] = one.closes.at(t, 0);
+    }
+    vector<SarParameters> sarGrid;
+    for (double acceleration : {0.01, 0.02, 0.03, 0.04}) {
+        for (double maximum : {0.1, 0.2, 0.3}) {
+            SarParameters parameters = {acceleration, maximum};
+            sarGrid.push_back(parameters);
+        }
+    }
+    size_t period = config.trend.smaPeriod;
+    SarParameters sarParameters = {config.trend.sarAcceleration, config.trend.sarMaximum};
+
+    TrendBatch batch;
+    size_t mismatches = 0;
+    cout << config.symbols << " symbols x " << config.bars << " bars, sweep of " << config.periods.size() << " periods and " << sarGrid.size()
+         << " SAR parameter sets, AVX2 " << (batch.isVectorized() ? "on" : "not available") << endl;
+    cout << left << setw(16) << "indicator" << right << setw(12) << "streaming" << setw(12) << "batch" << setw(12) << "batch simd" << setw(12)
+         << "mismatches" << "   ns per bar and lane" << endl;
+
+    mismatches += compareModes("SMA symbols", batch, config.bars, config.symbols,
+        [&](SeriesMatrix& out) {
+            vector<SimpleMovingAverage> smas;
+            for (size_t lane = 0; lane < config.symbols; ++lane) {
+                smas.push_back(SimpleMovingAverage(period));
+            }
+            for (size_t t = 0; t < config.bars; ++t) {
+                for (size_t lane = 0; lane < config.symbols; ++lane) {
+                    out.at(t, lane) = smas[lane].update(many.closes.at(t, lane));
+                }
+            }
+        },
+        [&](SeriesMatrix& out) { batch.smaSymbols(many.closes, period, out); });
+    mismatches += compareModes("EMA symbols", batch, config.bars, config.symbols,
+        [&](SeriesMatrix& out) {
+            vector<ExponentialMovingAverage> emas;
+            for (size_t lane = 0; lane < config.symbols; ++lane) {
+                emas.push_back(ExponentialMovingAverage(period));
+            }
+            for (size_t t = 0; t < config.bars; ++t) {
+                for (size_t lane = 0; lane < config.symbols; ++lane) {
+                    out.at(t, lane) = emas[lane].update(many.closes.at(t, lane));
+                }
+            }
+        },
+        [&](SeriesMatrix& out) { batch.emaSymbols(many.closes, period, out); });
+    mismatches += compareModes("SAR symbols", batch, config.bars, config.symbols,
+        [&](SeriesMatrix& out) {
+            vector<ParabolicSar> sars;
+            for (size_t lane = 0; lane < config.symbols; ++lane) {
+                sars.push_back(ParabolicSar(sarParameters.acceleration, sarParameters.maximum));
+            }
+            for (size_t t = 0; t < config.bars; ++t) {
+                for (size_t lane = 0; lane < config.symbols; ++lane) {
+                    out.at(t, lane) = sars[lane].update(many.highs.at(t, lane), many.lows.at(t, lane));
+                }
+            }
+        },
+        [&](SeriesMatrix& out) { batch.sarSymbols(many.highs, many.lows, sarParameters, out); });
+    mismatches += compareModes("SMA sweep", batch, config.bars, config.periods.size(),
+        [&](SeriesMatrix& out) {
+            vector<SimpleMovingAverage> smas;
+            for (size_t lane = 0; lane < config.periods.size(); ++lane) {
+                smas.push_back(SimpleMovingAverage(config.periods[lane]));
+            }
+            for (size_t t = 0; t < config.bars; ++t) {
+                for (size_t lane = 0; lane < config.periods.size(); ++lane) {
+                    out.at(t, lane) = smas[lane].update(closes[t]);
+                }
+            }
+        },
+        [&](SeriesMatrix& out) { batch.smaSweep(closes.data(), config.bars, config.periods, out); });
+    mismatches += compareModes("EMA sweep", batch, config.bars, config.periods.size(),
+        [&](SeriesMatrix& out) {
+            vector<ExponentialMovingAverage> emas;
+            for (size_t lane = 0; lane < config.periods.size(); ++lane) {
+                emas.push_back(ExponentialMovingAverage(config.periods[lane]));
+            }
+            for (size_t t = 0; t < config.bars; ++t) {
+                for (size_t lane = 0; lane < config.periods.size(); ++lane) {
+                    out.at(t, lane) = emas[lane].update(closes[t]);
+                }
+            }
+        },
+        [&](SeriesMatrix& out) { batch.emaSweep(closes.data(), config.bars, config.periods, out); });
+    mismatches += compareModes("SAR sweep", batch, config.bars, sarGrid.size(),
+        [&](SeriesMatrix& out) {
+            vector<ParabolicSar> sars;
+            for (size_t lane = 0; lane < sarGrid.size(); ++lane) {
+                sars.push_back(ParabolicSar(sarGrid[lane].acceleration, sarGrid[lane].maximum));
+            }
+            for (size_t t = 0; t < config.bars; ++t) {
+                for (size_t lane = 0; lane < sarGrid.size(); ++lane) {
+                    out.at(t, lane) = sars[lane].update(highs[t], lows[t]);
+                }
+            }
+        },
+        [&](SeriesMatrix& out) { batch.sarSweep(highs.data(), lows.data(), config.bars, sarGrid, out); });
+
+    if (mismatches > 0) {
+        cout << "MISMATCH: batch and streaming results differ in " << mismatches << " cells" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+#ifndef TRADEINDICATORS_HPP
+#define TRADEINDICATORS_HPP
+
+#include "executionEvents.hpp"
+#include "trendIndicators.hpp"
+
+// Periods of the trend indicators kept on a trade stream, defaults as in the notebooks
+struct TrendConfig {
+    size_t smaPeriod;
+    size_t emaPeriod;
+    double sarAcceleration;
+    double sarMaximum;
+    unsigned long long tradesPerBar; // trades making up one bar, 1 to update on every trade
+
+    TrendConfig() {
+        smaPeriod = 20;
+        emaPeriod = 12;
+        sarAcceleration = 0.02;
+        sarMaximum = 0.2;
+        tradesPerBar = 1;
+    }
+};
+
+// The last completed bar and the indicators after it. Prices are in ticks of the book.
+struct TrendSnapshot {
+    unsigned long long bars; // bars completed so far
+    double high, low, close; // of the last bar
+    double sma, ema, sar; // NaN until each has enough bars
+    bool sarLong; // direction of the SAR for the next bar
+};
+
+/**
+ * @brief Keeps SMA, EMA and Parabolic SAR up to date from the trade prints of an
+ *        OrderBook, as its ExecutionListener
+ *
+ * @details Every trade is reported twice by the engine (once per order); it is counted
+ *          once, on the bid's report, like ShardStats does. Trades are grouped into bars of
+ *          tradesPerBar prints (high, low and last price), and every completed bar costs
+ *          three O(1) indicator updates, which keeps the listener cheap enough to run inside
+ *          the matching loop. Execution reports carry no time, so bars are counted in trades;
+ *          time, volume or notional bars belong to a bar builder in front of the streaming
+ *          indicators.
+ */
+class TradeIndicators : public ExecutionListener {
+    private:
+    TrendConfig config;
+    SimpleMovingAverage sma;
+    ExponentialMovingAverage ema;
+    ParabolicSar sar;
+    unsigned long long trades; // trades in the bar being built
+    double high, low, close; // of the bar being built
+    unsigned long long totalTrades;
+    TrendSnapshot last;
+
+    void closeBar() {
+        last.bars += 1;
+        last.high = high;
+        last.low = low;
+        last.close = close;
+        last.sma = sma.update(close);
+        last.ema = ema.update(close);
+        last.sar = sar.update(high, low);
+        last.sarLong = sar.isLong();
+        trades = 0;
+    }
+
+    public:
+    TradeIndicators(const TrendConfig& trendConfig = TrendConfig())
+        : config(trendConfig), sma(config.smaPeriod), ema(config.emaPeriod), sar(config.sarAcceleration, config.sarMaximum), trades(0), high(0), low(0),
+          close(0), totalTrades(0) {
+        if (config.tradesPerBar == 0) {
+            config.tradesPerBar = 1;
+        }
+        last.bars = 0;
+        last.high = last.low = last.close = 0;
+        last.sma = last.ema = last.sar = indicatorNaN();
+        last.sarLong = true;
+    }
+
+    void onEvent(const ExecutionEvent& event) {
+        if ((event.type != EVENT_FILL && event.type != EVENT_PARTIAL_FILL) || !event.isBid) {
+            return;
+        }
+        onTrade((double)event.price);
+    }
+
+    // A trade print from any other source, e.g. an L2 trade stream; price in the units wanted out
+    void onTrade(double price) {
+        if (trades == 0) {
+            high = low = price;
+        } else {
+            high = price > high ? price : high;
+            low = price < low ? price : low;
+        }
+        close = price;
+        ++totalTrades;
+        if (++trades == config.tradesPerBar) {
+            closeBar();
+        }
+    }
+
+    const TrendSnapshot& latest() const { return last; }
+    unsigned long long tradeCount() const { return totalTrades; }
+    const TrendConfig& getConfig() const { return config; }
+};
+
+#endif // TRADEINDICATORS_HPP
@@ -0,0 +1,365 @@
+#ifndef TRENDBATCH_HPP
+#define TRENDBATCH_HPP
+
+#include <cstring>
+#include <vector>
+#include "trendIndicators.hpp"
+#if defined(__x86_64__) && defined(__GNUC__)
+#define TREND_BATCH_AVX2 1
+#endif
+
+// Lanes the rows of a SeriesMatrix are padded to: one AVX2 register of doubles
+const size_t BATCH_BLOCK = 4;
+
+// Lanes of the kernels as GCC vectors, on which arithmetic and ?: work per lane: two
+// doubles (SSE2, every x86-64 CPU) for the baseline kernels, four inside the AVX2 ones.
+// Only the AVX2 kernels hold 32-byte vectors and every function they pass one to is
+// inlined, so GCC's -Wpsabi note about how such vectors are passed does not apply.
+typedef double BaseLanes __attribute__((vector_size(2 * sizeof(double))));
+typedef double WideLanes __attribute__((vector_size(4 * sizeof(double))));
+
+template <class Lanes>
+inline __attribute__((always_inline)) Lanes loadLanes(const double* from) {
+    Lanes lanes;
+    std::memcpy(&lanes, from, sizeof(lanes));
+    return lanes;
+}
+
+template <class Lanes>
+inline __attribute__((always_inline)) void storeLanes(double* to, Lanes lanes) { std::memcpy(to, &lanes, sizeof(lanes)); }
+
+/**
+ * @brief Bars x lanes matrix of doubles in structure-of-arrays layout: one row per bar,
+ *        one lane per symbol or parameter set
+ *
+ * @details A lane's series is strided, a bar of every lane is contiguous, which is what
+ *          the batch kernels want: they walk the bars in order (every indicator is a
+ *          recurrence in time) and update all lanes of a bar side by side. Rows are padded
+ *          to a multiple of BATCH_BLOCK lanes so the kernels only ever see whole blocks.
+ */
+class SeriesMatrix {
+    private:
+    size_t bars;
+    size_t lanes;
+    size_t stride; // lanes rounded up to BATCH_BLOCK
+    std::vector<double> data;
+
+    public:
+    SeriesMatrix() : bars(0), lanes(0), stride(0) {};
+    SeriesMatrix(size_t barCount, size_t laneCount) { resize(barCount, laneCount); }
+
+    // Reshapes the matrix; the contents are zero afterwards
+    void resize(size_t barCount, size_t laneCount) {
+        bars = barCount;
+        lanes = laneCount;
+        stride = (laneCount + BATCH_BLOCK - 1) / BATCH_BLOCK * BATCH_BLOCK;
+        data.assign(bars * stride, 0.0);
+    }
+
+    size_t barCount() const { return bars; }
+    size_t laneCount() const { return lanes; }
+    size_t rowStride() const { return stride; }
+    double* row(size_t bar) { return data.data() + bar * stride; }
+    const double* row(size_t bar) const { return data.data() + bar * stride; }
+    double& at(size_t bar, size_t lane) { return data[bar * stride + lane]; }
+    double at(size_t bar, size_t lane) const { return data[bar * stride + lane]; }
+};
+
+// Acceleration and cap of one Parabolic SAR lane
+struct SarParameters {
+    double acceleration;
+    double maximum;
+};
+
+/**
+ * @brief Computes SMA, EMA and Parabolic SAR over whole histories of many lanes at once
+ *
+ * @details Two shapes of batch:
+ *          - ...Symbols(): one matrix of prices, a lane per symbol, one parameter set;
+ *          - ...Sweep(): one price series shared by every lane, a parameter set per lane
+ *            (e.g. every SMA period from 5 to 200 in a single pass).
+ *
+ *          Each lane runs exactly the update rules of the streaming indicators
+ *          (trendIndicators.hpp), instantiated on vectors of lanes, so two or four lanes go
+ *          through them at once in SIMD registers and the results are bit-identical to feeding
+ *          each lane through a SimpleMovingAverage, ExponentialMovingAverage or
+ *          ParabolicSar. The kernels are compiled twice, two lanes wide for the baseline
+ *          instruction set and four wide for AVX2 (picked at runtime when the CPU has it).
+ *
+ *          The lane state lives here, also in structure-of-arrays layout, and is reused
+ *          across calls, so a batch of the same width allocates nothing. Results go to an
+ *          output matrix of the same bars x lanes shape, NaN where TA-Lib has no value.
+ */
+class TrendBatch {
+    private:
+    // Per lane parameters and state, padded to a whole number of blocks
+    std::vector<double> periods; // SMA / EMA period
+    std::vector<double> rates; // EMA 2 / (period + 1)
+    std::vector<double> accelerations; // SAR factor steps
+    std::vector<double> maximums; // SAR factor caps
+    std::vector<double> sums; // SMA running sum, EMA seed sum
+    std::vector<double> values; // EMA
+    std::vector<size_t> lookbacks; // SMA period as an index offset
+    std::vector<double> directions, stops, extremes, factors, prevHighs, prevLows; // SarState of every lane
+    bool vectorized; // run the AVX2 kernels
+
+    void prepare(size_t stride) {
+        periods.assign(stride, 1.0);
+        rates.assign(stride, 1.0);
+        accelerations.assign(stride, 0.0);
+        maximums.assign(stride, 0.0);
+        sums.assign(stride, 0.0);
+        values.assign(stride, 0.0);
+        lookbacks.assign(stride, 1);
+    }
+
+    // Input row of a bar: every lane's own column, or the one series every lane shares
+    template <bool Shared>
+    static const double* inputRow(const double* prices, size_t stride, size_t bar) {
+        return Shared ? prices + bar : prices + bar * stride;
+    }
+
+    template <class Lanes, bool Shared>
+    static Lanes inputLanes(const double* row, size_t block) {
+        return Shared ? Lanes() + row[0] : loadLanes<Lanes>(row + block);
+    }
+
+    template <class Lanes, bool Shared>
+    __attribute__((always_inline)) inline void smaBody(const double* prices, size_t stride, size_t bars, SeriesMatrix& out) {
+        const size_t WIDTH = sizeof(Lanes) / sizeof(double);
+        for (size_t t = 0; t < bars; ++t) {
+            const double* in = inputRow<Shared>(prices, stride, t);
+            double* result = out.row(t);
+            Lanes count = Lanes() + (double)(t + 1);
+            for (size_t b = 0; b < stride; b += WIDTH) {
+                Lanes period = loadLanes<Lanes>(&periods[b]);
+                Lanes sum = loadLanes<Lanes>(&sums[b]);
+                Lanes trailing = Lanes();
+                if (Shared) { // a window per lane over the same series
+                    for (size_t k = 0; k < WIDTH; ++k) {
+                        trailing[k] = prices[t + 1 >= lookbacks[b + k] ? t + 1 - lookbacks[b + k] : 0];
+                    }
+                } else { // one window length, the oldest bar is one row
+                    trailing = loadLanes<Lanes>(inputRow<false>(prices, stride, t + 1 >= lookbacks[b] ? t + 1 - lookbacks[b] : 0) + b);
+                }
+                storeLanes(result + b, smaStep(inputLanes<Lanes, Shared>(in, b), trailing, count >= period, period, sum));
+                storeLanes(&sums[b], sum);
+            }
+        }
+    }
+
+    template <class Lanes, bool Shared>
+    __attribute__((always_inline)) inline void emaBody(const double* prices, size_t stride, size_t bars, SeriesMatrix& out) {
+        const size_t WIDTH = sizeof(Lanes) / sizeof(double);
+        for (size_t t = 0; t < bars; ++t) {
+            const double* in = inputRow<Shared>(prices, stride, t);
+            double* result = out.row(t);
+            Lanes count = Lanes() + (double)(t + 1);
+            for (size_t b = 0; b < stride; b += WIDTH) {
+                Lanes sum = loadLanes<Lanes>(&sums[b]);
+                Lanes value = loadLanes<Lanes>(&values[b]);
+                storeLanes(result + b, emaStep(inputLanes<Lanes, Shared>(in, b), count, loadLanes<Lanes>(&periods[b]), loadLanes<Lanes>(&rates[b]), sum, value));
+                storeLanes(&sums[b], sum);
+                storeLanes(&values[b], value);
+            }
+        }
+    }
+
+    // Bars from the second one on; the first two have started every lane already
+    template <class Lanes, bool Shared>
+    __attribute__((always_inline)) inline void sarBody(const double* highs, const double* lows, size_t stride, size_t bars, SeriesMatrix& out) {
+        const size_t WIDTH = sizeof(Lanes) / sizeof(double);
+        for (size_t t = 1; t < bars; ++t) {
+            const double* high = inputRow<Shared>(highs, stride, t);
+            const double* low = inputRow<Shared>(lows, stride, t);
+            double* result = out.row(t);
+            for (size_t b = 0; b < stride; b += WIDTH) {
+                BasicSarState<Lanes> state = {loadLanes<Lanes>(&directions[b]), loadLanes<Lanes>(&stops[b]), loadLanes<Lanes>(&extremes[b]),
+                                             loadLanes<Lanes>(&factors[b]), loadLanes<Lanes>(&prevHighs[b]), loadLanes<Lanes>(&prevLows[b])};
+                storeLanes(result + b, sarStep(inputLanes<Lanes, Shared>(high, b), inputLanes<Lanes, Shared>(low, b), loadLanes<Lanes>(&accelerations[b]), loadLanes<Lanes>(&maximums[b]), state));
+                storeLanes(&directions[b], state.direction);
+                storeLanes(&stops[b], state.sar);
+                storeLanes(&extremes[b], state.extreme);
+                storeLanes(&factors[b], state.factor);
+                storeLanes(&prevHighs[b], state.prevHigh);
+                storeLanes(&prevLows[b], state.prevLow);
+            }
+        }
+    }
+
+    template <bool Shared>
+    void smaBase(const double* prices, size_t stride, size_t bars, SeriesMatrix& out) { smaBody<BaseLanes, Shared>(prices, stride, bars, out); }
+    template <bool Shared>
+    void emaBase(const double* prices, size_t stride, size_t bars, SeriesMatrix& out) { emaBody<BaseLanes, Shared>(prices, stride, bars, out); }
+    template <bool Shared>
+    void sarBase(const double* highs, const double* lows, size_t stride, size_t bars, SeriesMatrix& out) { sarBody<BaseLanes, Shared>(highs, lows, stride, bars, out); }
+#ifdef TREND_BATCH_AVX2
+    template <bool Shared>
+    __attribute__((target("avx2"))) void smaAvx2(const double* prices, size_t stride, size_t bars, SeriesMatrix& out) { smaBody<WideLanes, Shared>(prices, stride, bars, out); }
+    template <bool Shared>
+    __attribute__((target("avx2"))) void emaAvx2(const double* prices, size_t stride, size_t bars, SeriesMatrix& out) { emaBody<WideLanes, Shared>(prices, stride, bars, out); }
+    template <bool Shared>
+    __attribute__((target("avx2"))) void sarAvx2(const double* highs, const double* lows, size_t stride, size_t bars, SeriesMatrix& out) {
+        sarBody<WideLanes, Shared>(highs, lows, stride, bars, out);
+    }
+#endif
+
+    template <bool Shared>
+    void runSma(const double* prices, size_t stride, size_t bars, SeriesMatrix& out) {
+#ifdef TREND_BATCH_AVX2
+        if (vectorized) {
+            smaAvx2<Shared>(prices, stride, bars, out);
+            return;
+        }
+#endif
+        smaBase<Shared>(prices, stride, bars, out);
+    }
+
+    template <bool Shared>
+    void runEma(const double* prices, size_t stride, size_t bars, SeriesMatrix& out) {
+#ifdef TREND_BATCH_AVX2
+        if (vectorized) {
+            emaAvx2<Shared>(prices, stride, bars, out);
+            return;
+        }
+#endif
+        emaBase<Shared>(prices, stride, bars, out);
+    }
+
+    // Starts every lane from the first two bars, then runs the kernel over the rest
+    template <bool Shared>
+    void runSar(const double* highs, const double* lows, size_t stride, size_t bars, SeriesMatrix& out) {
+        directions.assign(stride, 1.0);
+        stops.assign(stride, 0.0);
+        extremes.assign(stride, 0.0);
+        factors.assign(stride, 0.0);
+        prevHighs.assign(stride, 0.0);
+        prevLows.assign(stride, 0.0);
+        if (bars == 0) {
+            return;
+        }
+        for (size_t k = 0; k < stride; ++k) {
+            out.row(0)[k] = indicatorNaN();
+        }
+        if (bars < 2) {
+            return;
+        }
+        for (size_t k = 0; k < stride; ++k) {
+            const double* high0 = inputRow<Shared>(highs, stride, 0);
+            const double* low0 = inputRow<Shared>(lows, stride, 0);
+            const double* high1 = inputRow<Shared>(highs, stride, 1);
+            const double* low1 = inputRow<Shared>(lows, stride, 1);
+            size_t lane = Shared ? 0 : k;
+            SarState state;
+            sarStart(high0[lane], low0[lane], high1[lane], low1[lane], accelerations[k], state);
+            directions[k] = state.direction;
+            stops[k] = state.sar;
+            extremes[k] = state.extreme;
+            factors[k] = state.factor;
+            prevHighs[k] = state.prevHigh;
+            prevLows[k] = state.prevLow;
+        }
+#ifdef TREND_BATCH_AVX2
+        if (vectorized) {
+            sarAvx2<Shared>(highs, lows, stride, bars, out);
+            return;
+        }
+#endif
+        sarBase<Shared>(highs, lows, stride, bars, out);
+    }
+
+    void setPeriod(size_t lane, size_t period) {
+        size_t length = period > 0 ? period : 1;
+        periods[lane] = (double)length;
+        rates[lane] = 2.0 / ((double)length + 1.0);
+        lookbacks[lane] = length;
+    }
+
+    void setSar(size_t lane, const SarParameters& parameters) {
+        accelerations[lane] = parameters.acceleration < parameters.maximum ? parameters.acceleration : parameters.maximum;
+        maximums[lane] = parameters.maximum;
+    }
+
+    public:
+    TrendBatch() : vectorized(false) {
+#ifdef TREND_BATCH_AVX2
+        vectorized = __builtin_cpu_supports("avx2");
+#endif
+    };
+
+    // Uses the AVX2 kernels if enable and the CPU has AVX2, the two-lane baseline ones otherwise
+    void setVectorized(bool enable) {
+#ifdef TREND_BATCH_AVX2
+        vectorized = enable && __builtin_cpu_supports("avx2");
+#else
+        vectorized = false;
+        (void)enable;
+#endif
+    }
+
+    bool isVectorized() const { return vectorized; }
+
+    // SMA of period over every lane (symbol) of prices into out
+    void smaSymbols(const SeriesMatrix& prices, size_t period, SeriesMatrix& out) {
+        out.resize(prices.barCount(), prices.laneCount());
+        prepare(prices.rowStride());
+        for (size_t k = 0; k < prices.rowStride(); ++k) {
+            setPeriod(k, period);
+        }
+        runSma<false>(prices.row(0), prices.rowStride(), prices.barCount(), out);
+    }
+
+    // EMA of period over every lane (symbol) of prices into out
+    void emaSymbols(const SeriesMatrix& prices, size_t period, SeriesMatrix& out) {
+        out.resize(prices.barCount(), prices.laneCount());
+        prepare(prices.rowStride());
+        for (size_t k = 0; k < prices.rowStride(); ++k) {
+            setPeriod(k, period);
+        }
+        runEma<false>(prices.row(0), prices.rowStride(), prices.barCount(), out);
+    }
+
+    // Parabolic SAR over every lane (symbol) of highs and lows (same shape) into out
+    void sarSymbols(const SeriesMatrix& highs, const SeriesMatrix& lows, const SarParameters& parameters, SeriesMatrix& out) {
+        out.resize(highs.barCount(), highs.laneCount());
+        prepare(highs.rowStride());
+        for (size_t k = 0; k < highs.rowStride(); ++k) {
+            setSar(k, parameters);
+        }
+        runSar<false>(highs.row(0), lows.row(0), highs.rowStride(), highs.barCount(), out);
+    }
+
+    // SMA of one series of bars prices for every period, lane k of out has periods[k]
+    void smaSweep(const double* prices, size_t bars, const std::vector<size_t>& sweep, SeriesMatrix& out) {
+        out.resize(bars, sweep.size());
+        prepare(out.rowStride());
+        for (size_t k = 0; k < sweep.size(); ++k) {
+            setPeriod(k, sweep[k]);
+        }
+        runSma<true>(prices, out.rowStride(), bars, out);
+    }
+
+    // EMA of one series of bars prices for every period, lane k of out has periods[k]
+    void emaSweep(const double* prices, size_t bars, const std::vector<size_t>& sweep, SeriesMatrix& out) {
+        out.resize(bars, sweep.size());
+        prepare(out.rowStride());
+        for (size_t k = 0; k < sweep.size(); ++k) {
+            setPeriod(k, sweep[k]);
+        }
+        runEma<true>(prices, out.rowStride(), bars, out);
+    }
+
+    // Parabolic SAR of one series of bars highs and lows for every parameter set
+    void sarSweep(const double* highs, const double* lows, size_t bars, const std::vector<SarParameters>& sweep, SeriesMatrix& out) {
+        out.resize(bars, sweep.size());
+        prepare(out.rowStride());
+        SarParameters padding = {0.02, 0.2};
+        for (size_t k = 0; k < out.rowStride(); ++k) {
+            setSar(k, k < sweep.size() ? sweep[k] : padding);
+        }
+        runSar<true>(highs, lows, out.rowStride(), bars, out);
+    }
+};
+
+
+#endif // TRENDBATCH_HPP
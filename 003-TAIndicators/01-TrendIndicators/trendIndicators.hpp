@@ -0,0 +1,252 @@
+#ifndef TRENDINDICATORS_HPP
+#define TRENDINDICATORS_HPP
+
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+// Streaming trend indicators (SMA, EMA, Parabolic SAR), one value per bar in O(1).
+//
+// Every indicator follows TA-Lib, which the notebooks of this folder use: the same seeding,
+// the same lookback (the first period - 1 bars of an average and the first bar of the SAR
+// have no value, NaN here) and the same order of floating point operations. The update
+// rules are the free functions below; the streaming classes and the batch kernels of
+// trendBatch.hpp both call them, so the two modes give bit-identical results.
+
+inline double indicatorNaN() { return std::numeric_limits<double>::quiet_NaN(); }
+
+// The update rules are templates over the value type: double for the streaming classes,
+// a vector of lanes for the batch kernels. They only use arithmetic and ?: (which picks
+// per lane on vectors), so both instantiations do the same operations in the same order.
+
+template <class Value>
+inline Value lowerOf(Value a, Value b) { return a < b ? a : b; }
+template <class Value>
+inline Value higherOf(Value a, Value b) { return a > b ? a : b; }
+
+/**
+ * @brief One step of a simple moving average kept as a running sum
+ *
+ * @param price The new price
+ * @param trailing The oldest price of the window once it is full (the one that drops out
+ *        after this step), anything otherwise
+ * @param full true once the window holds period prices including this one
+ * @param period Window length
+ * @param sum Running sum of the window, updated
+ *
+ * @return Value The average, NaN until the window is full
+ */
+template <class Value, class Mask>
+inline Value smaStep(Value price, Value trailing, Mask full, Value period, Value& sum) {
+    Value none = Value() + indicatorNaN();
+    sum += price;
+    Value average = sum / period;
+    Value out = full ? average : none;
+    sum -= full ? trailing : Value();
+    return out;
+}
+
+/**
+ * @brief One step of an exponential moving average seeded with the SMA of its first
+ *        period prices, then value += (price - value) * 2 / (period + 1)
+ *
+ * @param price The new price
+ * @param count Prices seen including this one
+ * @param period Smoothing period
+ * @param rate 2 / (period + 1)
+ * @param sum Sum of the first period prices, updated
+ * @param value The average, updated (meaningless before the seed)
+ *
+ * @return Value The average, NaN for the first period - 1 prices
+ */
+template <class Value>
+inline Value emaStep(Value price, Value count, Value period, Value rate, Value& sum, Value& value) {
+    Value none = Value() + indicatorNaN();
+    sum += count <= period ? price : Value();
+    Value seed = sum / period;
+    Value smoothed = (price - value) * rate + value;
+    value = count == period ? seed : smoothed;
+    return count >= period ? value : none;
+}
+
+// State of one Parabolic SAR between bars (or of a vector of them)
+template <class Value>
+struct BasicSarState {
+    Value direction; // +1 long (SAR below the price), -1 short
+    Value sar; // stop for the next bar
+    Value extreme; // highest high of a long run, lowest low of a short one
+    Value factor; // acceleration factor, from acceleration up to maximum
+    Value prevHigh; // high and low of the previous bar
+    Value prevLow;
+};
+
+typedef BasicSarState<double> SarState;
+
+/**
+ * @brief Starts a Parabolic SAR from its first two bars
+ *
+ * @details The first direction is short when the second bar makes a lower low by more
+ *          than it makes a higher high (a positive -DM), long otherwise. The second bar is
+ *          then passed to sarStep() like every later one.
+ */
+inline void sarStart(double high0, double low0, double high1, double low1, double acceleration, SarState& state) {
+    double up = high1 - high0;
+    double down = low0 - low1;
+    bool isLong = !(down > 0 && up < down);
+    state.direction = isLong ? 1.0 : -1.0;
+    state.extreme = isLong ? high1 : low1;
+    state.sar = isLong ? low0 : high0;
+    state.factor = acceleration;
+    state.prevHigh = high1;
+    state.prevLow = low1;
+}
+
+/**
+ * @brief One bar of a Parabolic SAR, written without branches so a vector of them runs
+ *        side by side: both the reversal and the continuation are computed, then selected
+ *
+ * @param high High of the bar
+ * @param low Low of the bar
+ * @param acceleration Step of the acceleration factor (0.02)
+ * @param maximum Cap of the acceleration factor (0.2), at least acceleration
+ * @param state Updated
+ *
+ * @return Value The SAR of this bar
+ */
+template <class Value>
+inline Value sarStep(Value high, Value low, Value acceleration, Value maximum, BasicSarState<Value>& state) {
+    auto isLong = state.direction > Value();
+    auto reverse = isLong ? low <= state.sar : high >= state.sar;
+    Value ph = state.prevHigh, pl = state.prevLow;
+
+    // Reversal: the stop jumps to the extreme of the run that ended, never into this bar
+    // or the previous one, and starts moving towards the new extreme
+    Value flipped = isLong ? higherOf(higherOf(state.extreme, ph), high) : lowerOf(lowerOf(state.extreme, pl), low);
+    Value flippedExtreme = isLong ? low : high;
+    Value flippedSar = flipped + acceleration * (flippedExtreme - flipped);
+    flippedSar = isLong ? higherOf(higherOf(flippedSar, ph), high) : lowerOf(lowerOf(flippedSar, pl), low);
+
+    // Continuation: a new extreme raises the factor, the stop may not enter the last two bars
+    auto extended = isLong ? high > state.extreme : low < state.extreme;
+    Value extreme = extended ? (isLong ? high : low) : state.extreme;
+    Value factor = extended ? lowerOf(state.factor + acceleration, maximum) : state.factor;
+    Value next = state.sar + factor * (extreme - state.sar);
+    next = isLong ? lowerOf(lowerOf(next, pl), low) : higherOf(higherOf(next, ph), high);
+
+    Value out = reverse ? flipped : state.sar;
+    state.sar = reverse ? flippedSar : next;
+    state.extreme = reverse ? flippedExtreme : extreme;
+    state.factor = reverse ? acceleration : factor;
+    state.direction = reverse ? -state.direction : state.direction;
+    state.prevHigh = high;
+    state.prevLow = low;
+    return out;
+}
+
+// Simple moving average over a ring buffer of the last period prices
+class SimpleMovingAverage {
+    private:
+    std::vector<double> window; // the last period prices, oldest at next once full
+    size_t next; // slot of the next price
+    unsigned long long count; // prices seen
+    double sum;
+    double value;
+
+    public:
+    SimpleMovingAverage(size_t period = 20) { init(period); }
+
+    void init(size_t period) {
+        window.assign(period > 0 ? period : 1, 0.0);
+        next = 0;
+        count = 0;
+        sum = 0;
+        value = indicatorNaN();
+    }
+
+    // Adds a price, returns the average (NaN until period prices were seen)
+    double update(double price) {
+        window[next] = price;
+        ++count;
+        size_t oldest = next + 1 == window.size() ? 0 : next + 1;
+        value = smaStep(price, window[oldest], count >= window.size(), (double)window.size(), sum);
+        next = oldest;
+        return value;
+    }
+
+    bool ready() const { return count >= window.size(); }
+    double get() const { return value; }
+    size_t period() const { return window.size(); }
+};
+
+// Exponential moving average, seeded with the SMA of its first period prices
+class ExponentialMovingAverage {
+    private:
+    double length; // period
+    double rate; // 2 / (period + 1)
+    double count; // prices seen, exact up to 2^53
+    double sum;
+    double average;
+
+    public:
+    ExponentialMovingAverage(size_t period = 12) { init(period); }
+
+    void init(size_t period) {
+        length = (double)(period > 0 ? period : 1);
+        rate = 2.0 / (length + 1.0);
+        count = 0;
+        sum = 0;
+        average = 0;
+    }
+
+    // Adds a price, returns the average (NaN for the first period - 1 prices)
+    double update(double price) {
+        count += 1;
+        return emaStep(price, count, length, rate, sum, average);
+    }
+
+    bool ready() const { return count >= length; }
+    double get() const { return ready() ? average : indicatorNaN(); }
+    size_t period() const { return (size_t)length; }
+};
+
+// Parabolic SAR (Wilder's stop and reverse) from the high and low of each bar
+class ParabolicSar {
+    private:
+    double acceleration; // factor step and start
+    double maximum; // factor cap
+    unsigned long long count; // bars seen
+    SarState state;
+    double value; // SAR of the last bar
+
+    public:
+    ParabolicSar(double step = 0.02, double cap = 0.2) { init(step, cap); }
+
+    void init(double step, double cap) {
+        acceleration = step < cap ? step : cap;
+        maximum = cap;
+        count = 0;
+        state = SarState();
+        value = indicatorNaN();
+    }
+
+    // Adds a bar, returns its SAR (NaN for the first bar)
+    double update(double high, double low) {
+        if (++count == 1) {
+            state.prevHigh = high;
+            state.prevLow = low;
+            return value;
+        }
+        if (count == 2) {
+            sarStart(state.prevHigh, state.prevLow, high, low, acceleration, state);
+        }
+        value = sarStep(high, low, acceleration, maximum, state);
+        return value;
+    }
+
+    bool ready() const { return count >= 2; }
+    double get() const { return value; }
+    bool isLong() const { return state.direction > 0; } // direction for the next bar
+    double stop() const { return state.sar; } // SAR the next bar will be tested against
+};
+
+#endif // TRENDINDICATORS_HPP